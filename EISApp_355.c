@@ -42,8 +42,10 @@ to ensure that the resulting application performs as required and is safe.
 #include "DioLib.h"
 #include "PwrLib.h"
 #include "AfeWdtLib.h"
+#include "GptLib.h"
 #include "stdio.h"
 #include "string.h"
+#include "stddef.h"
 
 /*
    Uncomment macro below to add DC bias for biased sensor(ex. O2 sensor) Impedance measuremnt
@@ -53,6 +55,293 @@ to ensure that the resulting application performs as required and is safe.
 */
 #define EIS_DCBIAS_EN   1
 
+/*
+   Low power waiting during DFT accumulation and settling delays
+   1 - digital die sleeps in flexi mode until the DFTRDY or timer interrupt
+   0 - busy wait
+*/
+#define EIS_LPWAIT_EN   1
+/*
+   1 - report sweep time and time spent in low power waits after each sweep as
+       "PWR,<sweep ms>,<sleep ms>"
+*/
+#define EIS_PWRSTAT_EN  0
+
+/*
+   Per frequency HSTIA DE RTIA / ADC PGA ranging from a short DFT pre-measurement
+   1 - sensor and RCAL measurements each use the highest gain in HsRange that keeps the
+       signal under EIS_RANGE_TARGET, RCAL DFT results are rescaled to the sensor gain
+   0 - fixed HPTIADE_RTIA_50 and PGA 1
+   note: the rescaling uses nominal gains, the gain error between ranges adds to the magnitude error
+*/
+#define EIS_AUTORANGE_EN   0
+#define EIS_RANGE_TARGET   12000          // peak ADC codes aimed for, of 32767
+#define EIS_RANGE_DFTNUM   DFTNUM_256     // pre-measurement DFT length
+#define EIS_RANGE_DFT_N    256
+#define EIS_RANGE_SETTLE   100            // 10us units, settling after a range change
+
+typedef struct
+{
+   uint32_t rtia;       // HPTIADE_RTIA_xx
+   uint32_t pga;        // GNPGA_xx
+   float gain;          // nominal RTIA * PGA gain in ohms
+}HsRange_t;
+
+/*
+   DC current logging during the sweep. While a sensor is back on its LP TIA (RCAL settling of
+   every frequency) the ADC is switched to that LP TIA and SINC2 results are averaged by
+   EIS_DCLOG_DECIM into a ring buffer, streamed after each frequency as "I,<ms>,<code>"
+   1 - enabled
+   0 - disabled, legacy stream
+   note: the LP TIA is disconnected from the sensor during its own AC measurement, no DC
+         samples exist for that part of the sweep
+*/
+#define EIS_DCLOG_EN       0
+#define EIS_DCLOG_DECIM    64             // SINC2 results averaged per logged sample
+#define EIS_DCLOG_LEN      64             // ring buffer entries
+#define EIS_DCLOG_FLUSH    1000           // 10us units, SINC2 refill before the RCAL DFT
+
+typedef struct
+{
+   uint32_t tick;       // timebase ticks since sweep start
+   uint16_t code;       // averaged SINC2 result
+}DcLog_t;
+
+/*
+   Raw filter output capture. 'c' (SINC2) or 'C' (SINC3) on the UART arms a capture of
+   EIS_CAPTURE_LEN results during the next sensor DFT, sent after that frequency as
+   "CAP,<src>,<n>,<Hz>" followed by binary blocks:
+      0xA5 0x5A <n lo> <n hi> n x <sample lo> <sample hi> <sum16 lo> <sum16 hi>
+   'B' measures the sustained capture rate of each filter setting in CapBench
+   EIS_CAPTURE_TRIG: CAP_TRIG_NOW starts with the DFT, CAP_TRIG_RISING at the first
+   result crossing EIS_CAPTURE_LEVEL upwards
+   note: the rate is timed with DWT, the core stays awake while a capture runs
+*/
+#define EIS_CAPTURE_MAX    4096           // capture buffer, samples
+#define EIS_CAPTURE_LEN    2048
+#define EIS_CAPTURE_TRIG   CAP_TRIG_NOW
+#define EIS_CAPTURE_LEVEL  0x8000
+#define EIS_CAPTURE_BLOCK  256            // samples per binary block
+#define EIS_CAPBENCH_10US  20000          // 200ms per benchmark setting
+#define CORE_CLK_HZ        26000000       // HFOSC, for DWT based rates
+
+typedef enum
+{
+   CAP_TRIG_NOW = 0,
+   CAP_TRIG_RISING
+}CapTrig_t;
+
+typedef enum
+{
+   CAP_IDLE = 0,
+   CAP_ARMED,           // waiting for the next sensor DFT
+   CAP_WAIT_TRIG,
+   CAP_RUN,
+   CAP_DONE             // buffer ready to send
+}CapState_t;
+
+typedef struct
+{
+   uint32_t sinc3osr;   // SINC3OSR_xx
+   uint32_t sinc2osr;   // SINC2OSR_xx
+   uint32_t rate;       // ADCSAMPLERATE_xx
+   uint32_t adcHz;      // ADC rate, SINC3 and SINC2 ratios for the nominal output rate
+   uint32_t div3;
+   uint32_t div2;
+}CapBench_t;
+
+/*
+   Signal chain bands, SnsACSigChainCfg only reprograms filters, DFT and clocks when a frequency
+   falls in another band than the previous one
+   1 - sweep points are measured grouped by band and printed in the requested order
+   0 - sweep points are measured in the requested order
+*/
+#define EIS_SWEEP_ORDER_EN 1
+#define SIG_BAND_NONE      0xFF           // signal chain not configured since SnsACInit
+
+typedef struct
+{
+   float fmax;          // band upper limit, exclusive
+   uint32_t sinc3osr;   // SINC3OSR_xx
+   uint32_t sinc2osr;   // SINC2OSR_xx
+   uint32_t adcrate;    // ADCSAMPLERATE_xx
+   uint32_t dftnum;     // DFTNUM_xx
+   uint32_t dftsrc;     // DFTIN_xx
+   uint8_t hp;          // 1 - 32MHz AFE clock, HP power mode, no ADC chop
+   uint32_t dftHz;      // DFT input rate and length for DFT times
+   uint32_t dftN;
+}SigBand_t;
+
+/*
+   Boot readiness. After SnsInit the LP TIA output of each enabled channel is sampled every
+   EIS_BOOT_STEP, a channel is ready once consecutive samples stay within EIS_BOOT_DELTA codes
+   EIS_BOOT_STABLE times in a row. EIS_BOOT_MAX_MS caps the wait at the former fixed delay.
+   time from reset to ready and the mask of channels that timed out are reported by 'i',
+   a timeout also prints "BOOT,TIMEOUT,<mask>" (bit0 CHAN0, bit1 CHAN1)
+*/
+#define EIS_BOOT_STEP      10000          // 10us units between samples of a channel
+#define EIS_BOOT_DELTA     16             // SINC2 codes
+#define EIS_BOOT_STABLE    3
+#define EIS_BOOT_MAX_MS    5000
+
+/*
+   Settings store. The mux setting and the last sweep command are kept with a boot counter and
+   the firmware version in 32 byte records written round robin over two flash pages at
+   EIS_STORE_BASE, which the linker file must keep free of code. 'l' repeats the stored sweep
+   1 - enabled
+   0 - disabled
+   note: RCAL is measured with every frequency of a sweep, there is no boot calibration to keep
+*/
+#define EIS_STORE_EN       0
+#ifndef EIS_STORE_BASE
+#define EIS_STORE_BASE     0x1F000        // last two 2kB pages of the 128kB flash
+#endif
+#define EIS_STORE_PAGE     0x800
+#define NVREC_MAGIC        0x45495331     // "EIS1"
+
+typedef struct
+{
+   uint32_t magic;
+   uint32_t seq;        // newest record with a good CRC is current
+   char fw[8];
+   uint32_t boots;
+   uint8_t setting;     // mux setting '1'-'6'
+   uint8_t cmd;         // last sweep command
+   uint16_t rsvd;
+   uint32_t rsvd2;
+   uint32_t crc;        // CRC-16/CCITT of the preceding bytes
+}NvRec_t;
+
+/*
+   Continuous single frequency monitoring. 'm' on the UART configures the signal chain once for
+   EIS_MON_FREQ, measures RCAL and then runs back to back sensor DFTs until any byte is received.
+   The DFT interrupt starts the next DFT and queues the raw result with a DWT time stamp, main
+   streams them as "M,<ms>,<mag>,<phase>" using the latest RCAL. RCAL is measured again every
+   EIS_MON_RCAL_MS (0 - only at the start), leaving a gap in the sensor series
+   note: the core is not put in flexi mode while DFTs are queued, the DWT counter needs the
+         core clock
+*/
+#define EIS_MON_EN         1
+#define EIS_MON_FREQ       1000.0
+#define EIS_MON_RCAL_MS    10000
+#define EIS_MON_SETTLE     1000           // 10us units, settling after switching sensor/RCAL
+#define EIS_MON_LEN        32             // ring buffer entries
+
+typedef struct
+{
+   uint32_t cyc;        // DWT->CYCCNT at DFT ready
+   int32_t re;
+   int32_t im;
+}MonLog_t;
+
+/*
+   Warm standby. After a sweep the HS DAC, HS TIA and ADC stay powered and configured, the next
+   sweep skips SnsACInit and starts measuring right away
+   1 - enabled, the loop is powered down after EIS_STANDBY_MS without a sweep
+   0 - the loop is powered down after every sweep
+*/
+#define EIS_STANDBY_EN     0
+#define EIS_STANDBY_MS     60000
+
+/*
+   Settling before each DFT in 10us units, shared by the CPU and the sequencer sweep
+*/
+#define EIS_SETTLE_SW      1000           // switch settling
+#define EIS_SETTLE_SNS     1000000        // -200mV applied to the sensor and waveform settling
+#define EIS_SETTLE_RCAL    500000         // waveform settling on RCAL
+
+/*
+   Sequencer driven sweep. 'q' on the UART compiles the ImpResult_hold sweep of CHAN0 into AFE
+   sequencer commands and runs it without the core: per measurement the register state left by
+   SnsACSigChainCfg and the switch helpers is compared with the previous one and only changed
+   registers are written, settling and DFT times become sequencer waits and DFT results go to the
+   data FIFO. The core sleeps and drains the FIFO, output is the same as the CPU sweep.
+   'Q' dumps the compiled command stream as "SEQ,<index>,<hex>" for checking on the host
+   1 - enabled
+   0 - disabled
+   note: frequencies >= 80kHz change the AFE clock and are not supported, a sweep containing
+         them or registers out of sequencer reach falls back to the CPU sweep.
+         autoranging, DC logging and capture are CPU sweep only
+*/
+#define EIS_SEQ_EN         1
+#define EIS_SEQ_MAX        1024           // command memory words, 4kB
+#define EIS_SEQ_CLK_HZ     16000000       // AFE system clock, sequencer wait unit
+#define EIS_SEQ_WAIT_MAX   0x3FFFFFFF     // longest single wait command
+#define EIS_SEQ_CMDMEM     1              // CMDDATACON CMD_MEM_SEL, 4kB command memory
+#define EIS_SEQ_DATAMEM    0              // CMDDATACON DATA_MEM_SEL, 2kB data FIFO
+#define EIS_SEQ_FIFOSRC    2              // FIFOCON DATAFIFOSRCSEL, DFT results
+#define EIS_SEQ_DATA_MASK  0x3FFFF        // DFT result bits of a FIFO word
+#define EIS_SEQ_POLL       10000          // 10us units between FIFO polls
+#define EIS_SEQ_MARGIN_MS  5000           // timeout margin on the compiled sweep time
+
+#define SEQ_WR(off,data)   (0x80000000|((((off)>>2)&0x7F)<<24)|((data)&0xFFFFFF))
+#define SEQ_WAIT(clk)      ((clk)&0x3FFFFFFF)
+
+/*
+   Timebase: TMR1 free running from the 32kHz LFOSC /256, TMR0 one shot from LFOSC /16 for sleeps
+*/
+#define TIMEBASE_HZ     128
+#define SLEEPTMR_HZ     2048
+
+/*
+   Hot path profiling with the DWT cycle counter, 'p' on the UART dumps and clears the counters
+   1 - enabled
+   0 - disabled, no overhead
+   note: the core clock is gated in flexi mode, with EIS_LPWAIT_EN waits only count awake cycles
+*/
+#define EIS_PROFILE_EN  1
+
+typedef enum
+{
+   PROF_SIGCHAIN = 0,   // SnsACSigChainCfg
+   PROF_SETTLE,         // switch and waveform settling delays
+   PROF_DFT,            // wait for DFT result
+   PROF_PRINTF,         // result printf
+   PROF_NUM
+}ProfRegion_t;
+
+typedef struct
+{
+   const char *name;
+   uint32_t count;
+   uint32_t min;        // cycles
+   uint32_t max;
+   uint64_t total;
+   uint32_t start;
+}ProfData_t;
+
+#if EIS_PROFILE_EN
+#define PROF_BEGIN(r)   ProfBegin(r)
+#define PROF_END(r)     ProfEnd(r)
+#else
+#define PROF_BEGIN(r)
+#define PROF_END(r)
+#endif
+
+/*
+   Firmware identity reported by 'i' on the UART as
+   "ID,<fw>,<version>,<device>,<runs>,<baud>,<boot ms>,<boot timeout mask>"
+   DEVICE_ID can be overridden per board at build time
+*/
+#define FW_NAME         "EIS355"
+#define FW_VERSION      "1.1"
+#ifndef DEVICE_ID
+#define DEVICE_ID       0
+#endif
+/*
+   Run markers around each sweep so a host can split the stream into runs
+   1 - "RUN,BEGIN,<run>,<setting>,<grid id>" and the "RUN,CFG,<rcal>,<n>,<f1>;..;<fn>" header (frequency grid in Hz)
+       before and "RUN,END,<run>,<points>" after the sweep
+   0 - legacy stream
+*/
+#define EIS_RUN_MARKERS_EN 0
+
+/*
+   UART baud rate, UrtCfg setting and value in bit/s for the 'r' throughput report
+*/
+#define UART_BAUD       B9600
+#define UART_BAUD_BPS   9600
+
 #define MCU_STATUS_ACTIVE   0
 #define MCU_STATUS_SLEPT   1
 #define MCU_STATUS_WAKEUP   2
@@ -62,6 +351,53 @@ to ensure that the resulting application performs as required and is safe.
 void ClockInit(void);
 void UartInit(void);
 void GPIOInit(void);
+void TimebaseInit(void);
+uint32_t TimebaseNow(void);
+void SnsWaitDftRdy(void);
+void SnsSleep_10us(uint32_t time);
+void ProfInit(void);
+void ProfBegin(ProfRegion_t region);
+void ProfEnd(ProfRegion_t region);
+void ProfDump(void);
+void SnsHsRangeSet(uint8_t range);
+uint8_t SnsACTestDual(void);
+void SnsACMeasStart(float freq);
+void SnsACMeasStop(void);
+uint8_t SnsACMeasSensor(uint8_t channel, int32_t *pDft);
+uint8_t SnsACMeasRcal(uint8_t channel, int32_t *pDft);
+void SnsACRcalScale(int32_t *pDft, uint8_t rngSns, uint8_t rngRcal);
+void SnsACSensorCfg(uint8_t channel);
+void SnsACLpTiaRestore(uint8_t channel);
+void SnsACRcalCfg(uint8_t channel);
+uint8_t SnsMagPhaseCalRes(ImpResult_t *pRes, uint32_t testNum, char chan);
+void SnsImpCalc(ImpResult_t *pRes);
+void SnsMonitor(uint8_t channel);
+uint32_t SnsMonFlush(ImpResult_t *pRes);
+uint8_t SnsHsRange(void);
+void SnsDcLogSettle(uint8_t channel, uint32_t time);
+void SnsDcLogFlush(void);
+void SnsCaptureArm(uint8_t src);
+void SnsCaptureStart(void);
+void SnsCaptureStop(void);
+void SnsCaptureSend(void);
+void SnsCaptureBench(void);
+uint8_t SnsSigBand(float freq);
+void SnsSweepOrder(ImpResult_t *pRes, uint32_t testNum, uint8_t *pOrder);
+void SnsACSweep(void);
+void NvLoad(void);
+void NvSave(uint8_t boot);
+uint8_t SnsBootSettle(uint8_t chanMask);
+uint8_t SnsACReady(uint8_t channel);
+void SnsACIdle(void);
+void SnsACPowerDown(void);
+uint8_t SnsSeqCompile(ImpResult_t *pRes, uint32_t testNum, uint8_t channel);
+uint8_t SnsSeqSweep(ImpResult_t *pRes, uint32_t testNum, uint8_t channel);
+void SnsSeqDump(void);
+void ThruReport(void);
+void Identify(void);
+uint16_t Crc16(uint16_t crc, const uint8_t *pData, uint32_t len);
+uint16_t GridId(void);
+void GridReport(void);
 
 
 
@@ -85,6 +421,128 @@ uint32_t cx = 0;
 uint32_t dx = 0;
 uint32_t n_impresult = 0;
 uint8_t setting = 0;
+uint8_t u8DualChan = 0;         // 'd' sweeps CHAN0 and CHAN1 together
+volatile uint8_t u8DcLogOn = 0;
+uint32_t u32DcLogAcc = 0;
+uint32_t u32DcLogCnt = 0;
+volatile uint32_t u32DcLogHead = 0;   // written by the ADC interrupt
+uint32_t u32DcLogTail = 0;
+uint32_t u32DcLogLost = 0;
+DcLog_t DcLog[EIS_DCLOG_LEN];
+volatile uint8_t u8CapState = CAP_IDLE;
+volatile uint8_t ucCapBench = 0;
+uint8_t u8CapSrc = '2';          // '2' SINC2DAT, '3' ADCDAT (SINC3)
+volatile uint32_t u32CapFill = 0;
+uint32_t u32CapLen = EIS_CAPTURE_LEN;
+uint16_t u16CapPrev = 0;
+uint32_t u32CapFirst = 0;        // DWT at the first and last captured sample
+uint32_t u32CapLast = 0;
+uint16_t CapBuf[EIS_CAPTURE_MAX];
+const CapBench_t CapBench[] =
+{
+   {SINC3OSR_4,SINC2OSR_1067,ADCSAMPLERATE_800K,800000,4,1067},
+   {SINC3OSR_4,SINC2OSR_640,ADCSAMPLERATE_800K,800000,4,640},
+   {SINC3OSR_4,SINC2OSR_533,ADCSAMPLERATE_800K,800000,4,533},
+   {SINC3OSR_4,SINC2OSR_178,ADCSAMPLERATE_800K,800000,4,178},
+   {SINC3OSR_5,SINC2OSR_178,ADCSAMPLERATE_800K,800000,5,178},
+   {SINC3OSR_2,SINC2OSR_178,ADCSAMPLERATE_1600K,1600000,2,178},
+};
+uint8_t u8Standby = 0;          // excitation loop left powered by the last sweep
+uint32_t u32StandbyStart = 0;
+uint8_t u8SigBand = SIG_BAND_NONE;   // SigBand entry the signal chain is configured for
+const SigBand_t SigBand[] =
+{
+   {.11,   SINC3OSR_4,SINC2OSR_1067,ADCSAMPLERATE_800K, DFTNUM_16384,DFTIN_SINC2,0,800000/4/1067,16384},
+   {.51,   SINC3OSR_4,SINC2OSR_640, ADCSAMPLERATE_800K, DFTNUM_16384,DFTIN_SINC2,0,800000/4/640, 16384},
+   {5,     SINC3OSR_4,SINC2OSR_533, ADCSAMPLERATE_800K, DFTNUM_16384,DFTIN_SINC2,0,800000/4/533, 16384},
+   {450,   SINC3OSR_4,SINC2OSR_178, ADCSAMPLERATE_800K, DFTNUM_8192, DFTIN_SINC2,0,800000/4/178, 8192},
+   {80000, SINC3OSR_4,SINC2OSR_178, ADCSAMPLERATE_800K, DFTNUM_16384,DFTIN_SINC3,0,800000/4,     16384},
+   {200000,SINC3OSR_2,SINC2OSR_178, ADCSAMPLERATE_1600K,DFTNUM_16384,DFTIN_SINC3,1,1600000/2,    16384},
+};
+#define SIG_BAND_NUM    (sizeof(SigBand)/sizeof(SigBand[0]))
+uint8_t u8SeqMode = 0;           // 'q' runs the next sweep on the sequencer
+volatile uint8_t ucSeqDump = 0;
+uint32_t u32SeqLen = 0;          // compiled command words
+uint32_t u32SeqMs = 0;           // compiled sweep time
+uint8_t u8SeqErr = 0;
+uint32_t SeqCmd[EIS_SEQ_MAX];
+/*registers the sequencer rewrites between measurements, in write order, switches last*/
+volatile uint32_t * const SeqReg[] =
+{
+   &pADI_AFE->HSDACCON,
+   &pADI_AFE->WGFCW,
+   &pADI_AFE->ADCFILTERCON,
+   &pADI_AFE->DFTCON,
+   &pADI_AFE->AFECON,
+   &pADI_AFE->DACDCBUFCON,
+   &pADI_AFE->LPTIACON0,
+   &pADI_AFE->LPTIACON1,
+   &pADI_AFE->LPTIASW0,
+   &pADI_AFE->LPTIASW1,
+   &pADI_AFE->DE0RESCON,
+   &pADI_AFE->DE1RESCON,
+   &pADI_AFE->HSRTIACON,
+   &pADI_AFE->DSWFULLCON,
+   &pADI_AFE->NSWFULLCON,
+   &pADI_AFE->PSWFULLCON,
+   &pADI_AFE->TSWFULLCON,
+   &pADI_AFE->SWCON,
+};
+#define SEQ_REG_NUM     (sizeof(SeqReg)/sizeof(SeqReg[0]))
+#define SEQ_REG_AFECON  4
+#define SEQ_REG_SW      13               // first switch matrix register, latched by SWCON
+#define SEQ_REG_SWCON   17
+uint32_t SeqInit[SEQ_REG_NUM];   // register state before compiling
+uint32_t SeqShadow[SEQ_REG_NUM]; // register state at the compile position
+volatile uint8_t u8SleepTmrDone = 0;
+uint32_t u32LpWaitTicks = 0;    // timebase ticks spent in low power waits
+uint32_t u32SweepStart = 0;
+volatile uint8_t ucProfDump = 0;
+volatile uint8_t ucThruReport = 0;
+volatile uint8_t ucIdentify = 0;
+volatile uint8_t ucGridReport = 0;
+uint32_t u32RunCount = 0;       // sweeps run since reset
+uint32_t u32BootMs = 0;         // reset to sensors ready
+uint8_t u8BootTimeout = 0;      // channels not settled within EIS_BOOT_MAX_MS
+NvRec_t NvRec;                  // current settings store record
+uint32_t u32NvAddr = 0;         // flash address of NvRec, 0 if none
+volatile uint8_t u8LastCmd = 0; // last sweep command received
+volatile uint8_t ucMonStart = 0;
+volatile uint8_t u8MonActive = 0;       // monitoring, any UART byte stops it
+volatile uint8_t u8MonStop = 0;
+volatile uint8_t u8MonOn = 0;           // DFT interrupt restarts the DFT and queues results
+volatile uint32_t u32MonHead = 0;       // written by the ADC interrupt
+uint32_t u32MonTail = 0;
+uint32_t u32MonLost = 0;
+uint32_t u32MonSegMs = 0;               // start of the current back to back DFT run
+uint32_t u32MonCyc = 0;                 // DWT count of the last streamed result
+uint64_t u64MonCyc = 0;                 // core cycles since u32MonSegMs
+MonLog_t MonLog[EIS_MON_LEN];
+uint32_t u32ThruPoints = 0;     // results sent in the last sweep
+uint32_t u32ThruBytes = 0;      // bytes sent on the UART in the last sweep
+uint32_t u32ThruFirst = 0;      // timebase ticks from sweep start to first result
+uint32_t u32ThruElapsed = 0;    // timebase ticks of the last sweep
+uint32_t u32ThruLpWait = 0;     // low power wait ticks of the last sweep
+uint8_t  u8ThruActive = 0;
+const HsRange_t HsRange[] =       // ascending gain, entry 0 is the fixed range
+{
+   {HPTIADE_RTIA_50,   GNPGA_1, 50},
+   {HPTIADE_RTIA_200,  GNPGA_1, 200},
+   {HPTIADE_RTIA_1K,   GNPGA_1, 1000},
+   {HPTIADE_RTIA_5K,   GNPGA_1, 5000},
+   {HPTIADE_RTIA_20K,  GNPGA_1, 20000},
+   {HPTIADE_RTIA_80K,  GNPGA_1, 80000},
+   {HPTIADE_RTIA_160K, GNPGA_1, 160000},
+   {HPTIADE_RTIA_160K, GNPGA_4, 640000},
+   {HPTIADE_RTIA_160K, GNPGA_9, 1440000},
+};
+ProfData_t ProfData[PROF_NUM] =
+{
+   {"sigchain"},
+   {"settle"},
+   {"dft"},
+   {"printf"},
+};
 
 
 /*
@@ -155,6 +613,11 @@ ImpResult_t ImpResult[] =
    //user can add frequency option here
 };
 
+ImpResult_t ImpResultCh1[sizeof(ImpResult)/sizeof(ImpResult_t)];   //CHAN1 results of a dual channel sweep
+ImpResult_t ImpResultCh1_hold[sizeof(ImpResult_hold)/sizeof(ImpResult_t)];
+uint8_t SweepOrder[sizeof(ImpResult_hold)/sizeof(ImpResult_t)];   //measurement order of ImpResult_hold
+uint8_t SweepDone[sizeof(ImpResult_hold)/sizeof(ImpResult_t)];
+
 void main(void)
 {
    u32AFEDieStaRdy = AfeDieSta();              // Check if Kernel completed correctly before accessing AFE die             
@@ -169,23 +632,36 @@ void main(void)
    GPIOInit();                                 // init GPIO pins
    ClockInit();                                // Init system clock sources
    UartInit();                                 // Init UART for 57600-8-N-1
+   TimebaseInit();                             // Init timers for low power waits
+   ProfInit();                                 // Start DWT cycle counter
+#if EIS_STORE_EN
+   NvLoad();                                   // last setting, count the boot
+   NvSave(1);
+#endif
 
    pSnsCfg0 = getSnsCfg(CHAN0);
    pSnsCfg1 = getSnsCfg(CHAN1);
+   /*bias both channels first, then wait for them to settle together*/
    if((pSnsCfg0->Enable == SENSOR_CHANNEL_ENABLE))
    {
       printf("%s Sensor Initializing...", pSnsCfg0->SensorName);
       SnsInit(pSnsCfg0);
-      for(uint32_t i=0;i<5000;i++)delay_10us(100);
-      printf("Finish" EOL);
    }
    if((pSnsCfg1->Enable == SENSOR_CHANNEL_ENABLE))
    {
     // printf("%s Sensor Initializing...", pSnsCfg1->SensorName);
       SnsInit(pSnsCfg1);
-      for(uint32_t i=0;i<5000;i++)delay_10us(100);
-      printf("Finish" EOL);
    }
+   u8BootTimeout = ((pSnsCfg0->Enable == SENSOR_CHANNEL_ENABLE) ? 1 : 0)|
+                   ((pSnsCfg1->Enable == SENSOR_CHANNEL_ENABLE) ? 2 : 0);
+   u8BootTimeout &= ~SnsBootSettle(u8BootTimeout);
+   if((pSnsCfg0->Enable == SENSOR_CHANNEL_ENABLE))
+      printf("Finish" EOL);
+   if((pSnsCfg1->Enable == SENSOR_CHANNEL_ENABLE))
+      printf("Finish" EOL);
+   u32BootMs = (TimebaseNow()*1000)/TIMEBASE_HZ;
+   if(u8BootTimeout)
+      printf("BOOT,TIMEOUT,%u"EOL,u8BootTimeout);
 //gpio test
    
     DioClrPin(pADI_GPIO0,PIN0);           // Flash LED
@@ -222,21 +698,40 @@ void main(void)
          /*Digital die Enter hibernater mode, no battery monitor, 24K SRAM*/
          //PwrCfg(ENUM_PMG_PWRMOD_HIBERNATE,BITM_PMG_PWRMOD_MONVBATN,BITM_PMG_SRAMRET_BNK2EN);
          /*Following instruction should not be executed before user sent 1 to wakeup MCU*/
-         
+#if EIS_STORE_EN
+         if((u8LastCmd != NvRec.cmd) || (setting != NvRec.setting))
+            NvSave(0);
+#endif
+         u32SweepStart = TimebaseNow();
+         u32LpWaitTicks = 0;
+         u32ThruPoints = 0;
+         u32ThruBytes = 0;
+         u32ThruFirst = 0;
+         u8ThruActive = 1;
+         u32DcLogHead = u32DcLogTail = u32DcLogLost = 0;
+         u32RunCount++;
+#if EIS_RUN_MARKERS_EN
+         printf("RUN,BEGIN,%lu,%c,%04X"EOL,u32RunCount,setting,GridId());
+         printf("RUN,CFG,%lu,%u,",(uint32_t)AFE_RCAL,sizeof(ImpResult_hold)/sizeof(ImpResult_t));
          for(int i = 0; i<sizeof(ImpResult_hold)/sizeof(ImpResult_t);i++)
-         {
-         ImpResult[0] = ImpResult_hold[i];
-         SnsACInit(CHAN0);
-         SnsACTest(CHAN0);
-         SnsMagPhaseCal();   //calculate impedance
-         }
-         /*power off high power exitation loop if required*/
-         AfeAdcIntCfg(NOINT); //disable all ADC interrupts
-         NVIC_DisableIRQ(AFE_ADC_IRQn);
-         AfeWaveGenGo(false);
-         AfeHPDacPwrUp(false);
-         AfeHpTiaPwrUp(false);
-
+            printf(i ? ";%.4f" : "%.4f",ImpResult_hold[i].freq);
+         printf(EOL);
+#endif
+#if EIS_SEQ_EN
+         if(!(u8SeqMode && SnsSeqSweep(ImpResult_hold,sizeof(ImpResult_hold)/sizeof(ImpResult_t),CHAN0)))
+#endif
+         SnsACSweep();
+         SnsACIdle();
+         u8ThruActive = 0;
+         u32ThruElapsed = TimebaseNow()-u32SweepStart;
+         u32ThruLpWait = u32LpWaitTicks;
+#if EIS_RUN_MARKERS_EN
+         printf("RUN,END,%lu,%lu"EOL,u32RunCount,u32ThruPoints);
+#endif
+#if EIS_PWRSTAT_EN
+         printf("PWR,%lu,%lu"EOL,((TimebaseNow()-u32SweepStart)*1000)/TIMEBASE_HZ,
+                                (u32LpWaitTicks*1000)/TIMEBASE_HZ);
+#endif
         
          cx = 0;
          
@@ -249,6 +744,63 @@ void main(void)
      
  
    
+      if(ucProfDump==1)
+      {
+         ucProfDump = 0;
+         ProfDump();
+      }
+
+      if(ucThruReport==1)
+      {
+         ucThruReport = 0;
+         ThruReport();
+      }
+
+      if(ucIdentify==1)
+      {
+         ucIdentify = 0;
+         Identify();
+      }
+
+      if(ucGridReport==1)
+      {
+         ucGridReport = 0;
+         GridReport();
+      }
+
+      if(ucCapBench==1)
+      {
+         ucCapBench = 0;
+         SnsACPowerDown();   //the benchmark reprograms the ADC filters
+         SnsCaptureBench();
+      }
+
+#if EIS_MON_EN
+      if(ucMonStart==1)
+      {
+         ucMonStart = 0;
+         SnsMonitor(CHAN0);
+      }
+#endif
+
+#if EIS_STANDBY_EN
+      if(u8Standby && ((TimebaseNow()-u32StandbyStart) > (EIS_STANDBY_MS/1000)*TIMEBASE_HZ))
+      {
+         SnsACPowerDown();   //idle timeout, leave warm standby
+      }
+#endif
+
+#if EIS_SEQ_EN
+      if(ucSeqDump==1)
+      {
+         ucSeqDump = 0;
+         SnsACInit(CHAN0);
+         SnsSeqCompile(ImpResult_hold,sizeof(ImpResult_hold)/sizeof(ImpResult_t),CHAN0);
+         SnsSeqDump();
+         SnsACPowerDown();
+      }
+#endif
+
       if(ucUARTPress==1) //Press S2
       {
         printf("scaaa");
@@ -257,22 +809,10 @@ void main(void)
          ucUARTPress = 0;
        
 
-         SnsACInit(CHAN0);
-         SnsACTest(CHAN0);
-         SnsMagPhaseCal();   //calculate impedance
-         
-  
-
-SnsACInit(CHAN0);
+         SnsACReady(CHAN0);
          SnsACTest(CHAN0);
          SnsMagPhaseCal();   //calculate impedance
-
-         /*power off high power exitation loop if required*/
-         AfeAdcIntCfg(NOINT); //disable all ADC interrupts
-         NVIC_DisableIRQ(AFE_ADC_IRQn);
-         AfeWaveGenGo(false);
-         AfeHPDacPwrUp(false);
-         AfeHpTiaPwrUp(false);
+         SnsACIdle();
 
       
          cx = 0;
@@ -312,9 +852,14 @@ void GPIOInit(void)
 uint8_t SnsACInit(uint8_t channel)
 {
    uint32_t ctia;
+   u8SigBand = SIG_BAND_NONE;   //AfeAdcFiltCfg below changes the filters
    /*DFT interrupt enable*/
    //AfeAdcIntCfg(BITM_AFE_ADCINTIEN_DFTRDYIEN);//dftaidan this is where DFT interrupt is enabled .. find next step
+#if EIS_LPWAIT_EN
+   AfeAdcIntCfg(BITM_AFE_ADCINTIEN_DFTRDYIEN);  //SINC2 results unused, don't wake the core for them
+#else
    AfeAdcIntCfg(BITM_AFE_ADCINTIEN_DFTRDYIEN|BITM_AFE_ADCINTIEN_SINC2RDYIEN);
+#endif
  
    NVIC_EnableIRQ(AFE_ADC_IRQn);
    /******setup exitation loop and TIA********/
@@ -348,13 +893,195 @@ uint8_t SnsACInit(uint8_t channel)
    return 1;
 }
 
+#if EIS_STORE_EN
+/*run a flash controller command, 1 if it succeeded*/
+static uint8_t NvFlashCmd(uint32_t cmd)
+{
+   pADI_FLCC0->KEY = ENUM_FLCC_KEY_USERKEY;
+   pADI_FLCC0->CMD = cmd;
+   while(pADI_FLCC0->STAT & BITM_FLCC_STAT_CMDBUSY);
+   return !(pADI_FLCC0->STAT & BITM_FLCC_STAT_CMDFAIL);
+}
+
+/**
+   @brief void NvLoad(void)
+          load the newest settings store record and restore the mux setting
+*/
+void NvLoad(void)
+{
+   const NvRec_t *pRec;
+
+   memset(&NvRec,0,sizeof(NvRec));
+   u32NvAddr = 0;
+   for(uint32_t addr=EIS_STORE_BASE;addr+sizeof(NvRec_t)<=EIS_STORE_BASE+2*EIS_STORE_PAGE;addr+=sizeof(NvRec_t))
+   {
+      pRec = (const NvRec_t *)addr;
+      if((pRec->magic == NVREC_MAGIC) && (pRec->crc == Crc16(0xFFFF,(const uint8_t *)pRec,offsetof(NvRec_t,crc))) &&
+         ((u32NvAddr == 0) || (pRec->seq > NvRec.seq)))
+      {
+         memcpy(&NvRec,pRec,sizeof(NvRec));
+         u32NvAddr = addr;
+      }
+   }
+   if((u32NvAddr != 0) && (strncmp(NvRec.fw,FW_VERSION,sizeof(NvRec.fw)) == 0))
+   {
+      setting = NvRec.setting;
+      u8LastCmd = NvRec.cmd;
+   }
+   else
+   {
+      NvRec.cmd = 0;   //no replay across firmware versions
+   }
+}
+
+/**
+   @brief void NvSave(uint8_t boot)
+          append the current settings as the next record, boot counts a boot
+   @note when the page of the current record is full the other page is erased first,
+         the current record survives an interrupted write
+*/
+void NvSave(uint8_t boot)
+{
+   const uint32_t *pWord = (const uint32_t *)&NvRec;
+   uint32_t page = (u32NvAddr-EIS_STORE_BASE)/EIS_STORE_PAGE;
+   uint32_t addr = u32NvAddr+sizeof(NvRec_t);
+
+   if((u32NvAddr == 0) || (addr+sizeof(NvRec_t) > EIS_STORE_BASE+(page+1)*EIS_STORE_PAGE) ||
+      (*(const uint32_t *)addr != 0xFFFFFFFF))
+   {
+      page = u32NvAddr ? 1-page : 0;
+      addr = EIS_STORE_BASE+page*EIS_STORE_PAGE;
+      pADI_FLCC0->PAGE_ADDR0 = addr;
+      if(!NvFlashCmd(ENUM_FLCC_CMD_ERASEPAGE))
+         return;
+   }
+   NvRec.magic = NVREC_MAGIC;
+   NvRec.seq++;
+   if(boot)
+      NvRec.boots++;
+   strncpy(NvRec.fw,FW_VERSION,sizeof(NvRec.fw));
+   NvRec.setting = setting;
+   NvRec.cmd = u8LastCmd;
+   NvRec.crc = Crc16(0xFFFF,(const uint8_t *)&NvRec,offsetof(NvRec_t,crc));
+   for(uint32_t i=0;i<sizeof(NvRec_t)/4;i+=2)   //64 bit flash writes
+   {
+      pADI_FLCC0->KH_ADDR = addr+i*4;
+      pADI_FLCC0->KH_DATA0 = pWord[i];
+      pADI_FLCC0->KH_DATA1 = pWord[i+1];
+      if(!NvFlashCmd(ENUM_FLCC_CMD_WRITE))
+         return;
+   }
+   u32NvAddr = addr;
+}
+#endif
+
+/**
+   @brief uint8_t SnsBootSettle(uint8_t chanMask)
+          wait until the LP TIA output of the channels in chanMask (bit0 CHAN0, bit1 CHAN1) settles
+   @return mask of the channels found settled, others timed out after EIS_BOOT_MAX_MS.
+*/
+uint8_t SnsBootSettle(uint8_t chanMask)
+{
+   uint16_t prev[2] = {0,0};
+   uint8_t stable[2] = {0,0};
+   uint8_t seen = 0;
+   uint8_t ready = 0;
+   uint16_t code;
+   int32_t delta;
+   uint32_t t0 = TimebaseNow();
+
+   AfeAdcFiltCfg(SINC3OSR_5,SINC2OSR_178,LFPBYPEN_NOBYP,ADCSAMPLERATE_800K);
+   AfeAdcPgaCfg(GNPGA_1,0);
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_ADCEN|BITM_AFE_AFECON_ADCCONVEN;
+   while((ready != chanMask) && ((TimebaseNow()-t0) < (EIS_BOOT_MAX_MS*TIMEBASE_HZ)/1000))
+   {
+      SnsSleep_10us(EIS_BOOT_STEP);
+      for(uint8_t ch=0;ch<2;ch++)
+      {
+         if(!(chanMask&(1<<ch)) || (ready&(1<<ch)))
+            continue;
+         if(ch>0)
+            AfeAdcChan(MUXSELP_LPTIA1_LPF,MUXSELN_LPTIA1_N);
+         else
+            AfeAdcChan(MUXSELP_LPTIA0_LPF,MUXSELN_LPTIA0_N);
+         pADI_AFE->AFECON &= (~(BITM_AFE_AFECON_SINC2EN));   // flush the other channel out of SINC2
+         delay_10us(50);
+         pADI_AFE->AFECON |= BITM_AFE_AFECON_SINC2EN;
+         SnsSleep_10us(EIS_DCLOG_FLUSH);
+         code = (uint16_t)pADI_AFE->SINC2DAT;
+         delta = (int32_t)code - prev[ch];
+         if((seen&(1<<ch)) && (delta <= EIS_BOOT_DELTA) && (delta >= -EIS_BOOT_DELTA))
+         {
+            if(++stable[ch] >= EIS_BOOT_STABLE)
+               ready |= (1<<ch);
+         }
+         else
+         {
+            stable[ch] = 0;
+         }
+         seen |= (1<<ch);
+         prev[ch] = code;
+      }
+   }
+   pADI_AFE->AFECON &= (~(BITM_AFE_AFECON_ADCCONVEN|BITM_AFE_AFECON_ADCEN));
+   AfeAdcChan(MUXSELP_AIN6,MUXSELN_VZERO0);
+   return ready;
+}
+
+/**
+   @brief uint8_t SnsACReady(uint8_t channel)
+          SnsACInit unless the excitation loop is still configured from warm standby
+   @return 1.
+*/
+uint8_t SnsACReady(uint8_t channel)
+{
+   if(u8Standby)
+   {
+      u8Standby = 0;
+      return 1;
+   }
+   return SnsACInit(channel);
+}
+
+/**
+   @brief void SnsACIdle(void)
+          after a sweep, enter warm standby with EIS_STANDBY_EN or power the loop down
+*/
+void SnsACIdle(void)
+{
+#if EIS_STANDBY_EN
+   AfeWaveGenGo(false);
+   u8Standby = 1;
+   u32StandbyStart = TimebaseNow();
+#else
+   SnsACPowerDown();
+#endif
+}
+
+/**
+   @brief void SnsACPowerDown(void)
+          power off high power exitation loop
+*/
+void SnsACPowerDown(void)
+{
+   AfeAdcIntCfg(NOINT); //disable all ADC interrupts
+   NVIC_DisableIRQ(AFE_ADC_IRQn);
+   AfeWaveGenGo(false);
+   AfeHPDacPwrUp(false);
+   AfeHpTiaPwrUp(false);
+   u8Standby = 0;
+}
+
 /**
    @brief uint8_t SnsACSigChainCfg(uint32_t freq)
          ======== configuration of AC signal chain depends on required excitation frequency.
    @param freq :{}
             - excitation AC signal frequency
    @return 1.
-   @note settings including DAC update rate, ADC update rate and DFT samples can be adjusted for
+   @note band settings are in SigBand and only written when freq is in another band than the
+   previous call, the AFE clock only changes between HP and LP bands. SnsACInit forces a full
+   configuration.
+   settings including DAC update rate, ADC update rate and DFT samples can be adjusted for
    different excitation frequencies to get better performance. As general guidelines,
        - DAC update rate: make sure at least 4 points per sinewave period. Higher rate comsumes more power.
        - ADC update rate:  at least follow Nyquist sampling rule.
@@ -363,392 +1090,456 @@ uint8_t SnsACInit(uint8_t channel)
 */
 uint8_t SnsACSigChainCfg(float freq)
 {
+   uint8_t band = SnsSigBand(freq);
+   const SigBand_t *pBand = &SigBand[band];
    uint16_t DacCon;
    uint32_t WgFreqReg;
 
-   DacCon = pADI_AFE->HSDACCON;
-   DacCon &= (~BITM_AFE_HSDACCON_RATE);  //clear rate bits for later setting
-  // WgFreqReg = (uint32_t)((((uint64_t)freq)<<30)/16000000.0+0.5);  //ATE version 0x14// a divide by 10 to make each bit workt 1/160MHz instead of 16Mhz must check on oscilliscope freqaidan
-   //WgFreqReg = (uint32_t)((((uint64_t)freq)<<26)/16000000.0+0.5); //ATE version less than 0x03
-    if (freq < .11){
-      
-      ClkDivCfg(1,1);                       // digital die to 26MHz 
-      AfeHFOsc32M(0x0);                       //AFE oscillator change to 16MHz
-      AfeSysClkDiv(AFE_SYSCLKDIV_1);        //AFE system clock remain in 16MHz
-
-      AfeSysCfg(ENUM_AFE_PMBW_LP,ENUM_AFE_PMBW_BW250);       
-      AfeHpTiaCon(HPTIABIAS_1V1);
-      
-      
-     
-      DacCon &= 0xFE01;                        // Clear DACCON[8:1] bits
-      DacCon |= (0x1b<<BITP_AFE_HSDACCON_RATE);        // Set DACCLK to recommended setting for LP mode   
-      
-      
-      pADI_AFE->AFECON &= (~(BITM_AFE_AFECON_SINC2EN));          // Clear the SINC2 filter to flush its contents
-      delay_10us(50);
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_SINC2EN;               // re-enable SINC2 filter
-      
-      AfeAdcFiltCfg(SINC3OSR_4,
-                    SINC2OSR_1067,
-                    LFPBYPEN_BYP,
-                    ADCSAMPLERATE_800K); // Configure ADC update = 800KSPS/5 = 200KSPS SINC3 output. 200K/800, SINC2 O/P = 250 SPS
-      
-      //DFT source: supply filter output. 
-      pADI_AFE->AFECON &=
-        (~(BITM_AFE_AFECON_DFTEN));            // Clear DFT enable bit
-      delay_10us(50);
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN;// re-enable DFT
-            
-      AfeAdcDFTCfg(BITM_AFE_DFTCON_HANNINGEN,
-                   DFTNUM_16384,
-                   DFTIN_SINC2); // DFT input is from SINC2 filter. 16384 * (1/250) = 65.5 seconds to fill
-      
-      FCW_Val = (((freq/16000000)*1073741824)+0.5);
-      WgFreqReg = (uint32_t)FCW_Val; 
-   }
-   
-   else if (freq < .51){
-      
-      ClkDivCfg(1,1);                       // digital die to 26MHz 
-      AfeHFOsc32M(0x0);                       //AFE oscillator change to 16MHz
-      AfeSysClkDiv(AFE_SYSCLKDIV_1);        //AFE system clock remain in 16MHz
-
-      AfeSysCfg(ENUM_AFE_PMBW_LP,ENUM_AFE_PMBW_BW250);       
-      AfeHpTiaCon(HPTIABIAS_1V1);
-      
-     
-      DacCon &= 0xFE01;                        // Clear DACCON[8:1] bits
-      DacCon |= (0x1b<<BITP_AFE_HSDACCON_RATE);        // Set DACCLK to recommended setting for LP mode   
-      
-      pADI_AFE->AFECON &= (~(BITM_AFE_AFECON_SINC2EN));          // Clear the SINC2 filter to flush its contents
+   if(band != u8SigBand)
+   {
+      if((u8SigBand == SIG_BAND_NONE) || (pBand->hp != SigBand[u8SigBand].hp))
+      {
+         DacCon = pADI_AFE->HSDACCON;
+         DacCon &= 0xFE01;                        // Clear DACCON[8:1] bits
+         if(pBand->hp)   /*80KHz < frequency < 200KHz*/
+         {
+            /*****boost ADC sample rate to 1.6MHz****/
+            AfeAdcChopEn(0);  //Disable ADC input buffer chop for HP mode (>80kHz)
+            AfeSysCfg(ENUM_AFE_PMBW_HP,ENUM_AFE_PMBW_BW250);   //set High speed DAC and ADC in high power mode
+            AfeHpTiaCon(HPTIABIAS_1V1);
+            ClkDivCfg(2,2);
+            AfeSysClkDiv(AFE_SYSCLKDIV_2);   //AFE system clock remain in 8MHz
+            AfeHFOsc32M(BITM_AFE_HPOSCCON_CLK32MHZEN);   //AFE oscillator change to 32MHz
+            ClkDivCfg(1,1);
+            /*set High DAC update rate,16MHz/9=~1.6MHz update rate,skew the DAC and ADC clocks with respect to each other*/
+            DacCon |= (0x07<<BITP_AFE_HSDACCON_RATE);   // Set DACCLK to recommended setting for HP mode
+         }
+         else
+         {
+            ClkDivCfg(1,1);                          // digital die to 26MHz 
+            AfeHFOsc32M(0);                          // AFE oscillator change to 16MHz
+            AfeSysClkDiv(AFE_SYSCLKDIV_1);           // AFE system clock remain in 16MHz
+            AfeAdcChopEn(1);                         // Enable ADC input buffer chop for LP mode (up to 80kHz)
+            AfeSysCfg(ENUM_AFE_PMBW_LP,ENUM_AFE_PMBW_BW250);       
+            AfeHpTiaCon(HPTIABIAS_1V1);
+            DacCon |= (0x1b<<BITP_AFE_HSDACCON_RATE);   // Set DACCLK to recommended setting for LP mode   
+         }
+         pADI_AFE->HSDACCON = DacCon;
+      }
+      pADI_AFE->AFECON &= (~(BITM_AFE_AFECON_SINC2EN));   // Clear the SINC2 filter to flush its contents
       delay_10us(50);
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_SINC2EN;               // re-enable SINC2 filter
-      
-      AfeAdcFiltCfg(SINC3OSR_4,
-                    SINC2OSR_640,
-                    LFPBYPEN_BYP,ADCSAMPLERATE_800K); // Configure ADC update = 800KSPS/5 = 160KSPS SINC3 output. 160K/640, SINC2 O/P = 250 SPS
-      
+      pADI_AFE->AFECON |= BITM_AFE_AFECON_SINC2EN;        // re-enable SINC2 filter
+      AfeAdcFiltCfg(pBand->sinc3osr,pBand->sinc2osr,LFPBYPEN_BYP,pBand->adcrate);
       //DFT source: supply filter output. 
-      pADI_AFE->AFECON &=
-        (~(BITM_AFE_AFECON_DFTEN));            // Clear DFT enable bit
+      pADI_AFE->AFECON &= (~(BITM_AFE_AFECON_DFTEN));     // Clear DFT enable bit
       delay_10us(50);
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN;// re-enable DFT
-      
-      AfeAdcDFTCfg(BITM_AFE_DFTCON_HANNINGEN,
-                   DFTNUM_16384,
-                   DFTIN_SINC2);// DFT input is from SINC2 filter. 8192 * (1/250) = 32.7 seconds to fill
-      
-      WgFreqReg = 0x21; //(.5Hz * 2^30)/16MHz = 33 (0x21)
-      FCW_Val = (((freq/16000000)*1073741824)+0.5);
-      WgFreqReg = (uint32_t)FCW_Val; 
+      pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN;          // re-enable DFT
+      AfeAdcDFTCfg(BITM_AFE_DFTCON_HANNINGEN,pBand->dftnum,pBand->dftsrc);
+      u8SigBand = band;
    }
-   
-   else if(freq<5)   
-   {
-      ClkDivCfg(1,1);                          // digital die to 26MHz 
-      AfeHFOsc32M(0);                          // AFE oscillator change to 16MHz
-      AfeSysClkDiv(AFE_SYSCLKDIV_1);           // AFE system clock remain in 16MHz
-      DacCon &= 0xFE01;                        // Clear DACCON[8:1] bits
-      DacCon |= 
-        (0x1b<<BITP_AFE_HSDACCON_RATE);        // Set DACCLK to recommended setting for LP mode   
-      AfeSysCfg(ENUM_AFE_PMBW_LP,ENUM_AFE_PMBW_BW250);       
-		AfeHpTiaCon(HPTIABIAS_1V1); // Aidan, this is where I probably change switch settings from HSTIA to LPTIA, look at where RTIA& self calibration etc is too!
-
-      pADI_AFE->AFECON &= (~(BITM_AFE_AFECON_SINC2EN)); // Clear the SINC2 filter
-      delay_10us(50);
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_SINC2EN;
-   
-      AfeAdcFiltCfg(SINC3OSR_4,
-                    SINC2OSR_533,LFPBYPEN_BYP,
-                    ADCSAMPLERATE_800K);       // Configure ADC update = 800KSPS/4 = 200KSPS SINC3 output. 200K/533, SINC2 O/P = 375 SPS Mike, digitally altering the bin width, must do it by slowing down system instead
-      //DFT source: supply filter output. 
-      pADI_AFE->AFECON &=
-        (~(BITM_AFE_AFECON_DFTEN));            // Clear DFT enable bit
-      delay_10us(50);
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN;// re-enable DFT
-    
-      AfeAdcDFTCfg(BITM_AFE_DFTCON_HANNINGEN,  // DFT input is from SINC2 filter. 8192 * (1/375) = 21.83 seconds to fill
-                   DFTNUM_16384,
-                   DFTIN_SINC2);
-      FCW_Val = (((freq/16000000)*1073741824)+0.5);
-      WgFreqReg = (uint32_t)FCW_Val;                     
-    }
-   else if(freq<450)   /*frequency lower than 450 Hz*/
-   {
-      ClkDivCfg(1,1);                          // digital die to 26MHz 
-      AfeHFOsc32M(0);                          // AFE oscillator change to 16MHz
-      AfeSysClkDiv(AFE_SYSCLKDIV_1);           // AFE system clock remain in 16MHz
-     
-      AfeSysCfg(ENUM_AFE_PMBW_LP,ENUM_AFE_PMBW_BW250);       
-		AfeHpTiaCon(HPTIABIAS_1V1);
-      DacCon &= 0xFE01;                        // Clear DACCON[8:1] bits
-      DacCon |= 
-        (0x1b<<BITP_AFE_HSDACCON_RATE);        // Set DACCLK to recommended setting for LP mode   
-      /*ADC 900sps update rate to DFT engine*/
-      pADI_AFE->AFECON &= 
-        (~(BITM_AFE_AFECON_SINC2EN));          // Clear the SINC2 filter to flush its contents
-      delay_10us(50);
-      pADI_AFE->AFECON |= 
-        BITM_AFE_AFECON_SINC2EN;               // re-enable SINC2 filter
-      AfeAdcFiltCfg(SINC3OSR_4,
-                    SINC2OSR_178,LFPBYPEN_BYP,
-                    ADCSAMPLERATE_800K);       // Configure ADC update = 800KSPS/4 = 200KSPS SINC3 output. 200K/178, SINC2 O/P = 1123 SPS
-      pADI_AFE->AFECON &=
-        (~(BITM_AFE_AFECON_DFTEN));            // Clear DFT enable bit
-      delay_10us(50);
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN;// re-enable DFT
-      AfeAdcDFTCfg(BITM_AFE_DFTCON_HANNINGEN,  // DFT input is from SINC2 filter. 4096 * (1/1123) = 3.64 seconds to fill
-                   DFTNUM_8192,
-                   DFTIN_SINC2);
-      FCW_Val = (((freq/16000000)*1073741824)+0.5);
-      WgFreqReg = (uint32_t)FCW_Val; 
-   }
-   else if(freq<80000)  /*450Hz < frequency < 80KHz*/
-   {
-     ClkDivCfg(1,1);                           // digital die to 26MHz 
-     AfeHFOsc32M(0);                           // AFE oscillator change to 16MHz
-     AfeSysClkDiv(AFE_SYSCLKDIV_1);            // AFE system clock remain in 16MHz  
-      /*set middle DAC update rate,16MHz/18=~888KHz update rate,skew the DAC and ADC clocks with respect to each other*/
-      AfeSysCfg(ENUM_AFE_PMBW_LP,ENUM_AFE_PMBW_BW250);   
-		AfeHpTiaCon(HPTIABIAS_1V1);
-      DacCon &= 0xFE01;                        // Clear DACCON[8:1] bits
-      DacCon |= 
-        (0x1b<<BITP_AFE_HSDACCON_RATE);        // Set DACCLK to recommended setting for LP mode   
-      /*ADC 160Ksps update rate to DFT engine*/
-      pADI_AFE->AFECON &= 
-        (~(BITM_AFE_AFECON_SINC2EN));          // Clear the SINC2 filter to flush its contents
-      delay_10us(50);
-      pADI_AFE->AFECON |= 
-        BITM_AFE_AFECON_SINC2EN;               // re-enable SINC2 filter
-      AfeAdcFiltCfg(SINC3OSR_4,SINC2OSR_178,
-                    LFPBYPEN_BYP,
-                    ADCSAMPLERATE_800K);      //bypass LPF, 200KHz ADC update rate
-      pADI_AFE->AFECON &=
-        (~(BITM_AFE_AFECON_DFTEN));            // Clear DFT enable bit
-      delay_10us(50);
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN;// re-enable DFT
-      AfeAdcDFTCfg(BITM_AFE_DFTCON_HANNINGEN,
-                   DFTNUM_16384,
-                   DFTIN_SINC3);               //DFT source: Sinc3 result. 16384 * (1/200000) = 81.92mS
-     FCW_Val = (((freq/16000000)*1073741824)+0.5);
-      WgFreqReg = (uint32_t)FCW_Val; 
-   }
-   else/*80KHz < frequency < 200KHz*/
-   {
-      /*****boost ADC sample rate to 1.6MHz****/
-      AfeAdcChopEn(0);  //Disable ADC input buffer chop for HP mode (>80kHz)
-      AfeSysCfg(ENUM_AFE_PMBW_HP,ENUM_AFE_PMBW_BW250);   //set High speed DAC and ADC in high power mode
-		 AfeHpTiaCon(HPTIABIAS_1V1);
-      ClkDivCfg(2,2);
-      AfeSysClkDiv(AFE_SYSCLKDIV_2);   //AFE system clock remain in 8MHz
-      AfeHFOsc32M(BITM_AFE_HPOSCCON_CLK32MHZEN);   //AFE oscillator change to 32MHz
-      ClkDivCfg(1,1);
-      /*set High DAC update rate,16MHz/9=~1.6MHz update rate,skew the DAC and ADC clocks with respect to each other*/
-      DacCon &= 0xFE01;                        // Clear DACCON[8:1] bits
-      DacCon |= 
-        (0x07<<BITP_AFE_HSDACCON_RATE);        // Set DACCLK to recommended setting for HP mode   
-      /*ADC 400Ksps update rate to DFT engine*/
-      pADI_AFE->AFECON &= 
-        (~(BITM_AFE_AFECON_SINC2EN));          // Clear the SINC2 filter to flush its contents
-      delay_10us(50);
-      pADI_AFE->AFECON |= 
-        BITM_AFE_AFECON_SINC2EN;               // re-enable SINC2 filter
-      AfeAdcFiltCfg(SINC3OSR_2,SINC2OSR_178,LFPBYPEN_BYP,ADCSAMPLERATE_1600K); //800KHz ADC update rate
-      pADI_AFE->AFECON &=
-        (~(BITM_AFE_AFECON_DFTEN));            // Clear DFT enable bit
-      delay_10us(50);
-      pADI_AFE->AFECON |= 
-        BITM_AFE_AFECON_DFTEN;                 // re-enable DFT
-      AfeAdcDFTCfg(BITM_AFE_DFTCON_HANNINGEN,
-                   DFTNUM_16384,DFTIN_SINC3); //DFT source: Sinc3 result 16384 * (1/800000) = 20.48mS
-     FCW_Val = (((freq/16000000)*1073741824)+0.5);
-     WgFreqReg = (uint32_t)FCW_Val;
-   }
-   pADI_AFE->HSDACCON = DacCon;
+   FCW_Val = (((freq/16000000)*1073741824)+0.5);
+   WgFreqReg = (uint32_t)FCW_Val;
    AfeHPDacSineCfg(WgFreqReg,0,SINE_OFFSET_REG,SINE_AMPLITUDE_REG);  //set new frequency
    return 1;
 }
 
 /**
-   @brief uint8_t SnsACTest(uint8_t channel)
-          start AC test
-   @param channel :{CHAN0,CHAN1}
-      - 0 or CHAN0, Sensor channel 0
-      - 1 or CHAN1, Sensor channel 1
-   @param pDFTData :{}
-      - pointer to DFT result:6x word
-   @return 1.
+   @brief uint8_t SnsSigBand(float freq)
+          SigBand entry of an excitation frequency
 */
-uint8_t SnsACTest(uint8_t channel)
+uint8_t SnsSigBand(float freq)
+{
+   uint8_t band = 0;
+
+   while((band < SIG_BAND_NUM-1) && (freq >= SigBand[band].fmax))
+      band++;
+   return band;
+}
+
+/**
+   @brief void SnsSweepOrder(ImpResult_t *pRes, uint32_t testNum, uint8_t *pOrder)
+          measurement order of a sweep, points of a band are grouped so the signal chain
+          changes band as rarely as possible. bands keep the order they first appear in,
+          points within a band keep the requested order
+*/
+void SnsSweepOrder(ImpResult_t *pRes, uint32_t testNum, uint8_t *pOrder)
+{
+   uint8_t rank[SIG_BAND_NUM];
+   uint8_t next = 0;
+   uint8_t key, tmp;
+   uint32_t j;
+
+   memset(rank,0xFF,sizeof(rank));
+   for(uint32_t i=0;i<testNum;i++)
+   {
+      key = SnsSigBand(pRes[i].freq);
+      if(rank[key] == 0xFF)
+         rank[key] = next++;
+   }
+   for(uint32_t i=0;i<testNum;i++)   /*stable insertion sort by band rank*/
+   {
+      tmp = i;
+      key = rank[SnsSigBand(pRes[tmp].freq)];
+      for(j=i;(j>0) && (rank[SnsSigBand(pRes[pOrder[j-1]].freq)] > key);j--)
+         pOrder[j] = pOrder[j-1];
+      pOrder[j] = tmp;
+   }
+}
+
+/**
+   @brief uint8_t SnsACTest(uint8_t channel)
+          start AC test
+   @param channel :{CHAN0,CHAN1}
+      - 0 or CHAN0, Sensor channel 0
+      - 1 or CHAN1, Sensor channel 1
+   @param pDFTData :{}
+      - pointer to DFT result:6x word
+   @return 1.
+*/
+uint8_t SnsACTest(uint8_t channel)
 {
    uint32_t freqNum = sizeof(ImpResult)/sizeof(ImpResult_t);
+   uint8_t rngSns, rngRcal;
    for(uint32_t i=0;i<freqNum;i++)
    {
-     
-      SnsACSigChainCfg(ImpResult[i].freq);
-      AfeWaveGenGo(true);
-      
-      /*********Sensor+Rload AC measurement*************/
-      /*break LP TIA connection*/
-      AfeLpTiaSwitchCfg(channel,SWMODE_AC);  /*LP TIA disconnect sensor for AC test*/
-#ifdef EIS_DCBIAS_EN //add bias voltage to excitation sinewave
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_DACBUFEN;   //enable DC buffer for excitation loop
-      if(channel>0)
+      SnsACMeasStart(ImpResult[i].freq);
+      rngSns = SnsACMeasSensor(channel,ImpResult[i].DFT_result);
+      rngRcal = SnsACMeasRcal(channel,ImpResult[i].DFT_result);
+      SnsACRcalScale(ImpResult[i].DFT_result,rngSns,rngRcal);
+      SnsACMeasStop();
+   }
+
+   return 1;
+}
+
+/**
+   @brief void SnsACSweep(void)
+          CPU sweep of ImpResult_hold, CHAN0 with the mux setting or both channels with u8DualChan
+   @note the AFE is initialized once, points are measured in SnsSweepOrder order and each
+         result is printed as soon as all points before it in ImpResult_hold are done
+*/
+void SnsACSweep(void)
+{
+   uint32_t testNum = sizeof(ImpResult_hold)/sizeof(ImpResult_t);
+   uint32_t next = 0;
+   uint32_t i;
+
+   SnsACReady(CHAN0);
+#if EIS_SWEEP_ORDER_EN
+   SnsSweepOrder(ImpResult_hold,testNum,SweepOrder);
+#else
+   for(i=0;i<testNum;i++)
+      SweepOrder[i] = i;
+#endif
+   memset(SweepDone,0,sizeof(SweepDone));
+   for(uint32_t k=0;k<testNum;k++)
+   {
+      i = SweepOrder[k];
+      ImpResult[0] = ImpResult_hold[i];
+      if(u8DualChan)
       {
-         pADI_AFE->DACDCBUFCON = ENUM_AFE_DACDCBUFCON_CHAN1;   //set DC offset using LP DAC1
+         ImpResultCh1[0] = ImpResult_hold[i];
+         SnsACTestDual();
+         ImpResultCh1_hold[i] = ImpResultCh1[0];
       }
       else
       {
-         pADI_AFE->DACDCBUFCON = ENUM_AFE_DACDCBUFCON_CHAN0;   //set DC offset using LP DAC0
-      }
-#endif
-      /*switch to sensor+rload*/
-      if(channel>0)
-      {
-         /*disconnect RTIA to avoid RC filter discharge*/
-         AfeLpTiaCon(CHAN1,pSnsCfg1->Rload,LPTIA_RGAIN_DISCONNECT,pSnsCfg1->Rfilter);
-         AfeSwitchDPNT(SWID_D6_CE1,SWID_P6_RE1,SWID_N7_SE1RLOAD,SWID_T7_SE1RLOAD|SWID_T9);
+         SnsACTest(CHAN0);
       }
-      else
+      ImpResult_hold[i] = ImpResult[0];
+      SweepDone[i] = 1;
+      while((next < testNum) && SweepDone[next])
       {
-         /*disconnect RTIA to avoid RC filter discharge*/
-         AfeLpTiaCon(CHAN0,pSnsCfg0->Rload,LPTIA_RGAIN_DISCONNECT,pSnsCfg0->Rfilter); //what is lptia rgain
-        //WE1 SWID_T5_SE0RLOAD
-         //WE2 SWID_T3_AIN2
-         //WE3 SWID_T4_AIN3
-         //WE4 SWID_T2_AIN1
-         //WE5 SWID_T1_AIN0
-         //WE6 SWID_T7_SE1RLOAD
-       // AfeSwitchDPNT(SWID_D5_CE0,SWID_P5_RE0,SWID_NL,SWID_T1_AIN0|SWID_T9);
-         //SE0,AIN2,AIN3,AIN1,AIN0,SE1
-         
-         if (setting==0x31)
-         {
-         AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T5_SE0RLOAD|SWID_T8_DE1|SWID_T9);
-         }
-         if (setting==0x32)
-         {
-         AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T3_AIN2|SWID_T8_DE1|SWID_T9);
-         }
-         if (setting==0x33)
-         {
-         AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T4_AIN3|SWID_T8_DE1|SWID_T9);
-         }
-         if (setting==0x34)
-         {
-         AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T2_AIN1|SWID_T8_DE1|SWID_T9);
-         }
-         if (setting==0x35)
+         if(u8DualChan)
          {
-         AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T1_AIN0|SWID_T8_DE1|SWID_T9);
+            SnsMagPhaseCalRes(&ImpResult_hold[next],1,'0');
+            SnsMagPhaseCalRes(&ImpResultCh1_hold[next],1,'1');
          }
-         if (setting==0x36)
+         else
          {
-         AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T7_SE1RLOAD|SWID_T8_DE1|SWID_T9);
+            SnsMagPhaseCalRes(&ImpResult_hold[next],1,0);   //calculate impedance
          }
-         //AfeSwitchDPNT(SWID_D5_CE0,SWID_P5_RE0,SWID_NL,SWID_T7_SE1RLOAD|SWID_T8_DE1|SWID_T9);
-         // AfeSwitchDPNT(SWID_D5_CE0,SWID_P5_RE0,SWID_NL,SWID_T5_SE0RLOAD|SWID_T8_DE1|SWID_T9);
-         //pADI_AFE->LPTIASW0 = 0x180;
-         //pADI_AFE->LPTIASW1 = 0x180;
+         next++;
+      }
+#if EIS_DCLOG_EN
+      SnsDcLogFlush();
+#endif
+      SnsCaptureSend();
+   }
+}
 
+/**
+   @brief uint8_t SnsACTestDual(void)
+          AC test of both sensor channels, per frequency the signal chain is configured once,
+          CHAN0 and CHAN1 are measured back to back and share one RCAL measurement
+          results are in ImpResult (CHAN0) and ImpResultCh1 (CHAN1)
+   @return 1.
+*/
+uint8_t SnsACTestDual(void)
+{
+   uint32_t freqNum = sizeof(ImpResult)/sizeof(ImpResult_t);
+   uint8_t rngSns0, rngSns1, rngRcal;
+   for(uint32_t i=0;i<freqNum;i++)
+   {
+      SnsACMeasStart(ImpResult[i].freq);
+      rngSns0 = SnsACMeasSensor(CHAN0,ImpResult[i].DFT_result);
+      rngSns1 = SnsACMeasSensor(CHAN1,ImpResultCh1[i].DFT_result);
+      rngRcal = SnsACMeasRcal(CHAN0,ImpResult[i].DFT_result);
+      ImpResultCh1[i].DFT_result[4] = ImpResult[i].DFT_result[4];
+      ImpResultCh1[i].DFT_result[5] = ImpResult[i].DFT_result[5];
+      SnsACRcalScale(ImpResultCh1[i].DFT_result,rngSns1,rngRcal);
+      SnsACRcalScale(ImpResult[i].DFT_result,rngSns0,rngRcal);
+      SnsACMeasStop();
+   }
 
-          
-          AfeHpTiaDeCfg(CHAN0,HPTIADE_RLOAD_0,HPTIADE_RTIA_50);
-          
-          
-        //AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T1_AIN0|SWID_T10);rtiaidan
-        
-        
-        /* pADI_AFE->HSRTIACON = 0xF;          // Disconnect WE from HPTIA try aidan
-      pADI_AFE->DE1RESCON=0xFF;         // Disconnect DE1 from HPTIA try aidan
-                 pADI_AFE->NSWFULLCON = 
-           0;           // DisConnect RCAL1 to N-Node of excitation Amp
-         pADI_AFE->PSWFULLCON = 
-            0;           // DisConnect RCAL0 to P-Node of excitation amp  
-         pADI_AFE->DSWFULLCON = 
-            0;          
-         pADI_AFE->SWCON = 0x10000;            // Switches controlled by their own FULLCON registers 
-     
-        
-        
-        // pADI_AFE->DE0RESCON = 0x00;           // 0ohm RLOAD03 and 50ohm RTIA2_03
-         pADI_AFE->DE1RESCON = 0xFF;           // disconnect RES2_5 gain resistors     
-          pADI_AFE->HSRTIACON |= 0xF;           // open HP RTIA switch
+   return 1;
+}
+
+/**
+   @brief void SnsACMeasStart(float freq)
+          configure the signal chain for a frequency and start the waveform generator
 */
-      }
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_ADCEN;
-    //  delay_10us(20);   //200us for switch settling
-      delay_10us(1000);   //10ms for switch settling
-      
-      //delay for -200mV to be applied for 10sec prior to test and allow waveform settling
-     delay_10us(1000000);
+void SnsACMeasStart(float freq)
+{
+   PROF_BEGIN(PROF_SIGCHAIN);
+   SnsACSigChainCfg(freq);
+   PROF_END(PROF_SIGCHAIN);
+   AfeWaveGenGo(true);
+}
+
+/**
+   @brief void SnsACMeasStop(void)
+          open all switches and stop the waveform generator after a frequency
+*/
+void SnsACMeasStop(void)
+{
+   AfeSwitchDPNT(SWID_ALLOPEN,SWID_ALLOPEN,SWID_ALLOPEN,SWID_ALLOPEN);
+   AfeWaveGenGo(false);
+}
+
+/**
+   @brief uint8_t SnsACMeasSensor(uint8_t channel, int32_t *pDft)
+          measure sensor+rload of a channel, the LP TIA is reconnected afterwards
+   @param pDft : DFT result, real/imag stored in pDft[0], pDft[1]
+   @return HsRange entry used.
+*/
+uint8_t SnsACMeasSensor(uint8_t channel, int32_t *pDft)
+{
+   uint8_t range = 0;
+
+   SnsACSensorCfg(channel);
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_ADCEN;
+ //  delay_10us(20);   //200us for switch settling
+   PROF_BEGIN(PROF_SETTLE);
+   SnsSleep_10us(EIS_SETTLE_SW);   //10ms for switch settling
+   
+   //delay for -200mV to be applied for 10sec prior to test and allow waveform settling
+  SnsSleep_10us(EIS_SETTLE_SNS);
+   PROF_END(PROF_SETTLE);
+#if EIS_AUTORANGE_EN
+   range = SnsHsRange();
+#endif
+   
+   /*start ADC conversion and DFT*/      
+   SnsCaptureStart();
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN|BITM_AFE_AFECON_ADCCONVEN;
+   SnsWaitDftRdy();
+   SnsCaptureStop();
+   pDft[0] = convertDftToInt(pADI_AFE->DFTREAL);
+   pDft[1] = convertDftToInt(pADI_AFE->DFTIMAG);
+   /**********recover LP TIA connection to maintain sensor*********/
+   AfeSwitchDPNT(SWID_ALLOPEN,SWID_ALLOPEN,SWID_ALLOPEN,SWID_ALLOPEN);   //release the sensor from the HS loop first
+   SnsACLpTiaRestore(channel);
+   return range;
+}
+
+/**
+   @brief uint8_t SnsACMeasRcal(uint8_t channel, int32_t *pDft)
+          measure RCAL, channel selects the LP DAC used for the DC bias
+   @param pDft : DFT result, real/imag stored in pDft[4], pDft[5]
+   @return HsRange entry used.
+*/
+uint8_t SnsACMeasRcal(uint8_t channel, int32_t *pDft)
+{
+   uint8_t range = 0;
+
+   SnsACRcalCfg(channel);
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_ADCEN;
+ //  delay_10us(20);   //200us for switch settling
+   PROF_BEGIN(PROF_SETTLE);
+   SnsSleep_10us(EIS_SETTLE_SW);   //10ms for switch settling
+   
+   //5sec prior to test and allow waveform settling
+#if EIS_DCLOG_EN
+   SnsDcLogSettle(channel,EIS_SETTLE_RCAL);
+#else
+  SnsSleep_10us(EIS_SETTLE_RCAL);
+#endif
+   PROF_END(PROF_SETTLE);
+#if EIS_AUTORANGE_EN
+   range = SnsHsRange();
+#endif
+   /*start ADC conversion and DFT*/
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN|BITM_AFE_AFECON_ADCCONVEN;
+   SnsWaitDftRdy();
+   pDft[4] = convertDftToInt(pADI_AFE->DFTREAL);
+   pDft[5] = convertDftToInt(pADI_AFE->DFTIMAG   );
+   return range;
+}
+
+/**
+   @brief void SnsACSensorCfg(uint8_t channel)
+          disconnect the sensor of channel from its LP TIA and switch it to the excitation loop
+*/
+void SnsACSensorCfg(uint8_t channel)
+{
+   /*********Sensor+Rload AC measurement*************/
+   /*break LP TIA connection*/
+   AfeLpTiaSwitchCfg(channel,SWMODE_AC);  /*LP TIA disconnect sensor for AC test*/
+#ifdef EIS_DCBIAS_EN //add bias voltage to excitation sinewave
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_DACBUFEN;   //enable DC buffer for excitation loop
+   if(channel>0)
+   {
+      pADI_AFE->DACDCBUFCON = ENUM_AFE_DACDCBUFCON_CHAN1;   //set DC offset using LP DAC1
+   }
+   else
+   {
+      pADI_AFE->DACDCBUFCON = ENUM_AFE_DACDCBUFCON_CHAN0;   //set DC offset using LP DAC0
+   }
+#endif
+   /*switch to sensor+rload*/
+   if(channel>0)
+   {
+      /*disconnect RTIA to avoid RC filter discharge*/
+      AfeLpTiaCon(CHAN1,pSnsCfg1->Rload,LPTIA_RGAIN_DISCONNECT,pSnsCfg1->Rfilter);
+      AfeSwitchDPNT(SWID_D6_CE1,SWID_P6_RE1,SWID_N7_SE1RLOAD,SWID_T7_SE1RLOAD|SWID_T9);
+   }
+   else
+   {
+      /*disconnect RTIA to avoid RC filter discharge*/
+      AfeLpTiaCon(CHAN0,pSnsCfg0->Rload,LPTIA_RGAIN_DISCONNECT,pSnsCfg0->Rfilter); //what is lptia rgain
+     //WE1 SWID_T5_SE0RLOAD
+      //WE2 SWID_T3_AIN2
+      //WE3 SWID_T4_AIN3
+      //WE4 SWID_T2_AIN1
+      //WE5 SWID_T1_AIN0
+      //WE6 SWID_T7_SE1RLOAD
+    // AfeSwitchDPNT(SWID_D5_CE0,SWID_P5_RE0,SWID_NL,SWID_T1_AIN0|SWID_T9);
+      //SE0,AIN2,AIN3,AIN1,AIN0,SE1
       
-      /*start ADC conversion and DFT*/      
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN|BITM_AFE_AFECON_ADCCONVEN;
-      while(!dftRdy)
+      if (setting==0x31)
       {
-      
-        // PwrCfg(ENUM_PMG_PWRMOD_FLEXI,0,BITM_PMG_SRAMRET_BNK2EN);
+      AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T5_SE0RLOAD|SWID_T8_DE1|SWID_T9);
       }
-      dftRdy = 0;
-      ImpResult[i].DFT_result[0] = convertDftToInt(pADI_AFE->DFTREAL);
-      ImpResult[i].DFT_result[1] = convertDftToInt(pADI_AFE->DFTIMAG);
-      /***************Rload AC measurement*************/
-
-      #ifdef EIS_DCBIAS_EN //add bias voltage to excitation sinewave
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_DACBUFEN;   //enable DC buffer for excitation loop
-      if(channel>0)
+      if (setting==0x32)
       {
-         pADI_AFE->DACDCBUFCON = ENUM_AFE_DACDCBUFCON_CHAN1;   //set DC offset using LP DAC1
+      AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T3_AIN2|SWID_T8_DE1|SWID_T9);
       }
-      else
+      if (setting==0x33)
       {
-         pADI_AFE->DACDCBUFCON = ENUM_AFE_DACDCBUFCON_CHAN0;   //set DC offset using LP DAC0
+      AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T4_AIN3|SWID_T8_DE1|SWID_T9);
       }
-#endif
-      
-      /************RCAL AC measurement***************/
-      /*switch to RCAL, loop exitation before power up*/
-      //AfeSwitchDPNT(SWID_DR0_RCAL0,SWID_PR0_RCAL0,SWID_NR1_RCAL1,SWID_TR1_RCAL1|SWID_T9);
-     // AfeSwitchDPNT(SWID_DR0_RCAL0,SWID_PR0_RCAL0,SWID_NR1_RCAL1,SWID_TR1_RCAL1|SWID_T1_AIN0|SWID_T9); AIDAN MUST CHANGE THIS FOR EACH DIFFERENT MUX ON SD
-      AfeSwitchDPNT(SWID_DR0_RCAL0,SWID_PR0_RCAL0,SWID_NR1_RCAL1,SWID_TR1_RCAL1|SWID_T8_DE1|SWID_T9);
-      // AfeSwitchDPNT(SWID_DR0_RCAL0,SWID_PR0_RCAL0,SWID_NR1_RCAL1,SWID_TR1_RCAL1|SWID_T7_SE1RLOAD|SWID_T9); switch d1,s1 
-      
-      //AfeSwitchDPNT(SWID_DR0_RCAL0,SWID_PR0_RCAL0,SWID_NR1_RCAL1,SWID_TR1_RCAL1|SWID_T1_AIN0); //aidan notions of changing RGain for LPTIA to be same as HSRTIA
-      //pADI_AFE->DE0RESCON = 0x90;           // 0ohm RLOAD03 and 50ohm RTIA2_03
-      
-      AfeLpTiaSwitchCfg(channel,SWMODE_NORM);  //LP TIA normal working mode
-      if(channel>0)
+      if (setting==0x34)
       {
-         AfeLpTiaCon(CHAN1,pSnsCfg1->Rload,pSnsCfg1->Rtia,pSnsCfg1->Rfilter);//connect RTIA
+      AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T2_AIN1|SWID_T8_DE1|SWID_T9);
       }
-      else
+      if (setting==0x35)
       {
-         AfeLpTiaCon(CHAN0,pSnsCfg0->Rload,pSnsCfg0->Rtia,pSnsCfg0->Rfilter);//connect RTIA
+      AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T1_AIN0|SWID_T8_DE1|SWID_T9);
       }
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_ADCEN;
-    //  delay_10us(20);   //200us for switch settling
-      delay_10us(1000);   //10ms for switch settling
-      
-      //5sec prior to test and allow waveform settling
-     delay_10us(500000);
-      /*start ADC conversion and DFT*/
-      pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN|BITM_AFE_AFECON_ADCCONVEN;
-      while(!dftRdy)
+      if (setting==0x36)
       {
-       
-        // PwrCfg(ENUM_PMG_PWRMOD_FLEXI,0,BITM_PMG_SRAMRET_BNK2EN);
+      AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T7_SE1RLOAD|SWID_T8_DE1|SWID_T9);
       }
-      dftRdy = 0;
-      ImpResult[i].DFT_result[4] = convertDftToInt(pADI_AFE->DFTREAL);
-      ImpResult[i].DFT_result[5] = convertDftToInt(pADI_AFE->DFTIMAG   );
-      /**********recover LP TIA connection to maintain sensor*********/
-      AfeSwitchDPNT(SWID_ALLOPEN,SWID_ALLOPEN,SWID_ALLOPEN,SWID_ALLOPEN);
-      AfeWaveGenGo(false);
+      //AfeSwitchDPNT(SWID_D5_CE0,SWID_P5_RE0,SWID_NL,SWID_T7_SE1RLOAD|SWID_T8_DE1|SWID_T9);
+      // AfeSwitchDPNT(SWID_D5_CE0,SWID_P5_RE0,SWID_NL,SWID_T5_SE0RLOAD|SWID_T8_DE1|SWID_T9);
+      //pADI_AFE->LPTIASW0 = 0x180;
+      //pADI_AFE->LPTIASW1 = 0x180;
+
+
+       
+       AfeHpTiaDeCfg(CHAN0,HPTIADE_RLOAD_0,HPTIADE_RTIA_50);
+       
+       
+     //AfeSwitchDPNT(SWID_D5_CE0,SWID_P11_CE0,SWID_NL,SWID_T1_AIN0|SWID_T10);rtiaidan
+     
+     
+     /* pADI_AFE->HSRTIACON = 0xF;          // Disconnect WE from HPTIA try aidan
+   pADI_AFE->DE1RESCON=0xFF;         // Disconnect DE1 from HPTIA try aidan
+              pADI_AFE->NSWFULLCON = 
+        0;           // DisConnect RCAL1 to N-Node of excitation Amp
+      pADI_AFE->PSWFULLCON = 
+         0;           // DisConnect RCAL0 to P-Node of excitation amp  
+      pADI_AFE->DSWFULLCON = 
+         0;          
+      pADI_AFE->SWCON = 0x10000;            // Switches controlled by their own FULLCON registers 
+  
+     
+     
+     // pADI_AFE->DE0RESCON = 0x00;           // 0ohm RLOAD03 and 50ohm RTIA2_03
+      pADI_AFE->DE1RESCON = 0xFF;           // disconnect RES2_5 gain resistors     
+       pADI_AFE->HSRTIACON |= 0xF;           // open HP RTIA switch
+*/
    }
+}
 
-   return 1;
+/**
+   @brief void SnsACLpTiaRestore(uint8_t channel)
+          reconnect the sensor of channel to its LP TIA to maintain the bias
+*/
+void SnsACLpTiaRestore(uint8_t channel)
+{
+   AfeLpTiaSwitchCfg(channel,SWMODE_NORM);  //LP TIA normal working mode
+   if(channel>0)
+   {
+      AfeLpTiaCon(CHAN1,pSnsCfg1->Rload,pSnsCfg1->Rtia,pSnsCfg1->Rfilter);//connect RTIA
+   }
+   else
+   {
+      AfeLpTiaCon(CHAN0,pSnsCfg0->Rload,pSnsCfg0->Rtia,pSnsCfg0->Rfilter);//connect RTIA
+   }
+}
+
+/**
+   @brief void SnsACRcalCfg(uint8_t channel)
+          switch the excitation loop to RCAL, channel selects the LP DAC used for the DC bias
+*/
+void SnsACRcalCfg(uint8_t channel)
+{
+#ifdef EIS_DCBIAS_EN //add bias voltage to excitation sinewave
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_DACBUFEN;   //enable DC buffer for excitation loop
+   if(channel>0)
+   {
+      pADI_AFE->DACDCBUFCON = ENUM_AFE_DACDCBUFCON_CHAN1;   //set DC offset using LP DAC1
+   }
+   else
+   {
+      pADI_AFE->DACDCBUFCON = ENUM_AFE_DACDCBUFCON_CHAN0;   //set DC offset using LP DAC0
+   }
+#endif
+   
+   /************RCAL AC measurement***************/
+   /*switch to RCAL, loop exitation before power up*/
+   //AfeSwitchDPNT(SWID_DR0_RCAL0,SWID_PR0_RCAL0,SWID_NR1_RCAL1,SWID_TR1_RCAL1|SWID_T9);
+  // AfeSwitchDPNT(SWID_DR0_RCAL0,SWID_PR0_RCAL0,SWID_NR1_RCAL1,SWID_TR1_RCAL1|SWID_T1_AIN0|SWID_T9); AIDAN MUST CHANGE THIS FOR EACH DIFFERENT MUX ON SD
+   AfeSwitchDPNT(SWID_DR0_RCAL0,SWID_PR0_RCAL0,SWID_NR1_RCAL1,SWID_TR1_RCAL1|SWID_T8_DE1|SWID_T9);
+   // AfeSwitchDPNT(SWID_DR0_RCAL0,SWID_PR0_RCAL0,SWID_NR1_RCAL1,SWID_TR1_RCAL1|SWID_T7_SE1RLOAD|SWID_T9); switch d1,s1 
+   
+   //AfeSwitchDPNT(SWID_DR0_RCAL0,SWID_PR0_RCAL0,SWID_NR1_RCAL1,SWID_TR1_RCAL1|SWID_T1_AIN0); //aidan notions of changing RGain for LPTIA to be same as HSRTIA
+   //pADI_AFE->DE0RESCON = 0x90;           // 0ohm RLOAD03 and 50ohm RTIA2_03
+}
+
+/**
+   @brief void SnsACRcalScale(int32_t *pDft, uint8_t rngSns, uint8_t rngRcal)
+          bring the RCAL result to the gain the sensor was measured with
+*/
+void SnsACRcalScale(int32_t *pDft, uint8_t rngSns, uint8_t rngRcal)
+{
+#if EIS_AUTORANGE_EN
+   pDft[4] = (int32_t)(pDft[4]*HsRange[rngSns].gain/HsRange[rngRcal].gain);
+   pDft[5] = (int32_t)(pDft[5]*HsRange[rngSns].gain/HsRange[rngRcal].gain);
+   SnsHsRangeSet(0);
+#endif
 }
 
 
@@ -765,85 +1556,928 @@ uint8_t SnsACTest(uint8_t channel)
    @return 1.
 */
 uint8_t SnsMagPhaseCal()
+{
+   return SnsMagPhaseCalRes(ImpResult,sizeof(ImpResult)/sizeof(ImpResult_t),0);
+}
+
+/**
+   @brief void SnsImpCalc(ImpResult_t *pRes)
+          calculate magnitude and phase of one result from its sensor and RCAL DFTs
+*/
+void SnsImpCalc(ImpResult_t *pRes)
 {
    float Src[8];
    //float Mag[4];
    float Phase[4];
    float Var1,Var2;
 
+   for (uint8_t ix=0;ix<6;ix++)
+   {
+      Src[ix] = (float)(pRes->DFT_result[ix]); // Load DFT Real/Imag results for RCAL, RLOAD, RLOAD+RSENSE into local array for this frequency 
+   }
+   Src[6] = (float)(Src[2]-Src[0]);                   // RLoad(real)-RSensor+load(real)
+   Src[7] = (float)(Src[3]-Src[1]);                   // RLoad(Imag)-RSensor+load(Imag)
+   for (uint8_t ix=0;ix<4;ix++)
+   {
+      pRes->DFT_Mag[ix] = Src[ix*2]*Src[ix*2]+Src[ix*2+1]*Src[ix*2+1];
+      Phase[ix] = atan2(Src[ix*2+1], Src[ix*2]);  // returns value between -pi to +pi (radians) of ATAN2(IMAG/Real)
+      pRes->DFT_Mag[ix] = sqrt(pRes->DFT_Mag[ix]);
+      // DFT_Mag[0] = Magnitude of Rsensor+Rload
+      // DFT_Mag[1] = Magnitude of Rload
+      // DFT_Mag[2] = Magnitude of RCAL
+      // DFT_Mag[3] = Magnitude of RSENSOR   (RSENSOR-RLOAD)
+   }
+   
+   // Sensor Magnitude in ohms = (RCAL(ohms)*|Mag(RCAL)|*|Mag(RSensor)) 
+   //                            --------------------------------------
+   //                            |Mag(RSensor+Rload)|*|Mag(RLoad)) 
+  // Var1 = pRes->DFT_Mag[2]*pRes->DFT_Mag[3]*AFE_RCAL; // Mag(RCAL)*Mag(RSENSOR)*RCAL
+  // Var2 = pRes->DFT_Mag[0]*pRes->DFT_Mag[1];          // Mag(RSENSE+LOAD)*Mag(RLOAD)   
+         /// altered this to remove RLOAD test from measurement
+   Var1 = pRes->DFT_Mag[2]*AFE_RCAL; // Mag(RCAL)*RCAL
+   Var2 = pRes->DFT_Mag[0];          // Mag(RSENSE+LOAD) aidan - rload is neglegable 
+   Var1 = Var1/Var2;
+   pRes->Mag = Var1;
+   // RSensor+Rload Magnitude in ohms =    (RCAL(ohms)*|Mag(RCAL)|*|Mag(Rload)) 
+   //                                       --------------------------------------
+   //                                       |Mag(RSensor+Rload)|*|Mag(RSensor+Rload)| 
+   Var1 = pRes->DFT_Mag[2]*pRes->DFT_Mag[0]*AFE_RCAL; // Mag(Rload)*Mag(Rcal)*RCAL
+   Var2 = pRes->DFT_Mag[0]*pRes->DFT_Mag[0];          // Mag(RSENSE+LOAD)*Mag(RSENSE+LOAD)   
+   Var1 = Var1/Var2;
+   pRes->RloadMag = (Var1 - pRes->Mag);               // Magnitude of Rload in ohms
+   
+   
+   // Phase calculation for sensor
+   //Var1 = -(Phase[2]+Phase[3]-Phase[1]-Phase[0]); // -((RCAL+RSENSE - RLOAD-RLOADSENSE)
+   Var1 = -(Phase[2]-Phase[0]); // -((RCAL-RLOADSENSE)Aidan Rload = rsense
+   Var1 = Var1*180/PI;                      // Convert radians to degrees.
+   /*shift phase back to range (-180,180]*/
+   if(Var1 > 180)
+   {
+      do
+      {
+         Var1 -= 360;
+      }
+      while(Var1 > 180);
+   }
+   else if(Var1 < -180)
+   {
+      do
+      {
+         Var1 += 360;
+      }
+      while(Var1 < -180);
+   }
+   pRes->Phase = Var1;
+}
 
-   uint32_t testNum = sizeof(ImpResult)/sizeof(ImpResult_t);
+/**
+   @brief uint8_t SnsMagPhaseCalRes(ImpResult_t *pRes, uint32_t testNum, char chan)
+          calculate and print magnitude and phase of testNum results
+   @param chan : 0 for the legacy "freq,mag,phase" lines, '0'/'1' to tag them "C<chan>,freq,mag,phase"
+   @return 1.
+*/
+uint8_t SnsMagPhaseCalRes(ImpResult_t *pRes, uint32_t testNum, char chan)
+{
    for(uint32_t i=0;i<testNum;i++)
    {
-      for (uint8_t ix=0;ix<6;ix++)
+      SnsImpCalc(&pRes[i]);
+      if(u8ThruActive && (u32ThruPoints++ == 0))
+         u32ThruFirst = TimebaseNow()-u32SweepStart;
+      PROF_BEGIN(PROF_PRINTF);
+      if(chan)
+         printf("C%c,%.4f,%.4f,%.4f"EOL,chan,pRes[i].freq,pRes[i].Mag,pRes[i].Phase);
+      else
+         printf("%.4f,%.4f,%.4f"EOL,pRes[i].freq,pRes[i].Mag,           
+                                                pRes[i].Phase);
+      PROF_END(PROF_PRINTF);
+   }
+
+   return 1;
+
+}
+
+/**
+   @brief void SnsHsRangeSet(uint8_t range)
+          select the HSTIA DE RTIA and ADC PGA gain of a HsRange entry
+*/
+void SnsHsRangeSet(uint8_t range)
+{
+   AfeHpTiaDeCfg(CHAN0,HPTIADE_RLOAD_0,HsRange[range].rtia);
+   AfeAdcPgaCfg(HsRange[range].pga,0);
+}
+
+#if EIS_MON_EN
+/*start back to back DFTs on the configured sensor, a new time stamp segment*/
+static void SnsMonRun(uint32_t t0)
+{
+   u32MonSegMs = ((TimebaseNow()-t0)*1000)/TIMEBASE_HZ;
+   u64MonCyc = 0;
+   u32MonCyc = DWT->CYCCNT;
+   u8MonOn = 1;
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN|BITM_AFE_AFECON_ADCCONVEN;
+}
+
+/*stop after the DFT in progress, the interrupt stops the ADC*/
+static void SnsMonHalt(void)
+{
+   u8MonOn = 0;
+   SnsWaitDftRdy();   //last DFT of the run, not queued
+}
+
+/**
+   @brief uint32_t SnsMonFlush(ImpResult_t *pRes)
+          stream the queued monitoring DFTs, pRes holds the RCAL DFT
+   @return number of results streamed.
+*/
+uint32_t SnsMonFlush(ImpResult_t *pRes)
+{
+   uint32_t head = u32MonHead;
+   uint32_t n = 0;
+   uint64_t us;
+
+   if(head-u32MonTail > EIS_MON_LEN)
+   {
+      u32MonLost += head-u32MonTail-EIS_MON_LEN;
+      printf("M,LOST,%lu"EOL,u32MonLost);
+      u32MonTail = head-EIS_MON_LEN;
+   }
+   while(u32MonTail != head)
+   {
+      MonLog_t *pLog = &MonLog[u32MonTail%EIS_MON_LEN];
+      u64MonCyc += pLog->cyc-u32MonCyc;
+      u32MonCyc = pLog->cyc;
+      pRes->DFT_result[0] = pLog->re;
+      pRes->DFT_result[1] = pLog->im;
+      u32MonTail++;
+      SnsImpCalc(pRes);
+      us = (uint64_t)u32MonSegMs*1000+u64MonCyc/(CORE_CLK_HZ/1000000);
+      printf("M,%lu.%03lu,%.4f,%.4f"EOL,(uint32_t)(us/1000),(uint32_t)(us%1000),pRes->Mag,pRes->Phase);
+      n++;
+   }
+   return n;
+}
+
+/**
+   @brief void SnsMonitor(uint8_t channel)
+          continuous impedance monitoring of channel at EIS_MON_FREQ until a UART byte arrives
+   @note the DFT rate is set by the SigBand entry of EIS_MON_FREQ, results that can't be
+         streamed in time are counted as lost. time stamps are DFT completion, in ms since
+         the start
+*/
+void SnsMonitor(uint8_t channel)
+{
+   ImpResult_t res;
+   uint32_t t0 = TimebaseNow();
+   uint32_t rcalT0;
+   uint32_t n = 0;
+   uint8_t rngSns = 0, rngRcal;
+
+   memset(&res,0,sizeof(res));
+   res.freq = EIS_MON_FREQ;
+   u32MonHead = u32MonTail = u32MonLost = 0;
+   SnsACReady(CHAN0);
+   SnsACMeasStart(res.freq);
+   rngRcal = SnsACMeasRcal(channel,res.DFT_result);
+   SnsACSensorCfg(channel);
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_ADCEN;
+   SnsSleep_10us(EIS_SETTLE_SW);
+   SnsSleep_10us(EIS_SETTLE_SNS);
+#if EIS_AUTORANGE_EN
+   rngSns = SnsHsRange();
+   SnsACRcalScale(res.DFT_result,rngSns,rngRcal);
+   SnsHsRangeSet(rngSns);
+#endif
+   printf("M,BEGIN,%.4f,%c"EOL,res.freq,setting);
+   u8MonStop = 0;   //bytes sent with the 'm', e.g. a line end, came before this
+   u8MonActive = 1;
+   rcalT0 = TimebaseNow();
+   SnsMonRun(t0);
+   while(!u8MonStop)
+   {
+      n += SnsMonFlush(&res);
+      if(EIS_MON_RCAL_MS && ((TimebaseNow()-rcalT0) >= (EIS_MON_RCAL_MS*TIMEBASE_HZ)/1000))
+      {
+         SnsMonHalt();
+         n += SnsMonFlush(&res);   //still with the previous RCAL
+         AfeSwitchDPNT(SWID_ALLOPEN,SWID_ALLOPEN,SWID_ALLOPEN,SWID_ALLOPEN);
+         SnsACLpTiaRestore(channel);
+         SnsACRcalCfg(channel);
+         pADI_AFE->AFECON |= BITM_AFE_AFECON_ADCEN;
+         SnsSleep_10us(EIS_MON_SETTLE);   //waveform is already running
+#if EIS_AUTORANGE_EN
+         rngRcal = SnsHsRange();
+#endif
+         pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN|BITM_AFE_AFECON_ADCCONVEN;
+         SnsWaitDftRdy();
+         res.DFT_result[4] = convertDftToInt(pADI_AFE->DFTREAL);
+         res.DFT_result[5] = convertDftToInt(pADI_AFE->DFTIMAG);
+         SnsACRcalScale(res.DFT_result,rngSns,rngRcal);
+         SnsACSensorCfg(channel);
+#if EIS_AUTORANGE_EN
+         SnsHsRangeSet(rngSns);
+#endif
+         pADI_AFE->AFECON |= BITM_AFE_AFECON_ADCEN;
+         SnsSleep_10us(EIS_MON_SETTLE);
+         rcalT0 = TimebaseNow();
+         SnsMonRun(t0);
+      }
+   }
+   SnsMonHalt();
+   n += SnsMonFlush(&res);
+   AfeSwitchDPNT(SWID_ALLOPEN,SWID_ALLOPEN,SWID_ALLOPEN,SWID_ALLOPEN);
+   SnsACLpTiaRestore(channel);
+   SnsACMeasStop();
+   SnsACIdle();
+   u8MonActive = 0;
+   printf("M,END,%lu,%lu"EOL,n,u32MonLost);
+}
+#endif
+
+/**
+   @brief uint8_t SnsHsRange(void)
+          pick the gain range for the signal currently switched to the HSTIA
+   @return selected HsRange entry, already applied and settled.
+   @note a EIS_RANGE_DFT_N point DFT is taken at the lowest gain, with the Hanning window
+         |DFT| ~= A*N/4 for a sine of A codes peak. The highest gain keeping A under
+         EIS_RANGE_TARGET is selected. The full length DFT configuration is restored.
+*/
+uint8_t SnsHsRange(void)
+{
+   uint32_t dftcon = pADI_AFE->DFTCON;
+   float re, im, amp;
+   uint8_t range = 0;
+
+   SnsHsRangeSet(0);
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_ADCEN;
+   SnsSleep_10us(EIS_RANGE_SETTLE);
+   AfeAdcDFTCfg(BITM_AFE_DFTCON_HANNINGEN,EIS_RANGE_DFTNUM,dftcon&BITM_AFE_DFTCON_DFTINSEL);
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN|BITM_AFE_AFECON_ADCCONVEN;
+   SnsWaitDftRdy();
+   re = (float)convertDftToInt(pADI_AFE->DFTREAL);
+   im = (float)convertDftToInt(pADI_AFE->DFTIMAG);
+   amp = 4*sqrt(re*re+im*im)/EIS_RANGE_DFT_N;
+   for(uint8_t r=1;r<sizeof(HsRange)/sizeof(HsRange_t);r++)
+   {
+      if(amp*HsRange[r].gain/HsRange[0].gain <= EIS_RANGE_TARGET)
+         range = r;
+   }
+   pADI_AFE->DFTCON = dftcon;
+   SnsHsRangeSet(range);
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_ADCEN;   //stopped by the DFTRDY interrupt
+   SnsSleep_10us(EIS_RANGE_SETTLE);
+   return range;
+}
+
+/**
+   @brief void SnsDcLogSettle(uint8_t channel, uint32_t time)
+          settling wait that logs the LP TIA current of channel meanwhile
+   @param time : wait in 10us units, the last EIS_DCLOG_FLUSH refill the SINC2 filter
+                 with the HSTIA signal again before the DFT
+*/
+void SnsDcLogSettle(uint8_t channel, uint32_t time)
+{
+   if(time <= EIS_DCLOG_FLUSH)
+   {
+      SnsSleep_10us(time);
+      return;
+   }
+   if(channel>0)
+      AfeAdcChan(MUXSELP_LPTIA1_LPF,MUXSELN_LPTIA1_N);
+   else
+      AfeAdcChan(MUXSELP_LPTIA0_LPF,MUXSELN_LPTIA0_N);
+   u32DcLogAcc = 0;
+   u32DcLogCnt = 0;
+   u8DcLogOn = 1;
+   AfeAdcIntCfg(BITM_AFE_ADCINTIEN_DFTRDYIEN|BITM_AFE_ADCINTIEN_SINC2RDYIEN);
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_ADCEN|BITM_AFE_AFECON_ADCCONVEN;
+   SnsSleep_10us(time-EIS_DCLOG_FLUSH);
+   pADI_AFE->AFECON &= (~BITM_AFE_AFECON_ADCCONVEN);
+   u8DcLogOn = 0;
+#if EIS_LPWAIT_EN
+   AfeAdcIntCfg(BITM_AFE_ADCINTIEN_DFTRDYIEN);
+#endif
+   AfeAdcChan(MUXSELP_AIN6,MUXSELN_VZERO0);
+   pADI_AFE->AFECON &= (~(BITM_AFE_AFECON_SINC2EN));          // Clear the SINC2 filter to flush its contents
+   delay_10us(50);
+   pADI_AFE->AFECON |= BITM_AFE_AFECON_SINC2EN;               // re-enable SINC2 filter
+   SnsSleep_10us(EIS_DCLOG_FLUSH);
+}
+
+/**
+   @brief void SnsDcLogFlush(void)
+          print the logged DC samples as "I,<ms since sweep start>,<code>"
+          samples overwritten before they were printed are reported as "I,LOST,<count>"
+*/
+void SnsDcLogFlush(void)
+{
+   uint32_t head = u32DcLogHead;
+
+   if(head-u32DcLogTail > EIS_DCLOG_LEN)
+   {
+      u32DcLogLost += head-u32DcLogTail-EIS_DCLOG_LEN;
+      printf("I,LOST,%lu"EOL,u32DcLogLost);
+      u32DcLogTail = head-EIS_DCLOG_LEN;
+   }
+   while(u32DcLogTail != head)
+   {
+      DcLog_t *pLog = &DcLog[u32DcLogTail%EIS_DCLOG_LEN];
+      printf("I,%lu,%u"EOL,(pLog->tick*1000)/TIMEBASE_HZ,pLog->code);
+      u32DcLogTail++;
+   }
+}
+
+/**
+   @brief void SnsCaptureArm(uint8_t src)
+          arm a capture of src ('2' SINC2, '3' SINC3) for the next sensor DFT
+*/
+void SnsCaptureArm(uint8_t src)
+{
+   u8CapSrc = src;
+   u32CapLen = (EIS_CAPTURE_LEN < EIS_CAPTURE_MAX) ? EIS_CAPTURE_LEN : EIS_CAPTURE_MAX;
+   u8CapState = CAP_ARMED;
+}
+
+/**
+   @brief void SnsCaptureStart(void)
+          start an armed capture, enabling the result interrupt of its filter
+*/
+void SnsCaptureStart(void)
+{
+   uint32_t ien = BITM_AFE_ADCINTIEN_DFTRDYIEN;
+
+   if(u8CapState != CAP_ARMED)
+      return;
+#if !EIS_LPWAIT_EN
+   ien |= BITM_AFE_ADCINTIEN_SINC2RDYIEN;
+#endif
+   ien |= (u8CapSrc == '3') ? BITM_AFE_ADCINTIEN_ADCRDYIEN : BITM_AFE_ADCINTIEN_SINC2RDYIEN;
+   u32CapFill = 0;
+   u16CapPrev = 0xFFFF;
+   u8CapState = (EIS_CAPTURE_TRIG == CAP_TRIG_RISING) ? CAP_WAIT_TRIG : CAP_RUN;
+   AfeAdcIntCfg(ien);
+}
+
+/**
+   @brief void SnsCaptureStop(void)
+          end the capture with the DFT, a shorter capture is kept as is
+*/
+void SnsCaptureStop(void)
+{
+   if((u8CapState == CAP_WAIT_TRIG) || (u8CapState == CAP_RUN))
+      u8CapState = CAP_DONE;
+   else if(u8CapState != CAP_DONE)
+      return;
+#if EIS_LPWAIT_EN
+   AfeAdcIntCfg(BITM_AFE_ADCINTIEN_DFTRDYIEN);
+#else
+   AfeAdcIntCfg(BITM_AFE_ADCINTIEN_DFTRDYIEN|BITM_AFE_ADCINTIEN_SINC2RDYIEN);
+#endif
+}
+
+/**
+   @brief void SnsCaptureSend(void)
+          send a finished capture, rate measured between the first and last sample
+*/
+void SnsCaptureSend(void)
+{
+   uint32_t hz = 0;
+   uint32_t n, sum;
+
+   if(u8CapState != CAP_DONE)
+      return;
+   if((u32CapFill > 1) && (u32CapLast != u32CapFirst))
+      hz = (uint32_t)(((uint64_t)(u32CapFill-1)*CORE_CLK_HZ)/(u32CapLast-u32CapFirst));
+   printf("CAP,%c,%lu,%lu"EOL,u8CapSrc,u32CapFill,hz);
+   for(uint32_t i=0;i<u32CapFill;i+=n)
+   {
+      n = ((u32CapFill-i) > EIS_CAPTURE_BLOCK) ? EIS_CAPTURE_BLOCK : (u32CapFill-i);
+      sum = 0;
+      putchar(0xA5);
+      putchar(0x5A);
+      putchar(n&0xFF);
+      putchar(n>>8);
+      for(uint32_t k=0;k<n;k++)
       {
-         Src[ix] = (float)(ImpResult[i].DFT_result[ix]); // Load DFT Real/Imag results for RCAL, RLOAD, RLOAD+RSENSE into local array for this frequency 
+         putchar(CapBuf[i+k]&0xFF);
+         putchar(CapBuf[i+k]>>8);
+         sum += CapBuf[i+k];
       }
-      Src[6] = (float)(Src[2]-Src[0]);                   // RLoad(real)-RSensor+load(real)
-      Src[7] = (float)(Src[3]-Src[1]);                   // RLoad(Imag)-RSensor+load(Imag)
-      for (uint8_t ix=0;ix<4;ix++)
+      putchar(sum&0xFF);
+      putchar((sum>>8)&0xFF);
+   }
+   u8CapState = CAP_IDLE;
+}
+
+/**
+   @brief void SnsCaptureBench(void)
+          sustained capture rate of each CapBench filter setting, SINC3 and SINC2,
+          "CAPBENCH,<src>,<sinc3 div>,<sinc2 div>,<nominal Hz>,<captured Hz>"
+   @note the ADC converts its current input, no excitation is needed. Rates under the
+         nominal one mean the interrupt does not keep up and results are lost.
+*/
+void SnsCaptureBench(void)
+{
+   uint32_t nominal, hz;
+   uint8_t src;
+
+   NVIC_EnableIRQ(AFE_ADC_IRQn);
+   for(uint32_t b=0;b<sizeof(CapBench)/sizeof(CapBench_t);b++)
+   {
+      for(src='2';src<='3';src++)
       {
-         ImpResult[i].DFT_Mag[ix] = Src[ix*2]*Src[ix*2]+Src[ix*2+1]*Src[ix*2+1];
-         Phase[ix] = atan2(Src[ix*2+1], Src[ix*2]);  // returns value between -pi to +pi (radians) of ATAN2(IMAG/Real)
-         ImpResult[i].DFT_Mag[ix] = sqrt(ImpResult[i].DFT_Mag[ix]);
-         // DFT_Mag[0] = Magnitude of Rsensor+Rload
-         // DFT_Mag[1] = Magnitude of Rload
-         // DFT_Mag[2] = Magnitude of RCAL
-         // DFT_Mag[3] = Magnitude of RSENSOR   (RSENSOR-RLOAD)
+         if((src == '3') && (b > 0) && (CapBench[b].div3 == CapBench[b-1].div3) &&
+            (CapBench[b].adcHz == CapBench[b-1].adcHz))
+            continue;   //same SINC3 rate already measured
+         AfeAdcFiltCfg(CapBench[b].sinc3osr,CapBench[b].sinc2osr,LFPBYPEN_BYP,CapBench[b].rate);
+         nominal = CapBench[b].adcHz/CapBench[b].div3;
+         if(src == '2')
+            nominal /= CapBench[b].div2;
+         u8CapSrc = src;
+         u32CapLen = EIS_CAPTURE_MAX;
+         u32CapFill = 0;
+         u8CapState = CAP_RUN;
+         AfeAdcIntCfg((src == '3') ? BITM_AFE_ADCINTIEN_ADCRDYIEN : BITM_AFE_ADCINTIEN_SINC2RDYIEN);
+         pADI_AFE->AFECON |= BITM_AFE_AFECON_ADCEN|BITM_AFE_AFECON_ADCCONVEN;
+         for(uint32_t t=0;(t<EIS_CAPBENCH_10US/100) && (u8CapState == CAP_RUN);t++)
+            delay_10us(100);
+         pADI_AFE->AFECON &= (~(BITM_AFE_AFECON_ADCCONVEN|BITM_AFE_AFECON_ADCEN));
+         AfeAdcIntCfg(NOINT);
+         hz = 0;
+         if((u32CapFill > 1) && (u32CapLast != u32CapFirst))
+            hz = (uint32_t)(((uint64_t)(u32CapFill-1)*CORE_CLK_HZ)/(u32CapLast-u32CapFirst));
+         printf("CAPBENCH,%c,%lu,%lu,%lu,%lu"EOL,src,CapBench[b].div3,(src == '2') ? CapBench[b].div2 : 1,
+                nominal,hz);
       }
-      
-      // Sensor Magnitude in ohms = (RCAL(ohms)*|Mag(RCAL)|*|Mag(RSensor)) 
-      //                            --------------------------------------
-      //                            |Mag(RSensor+Rload)|*|Mag(RLoad)) 
-     // Var1 = ImpResult[i].DFT_Mag[2]*ImpResult[i].DFT_Mag[3]*AFE_RCAL; // Mag(RCAL)*Mag(RSENSOR)*RCAL
-     // Var2 = ImpResult[i].DFT_Mag[0]*ImpResult[i].DFT_Mag[1];          // Mag(RSENSE+LOAD)*Mag(RLOAD)   
-            /// altered this to remove RLOAD test from measurement
-      Var1 = ImpResult[i].DFT_Mag[2]*AFE_RCAL; // Mag(RCAL)*RCAL
-      Var2 = ImpResult[i].DFT_Mag[0];          // Mag(RSENSE+LOAD) aidan - rload is neglegable 
-      Var1 = Var1/Var2;
-      ImpResult[i].Mag = Var1;
-      // RSensor+Rload Magnitude in ohms =    (RCAL(ohms)*|Mag(RCAL)|*|Mag(Rload)) 
-      //                                       --------------------------------------
-      //                                       |Mag(RSensor+Rload)|*|Mag(RSensor+Rload)| 
-      Var1 = ImpResult[i].DFT_Mag[2]*ImpResult[i].DFT_Mag[0]*AFE_RCAL; // Mag(Rload)*Mag(Rcal)*RCAL
-      Var2 = ImpResult[i].DFT_Mag[0]*ImpResult[i].DFT_Mag[0];          // Mag(RSENSE+LOAD)*Mag(RSENSE+LOAD)   
-      Var1 = Var1/Var2;
-      ImpResult[i].RloadMag = (Var1 - ImpResult[i].Mag);               // Magnitude of Rload in ohms
-      
-      
-      // Phase calculation for sensor
-      //Var1 = -(Phase[2]+Phase[3]-Phase[1]-Phase[0]); // -((RCAL+RSENSE - RLOAD-RLOADSENSE)
-      Var1 = -(Phase[2]-Phase[0]); // -((RCAL-RLOADSENSE)Aidan Rload = rsense
-      Var1 = Var1*180/PI;                      // Convert radians to degrees.
-      /*shift phase back to range (-180,180]*/
-      if(Var1 > 180)
-      {
-         do
-         {
-            Var1 -= 360;
-         }
-         while(Var1 > 180);
+   }
+   u8CapState = CAP_IDLE;
+   NVIC_DisableIRQ(AFE_ADC_IRQn);
+}
+
+#if EIS_SEQ_EN
+/*append one command word, u8SeqErr on overflow*/
+static void SnsSeqPut(uint32_t cmd)
+{
+   if(u32SeqLen >= EIS_SEQ_MAX)
+   {
+      u8SeqErr = 1;
+      return;
+   }
+   SeqCmd[u32SeqLen++] = cmd;
+}
+
+/*append a register write, the register must be within the 0x200 bytes the sequencer reaches*/
+static void SnsSeqWr(volatile uint32_t *reg, uint32_t val)
+{
+   uint32_t off = (uint32_t)reg - (uint32_t)&pADI_AFE->AFECON;
+
+   if((off >= 0x200) || (val > 0xFFFFFF))
+   {
+      if(!u8SeqErr)
+         printf("SEQ,UNSUPPORTED,REG,%03lX"EOL,off);
+      u8SeqErr = 1;
+      return;
+   }
+   SnsSeqPut(SEQ_WR(off,val));
+}
+
+/*append a wait of clk AFE clocks*/
+static void SnsSeqWait(uint32_t clk)
+{
+   u32SeqMs += clk/(EIS_SEQ_CLK_HZ/1000);
+   while(clk)
+   {
+      uint32_t chunk = (clk > EIS_SEQ_WAIT_MAX) ? EIS_SEQ_WAIT_MAX : clk;
+      SnsSeqPut(SEQ_WAIT(chunk));
+      clk -= chunk;
+   }
+}
+
+/*AFECON as the sequencer keeps it between conversions*/
+static uint32_t SnsSeqAfecon(void)
+{
+   return pADI_AFE->AFECON &
+          (~(BITM_AFE_AFECON_ADCEN|BITM_AFE_AFECON_ADCCONVEN|BITM_AFE_AFECON_DFTEN));
+}
+
+/*append writes for the registers in SeqReg that changed since the last call*/
+static void SnsSeqDiff(void)
+{
+   uint32_t val;
+   uint8_t sw = 0;
+
+   for(uint32_t i=0;i<SEQ_REG_NUM;i++)
+   {
+      val = (i == SEQ_REG_AFECON) ? SnsSeqAfecon() : *SeqReg[i];
+      if((val != SeqShadow[i]) || ((i == SEQ_REG_SWCON) && sw))
+      {
+         SnsSeqWr(SeqReg[i],val);
+         SeqShadow[i] = val;
+         if(i >= SEQ_REG_SW)
+            sw = 1;
+      }
+   }
+}
+
+/*DFT time of the band of freq in AFE clocks, +10% and 20ms margin*/
+static uint32_t SnsSeqDftClk(float freq)
+{
+   const SigBand_t *pBand = &SigBand[SnsSigBand(freq)];
+
+   return (uint32_t)(((float)pBand->dftN/pBand->dftHz*1.1 + 0.02)*EIS_SEQ_CLK_HZ);
+}
+
+/*append the filter flush SnsACSigChainCfg does on a band change, the register diff misses it.
+  DFTEN is set again with the conversion in SnsSeqMeas*/
+static void SnsSeqFlush(void)
+{
+   uint32_t afecon = SeqShadow[SEQ_REG_AFECON]|BITM_AFE_AFECON_SINC2EN;
+
+   SnsSeqWr(&pADI_AFE->AFECON,afecon&(~(BITM_AFE_AFECON_SINC2EN|BITM_AFE_AFECON_DFTEN)));
+   SnsSeqWait(50*(EIS_SEQ_CLK_HZ/100000));
+   SnsSeqWr(&pADI_AFE->AFECON,afecon);
+   SeqShadow[SEQ_REG_AFECON] = afecon;
+}
+
+/*append ADC enable, settling, one DFT and conversion stop*/
+static void SnsSeqMeas(float freq, uint32_t settle)
+{
+   uint32_t afecon = SeqShadow[SEQ_REG_AFECON];
+
+   SnsSeqWr(&pADI_AFE->AFECON,afecon|BITM_AFE_AFECON_ADCEN);
+   SnsSeqWait(settle*(EIS_SEQ_CLK_HZ/100000));
+   SnsSeqWr(&pADI_AFE->AFECON,afecon|BITM_AFE_AFECON_ADCEN|BITM_AFE_AFECON_DFTEN|BITM_AFE_AFECON_ADCCONVEN);
+   SnsSeqWait(SnsSeqDftClk(freq));
+   SnsSeqWr(&pADI_AFE->AFECON,afecon);
+}
+
+/**
+   @brief uint8_t SnsSeqCompile(ImpResult_t *pRes, uint32_t testNum, uint8_t channel)
+          compile the sweep of pRes into SeqCmd, the same measurements as SnsACTest
+   @note the signal chain and switch helpers run on the AFE to produce each register state,
+         the registers are put back to their state before compiling afterwards.
+         call after SnsACInit
+   @return 1 if the sweep can run on the sequencer.
+*/
+uint8_t SnsSeqCompile(ImpResult_t *pRes, uint32_t testNum, uint8_t channel)
+{
+   uint8_t band = SIG_BAND_NONE;
+
+   u32SeqLen = 0;
+   u32SeqMs = 0;
+   u8SeqErr = 0;
+   for(uint32_t i=0;i<SEQ_REG_NUM;i++)
+      SeqInit[i] = SeqShadow[i] = (i == SEQ_REG_AFECON) ? SnsSeqAfecon() : *SeqReg[i];
+   for(uint32_t i=0;(i<testNum) && !u8SeqErr;i++)
+   {
+      if(SigBand[SnsSigBand(pRes[i].freq)].hp)
+      {
+         printf("SEQ,UNSUPPORTED,%.4f"EOL,pRes[i].freq);
+         u8SeqErr = 1;
+         break;
       }
-      else if(Var1 < -180)
+      SnsACSigChainCfg(pRes[i].freq);
+      AfeWaveGenGo(true);
+      SnsACSensorCfg(channel);
+      SnsSeqDiff();
+      if(SnsSigBand(pRes[i].freq) != band)
       {
-         do
+         band = SnsSigBand(pRes[i].freq);
+         SnsSeqFlush();   //the first point too, the filters hold whatever ran before
+      }
+      SnsSeqMeas(pRes[i].freq,EIS_SETTLE_SW+EIS_SETTLE_SNS);
+      AfeSwitchDPNT(SWID_ALLOPEN,SWID_ALLOPEN,SWID_ALLOPEN,SWID_ALLOPEN);
+      SnsACLpTiaRestore(channel);
+      SnsACRcalCfg(channel);
+      SnsSeqDiff();
+      SnsSeqMeas(pRes[i].freq,EIS_SETTLE_SW+EIS_SETTLE_RCAL);
+      SnsACMeasStop();
+      SnsSeqDiff();
+   }
+   SnsSeqWr(&pADI_AFE->SEQCON,0);   //end of sequence
+   for(uint32_t i=0;i<SEQ_REG_NUM;i++)
+      *SeqReg[i] = SeqInit[i];
+   u8SigBand = SIG_BAND_NONE;
+   return !u8SeqErr;
+}
+
+/**
+   @brief uint8_t SnsSeqSweep(ImpResult_t *pRes, uint32_t testNum, uint8_t channel)
+          compile and run a sweep on the sequencer, each frequency is printed as soon as its
+          sensor and RCAL DFT results are in the data FIFO
+   @return 0 if the sweep can't run on the sequencer and nothing was measured.
+*/
+uint8_t SnsSeqSweep(ImpResult_t *pRes, uint32_t testNum, uint8_t channel)
+{
+   const uint8_t slot[4] = {0,1,4,5};   //FIFO order: sensor real/imag, RCAL real/imag
+   uint32_t got = 0;
+   uint32_t cnt;
+   uint32_t t0;
+   uint32_t timeout;
+
+   SnsACInit(channel);
+   if(!SnsSeqCompile(pRes,testNum,channel))
+      return 0;
+   /*the sequencer owns the ADC, DFTRDY would stop conversions behind its back*/
+   AfeAdcIntCfg(NOINT);
+   NVIC_DisableIRQ(AFE_ADC_IRQn);
+   pADI_AFE->SEQCON = 0;
+   pADI_AFE->FIFOCON = 0;
+   pADI_AFE->CMDDATACON = (EIS_SEQ_CMDMEM<<BITP_AFE_CMDDATACON_CMD_MEM_SEL)|
+                          (1<<BITP_AFE_CMDDATACON_CMDMEMMDE)|          //command memory mode
+                          (EIS_SEQ_DATAMEM<<BITP_AFE_CMDDATACON_DATA_MEM_SEL)|
+                          (2<<BITP_AFE_CMDDATACON_DATAMEMMDE);         //data FIFO mode
+   for(uint32_t i=0;i<u32SeqLen;i++)
+   {
+      pADI_AFE->CMDFIFOWADDR = i;
+      pADI_AFE->CMDFIFOWRITE = SeqCmd[i];
+   }
+   pADI_AFE->SEQ0INFO = u32SeqLen<<16;   //length, start address 0
+   pADI_AFE->FIFOCON = (EIS_SEQ_FIFOSRC<<BITP_AFE_FIFOCON_DATAFIFOSRCSEL)|BITM_AFE_FIFOCON_DATAFIFOEN;
+   pADI_AFE->SEQCON = BITM_AFE_SEQCON_SEQEN;
+   timeout = ((u32SeqMs+EIS_SEQ_MARGIN_MS)*TIMEBASE_HZ)/1000;
+   t0 = TimebaseNow();
+   pADI_AFE->TRIGSEQ = BITM_AFE_TRIGSEQ_TRIG0;
+   while(got < testNum*4)
+   {
+      cnt = (pADI_AFE->FIFOCNTSTA & BITM_AFE_FIFOCNTSTA_DATAFIFOCNTSTA)>>BITP_AFE_FIFOCNTSTA_DATAFIFOCNTSTA;
+      while(cnt-- && (got < testNum*4))
+      {
+         pRes[got/4].DFT_result[slot[got%4]] = convertDftToInt(pADI_AFE->DATAFIFORD & EIS_SEQ_DATA_MASK);
+         if((++got%4) == 0)
+            SnsMagPhaseCalRes(&pRes[got/4-1],1,0);
+      }
+      if(got >= testNum*4)
+         break;
+      if(TimebaseNow()-t0 > timeout)
+      {
+         printf("SEQ,TIMEOUT,%lu"EOL,got);
+         break;
+      }
+      SnsSleep_10us(EIS_SEQ_POLL);
+   }
+   pADI_AFE->SEQCON = 0;
+   pADI_AFE->FIFOCON = 0;
+#if EIS_LPWAIT_EN
+   AfeAdcIntCfg(BITM_AFE_ADCINTIEN_DFTRDYIEN);
+#else
+   AfeAdcIntCfg(BITM_AFE_ADCINTIEN_DFTRDYIEN|BITM_AFE_ADCINTIEN_SINC2RDYIEN);
+#endif
+   NVIC_EnableIRQ(AFE_ADC_IRQn);
+   return 1;
+}
+
+/**
+   @brief void SnsSeqDump(void)
+          print the compiled command stream as "SEQ,LEN,<words>,<ms>,<error>" and "SEQ,<index>,<hex>"
+*/
+void SnsSeqDump(void)
+{
+   printf("SEQ,LEN,%lu,%lu,%u"EOL,u32SeqLen,u32SeqMs,u8SeqErr);
+   for(uint32_t i=0;i<u32SeqLen;i++)
+      printf("SEQ,%lu,%08lX"EOL,i,SeqCmd[i]);
+}
+#endif
+
+/**
+   @brief void SnsWaitDftRdy(void)
+          wait for the DFTRDY interrupt and clear the flag
+   @note with EIS_LPWAIT_EN the core is put in flexi mode between interrupts.
+         interrupts are masked around the flag check so a DFTRDY arriving just before
+         sleeping is not lost, WFI still wakes on the pending interrupt.
+         no flexi mode while a capture runs, DWT stops with the core clock.
+*/
+void SnsWaitDftRdy(void)
+{
+   uint32_t t0 = TimebaseNow();
+   PROF_BEGIN(PROF_DFT);
+   while(!dftRdy)
+   {
+#if EIS_LPWAIT_EN
+      __disable_irq();
+      if(!dftRdy && (u8CapState != CAP_WAIT_TRIG) && (u8CapState != CAP_RUN))
+      {
+         PwrCfg(ENUM_PMG_PWRMOD_FLEXI,0,BITM_PMG_SRAMRET_BNK2EN);
+      }
+      __enable_irq();
+#endif
+   }
+   dftRdy = 0;
+   PROF_END(PROF_DFT);
+   u32LpWaitTicks += TimebaseNow() - t0;
+}
+
+/**
+   @brief void SnsSleep_10us(uint32_t time)
+          delay in 10us units, sleeping in flexi mode on TMR0
+   @param time :{}
+      - delay in 10us units
+   @note resolution is one TMR0 tick (~0.5ms), shorter delays fall back to delay_10us
+*/
+void SnsSleep_10us(uint32_t time)
+{
+#if EIS_LPWAIT_EN
+   uint32_t t0;
+   uint32_t chunk;
+   uint32_t ticks = (time/100000)*SLEEPTMR_HZ + ((time%100000)*SLEEPTMR_HZ)/100000;
+
+   if(ticks < 2)
+   {
+      delay_10us(time);
+      return;
+   }
+   t0 = TimebaseNow();
+   while(ticks)
+   {
+      chunk = (ticks > 0xFFFF) ? 0xFFFF : ticks;
+      ticks -= chunk;
+      u8SleepTmrDone = 0;
+      GptLd(pADI_TMR0,chunk);
+      GptCfg(pADI_TMR0,TCTL_CLK_LFOSC,TCTL_PRE_DIV16,BITM_TMR_CTL_MODE|BITM_TMR_CTL_EN);
+      while(!u8SleepTmrDone)
+      {
+         __disable_irq();
+         if(!u8SleepTmrDone)
          {
-            Var1 += 360;
+            PwrCfg(ENUM_PMG_PWRMOD_FLEXI,0,BITM_PMG_SRAMRET_BNK2EN);
          }
-         while(Var1 < -180);
+         __enable_irq();
       }
-      ImpResult[i].Phase = Var1;
-      printf("%.4f,%.4f,%.4f"EOL,ImpResult[i].freq,ImpResult[i].Mag,           
-                                                ImpResult[i].Phase);
    }
+   u32LpWaitTicks += TimebaseNow() - t0;
+#else
+   delay_10us(time);
+#endif
+}
 
-   return 1;
+void TimebaseInit(void)
+{
+   GptCfg(pADI_TMR1,TCTL_CLK_LFOSC,TCTL_PRE_DIV256,BITM_TMR_CTL_UP|BITM_TMR_CTL_EN);   //free running, 128Hz
+   NVIC_EnableIRQ(TMR0_EVT_IRQn);
+}
+
+/**
+   @brief uint32_t TimebaseNow(void)
+          32 bit timebase in TIMEBASE_HZ ticks
+   @note TMR1 wraps every 512s, must be called at least that often.
+         the wrap tracking runs with interrupts masked, so the AFE ADC interrupt
+         may call it too. PRIMASK is restored, not cleared, for use in handlers.
+*/
+uint32_t TimebaseNow(void)
+{
+   static uint16_t last = 0;
+   static uint32_t high = 0;
+   uint32_t primask = __get_PRIMASK();
+   uint32_t now;
+   uint16_t cnt;
+
+   __disable_irq();
+   cnt = (uint16_t)GptVal(pADI_TMR1);
+   if(cnt < last)
+   {
+      high += 0x10000;
+   }
+   last = cnt;
+   now = high + cnt;
+   __set_PRIMASK(primask);
+   return now;
+}
+
+/**
+   @brief void ProfInit(void)
+          enable the DWT cycle counter and clear the profiling counters
+*/
+void ProfInit(void)
+{
+   CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+   DWT->CYCCNT = 0;
+   DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+   for(uint32_t r=0;r<PROF_NUM;r++)
+   {
+      ProfData[r].count = 0;
+      ProfData[r].min = 0xFFFFFFFF;
+      ProfData[r].max = 0;
+      ProfData[r].total = 0;
+   }
+}
+
+void ProfBegin(ProfRegion_t region)
+{
+   ProfData[region].start = DWT->CYCCNT;
+}
+
+void ProfEnd(ProfRegion_t region)
+{
+   uint32_t cycles = DWT->CYCCNT - ProfData[region].start;
+   ProfData[region].count++;
+   ProfData[region].total += cycles;
+   if(cycles < ProfData[region].min)
+      ProfData[region].min = cycles;
+   if(cycles > ProfData[region].max)
+      ProfData[region].max = cycles;
+}
+
+/**
+   @brief void ProfDump(void)
+          print and clear the profiling counters, one line per region in core clock cycles
+          "PROF,<name>,<count>,<min>,<max>,<total/1000>"
+*/
+void ProfDump(void)
+{
+   for(uint32_t r=0;r<PROF_NUM;r++)
+   {
+      printf("PROF,%s,%lu,%lu,%lu,%lu"EOL,ProfData[r].name,ProfData[r].count,
+             ProfData[r].count ? ProfData[r].min : 0,ProfData[r].max,
+             (uint32_t)(ProfData[r].total/1000));
+   }
+   ProfInit();
+}
+
+/**
+   @brief void ThruReport(void)
+          print the throughput of the last sweep as one JSON line, rates with two decimals
+          cpu_busy is the fraction of the sweep not spent in low power waits
+*/
+void ThruReport(void)
+{
+   uint32_t ms = (u32ThruElapsed*1000)/TIMEBASE_HZ;
+   uint32_t pps = 0, bpp = 0, busy = 0;
+
+   if(ms)
+      pps = (uint32_t)(((uint64_t)u32ThruPoints*100000)/ms);
+   if(u32ThruPoints)
+      bpp = (u32ThruBytes*100)/u32ThruPoints;
+   if(u32ThruElapsed)
+      busy = ((u32ThruElapsed-u32ThruLpWait)*10000)/u32ThruElapsed;
+   printf("{\"fw\":\"355\",\"setting\":\"%c\",\"baud\":%u,\"enc\":\"ascii\",\"points\":%lu,"
+          "\"bytes\":%lu,\"elapsed_ms\":%lu,\"points_per_s\":%lu.%02lu,\"bytes_per_point\":%lu.%02lu,"
+          "\"cpu_busy\":%lu.%02lu,\"ttfr_ms\":%lu}"EOL,
+          setting ? setting : '-',UART_BAUD_BPS,u32ThruPoints,u32ThruBytes,ms,pps/100,pps%100,
+          bpp/100,bpp%100,busy/10000,(busy/100)%100,(u32ThruFirst*1000)/TIMEBASE_HZ);
+}
+
+/**
+   @brief void Identify(void)
+          print the firmware and board identity
+          "ID,<fw>,<version>,<device>,<runs>,<baud>,<boot ms>,<boot timeout mask>"
+*/
+void Identify(void)
+{
+   printf("ID,%s,%s,%u,%lu,%u,%lu,%u"EOL,FW_NAME,FW_VERSION,DEVICE_ID,u32RunCount,UART_BAUD_BPS,
+          u32BootMs,u8BootTimeout);
+}
+
+/**
+   @brief uint16_t Crc16(uint16_t crc, const uint8_t *pData, uint32_t len)
+          CRC-16/CCITT (0x1021), start with crc = 0xFFFF and chain calls for split data
+*/
+uint16_t Crc16(uint16_t crc, const uint8_t *pData, uint32_t len)
+{
+   for(uint32_t i=0;i<len;i++)
+   {
+      crc ^= (uint16_t)pData[i]<<8;
+      for(uint8_t b=0;b<8;b++)
+         crc = (crc&0x8000) ? (uint16_t)((crc<<1)^0x1021) : (uint16_t)(crc<<1);
+   }
+   return crc;
+}
+
+/**
+   @brief uint16_t GridId(void)
+          identifier of the sweep frequency grid, CRC of the ImpResult_hold frequencies in
+          output order. Hosts key cached per grid data (DRT kernels etc.) on it
+*/
+uint16_t GridId(void)
+{
+   uint16_t crc = 0xFFFF;
+
+   for(uint32_t i=0;i<sizeof(ImpResult_hold)/sizeof(ImpResult_t);i++)
+   {
+      float freq = ImpResult_hold[i].freq;
+      crc = Crc16(crc,(const uint8_t *)&freq,sizeof(freq));
+   }
+   return crc;
+}
+
+/**
+   @brief void GridReport(void)
+          print the sweep frequency grid "GRID,<id>,<n>,<f0>;<f1>;..." in output order
+*/
+void GridReport(void)
+{
+   uint32_t n = sizeof(ImpResult_hold)/sizeof(ImpResult_t);
 
+   printf("GRID,%04X,%lu,",GridId(),n);
+   for(uint32_t i=0;i<n;i++)
+      printf(i ? ";%.4f" : "%.4f",ImpResult_hold[i].freq);
+   printf(EOL);
 }
 
 //rewrite putchar to support printf in IAR
 int putchar(int c)
 {
+   if(u8ThruActive)
+      u32ThruBytes++;
    UrtTx(pADI_UART0,c);
    while(!(pADI_UART0->COMLSR&BITM_UART_COMLSR_TEMT));
    return c;
@@ -862,7 +2496,7 @@ void UartInit(void)
    DioCfgPin(pADI_GPIO0,PIN10,1);               // Setup P0.10 as UART pin
    DioCfgPin(pADI_GPIO0,PIN11,1);               // Setup P0.11 as UART pin
    pADI_UART0->COMLCR2 = 0x3;                  // Set PCLk oversampling rate 32. (PCLK to UART baudrate generator is /32)
-   UrtCfg(pADI_UART0,B9600,
+   UrtCfg(pADI_UART0,UART_BAUD,
           (BITM_UART_COMLCR_WLS|3),0);         // Configure UART for 57600 baud rate
    UrtFifoCfg(pADI_UART0, RX_FIFO_1BYTE,      // Configure the UART FIFOs for 1 bytes deep
               BITM_UART_COMFCR_FIFOEN);
@@ -877,6 +2511,26 @@ void UartInit(void)
    NVIC_EnableIRQ(AFE_EVT3_IRQn);    //UART_RX connected to EXT Int3
 }
 
+/*store one filter result of a running capture, called from the ADC interrupt*/
+static void SnsCaptureSample(uint16_t code)
+{
+   if(u8CapState == CAP_WAIT_TRIG)
+   {
+      if((u16CapPrev < EIS_CAPTURE_LEVEL) && (code >= EIS_CAPTURE_LEVEL))
+         u8CapState = CAP_RUN;
+      u16CapPrev = code;
+   }
+   if(u8CapState == CAP_RUN)
+   {
+      u32CapLast = DWT->CYCCNT;
+      if(u32CapFill == 0)
+         u32CapFirst = u32CapLast;
+      CapBuf[u32CapFill++] = code;
+      if(u32CapFill >= u32CapLen)
+         u8CapState = CAP_DONE;
+   }
+}
+
 void AfeAdc_Int_Handler()
 {
 	uint32_t sta;
@@ -884,8 +2538,20 @@ void AfeAdc_Int_Handler()
 	if(sta&BITM_AFE_ADCINTSTA_DFTRDY)
 	{
       pADI_AFE->ADCINTSTA = BITM_AFE_ADCINTSTA_DFTRDY;	//clear interrupt
+      if(u8MonOn)   //monitoring, queue the result and restart the DFT, the ADC keeps converting
+      {
+         MonLog[u32MonHead%EIS_MON_LEN].cyc = DWT->CYCCNT;
+         MonLog[u32MonHead%EIS_MON_LEN].re = convertDftToInt(pADI_AFE->DFTREAL);
+         MonLog[u32MonHead%EIS_MON_LEN].im = convertDftToInt(pADI_AFE->DFTIMAG);
+         u32MonHead++;
+         pADI_AFE->AFECON &= ~BITM_AFE_AFECON_DFTEN;
+         pADI_AFE->AFECON |= BITM_AFE_AFECON_DFTEN;
+      }
+      else
+      {
       dftRdy = 1;
       pADI_AFE->AFECON &= (~(BITM_AFE_AFECON_DFTEN|BITM_AFE_AFECON_ADCCONVEN|BITM_AFE_AFECON_ADCEN));  //stop conversion
+      }
        
 	}
       else if(sta&BITM_AFE_ADCINTSTA_SINC2RDY)
@@ -893,12 +2559,39 @@ void AfeAdc_Int_Handler()
         pADI_AFE->ADCINTSTA = BITM_AFE_ADCINTSTA_SINC2RDY; //clear interrupt
         //adcRdy = 1;
         dx = pADI_AFE->SINC2DAT;;
+        if(u8CapSrc == '2')
+           SnsCaptureSample((uint16_t)dx);
+        if(u8DcLogOn)
+        {
+           u32DcLogAcc += dx;
+           if(++u32DcLogCnt >= EIS_DCLOG_DECIM)
+           {
+              DcLog[u32DcLogHead%EIS_DCLOG_LEN].tick = TimebaseNow()-u32SweepStart;
+              DcLog[u32DcLogHead%EIS_DCLOG_LEN].code = (uint16_t)(u32DcLogAcc/u32DcLogCnt);
+              u32DcLogHead++;
+              u32DcLogAcc = 0;
+              u32DcLogCnt = 0;
+           }
+        }
         //printf("%6d\r\n",dx);
         //cx++;
       }
+      else if(sta&BITM_AFE_ADCINTSTA_ADCRDY)
+      {
+        pADI_AFE->ADCINTSTA = BITM_AFE_ADCINTSTA_ADCRDY;  //clear interrupt
+        if(u8CapSrc == '3')
+           SnsCaptureSample((uint16_t)pADI_AFE->ADCDAT);
+      }
 
 }
 
+void GP_Tmr0_Int_Handler(void)
+{
+   GptClrInt(pADI_TMR0,BITM_TMR_CLRINT_TIMEOUT);
+   GptCfg(pADI_TMR0,TCTL_CLK_LFOSC,TCTL_PRE_DIV16,0);   //one shot, stop timer
+   u8SleepTmrDone = 1;
+}
+
 void GPIO_A_Int_Handler()
 {
    unsigned int uiIntSta = 0;
@@ -940,11 +2633,81 @@ void UART_Int_Handler(void)
       for (uint8_t i=0; i<iNumBytesInFifo;i++)
       {
          ucComRx = UrtRx(pADI_UART0);
+#if EIS_MON_EN
+         if(u8MonActive)   //any byte stops monitoring
+         {
+            u8MonStop = 1;
+            continue;
+         }
+#endif
+#if EIS_STORE_EN
+         if((ucComRx=='l') && NvRec.cmd)   //repeat the stored sweep
+         {
+            ucComRx = NvRec.cmd;
+         }
+#endif
          //if(ucComRx==0x05)
          if((ucComRx==0x31)|(ucComRx==0x32)|(ucComRx==0x33)|(ucComRx==0x34)|(ucComRx==0x35)|(ucComRx==0x36))    //if 1-6 is written, start test.
          {
             wakeup = MCU_SLEEP_UART;
             setting = ucComRx;
+            u8LastCmd = ucComRx;
+            u8DualChan = 0;
+            u8SeqMode = 0;
+         }
+         else if(ucComRx=='d')   //sweep both channels, CHAN0 keeps the last mux setting
+         {
+            wakeup = MCU_SLEEP_UART;
+            if(setting==0)
+               setting = 0x31;
+            u8DualChan = 1;
+            u8SeqMode = 0;
+            u8LastCmd = ucComRx;
+         }
+         else if(ucComRx=='q')   //sequencer sweep of CHAN0, keeps the last mux setting
+         {
+            wakeup = MCU_SLEEP_UART;
+            if(setting==0)
+               setting = 0x31;
+            u8DualChan = 0;
+            u8SeqMode = 1;
+            u8LastCmd = ucComRx;
+         }
+         else if(ucComRx=='Q')   //dump the compiled sequencer sweep
+         {
+            if(setting==0)
+               setting = 0x31;
+            ucSeqDump = 1;
+         }
+         else if(ucComRx=='p')   //dump profiling counters
+         {
+            ucProfDump = 1;
+         }
+         else if(ucComRx=='r')   //report throughput of the last sweep
+         {
+            ucThruReport = 1;
+         }
+         else if(ucComRx=='i')   //report firmware and board identity
+         {
+            ucIdentify = 1;
+         }
+         else if(ucComRx=='g')   //report the sweep frequency grid
+         {
+            ucGridReport = 1;
+         }
+         else if((ucComRx=='c')|(ucComRx=='C'))   //arm SINC2/SINC3 capture for the next sweep
+         {
+            SnsCaptureArm((ucComRx=='c') ? '2' : '3');
+         }
+         else if(ucComRx=='B')   //capture rate benchmark
+         {
+            ucCapBench = 1;
+         }
+         else if(ucComRx=='m')   //monitor CHAN0 at EIS_MON_FREQ with the last mux setting
+         {
+            if(setting==0)
+               setting = 0x31;
+            ucMonStart = 1;
          }
          else if((ucComRx==0x39)|(ucComRx==0x01))   //wake up
          {
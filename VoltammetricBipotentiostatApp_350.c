@@ -19,6 +19,7 @@ License Agreement.
 #include <stddef.h>		/* for 'NULL' */  
 #include <stdio.h>
 #include <string.h>             /* for strlen */
+#include <math.h>               /* for sqrtf */
 
 #include "test_common.h"
 
@@ -27,6 +28,7 @@ License Agreement.
 #include "uart.h"
 #include "spi.h"
 #include "gpio.h"
+#include "flash.h"
 
 
 /* Macro to enable the returning of AFE data using the UART */
@@ -78,6 +80,34 @@ License Agreement.
 /* Default value on ADuCM350 Switch Mux Config Board Rev.0 is 7.5k  */
 #define RTIA                        (10000000)
 
+/* RTIA ranges in ohms, range 0 is the boot default RTIA. Each range is     */
+/* calibrated with adi_AFE_TiaChanCal at boot when the board can switch to   */
+/* it (see Board_SelectRtia). At least 10k, the current per code in aA has  */
+/* to fit 32 bits.                                                           */
+#define RTIA_RANGES                 { RTIA, 1000000, 100000 }
+#define RTIA_NUM_RANGES             (3u)
+/* Automatic RTIA ranging between steps, also set at runtime with 'g'       */
+/*      1 = switch range on saturation / under-range, tag samples with range */
+/*      0 = fixed range, legacy stream                                       */
+#define AUTORANGE_EN                (0)
+/* Codes from either rail treated as saturated */
+#define ADC_SAT_MARGIN              (256)
+/* Steps whose |code - zero| stays below this move to the next higher RTIA */
+#define ADC_UNDER_CODES             (1024)
+/* Consecutive under-range steps before moving to a higher RTIA */
+#define AUTORANGE_UNDER_STEPS       (4u)
+
+/* Units of the step results, selected with the 'u' command:               */
+/*      UNIT_CODES = LPF codes (legacy), UNIT_PA = current in pA            */
+#define SAMPLE_UNIT                 (UNIT_CODES)
+
+/* DO NOT EDIT: ADC input span in mV (+/-0.9V over 16 bits) and zero current */
+/* code. The AFE applies the TIA gain/offset calibration of the selected     */
+/* range to the codes (GAIN_OFFS_SEL = TIA), a calibrated code is the ideal   */
+/* code of that range's RTIA. See Range_ScaleAa.                              */
+#define ADC_SPAN_MV                 (1800u)
+#define ADC_ZERO_CODE               (32768)
+
 /* DO NOT EDIT: DAC LSB size in mV, before attenuator (1.6V / (2^12 - 1))(0.39072) */
 #define DAC_LSB_SIZE                (0.39072)
 /* DO NOT EDIT: DC Level 1 in DAC codes */
@@ -96,8 +126,148 @@ License Agreement.
 /* Size limit for each DMA transfer (max 1024) */
 #define DMA_BUFFER_SIZE             ( 300u)
 
+/* Oversampling: number of LPF samples captured per voltage step and reduced */
+/* on-device to one value. 1 = legacy single sample, no noise field.         */
+#define OVERSAMPLE_N                (SAMPLE_COUNT)
+/* Maximum oversampling count (size of the reduction buffer) */
+#define OVERSAMPLE_MAX              (64u)
+/* Reduction applied to the samples of a step: REDUCE_MEAN,                  */
+/* REDUCE_TRIMMED_MEAN or REDUCE_LASTK_MEAN                                  */
+#define OVERSAMPLE_MODE             (REDUCE_MEAN)
+/* Samples discarded at each end of the sorted step for the trimmed mean */
+#define OVERSAMPLE_TRIM             (2u)
+/* Number of most recent samples averaged by the last-K window mean */
+#define OVERSAMPLE_LASTK            (8u)
+
+/* On-device peak detection for CV and SWV, selected with the 'f' command   */
+/* (FEAT_RAW, FEAT_PEAKS or FEAT_BOTH). FEAT_RAW is the legacy stream.      */
+#define FEAT_MODE                   (FEAT_RAW)
+/* Smoothing window length (5, 7 or 9) and filter:                         */
+/*      1 = Savitzky-Golay quadratic, keeps peak height and position        */
+/*      0 = moving average                                                  */
+#define FEAT_SMOOTH_N               (5u)
+#define FEAT_SMOOTH_MAX             (9u)
+#define FEAT_SMOOTH_SG              (1)
+/* Baseline tracking speed, the baseline moves 1/2^n of the way per sample */
+#define FEAT_BASELINE_SHIFT         (3u)
+/* Minimum peak height above/below the baseline, in codes */
+#define FEAT_THRESHOLD              (20)
+
+/* DO NOT EDIT: LPF output period in us (178 / 160kHz) */
+#define LPF_SAMPLE_PERIOD_US        (1113u)
+/* DO NOT EDIT: Time in us from ADC_CONV_EN to the end of the step sequence  */
+/* (37ms LPF settling wait + DAC level 1 + DAC level 2)                      */
+#define STEP_CAPTURE_WINDOW_US      (37000u + DURL1 + DURL2)
+
+/* Fixed per-step time in us outside the scan rate wait (sequence waits, WE2 */
+/* update, sample output). Subtracted from the scan rate delay, verify with  */
+/* the 'b' step timing benchmark.                                            */
+#define STEP_OVERHEAD_US            (48500u)
+/* DO NOT EDIT: Longest sequencer wait in us (30 bit wait count of 16MHz ACLK) */
+#define SEQ_WAIT_MAX_US             (0x3FFFFFFFu / 16u)
+/* DO NOT EDIT: Core clock after SystemTransitionClocks (HFXTAL) */
+#define CORE_CLOCK_HZ               (16000000u)
+
+/* Step timing benchmark: steps timed per scan rate / step size combination */
+#define BENCH_STEPS                 (32u)
+
+/* UART baud rate, driver setting and value in bit/s for the throughput report */
+#define UART_BAUD_RATE              (ADI_UART_BAUD_9600)
+#define UART_BAUD_BPS               (9600u)
+
+/* Size of the UART driver Rx/Tx buffers (interrupt driven, non-blocking) */
+#define UART_RX_RING_SIZE           (64u)
+#define UART_TX_RING_SIZE           (64u)
+/* DO NOT EDIT: Payload lengths of the 'n' (configuration), 'o' (oversampling) */
+/* and the 1 byte 'f' (peak detection), 'u' (units), 'g' (range) commands      */
+/* and of 'c' (CV cycles, 2 digits "01".."99")                                */
+#define CMD_CONFIG_LEN              (27u)
+#define CMD_OVERSAMPLE_LEN          (5u)
+#define CMD_FEATURE_LEN             (1u)
+#define CMD_CYCLES_LEN              (2u)
+
+/* Hot path profiling with the DWT cycle counter                            */
+/*      1 = profile regions, 'p' command dumps and clears the counters       */
+/*      0 = disabled, no overhead                                            */
+#define PROFILE_EN                  (1)
+
+/* Firmware identity reported by the 'i' command */
+#define FW_NAME                     "VBP350"
+#define FW_VERSION                  "1.1"
+/* Board number reported by the 'i' command, override per board at build time */
+#ifndef DEVICE_ID
+#define DEVICE_ID                   (0u)
+#endif
+/* Run markers around each scan so a host can split the stream into runs    */
+/*      1 = "RUN,BEGIN,<run>,<mode>" followed by the "RUN,CFG,..." header    */
+/*          and "RUN,END,<run>,<points>,<ok|abort>" after the scan            */
+/*      0 = legacy stream, as expected by the App Inventor app               */
+#ifndef RUN_MARKERS_EN
+#define RUN_MARKERS_EN              (0)
+#endif
+
+/* Calibration store. The TIA (all ranges) and excitation calibration, the  */
+/* last 'n' configuration and validity metadata are kept in records written */
+/* round robin over two pages of the GP flash.                               */
+/*      1 = a valid record skips the boot calibrations, 'l' replays the     */
+/*          stored configuration                                             */
+/*      0 = calibrate at every boot                                         */
+#ifndef CAL_STORE_EN
+#define CAL_STORE_EN                (0)
+#endif
+#ifndef CAL_STORE_BASE
+#define CAL_STORE_BASE              (0x00040000u)   /* GP flash, 2 pages used */
+#endif
+#define CAL_STORE_PAGE_SIZE         (2048u)
+/* A calibration is reused for at most CAL_MAX_BOOTS boots and while the    */
+/* board temperature (Board_Temperature) stays within CAL_MAX_DTEMP 0.1 C   */
+#define CAL_MAX_BOOTS               (100u)
+#define CAL_MAX_DTEMP               (50)
+#define CAL_TEMP_UNKNOWN            (0x7FFF)
+
+/* Hold programs. Electrode cleaning and the equilibration before a scan   */
+/* hold one potential in seq_warm_afe_ampmeas with long sequencer waits     */
+/* instead of repeating steps, and report "HOLD,<mV>,<ms>,<pA>,<end>" with  */
+/* the current at the end of the hold, end is time, stable or abort.        */
+/*      1 = hold programs, no samples are streamed during the hold          */
+/*      0 = legacy 30 (cleaning) and 10 (equilibration) step loops          */
+#define HOLD_PROGRAM_EN             (0)
+#define HOLD_CLEAN_MS               (3000u)     /* ~30 legacy steps         */
+#define HOLD_EQUIL_MS               (1000u)     /* ~10 legacy steps         */
+/* Stop early once the current changed by at most HOLD_STABLE_PA between   */
+/* two checks HOLD_STABLE_US apart, 0 = always hold the full duration       */
+#define HOLD_STABLE_PA              (0)
+#define HOLD_STABLE_US              (500000u)
+/* Longest hold per sequence run, sequencer waits are 30 bit ACLK counts    */
+#define HOLD_CHUNK_US               (60000000u)
+/* Sequence time outside the hold wait, as for the warm up voltage          */
+#define HOLD_SEQ_OVERHEAD_US        (46450u)
+
+/* Resident sequence cache. The CRC-8 of every step sequence is kept with a  */
+/* shadow copy of its words; words changed between steps (DAC codes) are   */
+/* patched into the CRC instead of the driver recomputing the whole         */
+/* sequence on each adi_AFE_RunSequence. The first step runs with the       */
+/* driver CRC and is compared against the AFE_SEQ_CRC result, on a mismatch */
+/* the driver CRC stays in use.                                             */
+/*      1 = cached CRC                                                      */
+/*      0 = driver software CRC on every step                               */
+#ifndef SEQ_CACHE_EN
+#define SEQ_CACHE_EN                (0)
+#endif
+#define SEQ_CACHE_MAX               (8u)        /* resident sequences       */
+#define SEQ_CACHE_WORDS             (24u)       /* safety word + commands   */
+/* 1 = also recompute every patched CRC in full and FAIL on a difference    */
+#ifndef SEQ_CACHE_SELFTEST
+#define SEQ_CACHE_SELFTEST          (0)
+#endif
+/* Sequencer CRC-8, x^8 + x^2 + x + 1, MSB first over each 32 bit command   */
+#define SEQ_CRC_POLY                (0x07u)
+#define SEQ_CRC_SEED                (0x01u)
+#define SEQ_SAFETY_CRC_MASK         (0x000000FFu)
+#define SEQ_SAFETY_COUNT(w)         (((w) >> 16) & 0xFFu)
+
 /* DO NOT EDIT: Maximum printed message length. Used for printing only. */
-#define MSG_MAXLEN                  (50)
+#define MSG_MAXLEN                  (80)
 
 #pragma location="volatile_ram"
 uint16_t        dmaBuffer[DMA_BUFFER_SIZE * 2];
@@ -310,6 +480,278 @@ uint32_t seq_warm_afe_ampmeas[] = {
 /* Variables and functions needed for data output through UART */
 ADI_UART_HANDLE     hUartDevice     = NULL;
 
+/* Reduction of the oversampled LPF results of one voltage step */
+typedef enum {
+    REDUCE_MEAN = 0,            /* mean of all samples                      */
+    REDUCE_TRIMMED_MEAN,        /* mean after dropping Trim samples per end */
+    REDUCE_LASTK_MEAN           /* mean of the last LastK samples           */
+} REDUCE_MODE_TYPE;
+
+typedef struct {
+    uint32_t            Count;  /* LPF samples captured per step            */
+    REDUCE_MODE_TYPE    Mode;
+    uint32_t            Trim;
+    uint32_t            LastK;
+    uint32_t            ExtraUs;/* step time added to fit Count samples     */
+} OVERSAMPLE_CFG_TYPE;
+
+OVERSAMPLE_CFG_TYPE     osCfg = { OVERSAMPLE_N, OVERSAMPLE_MODE, OVERSAMPLE_TRIM, OVERSAMPLE_LASTK, 0 };
+static uint16_t         osSamples[OVERSAMPLE_MAX];
+static uint32_t         osFill = 0;
+
+/* Sweep of the last 'n', the scan rate wait is recomputed from it when    */
+/* 'o' changes the oversampling extension                                   */
+typedef struct {
+    bool_t              Valid;
+    int32_t             Span;       /* mV                                   */
+    int32_t             Rate;       /* mV/s                                 */
+    int32_t             NoStep;
+} STEP_CFG_TYPE;
+
+STEP_CFG_TYPE           stepCfg = { false, 0, 0, 0 };
+
+/* Step result of RxDmaCB, sent by RunStep from main context since the     */
+/* UART Tx ring only drains on its own interrupt                            */
+static volatile bool_t  osReady = false;
+static uint16_t         osValue;
+static uint16_t         osNoise;
+
+/* Peak detection. The scan loops announce the nominal potential of each   */
+/* step, a change of sweep direction starts a new segment.                 */
+typedef enum {
+    FEAT_RAW = 0,               /* raw samples only                         */
+    FEAT_PEAKS,                 /* peak records only                        */
+    FEAT_BOTH                   /* raw samples and peak records             */
+} FEAT_MODE_TYPE;
+
+typedef struct {
+    FEAT_MODE_TYPE      Mode;
+    bool_t              Active;     /* CV or SWV sweep in progress          */
+    bool_t              Swv;        /* samples come in forward/reverse pairs*/
+    bool_t              Half;       /* SWV forward sample held              */
+    int32_t             Forward;
+    int32_t             Potential;  /* mV of the step being measured        */
+    int32_t             Dir;        /* +1 / -1, 0 before the first step     */
+    uint32_t            Segment;
+    uint32_t            Fill;       /* samples in the smoothing window      */
+    int32_t             Win[FEAT_SMOOTH_MAX];
+    int32_t             WinPot[FEAT_SMOOTH_MAX];
+    int32_t             Baseline;
+    int32_t             PeakHeight; /* signed, 0 when no peak is open       */
+    int32_t             PeakValue;
+    int32_t             PeakPot;
+} FEAT_CTX_TYPE;
+
+FEAT_CTX_TYPE           featCtx = { FEAT_MODE };
+
+/* Savitzky-Golay quadratic smoothing coefficients, centre first (norms 35, 21, 231) */
+static const int16_t    featSg5[] = { 17, 12, -3 };
+static const int16_t    featSg7[] = { 7, 6, 3, -2 };
+static const int16_t    featSg9[] = { 59, 54, 39, 14, -21 };
+
+typedef enum {
+    UNIT_CODES = 0,             /* LPF codes                                */
+    UNIT_PA                     /* current in pA                            */
+} SAMPLE_UNIT_TYPE;
+
+SAMPLE_UNIT_TYPE        sampleUnit = SAMPLE_UNIT;
+
+/* RTIA ranging. Gain/offset hold the TIA calibration of each range. */
+typedef struct {
+    uint32_t            Gain;
+    uint32_t            Offset;
+    bool_t              Valid;  /* board can select it and it calibrated    */
+} RANGE_CAL_TYPE;
+
+typedef struct {
+    bool_t              Auto;
+    bool_t              Tag;        /* append ":<range>" to the step results */
+    uint32_t            Range;
+    uint32_t            ScaleAa;    /* current per code of Range, in aA      */
+    volatile bool_t     StepSat;    /* a sample of this step hit a rail      */
+    bool_t              StepUnder;
+    uint32_t            UnderCount;
+    RANGE_CAL_TYPE      Cal[RTIA_NUM_RANGES];
+} RANGE_CTX_TYPE;
+
+static const uint32_t   rtiaRanges[RTIA_NUM_RANGES] = RTIA_RANGES;
+RANGE_CTX_TYPE          rangeCtx = { (1 == AUTORANGE_EN), (1 == AUTORANGE_EN) };
+
+/* Command dispatcher state. Bytes are fed one at a time; while a scan is */
+/* running only the abort ('x') and status ('?') commands are honored.    */
+typedef enum {
+    CMD_STATE_IDLE = 0,         /* waiting for a command byte               */
+    CMD_STATE_PAYLOAD           /* collecting the payload of Cmd            */
+} CMD_STATE_TYPE;
+
+typedef struct {
+    CMD_STATE_TYPE      State;
+    uint8_t             Cmd;    /* command whose payload is being collected */
+    uint8_t             Payload[CMD_CONFIG_LEN];
+    uint32_t            Len;    /* expected payload length                  */
+    uint32_t            Fill;
+    volatile bool_t     ScanActive;
+    volatile bool_t     ScanAbort;
+    uint32_t            ScanStep;
+} CMD_CTX_TYPE;
+
+CMD_CTX_TYPE            cmdCtx;
+
+/* Step start timestamps (DWT cycles) recorded by RunStep() while benchmarking */
+typedef struct {
+    volatile bool_t     Active;
+    uint32_t            Fill;
+    uint32_t            Stamp[BENCH_STEPS];
+} BENCH_CTX_TYPE;
+
+BENCH_CTX_TYPE          benchCtx;
+static const uint16_t   benchScanRates[] = { 10, 25, 50, 100, 200 };   /* mV/s */
+static const uint16_t   benchStepSizes[] = { 1, 5, 10 };               /* mV   */
+static uint8_t          UartRxData[UART_RX_RING_SIZE];
+static uint8_t          UartTxData[UART_TX_RING_SIZE];
+
+/* Profiled regions of a voltammetry step */
+typedef enum {
+    PROF_RUN_SEQUENCE = 0,      /* adi_AFE_RunSequence, includes RxDmaCB     */
+    PROF_WE2_DAC,               /* AD5683R_WE2_Voltage                       */
+    PROF_DAC_CODE,              /* DAC code math and sequence update         */
+    PROF_RX_DMA_CB,             /* RxDmaCB reduction, sprintf and UART       */
+    PROF_NUM_REGIONS
+} PROF_REGION_TYPE;
+
+typedef struct {
+    const char          *Name;
+    uint32_t            Count;
+    uint32_t            Min;    /* cycles                                   */
+    uint32_t            Max;
+    uint64_t            Total;
+    uint32_t            Start;  /* CYCCNT at PROF_BEGIN                     */
+} PROF_REGION_DATA_TYPE;
+
+#if (1 == PROFILE_EN)
+#define PROF_BEGIN(r)               Prof_Begin(r)
+#define PROF_END(r)                 Prof_End(r)
+#else
+#define PROF_BEGIN(r)
+#define PROF_END(r)
+#endif
+
+PROF_REGION_DATA_TYPE   profData[PROF_NUM_REGIONS] = {
+    { "run_sequence" },
+    { "we2_dac" },
+    { "dac_code" },
+    { "rx_dma_cb" },
+};
+
+/* Throughput counters of the last scan, reported as JSON by the 'r' command */
+typedef struct {
+    volatile bool_t     Active;
+    uint8_t             Mode;       /* chem_test of the scan                */
+    uint32_t            Points;     /* step results sent                    */
+    uint32_t            Bytes;      /* bytes sent on the UART               */
+    uint32_t            LastCyc;    /* DWT at the last accounting update    */
+    uint64_t            Elapsed;    /* cycles since Scan_Begin              */
+    uint64_t            Idle;       /* cycles waiting on the sequencer      */
+    uint64_t            FirstResult;/* cycles from Scan_Begin to 1st result */
+    uint32_t            CbCycles;   /* RxDmaCB cycles of the current step   */
+} THRU_CTX_TYPE;
+
+THRU_CTX_TYPE           thruCtx;
+
+/* Hold program in progress, EmitSample keeps the result instead of sending */
+typedef struct {
+    volatile bool_t     Active;
+    uint16_t            Value;      /* result of the last hold chunk        */
+} HOLD_CTX_TYPE;
+
+HOLD_CTX_TYPE           holdCtx;
+
+/* Number of scans run since reset, identifies the run in the markers */
+uint32_t                runCount = 0;
+
+/* DWT cycles from Prof_Init() to the first command poll, reported as time-to-ready */
+uint32_t                bootCycles = 0;
+
+/* Scan configuration of the last 'n' command, reported in the run header */
+typedef struct {
+    char                Test;       /* chem_test                            */
+    int32_t             VInit;      /* mV                                   */
+    int32_t             VFinal;     /* mV                                   */
+    int32_t             VStep;      /* mV                                   */
+    int32_t             ScanRate;   /* mV/s                                 */
+    int32_t             SwvAmp;     /* mV                                   */
+    int32_t             VWe2;       /* mV, as requested before offsetting   */
+    char                Electrode;  /* clean_electrode                      */
+    uint32_t            Cycles;     /* CV cycles                            */
+} RUN_CFG_TYPE;
+
+RUN_CFG_TYPE            runCfg = { 'a', 200, -600, 10, 0, 50, 0, 'n', 1 };
+
+/* Multi-cycle CV. With more than one cycle every result is tagged          */
+/* "<result>@<cycle>.<segment> ", segment 1 runs to the vertex, 2 back.     */
+typedef struct {
+    uint32_t            Count;      /* cycles per ' ', set by 'c'           */
+    uint32_t            Cycle;      /* 1 based                              */
+    uint32_t            Segment;
+    bool_t              Tag;
+} CYCLE_CTX_TYPE;
+
+CYCLE_CTX_TYPE          cycleCtx = { 1, 1, 1, false };
+
+/* Calibration store record (96 bytes, flash writes are 64 bit). The record */
+/* with the highest Seq and a good CRC is the current one.                  */
+#define CAL_REC_MAGIC               (0x43414C31u)   /* "CAL1" */
+#define CAL_REC_CAL                 (0x0001u)       /* calibration valid    */
+#define CAL_REC_CFG                 (0x0002u)       /* Cfg holds an 'n'      */
+
+typedef struct {
+    uint32_t            Magic;
+    uint32_t            Seq;
+    char                FwVersion[8];
+    uint32_t            Boots;      /* boots seen by the store              */
+    uint32_t            CalBoot;    /* Boots at calibration                  */
+    int16_t             CalTemp;    /* 0.1 C at calibration                  */
+    uint16_t            Flags;
+    uint32_t            TiaGain[RTIA_NUM_RANGES];
+    uint32_t            TiaOffset[RTIA_NUM_RANGES];
+    uint32_t            TiaValid;   /* bit per calibrated range              */
+    uint32_t            DacOffset;  /* excitation calibration, no attenuator */
+    uint32_t            DacGain;
+    uint8_t             Cfg[(CMD_CONFIG_LEN + 3u) & ~3u];
+    uint32_t            Crc;        /* CRC-16/CCITT of the preceding bytes   */
+} CAL_REC_TYPE;
+
+CAL_REC_TYPE            calRec;
+uint32_t                calAddr = 0;    /* flash address of calRec, 0 if none */
+
+/* Resident sequence, Col[i][b] is bit b of a CRC change at command i      */
+/* carried through the commands after it                                    */
+typedef struct {
+    uint32_t           *pSeq;
+    uint32_t            Count;      /* commands after the safety word       */
+    uint8_t             Crc;
+    uint32_t            Shadow[SEQ_CACHE_WORDS];
+    uint8_t             Col[SEQ_CACHE_WORDS][8];
+} SEQ_ENTRY_TYPE;
+
+typedef enum {
+    SEQ_CACHE_CHECK = 0,            /* first step, compare with the driver  */
+    SEQ_CACHE_ON,
+    SEQ_CACHE_OFF                   /* self-check failed, driver CRC        */
+} SEQ_CACHE_STATE_TYPE;
+
+typedef struct {
+    SEQ_CACHE_STATE_TYPE State;
+    uint32_t            Num;
+    uint32_t            Patched;    /* words patched since boot             */
+    uint8_t             Table[256];
+    SEQ_ENTRY_TYPE      Entry[SEQ_CACHE_MAX];
+} SEQ_CACHE_TYPE;
+
+#if (1 == SEQ_CACHE_EN)
+SEQ_CACHE_TYPE          seqCache;
+#endif
+
 /* Function prototypes */
 void                    test_print                  (char *pBuffer);
 ADI_UART_RESULT_TYPE    uart_Init                   (void);
@@ -318,6 +760,53 @@ extern int32_t          adi_initpinmux              (void);
 void        RxDmaCB         (void *hAfeDevice, 
                              uint32_t length, 
                              void *pBuffer);
+void        RunStep         (ADI_AFE_DEV_HANDLE hAfeDevice, uint32_t *pSeq);
+void        SeqSetAll       (uint32_t index, uint32_t value);
+void        Hold_Run        (ADI_AFE_DEV_HANDLE hAfeDevice, uint32_t *pSeq, int32_t mV, uint32_t ms);
+void        Seq_CacheInit   (void);
+uint8_t     Seq_Crc         (const uint32_t *pSeq, uint32_t count);
+SEQ_ENTRY_TYPE *Seq_Lookup  (uint32_t *pSeq);
+void        Seq_Prepare     (uint32_t *pSeq);
+void        Seq_Verify      (ADI_AFE_DEV_HANDLE hAfeDevice, uint32_t *pSeq);
+void        Oversample_Apply(uint32_t dur4);
+uint16_t    Oversample_Reduce(uint16_t *pSamples, uint32_t n, uint16_t *pNoise);
+void        EmitSample      (uint16_t value, uint16_t noise);
+int32_t     Sample_CurrentPa(int32_t code);
+uint32_t    Range_ScaleAa   (uint32_t range);
+bool_t      Board_SelectRtia(uint32_t range);
+void        Range_Calibrate (ADI_AFE_DEV_HANDLE hAfeDevice);
+void        Range_Select    (uint32_t range);
+void        Range_Update    (void);
+int16_t     Board_Temperature(void);
+uint16_t    Cal_Crc         (const uint8_t *pData, uint32_t len);
+bool_t      Cal_Restore     (void);
+void        Cal_Capture     (void);
+void        Cal_SaveConfig  (const uint8_t *pCfg);
+void        Cal_Write       (bool_t boot);
+int32_t     Feat_Smooth     (uint32_t n);
+void        Feat_Begin      (bool_t swv);
+void        Feat_Step       (int32_t potential);
+void        Feat_Sample     (int32_t value);
+void        Feat_Flush      (void);
+void        Feat_End        (void);
+void        Cmd_Reset       (CMD_CTX_TYPE *pCtx);
+uint8_t     Cmd_Feed        (CMD_CTX_TYPE *pCtx, uint8_t b);
+uint8_t     Cmd_Poll        (void);
+void        Cmd_Service     (void);
+void        Cmd_Status      (void);
+void        Cmd_Identify    (void);
+void        Scan_Begin      (uint8_t mode);
+void        Scan_End        (void);
+void        Thru_Update     (void);
+void        Thru_Report     (void);
+void        WE2_Voltage     (uint32_t voltage);
+void        Prof_Init       (void);
+void        Prof_Begin      (PROF_REGION_TYPE region);
+void        Prof_End        (PROF_REGION_TYPE region);
+void        Prof_Dump       (void);
+uint32_t    ScanStepDelayUs (int32_t span, int32_t scanRate, int32_t noStep);
+void        ScanStepApply   (void);
+void        Bench_Run       (ADI_AFE_DEV_HANDLE hAfeDevice);
 
  //GPIO PINS
 typedef struct {
@@ -351,8 +840,7 @@ static uint8_t dataBuffer[27];
     ADI_UART_RESULT_TYPE uartResult;
     ADI_UART_INIT_DATA   initData;
     ADI_UART_GENERIC_SETTINGS_TYPE  Settings;
-    int16_t  rxSize;
-    int16_t  txSize;
+    uint8_t  cmd;
     int16_t count = 0;
     uint32_t SWV_AMP_pkpk = 0;
     
@@ -371,6 +859,9 @@ static uint8_t dataBuffer[27];
     /* Test initialization */
     test_Init();
     
+    /* Start the cycle counter used for profiling */
+    Prof_Init();
+    
     //GPIO SETUP
     
         if (adi_GPIO_Init()) {
@@ -439,17 +930,33 @@ static uint8_t dataBuffer[27];
         FAIL("ExciteChanCalAtten");
     }
 
+#if (1 == CAL_STORE_EN)
+    /* Reuse the stored calibration while it is valid */
+    if (!Cal_Restore())
+#endif
+    {
     /* TIA Channel Calibration */
     if (ADI_AFE_SUCCESS != adi_AFE_TiaChanCal(hAfeDevice)) 
     {
         FAIL("TiaChanCal");
     }
 
+    /* Calibrate the other RTIA ranges the board can switch to */
+    Range_Calibrate(hAfeDevice);
+    
     /* Excitation Channel (no attenuation) Calibration */
     if (ADI_AFE_SUCCESS != adi_AFE_ExciteChanCalNoAtten(hAfeDevice)) 
     {
             FAIL("adi_AFE_ExciteChanCalNoAtten");
         }
+#if (1 == CAL_STORE_EN)
+    Cal_Capture();
+#endif
+    }
+#if (1 == CAL_STORE_EN)
+    /* Count the boot, also saves a fresh calibration */
+    Cal_Write(true);
+#endif
 
     /* Amperometric Measurement */
     /* Set the user programmable portions of the sequence */
@@ -528,6 +1035,9 @@ static uint8_t dataBuffer[27];
         seq_afe_ampmeas_we6[19] = dur4 * 16;
         seq_afe_ampmeas_we7[19] = dur4 * 16;
         seq_afe_ampmeas_we8[19] = dur4 * 16;
+
+    /* Extend the DAC Level 2 wait if the oversampled step does not fit */
+    Oversample_Apply(dur4);
     
     /* Set DAC Level 1 */
     seq_afe_ampmeas_we3[4]  = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, DACL1);
@@ -572,6 +1082,9 @@ static uint8_t dataBuffer[27];
         
     /* Recalculate CRC in software for the amperometric measurement */
     adi_AFE_EnableSoftwareCRC(hAfeDevice, true);
+#if (1 == SEQ_CACHE_EN)
+    Seq_CacheInit();
+#endif
 
     /* Perform the Amperometric measurement(s) */
     
@@ -598,41 +1111,42 @@ static uint8_t dataBuffer[27];
         char chem_test = 'a';
         char clean_electrode = 'n';
         
+        Cmd_Reset(&cmdCtx);
+        bootCycles = DWT->CYCCNT;
             while (terminate == 0)
         {
         ///////////////////////////////test initialisation mode/////////////////////////////////////////////
-        rxSize = 1;
-        txSize = 1;
       
         
     
-     /* Read a character */
-        uartResult = adi_UART_BufRx(hUartDevice, RxBuffer, &rxSize);
-        if (ADI_UART_SUCCESS != uartResult)
+     /* Wait for a complete command, Rx is interrupt driven and never blocks */
+        do
         {
-            test_Fail("adi_UART_BufRx() failed");
-        }
+            cmd = Cmd_Poll();
+        } while (0 == cmd);
         
   
         
 
         
-   if(RxBuffer[0] == 'n')
+#if (1 == CAL_STORE_EN)
+   /* Replay the last stored configuration */
+   if ((cmd == 'l') && (calRec.Flags & CAL_REC_CFG))
+   {
+       memcpy(cmdCtx.Payload, calRec.Cfg, CMD_CONFIG_LEN);
+       cmd = 'n';
+   }
+#endif
+   if(cmd == 'n')
         {
         
   
           
-        rxSize = 27;
-        txSize = 27;
-        
-        //rxSize = 25;
-        //txSize = 25;
         //recieve data packet for all 350 configurations
-          uartResult = adi_UART_BufRx(hUartDevice, RxBuffer, &rxSize);
-        if (ADI_UART_SUCCESS != uartResult)
-        {
-            test_Fail("adi_UART_BufRx() failed");
-        }
+        memcpy(RxBuffer, cmdCtx.Payload, CMD_CONFIG_LEN);
+#if (1 == CAL_STORE_EN)
+        Cal_SaveConfig(RxBuffer);
+#endif
         //////////////////////////////////processing input data//////////////////////////////////
         //------------------------------test type--------------------------------------//
         chem_test = RxBuffer[0];
@@ -708,6 +1222,15 @@ static uint8_t dataBuffer[27];
           V_Final = V_Final*(-1);
         }    
        
+        runCfg.Test = chem_test;
+        runCfg.VInit = V_Init;
+        runCfg.VFinal = V_Final;
+        runCfg.VStep = V_Step;
+        runCfg.ScanRate = Scan_Rate;
+        runCfg.SwvAmp = SWV_AMP;
+        runCfg.VWe2 = (RxBuffer[20] == '-') ? -(int32_t)V_WE2 : (int32_t)V_WE2;
+        runCfg.Electrode = clean_electrode;
+        
         if (RxBuffer[20] == '-')
         {
           V_WE2 = 1100 - V_WE2 - V_Init;
@@ -720,14 +1243,12 @@ static uint8_t dataBuffer[27];
         no_step = 2*((V_Final - V_Init)/V_Step);
         
           //uint32_t delay_scanr = (uint32_t)((((V_Step/10)*((9.8765432/Scan_Rate)))-0.0485)*1000000);
-     uint32_t delay_scanr = (uint32_t)(((((2*(V_Final - V_Init))/Scan_Rate)/(no_step+2))-0.0485)*1000000);//mVs (required duration of each voltage point)-(manditory 350 delay at every point)
-         
-    seq_afe_ampmeas_we3[10] = delay_scanr * 16;
-    seq_afe_ampmeas_we4[10] = delay_scanr * 16;
-    seq_afe_ampmeas_we5[10] = delay_scanr * 16;
-    seq_afe_ampmeas_we6[10] = delay_scanr * 16;
-    seq_afe_ampmeas_we7[10] = delay_scanr * 16;
-    seq_afe_ampmeas_we8[10] = delay_scanr * 16;
+     //uint32_t delay_scanr = (uint32_t)(((((2*(V_Final - V_Init))/Scan_Rate)/(no_step+2))-0.0485)*1000000);//mVs (required duration of each voltage point)-(manditory 350 delay at every point)
+    stepCfg.Valid = true;
+    stepCfg.Span = V_Final - V_Init;
+    stepCfg.Rate = Scan_Rate;
+    stepCfg.NoStep = no_step;
+    ScanStepApply();
      
         V_Fin = V_Final;
         // - to make it wrt we instead of actual ce voltage
@@ -737,19 +1258,129 @@ static uint8_t dataBuffer[27];
         
         }
         ///////////// kills 350//////////
-         else if(RxBuffer[0] == 'e')
+         else if(cmd == 'e')
         {
            terminate = 1;  
         }  
         
+        ///////////////////////////////status while idle/////////////////////////////////////
+        else if(cmd == '?')
+        {
+          Cmd_Status();
+        }
+        
+        ///////////////////////////////device identity/////////////////////////////////////
+        else if(cmd == 'i')
+        {
+          Cmd_Identify();
+        }
+        
+        ///////////////////////////////profiling counters/////////////////////////////////////
+        else if(cmd == 'p')
+        {
+          Prof_Dump();
+        }
+        
+        ///////////////////////////////throughput of the last scan/////////////////////////////////////
+        else if(cmd == 'r')
+        {
+          Thru_Report();
+        }
+        
+        ///////////////////////////////step timing benchmark/////////////////////////////////////
+        else if(cmd == 'b')
+        {
+          Scan_Begin('B');
+          Bench_Run(hAfeDevice);
+          Scan_End();
+        }
+        
+        ///////////////////////////////oversampling configuration/////////////////////////////
+        // 'o' followed by 5 bytes: mode ('m' mean, 't' trimmed mean, 'k' last-K mean),
+        // samples per step (2 digits), trim or K (2 digits)
+        else if(cmd == 'o')
+        {
+          uint8_t *osParam = cmdCtx.Payload;
+          uint32_t osCount = (uint32_t)(((osParam[1] - '0') * 10) + (osParam[2] - '0'));
+          uint32_t osArg   = (uint32_t)(((osParam[3] - '0') * 10) + (osParam[4] - '0'));
+          if (osCount < 1)
+          {
+            osCount = 1;
+          }
+          if (osCount > OVERSAMPLE_MAX)
+          {
+            osCount = OVERSAMPLE_MAX;
+          }
+          osCfg.Count = osCount;
+          if (osParam[0] == 't')
+          {
+            osCfg.Mode = REDUCE_TRIMMED_MEAN;
+            osCfg.Trim = osArg;
+          }
+          else if (osParam[0] == 'k')
+          {
+            osCfg.Mode = REDUCE_LASTK_MEAN;
+            osCfg.LastK = (osArg > 0) ? osArg : 1;
+          }
+          else
+          {
+            osCfg.Mode = REDUCE_MEAN;
+          }
+          Oversample_Apply(dur4);
+          ScanStepApply();   /* ExtraUs changed */
+        }
+        
+        ///////////////////////////////peak detection mode/////////////////////////////////////
+        //'0' raw, '1' peaks only, '2' raw and peaks
+        else if(cmd == 'f')
+        {
+          uint8_t featArg = cmdCtx.Payload[0] - '0';
+          featCtx.Mode = (featArg <= FEAT_BOTH) ? (FEAT_MODE_TYPE)featArg : FEAT_RAW;
+        }
+        
+        ///////////////////////////////result units/////////////////////////////////////
+        //'c' LPF codes, 'a' current in pA
+        else if(cmd == 'u')
+        {
+          sampleUnit = (cmdCtx.Payload[0] == 'a') ? UNIT_PA : UNIT_CODES;
+        }
+        
+        ///////////////////////////////RTIA range/////////////////////////////////////
+        //'a' automatic ranging, '0'.. fixed range
+        else if(cmd == 'g')
+        {
+          uint8_t rangeArg = cmdCtx.Payload[0];
+          rangeCtx.Auto = (rangeArg == 'a');
+          if (!rangeCtx.Auto && ((uint32_t)(rangeArg - '0') < RTIA_NUM_RANGES))
+          {
+            Range_Select(rangeArg - '0');
+          }
+          rangeCtx.Tag = rangeCtx.Auto || (0 != rangeCtx.Range);
+        }
+        
+        ///////////////////////////////CV cycles/////////////////////////////////////
+        //"01".."99" cycles per scan, anything else 1
+        else if(cmd == 'c')
+        {
+          uint32_t tens = cmdCtx.Payload[0] - '0';
+          uint32_t ones = cmdCtx.Payload[1] - '0';
+          cycleCtx.Count = ((tens < 10u) && (ones < 10u)) ? (tens * 10u) + ones : 1u;
+          if (0u == cycleCtx.Count)
+          {
+            cycleCtx.Count = 1u;
+          }
+          runCfg.Cycles = cycleCtx.Count;
+        }
+        
 
 
       
       
         
         //////////////////initialise test//////////////////////  
-        else if (RxBuffer[0] == ' ')
+        else if (cmd == ' ')
         {
+        Scan_Begin(chem_test);
                      //////////////////// //gpio lights/////////////////////////////////////////////////
         if (adi_GPIO_SetHigh(Red.Port, Red.Pins)) {
             FAIL("Test_GPIO_Polling: adi_GPIO_SetHigh failed");
@@ -763,7 +1394,7 @@ static uint8_t dataBuffer[27];
         //////////////////////////cleans electrode at V-- ///////////////////////
         { 
         
-        AD5683R_WE2_Voltage(V_WE2);
+        WE2_Voltage(V_WE2);
     
         int VL3 = V_Init;
         int VL4 = V_Init;
@@ -774,13 +1405,13 @@ static uint8_t dataBuffer[27];
         uint32_t DACL3=   ((uint32_t)(((float)VL4 / (float)DAC_LSB_SIZE) + 0x800));
 
         
-                  for (int loop =0; loop <(30); loop++){
+#if (1 == HOLD_PROGRAM_EN)
+        Hold_Run(hAfeDevice, seq_afe_ampmeas_we3, V_Init, HOLD_CLEAN_MS);
+#else
+                  for (int loop =0; !cmdCtx.ScanAbort && (loop <(30)); loop++){
 
 	
-    if (ADI_AFE_SUCCESS != adi_AFE_RunSequence(hAfeDevice, seq_afe_ampmeas_we3, (uint16_t *) dmaBuffer, SAMPLE_COUNT)) 
-    	{
-        	FAIL("adi_AFE_RunSequence");   
-    	}
+    RunStep(hAfeDevice, seq_afe_ampmeas_we3);
 
         /* Update DAC Level settings */
         DACL3 = DACL5;
@@ -799,6 +1430,7 @@ static uint8_t dataBuffer[27];
       
    
     }
+#endif
         }
           
           
@@ -812,7 +1444,7 @@ static uint8_t dataBuffer[27];
         //////////////////////////initialisation phase//////////////////////////////////////
         { 
         
-        AD5683R_WE2_Voltage(V_WE2);
+        WE2_Voltage(V_WE2);
     
         int VL3 = 0;
         int VL4 = 0;
@@ -825,13 +1457,13 @@ static uint8_t dataBuffer[27];
         
         
         
-                  for (int loop =0; loop <(10); loop++){
+#if (1 == HOLD_PROGRAM_EN)
+        Hold_Run(hAfeDevice, seq_afe_ampmeas_we4, 0, HOLD_EQUIL_MS);
+#else
+                  for (int loop =0; !cmdCtx.ScanAbort && (loop <(10)); loop++){
 
 	
-    if (ADI_AFE_SUCCESS != adi_AFE_RunSequence(hAfeDevice, seq_afe_ampmeas_we4, (uint16_t *) dmaBuffer, SAMPLE_COUNT)) 
-    	{
-        	FAIL("adi_AFE_RunSequence");   
-    	}
+    RunStep(hAfeDevice, seq_afe_ampmeas_we4);
 
         /* Update DAC Level settings */
         DACL3 = DACL5;
@@ -850,6 +1482,7 @@ static uint8_t dataBuffer[27];
       
    
     } /*End loop*/
+#endif
         ///////////////////////////////CG_CV////////////////////////////////////
             if(RxBuffer[25] == 'n')
         { 
@@ -884,21 +1517,38 @@ static uint8_t dataBuffer[27];
         seq_afe_ampmeas_we3[16] = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, DACL3);
        
        
-      AD5683R_WE2_Voltage(1100);
+      WE2_Voltage(1100);
     
-   for (int loop =0; loop < no_step +1 ; loop++){
+   /* Cycles follow each other without reinitialization, the end of a cycle */
+   /* is the start of the next. 'p' turns at no_step/2 like 'n' when        */
+   /* cycling so each cycle closes.                                         */
+   int cycles = (int)cycleCtx.Count;
+   int pTurn = (cycles > 1) ? ((no_step/2) - 1) : (no_step/2);
+   cycleCtx.Tag = (cycles > 1);
+   Feat_Begin(false);
+   for (int loop =0; !cmdCtx.ScanAbort && (loop < (cycles * no_step) +1 ); loop++){
 
 	
-    if (ADI_AFE_SUCCESS != adi_AFE_RunSequence(hAfeDevice, seq_afe_ampmeas_we3, (uint16_t *) dmaBuffer, SAMPLE_COUNT)) 
-    	{
-        	FAIL("adi_AFE_RunSequence");   
-    	}
-        AD5683R_WE2_Voltage(V_WE2);
+    int pos = (no_step > 0) ? (loop % no_step) : loop;
+    if ((no_step > 0) && (loop < cycles * no_step))
+    {
+        cycleCtx.Cycle = (uint32_t)(loop / no_step) + 1u;
+        cycleCtx.Segment = (pos <= (no_step/2)) ? 1u : 2u;
+    }
+    else
+    {
+        cycleCtx.Cycle = (uint32_t)cycles;
+        cycleCtx.Segment = 2u;
+    }
+    Feat_Step(v);
+    RunStep(hAfeDevice, seq_afe_ampmeas_we3);
+        WE2_Voltage(V_WE2);
+        PROF_BEGIN(PROF_DAC_CODE);
         /* Update DAC Level settings */
         DACL3 = DACL5;
         if(RxBuffer[25] == 'n')
         {
-        if (loop <(no_step/2))
+        if (pos <(no_step/2))
         {
         v -= V_Step;
         V_WE2 -= (uint32_t)V_Step;
@@ -912,7 +1562,7 @@ static uint8_t dataBuffer[27];
         
          if(RxBuffer[25] == 'p')  
         {
-           if (loop >(no_step/2))
+           if (pos > pTurn)
         {
         v -= V_Step;
         V_WE2 -= (uint32_t)V_Step;
@@ -930,10 +1580,13 @@ static uint8_t dataBuffer[27];
         seq_afe_ampmeas_we3[4]  = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, DACL3);
     	/* Set DAC Level 2 */
         seq_afe_ampmeas_we3[16] = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, DACL3);
+        PROF_END(PROF_DAC_CODE);
         
         
    
     } /*End loop*/
+   cycleCtx.Tag = false;
+   Feat_End();
         
        
         }
@@ -947,7 +1600,7 @@ static uint8_t dataBuffer[27];
        else if (chem_test == 'b'|| chem_test == 'd')
        {
         
-        AD5683R_WE2_Voltage(1100);
+        WE2_Voltage(1100);
     
         float VL3 = 0;
         float VL4 = 0;
@@ -958,13 +1611,13 @@ static uint8_t dataBuffer[27];
         uint32_t DACL3=   ((uint32_t)(((float)VL4 / (float)DAC_LSB_SIZE) + 0x800));
 
         
-                  for (int loop =0; loop <(10); loop++){
+#if (1 == HOLD_PROGRAM_EN)
+        Hold_Run(hAfeDevice, seq_afe_ampmeas_we3, 0, HOLD_EQUIL_MS);
+#else
+                  for (int loop =0; !cmdCtx.ScanAbort && (loop <(10)); loop++){
 
 	
-    if (ADI_AFE_SUCCESS != adi_AFE_RunSequence(hAfeDevice, seq_afe_ampmeas_we3, (uint16_t *) dmaBuffer, SAMPLE_COUNT)) 
-    	{
-        	FAIL("adi_AFE_RunSequence");   
-    	}
+    RunStep(hAfeDevice, seq_afe_ampmeas_we3);
 
         /* Update DAC Level settings */
         DACL3 = DACL5;
@@ -983,6 +1636,7 @@ static uint8_t dataBuffer[27];
       
    
     } /*End loop*/
+#endif
     
     
     
@@ -1019,31 +1673,33 @@ static uint8_t dataBuffer[27];
     	seq_afe_ampmeas_we3[16] = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, DACL7);
        
     
-   for (int loop =0; loop < (no_step/2) + 1; loop++){
+   Feat_Begin(true);
+   for (int loop =0; !cmdCtx.ScanAbort && (loop < (no_step/2) + 1); loop++){
 
 	
-    if (ADI_AFE_SUCCESS != adi_AFE_RunSequence(hAfeDevice, seq_afe_ampmeas_we3, (uint16_t *) dmaBuffer, SAMPLE_COUNT)) 
-    	{
-        	FAIL("adi_AFE_RunSequence");   
-    	}
-        AD5683R_WE2_Voltage(V_WE2);
+    Feat_Step(v);
+    RunStep(hAfeDevice, seq_afe_ampmeas_we3);
+        WE2_Voltage(V_WE2);
         
         
         
         
         
         //uint32_t DACL6= (uint32_t)(((v-(SWV_AMP_pkpk/2)) / DAC_LSB_SIZE) + 0x800);  
+        PROF_BEGIN(PROF_DAC_CODE);
         uint32_t DACL6= (uint32_t)((((v-SWV_AMP)) / DAC_LSB_SIZE) + 0x800);  
         
     	/* Set DAC Level 1 */
     	seq_afe_ampmeas_we3[4]  = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, DACL6);
     	/* Set DAC Level 2 */
     	seq_afe_ampmeas_we3[16] = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, DACL6);
+        PROF_END(PROF_DAC_CODE);
         
-         if (ADI_AFE_SUCCESS != adi_AFE_RunSequence(hAfeDevice, seq_afe_ampmeas_we3, (uint16_t *) dmaBuffer, SAMPLE_COUNT)) 
-    	{
-        	FAIL("adi_AFE_RunSequence");   
-    	}
+        if (cmdCtx.ScanAbort)
+        {
+          break;
+        }
+         RunStep(hAfeDevice, seq_afe_ampmeas_we3);
         
         
                if(RxBuffer[25] == 'n')
@@ -1060,18 +1716,21 @@ static uint8_t dataBuffer[27];
       
         
         // DACL7= (uint32_t)(((v+(SWV_AMP_pkpk/2)) / DAC_LSB_SIZE) + 0x800);
+         PROF_BEGIN(PROF_DAC_CODE);
          DACL7= (uint32_t)(((v+SWV_AMP) / DAC_LSB_SIZE) + 0x800);
     	/* Set DAC Level 1 */
         seq_afe_ampmeas_we3[4]  = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, DACL7);
     	/* Set DAC Level 2 */
         seq_afe_ampmeas_we3[16] = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, DACL7);
+        PROF_END(PROF_DAC_CODE);
    
    
     } /*End loop*/
+   Feat_End();
        }
        
         
-       AD5683R_WE2_Voltage(1100);
+       WE2_Voltage(1100);
        
     
     
@@ -1083,7 +1742,7 @@ static uint8_t dataBuffer[27];
         //////////////////////////initialisation phase//////////////////////////////////////
         { 
         
-        AD5683R_WE2_Voltage(V_WE2);
+        WE2_Voltage(V_WE2);
     
         float VL3 = 0;
         float VL4 = 0;
@@ -1097,7 +1756,10 @@ static uint8_t dataBuffer[27];
     
     
         
-        for (int loop =0; loop <(10); loop++){
+#if (1 == HOLD_PROGRAM_EN)
+        Hold_Run(hAfeDevice, seq_afe_ampmeas_we4, 0, HOLD_EQUIL_MS);
+#else
+        for (int loop =0; !cmdCtx.ScanAbort && (loop <(10)); loop++){
           
           
           /* Set DAC Level 1 */
@@ -1106,10 +1768,7 @@ static uint8_t dataBuffer[27];
         seq_afe_ampmeas_we4[16] = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, DACL5);
 
 	
-    if (ADI_AFE_SUCCESS != adi_AFE_RunSequence(hAfeDevice, seq_afe_ampmeas_we4, (uint16_t *) dmaBuffer, SAMPLE_COUNT)) 
-    	{
-        	FAIL("adi_AFE_RunSequence");   
-    	}
+    RunStep(hAfeDevice, seq_afe_ampmeas_we4);
 
       
     
@@ -1129,6 +1788,7 @@ static uint8_t dataBuffer[27];
         seq_afe_ampmeas_we4[16] = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, DACL5);
         
                   }
+#endif
         
        ///////////////////////////////Ians_Water Test////////////////////////////////////
                   
@@ -1151,16 +1811,13 @@ static uint8_t dataBuffer[27];
     
 //Initialise SPI in 350
 
-      AD5683R_WE2_Voltage(1100);
+      WE2_Voltage(1100);
     
-   for (float loop =0; loop < no_step + 1; loop++){
+   for (float loop =0; !cmdCtx.ScanAbort && (loop < no_step + 1); loop++){
 
 	
-    if (ADI_AFE_SUCCESS != adi_AFE_RunSequence(hAfeDevice, seq_afe_ampmeas_we3, (uint16_t *) dmaBuffer, SAMPLE_COUNT)) 
-    	{
-        	FAIL("adi_AFE_RunSequence");   
-    	}
-        AD5683R_WE2_Voltage(V_DAC);
+    RunStep(hAfeDevice, seq_afe_ampmeas_we3);
+        WE2_Voltage(V_DAC);
         /* Update DAC Level settings */
         DACL3 = DACL5;
         
@@ -1208,16 +1865,13 @@ static uint8_t dataBuffer[27];
       DACL3=   (uint32_t)((V_350 / DAC_LSB_SIZE) + 0x800);
 //Initialise SPI in 350
 
-      AD5683R_WE2_Voltage(1100);
+      WE2_Voltage(1100);
     
-   for (float loop =0; loop < no_step + 1; loop++){
+   for (float loop =0; !cmdCtx.ScanAbort && (loop < no_step + 1); loop++){
 
 	
-    if (ADI_AFE_SUCCESS != adi_AFE_RunSequence(hAfeDevice, seq_afe_ampmeas_we3, (uint16_t *) dmaBuffer, SAMPLE_COUNT)) 
-    	{
-        	FAIL("adi_AFE_RunSequence");   
-    	}
-        AD5683R_WE2_Voltage(V_DAC);
+    RunStep(hAfeDevice, seq_afe_ampmeas_we3);
+        WE2_Voltage(V_DAC);
         /* Update DAC Level settings */
         DACL3 = DACL5;
         
@@ -1259,6 +1913,7 @@ static uint8_t dataBuffer[27];
                 if (adi_GPIO_SetHigh(Green.Port, Green.Pins)) {
             FAIL("Test_GPIO_Polling: adi_GPIO_SetHigh failed");
         }
+        Scan_End();
     }
     
     
@@ -1267,7 +1922,7 @@ static uint8_t dataBuffer[27];
     
     
     
-    AD5683R_WE2_Voltage(1100);
+    WE2_Voltage(1100);
     
     
     
@@ -1309,18 +1964,21 @@ static uint8_t dataBuffer[27];
  *              pBuffer     Pointer to the buffer containing the LPF results
  *              
  *
- * @details     16-bit results are converted to bytes and transferred using the UART
+ * @details     16-bit results of each step are reduced to one value and
+ *              transferred using the UART
  *
  */
 void RxDmaCB(void *hAfeDevice, uint32_t length, void *pBuffer)
 {
 #if (1 == USE_UART_FOR_DATA)
-    char                    msg[MSG_MAXLEN];
     uint32_t                i;
     uint16_t                *ppBuffer = (uint16_t*)pBuffer;
+    uint16_t                value;
+    uint16_t                noise;
     //float                   current;
+    uint32_t                cbStart = DWT->CYCCNT;
     
-    
+    PROF_BEGIN(PROF_RX_DMA_CB);
     
     /* Check if there are samples to be sent */
     if (length)
@@ -1328,20 +1986,32 @@ void RxDmaCB(void *hAfeDevice, uint32_t length, void *pBuffer)
       
         for (i = 0; i < length; i++)
         {
-          //int jj = 0 ;
-          
-              /**ppBuffer = (*ppBuffer-32768);*/
-              //current = (float)*ppBuffer;
-              //current = (current - 32768.0); 
-             // sprintf(msg, "%f\r\n", current++);
-              sprintf(msg, "%u ", *ppBuffer++);
-              PRINT(msg);
-              //for (jj = 0; jj < 10000; jj++);
-
-          
+            /* Collect the samples of the current step, a DMA transfer may */
+            /* hold a whole step or be split over several callbacks        */
+            if (osFill < OVERSAMPLE_MAX)
+            {
+                osSamples[osFill] = *ppBuffer;
+            }
+            if ((*ppBuffer < ADC_SAT_MARGIN) || (*ppBuffer > (0xFFFF - ADC_SAT_MARGIN)))
+            {
+                rangeCtx.StepSat = true;
+            }
+            ppBuffer++;
+            osFill++;
+            
+            if (osFill >= osCfg.Count)
+            {
+                value = Oversample_Reduce(osSamples, osFill, &noise);
+                osValue = value;
+                osNoise = noise;
+                osReady = true;
+                osFill = 0;
+            }
         }
       
     }
+    PROF_END(PROF_RX_DMA_CB);
+    thruCtx.CbCycles += DWT->CYCCNT - cbStart;
 
 #elif (0 == USE_UART_FOR_DATA)
     FAIL("Std. Output is too slow for ADC/LPF data. Use UART instead.");
@@ -1351,34 +2021,1521 @@ void RxDmaCB(void *hAfeDevice, uint32_t length, void *pBuffer)
     
 }
 
-/* Helper function for printing a string to UART or Std. Output */
-void test_print (char *pBuffer) {
-#if (1 == USE_UART_FOR_DATA)
-    int16_t size;
-    /* Print to UART */
-    size = strlen(pBuffer);
-    adi_UART_BufTx(hUartDevice, pBuffer, &size);
+/*!
+ * @brief       Run one voltage step sequence.
+ *
+ * @param[in]   hAfeDevice  Device handle obtained from adi_AFE_Init()
+ *              pSeq        Step sequence to run
+ *
+ * @details     Captures osCfg.Count LPF samples, RxDmaCB reduces them to a
+ *              single value for the step which is sent once the sequence
+ *              completes. Commands received meanwhile are serviced then too.
+ *
+ */
+void RunStep(ADI_AFE_DEV_HANDLE hAfeDevice, uint32_t *pSeq)
+{
+    uint32_t    start;
     
+    osFill = 0;
+    osReady = false;
+    if (benchCtx.Active && (benchCtx.Fill < BENCH_STEPS))
+    {
+        benchCtx.Stamp[benchCtx.Fill++] = DWT->CYCCNT;
+    }
+    Thru_Update();
+    thruCtx.CbCycles = 0;
+    start = DWT->CYCCNT;
+    PROF_BEGIN(PROF_RUN_SEQUENCE);
+#if (1 == SEQ_CACHE_EN)
+    Seq_Prepare(pSeq);
+#endif
+    if (ADI_AFE_SUCCESS != adi_AFE_RunSequence(hAfeDevice, pSeq, (uint16_t *) dmaBuffer, osCfg.Count)) 
+    {
+        FAIL("adi_AFE_RunSequence");
+    }
+#if (1 == SEQ_CACHE_EN)
+    Seq_Verify(hAfeDevice, pSeq);
+#endif
+    PROF_END(PROF_RUN_SEQUENCE);
+    
+    /* Time in adi_AFE_RunSequence not spent in RxDmaCB is sequencer wait */
+    Thru_Update();
+    if (thruCtx.Active)
+    {
+        thruCtx.Idle += (uint32_t)(thruCtx.LastCyc - start) - thruCtx.CbCycles;
+    }
+    cmdCtx.ScanStep++;
     
-#elif (0 == USE_UART_FOR_DATA)
-    /* Print  to console */
-    printf(pBuffer);
- 
-#endif /* USE_UART_FOR_DATA */
+    if (osReady)
+    {
+        osReady = false;
+        EmitSample(osValue, osNoise);
+    }
+    Range_Update();
+    
+    /* Honor abort/status received during the step */
+    Cmd_Service();
 }
 
-/* Initialize the UART, set the baud rate and enable */
-ADI_UART_RESULT_TYPE uart_Init (void) {
-    ADI_UART_RESULT_TYPE    result = ADI_UART_SUCCESS;
+/* Write the same command word into all working electrode sequences */
+void SeqSetAll(uint32_t index, uint32_t value)
+{
+    seq_afe_ampmeas_we3[index] = value;
+    seq_afe_ampmeas_we4[index] = value;
+    seq_afe_ampmeas_we5[index] = value;
+    seq_afe_ampmeas_we6[index] = value;
+    seq_afe_ampmeas_we7[index] = value;
+    seq_afe_ampmeas_we8[index] = value;
+}
+
+/*!
+ * @brief       Hold a potential on the electrode of a step sequence.
+ *
+ * @param[in]   hAfeDevice  Device handle obtained from adi_AFE_Init()
+ *              pSeq        Step sequence giving the electrode switches
+ *              mV          Potential to hold
+ *              ms          Hold duration
+ *
+ * @details     seq_warm_afe_ampmeas takes the mux and IVS words of pSeq
+ *              and the DAC code of mV, the hold itself is the wait before
+ *              ADC_CONV_EN so the captured result is the current at the end.
+ *              Holds longer than HOLD_CHUNK_US, or HOLD_STABLE_US with a
+ *              stability criterion, run as several back to back chunks.
+ *
+ */
+void Hold_Run(ADI_AFE_DEV_HANDLE hAfeDevice, uint32_t *pSeq, int32_t mV, uint32_t ms)
+{
+    char        msg[MSG_MAXLEN];
+    uint32_t    code = (uint32_t)(((float)mV / (float)DAC_LSB_SIZE) + 0x800);
+    uint32_t    captureUs = osCfg.Count * LPF_SAMPLE_PERIOD_US;
+    uint32_t    chunkMax = (0 != HOLD_STABLE_PA) ? HOLD_STABLE_US : HOLD_CHUNK_US;
+    uint64_t    remaining = (uint64_t)ms * 1000u;
+    uint64_t    cycles = 0;
+    uint32_t    chunk;
+    uint32_t    start;
+    int32_t     current = 0;
+    int32_t     last = 0;
+    uint32_t    n = 0;
+    const char *pEnd = "time";
+    
+    seq_warm_afe_ampmeas[4]  = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, code);
+    seq_warm_afe_ampmeas[7]  = pSeq[7];
+    seq_warm_afe_ampmeas[13] = captureUs * 16;
+    seq_warm_afe_ampmeas[14] = pSeq[14];
+    seq_warm_afe_ampmeas[15] = 0;
+    seq_warm_afe_ampmeas[16] = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, code);
+    seq_warm_afe_ampmeas[17] = 0;
+    seq_warm_afe_ampmeas[18] = pSeq[18];
+    seq_warm_afe_ampmeas[19] = 0;
+    
+    holdCtx.Active = true;
+    while ((remaining > 0) && !cmdCtx.ScanAbort)
+    {
+        chunk = (remaining > chunkMax) ? chunkMax : (uint32_t)remaining;
+        remaining -= chunk;
+        /* 200us minimum between WG_EN and ADC_CONV_EN as in the step sequences */
+        seq_warm_afe_ampmeas[10] = ((chunk > HOLD_SEQ_OVERHEAD_US + captureUs + 200u) ?
+                                    (chunk - HOLD_SEQ_OVERHEAD_US - captureUs) : 200u) * 16;
+        start = DWT->CYCCNT;
+        RunStep(hAfeDevice, seq_warm_afe_ampmeas);
+        cycles += DWT->CYCCNT - start;
+        current = Sample_CurrentPa(holdCtx.Value);
+        if ((0 != HOLD_STABLE_PA) && (n > 0) &&
+            (((current > last) ? (current - last) : (last - current)) <= HOLD_STABLE_PA))
+        {
+            pEnd = "stable";
+            break;
+        }
+        last = current;
+        n++;
+    }
+    holdCtx.Active = false;
+    if (cmdCtx.ScanAbort)
+    {
+        pEnd = "abort";
+    }
+    sprintf(msg, "HOLD,%d,%u,%d,%s\r\n", mV, (uint32_t)(cycles / (CORE_CLOCK_HZ / 1000u)), current, pEnd);
+    PRINT(msg);
+}
+
+#if (1 == SEQ_CACHE_EN)
+/*!
+ * @brief       Build the byte table of the sequencer CRC-8.
+ */
+void Seq_CacheInit(void)
+{
+    uint8_t     crc;
+    
+    for (uint32_t i = 0; i < 256u; i++)
+    {
+        crc = (uint8_t)i;
+        for (uint32_t b = 0; b < 8u; b++)
+        {
+            crc = (crc & 0x80u) ? (uint8_t)((crc << 1) ^ SEQ_CRC_POLY) : (uint8_t)(crc << 1);
+        }
+        seqCache.Table[i] = crc;
+    }
+    seqCache.State = SEQ_CACHE_CHECK;
+    seqCache.Num = 0;
+    seqCache.Patched = 0;
+}
+
+/* CRC-8 of one command word, continuing from crc */
+static uint8_t Seq_CrcWord(uint8_t crc, uint32_t word)
+{
+    crc = seqCache.Table[crc ^ (uint8_t)(word >> 24)];
+    crc = seqCache.Table[crc ^ (uint8_t)(word >> 16)];
+    crc = seqCache.Table[crc ^ (uint8_t)(word >> 8)];
+    return seqCache.Table[crc ^ (uint8_t)word];
+}
+
+/*!
+ * @brief       Full CRC-8 of the commands of a sequence.
+ *
+ * @param[in]   pSeq        Sequence, pSeq[0] is the safety word
+ *              count       Commands after the safety word
+ */
+uint8_t Seq_Crc(const uint32_t *pSeq, uint32_t count)
+{
+    uint8_t     crc = SEQ_CRC_SEED;
+    
+    for (uint32_t i = 1; i <= count; i++)
+    {
+        crc = Seq_CrcWord(crc, pSeq[i]);
+    }
+    return crc;
+}
+
+/*!
+ * @brief       Find a resident sequence, making it resident on first use.
+ *
+ * @return      Cache entry, NULL if the cache is full or the sequence too long.
+ *
+ * @details     A new entry gets its full CRC and the Col tables. The CRC is
+ *              linear in the commands, a change d at command i moves the
+ *              final CRC by the CRC of d (zero seed) shifted through the
+ *              Count - i following commands. Col[i] holds that shift for
+ *              each bit, so patching a word costs 4 table lookups and at
+ *              most 8 XORs wherever it is in the sequence.
+ */
+SEQ_ENTRY_TYPE *Seq_Lookup(uint32_t *pSeq)
+{
+    SEQ_ENTRY_TYPE *pEntry;
+    uint32_t        count = SEQ_SAFETY_COUNT(pSeq[0]);
+    uint8_t         col;
+    
+    for (uint32_t e = 0; e < seqCache.Num; e++)
+    {
+        if (seqCache.Entry[e].pSeq == pSeq)
+        {
+            return &seqCache.Entry[e];
+        }
+    }
+    if ((seqCache.Num >= SEQ_CACHE_MAX) || (count >= SEQ_CACHE_WORDS))
+    {
+        return NULL;
+    }
+    pEntry = &seqCache.Entry[seqCache.Num++];
+    pEntry->pSeq = pSeq;
+    pEntry->Count = count;
+    memcpy(pEntry->Shadow, pSeq, (count + 1u) * sizeof(uint32_t));
+    pEntry->Crc = Seq_Crc(pSeq, count);
+    for (uint32_t b = 0; b < 8u; b++)
+    {
+        col = (uint8_t)(1u << b);
+        for (uint32_t i = count; i >= 1u; i--)
+        {
+            pEntry->Col[i][b] = col;
+            col = Seq_CrcWord(col, 0u);
+        }
+    }
+    return pEntry;
+}
+
+/*!
+ * @brief       Bring the cached CRC of a sequence up to date before a step.
+ *
+ * @param[in]   pSeq        Step sequence about to run
+ *
+ * @details     Words differing from the shadow copy are patched into the
+ *              CRC. Once the self-check passed the CRC is written to the
+ *              safety word, the driver no longer recomputes it.
+ */
+void Seq_Prepare(uint32_t *pSeq)
+{
+    SEQ_ENTRY_TYPE *pEntry;
+    uint8_t         d;
+    
+    if (SEQ_CACHE_OFF == seqCache.State)
+    {
+        return;
+    }
+    pEntry = Seq_Lookup(pSeq);
+    if (NULL == pEntry)
+    {
+        /* Not resident, the driver CRC may already be off */
+        if (SEQ_CACHE_ON == seqCache.State)
+        {
+            pSeq[0] = (pSeq[0] & ~SEQ_SAFETY_CRC_MASK) | Seq_Crc(pSeq, SEQ_SAFETY_COUNT(pSeq[0]));
+        }
+        return;
+    }
+    for (uint32_t i = 1; i <= pEntry->Count; i++)
+    {
+        if (pSeq[i] != pEntry->Shadow[i])
+        {
+            d = Seq_CrcWord(0u, pSeq[i] ^ pEntry->Shadow[i]);
+            for (uint32_t b = 0; d != 0u; b++, d >>= 1)
+            {
+                if (d & 1u)
+                {
+                    pEntry->Crc ^= pEntry->Col[i][b];
+                }
+            }
+            pEntry->Shadow[i] = pSeq[i];
+            seqCache.Patched++;
+        }
+    }
+#if (1 == SEQ_CACHE_SELFTEST)
+    if (pEntry->Crc != Seq_Crc(pSeq, pEntry->Count))
+    {
+        FAIL("Seq_Prepare: patched CRC differs from full CRC");
+    }
+#endif
+    if (SEQ_CACHE_ON == seqCache.State)
+    {
+        pSeq[0] = (pSeq[0] & ~SEQ_SAFETY_CRC_MASK) | pEntry->Crc;
+    }
+}
+
+/*!
+ * @brief       Self-check of the cached CRC after the first step.
+ *
+ * @details     The first step runs with the driver software CRC, the CRC
+ *              the sequencer computed must equal the cached one. Then the
+ *              driver CRC is switched off, otherwise the cache is.
+ */
+void Seq_Verify(ADI_AFE_DEV_HANDLE hAfeDevice, uint32_t *pSeq)
+{
+    SEQ_ENTRY_TYPE *pEntry;
+    
+    if (SEQ_CACHE_CHECK != seqCache.State)
+    {
+        return;
+    }
+    pEntry = Seq_Lookup(pSeq);
+    if ((NULL != pEntry) && ((pADI_AFE->AFE_SEQ_CRC & SEQ_SAFETY_CRC_MASK) == pEntry->Crc))
+    {
+        seqCache.State = SEQ_CACHE_ON;
+        adi_AFE_EnableSoftwareCRC(hAfeDevice, false);
+    }
+    else
+    {
+        seqCache.State = SEQ_CACHE_OFF;
+        PRINT("Sequence CRC self-check failed, using driver CRC\r\n");
+    }
+}
+#endif /* SEQ_CACHE_EN */
+
+/*!
+ * @brief       Fit the oversampled step into the step sequences.
+ *
+ * @param[in]   dur4        Nominal DAC Level 2 wait in us
+ *
+ * @details     Samples are captured from ADC_CONV_EN onwards. Up to
+ *              STEP_CAPTURE_WINDOW_US / LPF_SAMPLE_PERIOD_US samples fit the
+ *              existing sequence, beyond that the DAC Level 2 wait is extended.
+ *              The extension is kept in osCfg.ExtraUs so the scan rate delay
+ *              can be shortened by the same amount.
+ *
+ */
+void Oversample_Apply(uint32_t dur4)
+{
+    uint32_t captureUs = osCfg.Count * LPF_SAMPLE_PERIOD_US;
+    
+    osCfg.ExtraUs = 0;
+    if (captureUs > STEP_CAPTURE_WINDOW_US)
+    {
+        osCfg.ExtraUs = captureUs - STEP_CAPTURE_WINDOW_US;
+    }
+    SeqSetAll(19, (dur4 + osCfg.ExtraUs) * 16);
+}
+
+/*!
+ * @brief       Reduce the samples of one step to a single value.
+ *
+ * @param[in]   pSamples    LPF results of the step, sorted in place for the
+ *                          trimmed mean
+ *              n           Number of samples captured
+ * @param[out]  pNoise      Standard deviation of the samples used, in codes
+ *
+ * @return      Reduced LPF code
+ *
+ */
+uint16_t Oversample_Reduce(uint16_t *pSamples, uint32_t n, uint16_t *pNoise)
+{
+    uint32_t    first = 0;
+    uint32_t    last;
+    uint32_t    i, j;
+    uint32_t    sum = 0;
+    float       mean;
+    float       var = 0;
+    float       diff;
+    uint16_t    tmp;
+    
+    if (n > OVERSAMPLE_MAX)
+    {
+        n = OVERSAMPLE_MAX;
+    }
+    last = n;
     
-    /* Open UART in blocking, non-intrrpt mode by supplying no internal buffs */
-    if (ADI_UART_SUCCESS != (result = adi_UART_Init(ADI_UART_DEVID_0, &hUartDevice, NULL)))
+    if (REDUCE_TRIMMED_MEAN == osCfg.Mode)
+    {
+        /* Insertion sort, n is small */
+        for (i = 1; i < n; i++)
+        {
+            tmp = pSamples[i];
+            for (j = i; (j > 0) && (pSamples[j - 1] > tmp); j--)
+            {
+                pSamples[j] = pSamples[j - 1];
+            }
+            pSamples[j] = tmp;
+        }
+        if ((2 * osCfg.Trim) < n)
+        {
+            first = osCfg.Trim;
+            last = n - osCfg.Trim;
+        }
+    }
+    else if (REDUCE_LASTK_MEAN == osCfg.Mode)
+    {
+        if (osCfg.LastK < n)
+        {
+            first = n - osCfg.LastK;
+        }
+    }
+    
+    for (i = first; i < last; i++)
+    {
+        sum += pSamples[i];
+    }
+    mean = (float)sum / (float)(last - first);
+    for (i = first; i < last; i++)
+    {
+        diff = (float)pSamples[i] - mean;
+        var += diff * diff;
+    }
+    var /= (float)(last - first);
+    
+    *pNoise = (uint16_t)(sqrtf(var) + 0.5f);
+    return (uint16_t)(mean + 0.5f);
+}
+
+/*!
+ * @brief       Send the result of one step.
+ *
+ * @param[in]   value       Reduced LPF code
+ *              noise       Standard deviation of the step, in codes
+ *
+ * @details     Without oversampling the legacy "<code> " format is kept,
+ *              otherwise "<code>,<noise> " is sent.
+ *
+ */
+void EmitSample(uint16_t value, uint16_t noise)
+{
+    char                    msg[MSG_MAXLEN];
+    
+    if (holdCtx.Active)
+    {
+        holdCtx.Value = value;
+        return;
+    }
+    if (thruCtx.Active && (0 == thruCtx.Points++))
+    {
+        Thru_Update();
+        thruCtx.FirstResult = thruCtx.Elapsed;
+    }
+    /* Before the peaks only return, autoranging still needs it */
+    rangeCtx.StepUnder = ((value > ADC_ZERO_CODE - ADC_UNDER_CODES) && (value < ADC_ZERO_CODE + ADC_UNDER_CODES));
+    if (featCtx.Active)
+    {
+        Feat_Sample(value);
+        if (FEAT_PEAKS == featCtx.Mode)
+        {
+            return;
+        }
+    }
+    if (UNIT_PA == sampleUnit)
+    {
+        if (osCfg.Count > 1)
+        {
+            sprintf(msg, "%d,%d ", Sample_CurrentPa(value), Sample_CurrentPa(ADC_ZERO_CODE + noise));
+        }
+        else
+        {
+            sprintf(msg, "%d ", Sample_CurrentPa(value));
+        }
+    }
+    else if (osCfg.Count > 1)
+    {
+        sprintf(msg, "%u,%u ", value, noise);
+    }
+    else
+    {
+        sprintf(msg, "%u ", value);
+    }
+    if (rangeCtx.Tag)
+    {
+        /* "<result>:<range> ", '!' marks a saturated step */
+        sprintf(msg + strlen(msg) - 1, ":%u%s ", rangeCtx.Range, rangeCtx.StepSat ? "!" : "");
+    }
+    if (cycleCtx.Tag)
+    {
+        sprintf(msg + strlen(msg) - 1, "@%u.%u ", cycleCtx.Cycle, cycleCtx.Segment);
+    }
+    PRINT(msg);
+}
+
+/* Convert a calibrated LPF code of the selected range to the WE1 current in pA */
+int32_t Sample_CurrentPa(int32_t code)
+{
+    int64_t     aa = (int64_t)(code - ADC_ZERO_CODE) * (int64_t)rangeCtx.ScaleAa;
+    
+    /* Rounded to the nearest pA */
+    return (int32_t)((aa + ((aa < 0) ? -500000 : 500000)) / 1000000);
+}
+
+/*!
+ * @brief       Current per code of a range.
+ *
+ * @param[in]   range       Index into RTIA_RANGES
+ *
+ * @return      Current of one calibrated code in aA, 0 if the range is not calibrated
+ *
+ * @details     span / 2^16 / RTIA of the range. Its TIA calibration makes
+ *              the codes fit that nominal RTIA, so an uncalibrated range has
+ *              no scale.
+ *
+ */
+uint32_t Range_ScaleAa(uint32_t range)
+{
+    if ((range >= RTIA_NUM_RANGES) || !rangeCtx.Cal[range].Valid)
+    {
+        return 0;
+    }
+    return (uint32_t)(((uint64_t)ADC_SPAN_MV * 1000000000000000ull / 65536u + rtiaRanges[range] / 2u) /
+                      rtiaRanges[range]);
+}
+
+/*!
+ * @brief       Board hook switching the external RTIA.
+ *
+ * @param[in]   range       Index into RTIA_RANGES
+ *
+ * @return      true if the board now uses that range
+ *
+ * @details     The default only has the boot RTIA fitted. Boards with an
+ *              RTIA switch override this function.
+ *
+ */
+__weak bool_t Board_SelectRtia(uint32_t range)
+{
+    return (0 == range);
+}
+
+/* Run the TIA channel calibration for every range the board supports and keep the results */
+void Range_Calibrate(ADI_AFE_DEV_HANDLE hAfeDevice)
+{
+    uint32_t    r;
+    
+    for (r = 0; r < RTIA_NUM_RANGES; r++)
+    {
+        rangeCtx.Cal[r].Valid = false;
+        if (!Board_SelectRtia(r))
+        {
+            continue;
+        }
+        if (r > 0)
+        {
+            if ((ADI_AFE_SUCCESS != adi_AFE_SetRtia(hAfeDevice, rtiaRanges[r])) ||
+                (ADI_AFE_SUCCESS != adi_AFE_TiaChanCal(hAfeDevice)))
+            {
+                continue;
+            }
+        }
+        rangeCtx.Cal[r].Gain = pADI_AFE->AFE_ADC_GAIN_TIA;
+        rangeCtx.Cal[r].Offset = pADI_AFE->AFE_ADC_OFFSET_TIA;
+        rangeCtx.Cal[r].Valid = true;
+    }
+    
+    /* Back to the boot RTIA */
+    adi_AFE_SetRtia(hAfeDevice, rtiaRanges[0]);
+    Range_Select(0);
+}
+
+/* Switch to a calibrated range between steps */
+void Range_Select(uint32_t range)
+{
+    if ((range >= RTIA_NUM_RANGES) || !rangeCtx.Cal[range].Valid || !Board_SelectRtia(range))
+    {
+        return;
+    }
+    pADI_AFE->AFE_ADC_GAIN_TIA = rangeCtx.Cal[range].Gain;
+    pADI_AFE->AFE_ADC_OFFSET_TIA = rangeCtx.Cal[range].Offset;
+    rangeCtx.Range = range;
+    rangeCtx.ScaleAa = Range_ScaleAa(range);
+    rangeCtx.UnderCount = 0;
+}
+
+/*!
+ * @brief       Automatic ranging after a step.
+ *
+ * @details     A saturated step moves to the next lower RTIA at once, a run
+ *              of AUTORANGE_UNDER_STEPS small steps to the next higher one.
+ *
+ */
+void Range_Update(void)
+{
+    if (rangeCtx.Auto)
+    {
+        if (rangeCtx.StepSat)
+        {
+            Range_Select(rangeCtx.Range + 1);
+        }
+        else if (rangeCtx.StepUnder && (rangeCtx.Range > 0))
+        {
+            if (++rangeCtx.UnderCount >= AUTORANGE_UNDER_STEPS)
+            {
+                Range_Select(rangeCtx.Range - 1);
+            }
+        }
+        else
+        {
+            rangeCtx.UnderCount = 0;
+        }
+    }
+    rangeCtx.StepSat = false;
+    rangeCtx.StepUnder = false;
+}
+
+#if (1 == CAL_STORE_EN)
+/*!
+ * @brief       Board temperature for the calibration store.
+ *
+ * @return      Temperature in 0.1 C, CAL_TEMP_UNKNOWN if not measured
+ *
+ * @details     The default has no sensor, the stored calibration then only
+ *              ages with CAL_MAX_BOOTS. Boards with a sensor override this
+ *              function.
+ *
+ */
+__weak int16_t Board_Temperature(void)
+{
+    return CAL_TEMP_UNKNOWN;
+}
+
+/* CRC-16/CCITT (0x1021, init 0xFFFF) of a calibration record */
+uint16_t Cal_Crc(const uint8_t *pData, uint32_t len)
+{
+    uint16_t    crc = 0xFFFFu;
+    uint32_t    i;
+    uint32_t    b;
+    
+    for (i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t)pData[i] << 8;
+        for (b = 0; b < 8; b++)
+        {
+            crc = (crc & 0x8000u) ? (uint16_t)((crc << 1) ^ 0x1021u) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static ADI_FEE_DEV_HANDLE   hFeeDevice = NULL;
+
+/*!
+ * @brief       Load the newest record of the calibration store and apply
+ *              its calibration if still valid.
+ *
+ * @return      true if the boot calibrations can be skipped
+ *
+ * @details     Both pages are scanned for the record with a good CRC and
+ *              the highest Seq. The calibration is valid for the same
+ *              firmware version, fewer than CAL_MAX_BOOTS boots after it
+ *              was made and, when both are known, a temperature within
+ *              CAL_MAX_DTEMP.
+ *
+ */
+bool_t Cal_Restore(void)
+{
+    const CAL_REC_TYPE  *pRec;
+    uint32_t            addr;
+    uint32_t            page;
+    int16_t             temp;
+    uint32_t            r;
+    
+    if ((NULL == hFeeDevice) && (ADI_FEE_SUCCESS != adi_FEE_Init(ADI_FEE_DEVID_GP, true, &hFeeDevice)))
+    {
+        hFeeDevice = NULL;
+        return false;
+    }
+    memset(&calRec, 0, sizeof(calRec));
+    calAddr = 0;
+    /* Records start at the base of their page, a page is not a multiple    */
+    /* of the record size                                                   */
+    for (page = 0; page < 2u; page++)
+    {
+        for (addr = CAL_STORE_BASE + page * CAL_STORE_PAGE_SIZE;
+             addr + sizeof(CAL_REC_TYPE) <= CAL_STORE_BASE + (page + 1u) * CAL_STORE_PAGE_SIZE;
+             addr += sizeof(CAL_REC_TYPE))
+        {
+            pRec = (const CAL_REC_TYPE *)addr;
+            if ((CAL_REC_MAGIC == pRec->Magic) &&
+                (pRec->Crc == Cal_Crc((const uint8_t *)pRec, offsetof(CAL_REC_TYPE, Crc))) &&
+                ((0 == calAddr) || (pRec->Seq > calRec.Seq)))
+            {
+                memcpy(&calRec, pRec, sizeof(calRec));
+                calAddr = addr;
+            }
+        }
+    }
+    if ((0 == calAddr) || !(calRec.Flags & CAL_REC_CAL) ||
+        (0 != strncmp(calRec.FwVersion, FW_VERSION, sizeof(calRec.FwVersion))) ||
+        (calRec.Boots + 1u - calRec.CalBoot >= CAL_MAX_BOOTS))     /* this boot counts */
+    {
+        return false;
+    }
+    temp = Board_Temperature();
+    if ((CAL_TEMP_UNKNOWN != temp) && (CAL_TEMP_UNKNOWN != calRec.CalTemp) &&
+        ((temp - calRec.CalTemp > CAL_MAX_DTEMP) || (calRec.CalTemp - temp > CAL_MAX_DTEMP)))
+    {
+        return false;
+    }
+    
+    for (r = 0; r < RTIA_NUM_RANGES; r++)
+    {
+        rangeCtx.Cal[r].Gain = calRec.TiaGain[r];
+        rangeCtx.Cal[r].Offset = calRec.TiaOffset[r];
+        rangeCtx.Cal[r].Valid = (0 != (calRec.TiaValid & (1u << r)));
+    }
+    Range_Select(0);
+    pADI_AFE->AFE_DAC_OFFSET_UNITY = calRec.DacOffset;
+    pADI_AFE->AFE_DAC_GAIN = calRec.DacGain;
+    return true;
+}
+
+/* Copy the results of the boot calibrations into the record */
+void Cal_Capture(void)
+{
+    uint32_t    r;
+    
+    calRec.TiaValid = 0;
+    for (r = 0; r < RTIA_NUM_RANGES; r++)
+    {
+        calRec.TiaGain[r] = rangeCtx.Cal[r].Gain;
+        calRec.TiaOffset[r] = rangeCtx.Cal[r].Offset;
+        if (rangeCtx.Cal[r].Valid)
+        {
+            calRec.TiaValid |= (1u << r);
+        }
+    }
+    calRec.DacOffset = pADI_AFE->AFE_DAC_OFFSET_UNITY;
+    calRec.DacGain = pADI_AFE->AFE_DAC_GAIN;
+    calRec.CalBoot = calRec.Boots + 1u;     /* the boot Cal_Write(true) counts */
+    calRec.CalTemp = Board_Temperature();
+    calRec.Flags |= CAL_REC_CAL;
+}
+
+/* Store a new 'n' configuration, unchanged ones cost no flash write */
+void Cal_SaveConfig(const uint8_t *pCfg)
+{
+    if ((calRec.Flags & CAL_REC_CFG) && (0 == memcmp(calRec.Cfg, pCfg, CMD_CONFIG_LEN)))
+    {
+        return;
+    }
+    memcpy(calRec.Cfg, pCfg, CMD_CONFIG_LEN);
+    calRec.Flags |= CAL_REC_CFG;
+    Cal_Write(false);
+}
+
+/*!
+ * @brief       Write calRec as the next record of the calibration store.
+ *
+ * @details     Records are appended behind the current one. When its page
+ *              is full the other page is erased and the record starts it,
+ *              so the current record always survives an interrupted write.
+ *
+ * @param[in]   boot        Count a boot in the record
+ *
+ */
+void Cal_Write(bool_t boot)
+{
+    uint32_t    addr;
+    uint32_t    page;
+    
+    if (NULL == hFeeDevice)
+    {
+        return;
+    }
+    page = (calAddr - CAL_STORE_BASE) / CAL_STORE_PAGE_SIZE;
+    addr = calAddr + sizeof(CAL_REC_TYPE);
+    if ((0 == calAddr) ||
+        (addr + sizeof(CAL_REC_TYPE) > CAL_STORE_BASE + (page + 1u) * CAL_STORE_PAGE_SIZE) ||
+        (0xFFFFFFFFu != *(const uint32_t *)addr))
+    {
+        /* no erased room behind the current record, start the other page */
+        page = calAddr ? 1u - page : 0u;
+        addr = CAL_STORE_BASE + page * CAL_STORE_PAGE_SIZE;
+        if (ADI_FEE_SUCCESS != adi_FEE_PageErase(hFeeDevice, addr / CAL_STORE_PAGE_SIZE))
+        {
+            return;
+        }
+    }
+    calRec.Magic = CAL_REC_MAGIC;
+    calRec.Seq++;
+    if (boot)
+    {
+        calRec.Boots++;
+    }
+    strncpy(calRec.FwVersion, FW_VERSION, sizeof(calRec.FwVersion));
+    calRec.Crc = Cal_Crc((const uint8_t *)&calRec, offsetof(CAL_REC_TYPE, Crc));
+    if (ADI_FEE_SUCCESS == adi_FEE_Write(hFeeDevice, addr, (uint8_t *)&calRec, sizeof(calRec)))
+    {
+        calAddr = addr;
+    }
+}
+#endif /* CAL_STORE_EN */
+
+/*!
+ * @brief       Smooth the peak detector window.
+ *
+ * @param[in]   n           Window length, Win[0] is the newest sample
+ *
+ * @return      Smoothed value at the window centre
+ *
+ * @details     Integer Savitzky-Golay (quadratic) for 5, 7 and 9 points
+ *              with FEAT_SMOOTH_SG, moving average otherwise.
+ *
+ */
+int32_t Feat_Smooth(uint32_t n)
+{
+    const int16_t   *pCoef = NULL;
+    int32_t         norm = 0;
+    int32_t         sum = 0;
+    uint32_t        c = n / 2;
+    uint32_t        i;
+    
+#if (1 == FEAT_SMOOTH_SG)
+    switch (n)
+    {
+    case 5:
+        pCoef = featSg5;
+        norm = 35;
+        break;
+    case 7:
+        pCoef = featSg7;
+        norm = 21;
+        break;
+    case 9:
+        pCoef = featSg9;
+        norm = 231;
+        break;
+    default:
+        break;
+    }
+#endif
+    if (NULL == pCoef)
+    {
+        for (i = 0; i < n; i++)
+        {
+            sum += featCtx.Win[i];
+        }
+        return sum / (int32_t)n;
+    }
+    sum = pCoef[0] * featCtx.Win[c];
+    for (i = 1; i <= c; i++)
+    {
+        sum += pCoef[i] * (featCtx.Win[c - i] + featCtx.Win[c + i]);
+    }
+    return sum / norm;
+}
+
+/* Start peak detection for a CV (swv = false) or SWV sweep */
+void Feat_Begin(bool_t swv)
+{
+    featCtx.Active = (FEAT_RAW != featCtx.Mode);
+    featCtx.Swv = swv;
+    featCtx.Half = false;
+    featCtx.Dir = 0;
+    featCtx.Segment = 0;
+    featCtx.Fill = 0;
+    featCtx.PeakHeight = 0;
+}
+
+/*!
+ * @brief       Announce the nominal potential of the next step.
+ *
+ * @param[in]   potential   Step potential in mV
+ *
+ * @details     A reversal of the sweep direction closes the open peak and
+ *              starts a new segment with a fresh smoothing window and
+ *              baseline.
+ *
+ */
+void Feat_Step(int32_t potential)
+{
+    int32_t     dir;
+    
+    if (!featCtx.Active)
+    {
+        return;
+    }
+    if (featCtx.Fill && (potential != featCtx.Potential))
+    {
+        dir = (potential > featCtx.Potential) ? 1 : -1;
+        if (featCtx.Dir && (dir != featCtx.Dir))
+        {
+            Feat_Flush();
+            featCtx.Segment++;
+            featCtx.Fill = 0;
+        }
+        featCtx.Dir = dir;
+    }
+    featCtx.Potential = potential;
+}
+
+/*!
+ * @brief       Feed one step result to the peak detector.
+ *
+ * @param[in]   value       Step result in codes
+ *
+ * @details     SWV results are paired into the forward - reverse difference.
+ *              The signal is smoothed over FEAT_SMOOTH_N points (see
+ *              Feat_Smooth), its potential being that of the window centre. The baseline
+ *              follows the smoothed signal and is held while a peak is open;
+ *              a peak is reported once the signal falls back under half its
+ *              height as "PK,<segment>,<dir>,<mV>,<smoothed>,<height>".
+ *
+ */
+void Feat_Sample(int32_t value)
+{
+    int32_t     smooth;
+    int32_t     pot;
+    int32_t     dev;
+    uint32_t    n = (FEAT_SMOOTH_N < FEAT_SMOOTH_MAX) ? FEAT_SMOOTH_N : FEAT_SMOOTH_MAX;
+    uint32_t    i;
+    
+    if (featCtx.Swv)
+    {
+        featCtx.Half = !featCtx.Half;
+        if (featCtx.Half)
+        {
+            featCtx.Forward = value;
+            return;
+        }
+        value = featCtx.Forward - value;
+    }
+    
+    for (i = n - 1; i > 0; i--)
+    {
+        featCtx.Win[i] = featCtx.Win[i - 1];
+        featCtx.WinPot[i] = featCtx.WinPot[i - 1];
+    }
+    featCtx.Win[0] = value;
+    featCtx.WinPot[0] = featCtx.Potential;
+    if (++featCtx.Fill < n)
+    {
+        return;
+    }
+    smooth = Feat_Smooth(n);
+    pot = featCtx.WinPot[n / 2];
+    
+    if (featCtx.Fill == n)
+    {
+        featCtx.Baseline = smooth;
+        featCtx.PeakHeight = 0;
+        return;
+    }
+    
+    dev = smooth - featCtx.Baseline;
+    if (0 == featCtx.PeakHeight)
+    {
+        if ((dev >= FEAT_THRESHOLD) || (dev <= -FEAT_THRESHOLD))
+        {
+            featCtx.PeakHeight = dev;
+            featCtx.PeakValue = smooth;
+            featCtx.PeakPot = pot;
+        }
+        else
+        {
+            featCtx.Baseline += dev / (1 << FEAT_BASELINE_SHIFT);
+        }
+    }
+    else if ((featCtx.PeakHeight > 0) ? (dev > featCtx.PeakHeight) : (dev < featCtx.PeakHeight))
+    {
+        featCtx.PeakHeight = dev;
+        featCtx.PeakValue = smooth;
+        featCtx.PeakPot = pot;
+    }
+    else if ((featCtx.PeakHeight > 0) ? (2 * dev < featCtx.PeakHeight) : (2 * dev > featCtx.PeakHeight))
+    {
+        Feat_Flush();
+    }
+}
+
+/* Report the open peak, if any */
+void Feat_Flush(void)
+{
+    char        msg[MSG_MAXLEN];
+    
+    if (featCtx.PeakHeight)
+    {
+        sprintf(msg, "PK,%u,%d,%d,%d,%d\r\n", featCtx.Segment, featCtx.Dir, featCtx.PeakPot,
+                featCtx.PeakValue, featCtx.PeakHeight);
+        PRINT(msg);
+        featCtx.PeakHeight = 0;
+    }
+}
+
+/* Close the sweep, reporting a peak still open at the end */
+void Feat_End(void)
+{
+    if (featCtx.Active)
+    {
+        Feat_Flush();
+    }
+    featCtx.Active = false;
+}
+
+/*!
+ * @brief       Scan rate wait of one step.
+ *
+ * @param[in]   span        Sweep span in mV (V_Final - V_Init)
+ *              scanRate    Requested scan rate in mV/s
+ *              noStep      Number of steps of the forward and reverse sweep
+ *
+ * @return      Wait in us for word 10 of the step sequences
+ *
+ * @details     Step period is one step size at the scan rate,
+ *              2 * span / (scanRate * noStep), minus the fixed per-step
+ *              overhead and any oversampling extension.
+ *              Clamped to 0 and to the longest sequencer wait.
+ *
+ */
+uint32_t ScanStepDelayUs(int32_t span, int32_t scanRate, int32_t noStep)
+{
+    float       delayUs;
+    
+    if (span < 0)
+    {
+        span = -span;
+    }
+    if ((scanRate <= 0) || (noStep <= 0))
+    {
+        return 0;
+    }
+    delayUs = (((2.0f * (float)span) / (float)scanRate) / (float)noStep) * 1000000.0f;
+    delayUs -= (float)(STEP_OVERHEAD_US + osCfg.ExtraUs);
+    if (delayUs <= 0.0f)
+    {
+        return 0;
+    }
+    if (delayUs > (float)SEQ_WAIT_MAX_US)
+    {
+        return SEQ_WAIT_MAX_US;
+    }
+    return (uint32_t)delayUs;
+}
+
+/* Program the scan rate wait of the last 'n' into the step sequences */
+void ScanStepApply(void)
+{
+    if (stepCfg.Valid)
+    {
+        SeqSetAll(10, ScanStepDelayUs(stepCfg.Span, stepCfg.Rate, stepCfg.NoStep) * 16);
+    }
+}
+
+/*!
+ * @brief       Step timing benchmark.
+ *
+ * @param[in]   hAfeDevice  Device handle obtained from adi_AFE_Init()
+ *
+ * @details     For every scan rate / step size combination BENCH_STEPS steps
+ *              are run at 0V with the same sequence, WE2 update and sample
+ *              output as a CV scan, timestamping each step with the DWT cycle
+ *              counter. Reports, in us unless noted:
+ *              "BENCH,<mV/s>,<step mV>,<target period>,<mean period>,
+ *               <achieved mV/s x100>,<jitter p50>,<jitter p90>,<jitter max>"
+ *              where jitter is |period - mean period|. The target period is
+ *              step / scan rate and the achieved rate is step / mean period,
+ *              independent of how ScanStepDelayUs computes the wait.
+ *              The scan rate wait of the step sequences is restored afterwards.
+ *
+ */
+void Bench_Run(ADI_AFE_DEV_HANDLE hAfeDevice)
+{
+    char        msg[2 * MSG_MAXLEN];
+    uint32_t    savedDelay = seq_afe_ampmeas_we3[10];
+    uint32_t    savedL1 = seq_afe_ampmeas_we3[4];
+    uint32_t    savedL2 = seq_afe_ampmeas_we3[16];
+    uint32_t    jitter[BENCH_STEPS];
+    uint32_t    sr, st, i, j, n;
+    uint32_t    period, mean, targetUs, rate, tmp;
+    uint64_t    sum;
+    int32_t     noStep;
+    
+    PRINT("\r\nBENCH,scan_rate,step,target_us,mean_us,rate_x100,jit_p50_us,jit_p90_us,jit_max_us\r\n");
+    
+    seq_afe_ampmeas_we3[4]  = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, 0x800);
+    seq_afe_ampmeas_we3[16] = SEQ_MMR_WRITE(REG_AFE_AFE_WG_DAC_CODE, 0x800);
+    
+    for (sr = 0; (sr < sizeof(benchScanRates) / sizeof(benchScanRates[0])) && !cmdCtx.ScanAbort; sr++)
+    {
+        for (st = 0; (st < sizeof(benchStepSizes) / sizeof(benchStepSizes[0])) && !cmdCtx.ScanAbort; st++)
+        {
+            /* Same timing as a CV scan of BENCH_STEPS steps */
+            noStep = (int32_t)BENCH_STEPS;
+            SeqSetAll(10, ScanStepDelayUs((int32_t)benchStepSizes[st] * noStep / 2,
+                                          (int32_t)benchScanRates[sr], noStep) * 16);
+            
+            benchCtx.Fill = 0;
+            benchCtx.Active = true;
+            for (i = 0; (i < BENCH_STEPS) && !cmdCtx.ScanAbort; i++)
+            {
+                RunStep(hAfeDevice, seq_afe_ampmeas_we3);
+                WE2_Voltage(1100);
+            }
+            benchCtx.Active = false;
+            
+            n = benchCtx.Fill;
+            if (n < 2)
+            {
+                continue;
+            }
+            n--;
+            
+            /* Periods between consecutive step starts, in us */
+            sum = 0;
+            for (i = 0; i < n; i++)
+            {
+                jitter[i] = (benchCtx.Stamp[i + 1] - benchCtx.Stamp[i]) / (CORE_CLOCK_HZ / 1000000u);
+                sum += jitter[i];
+            }
+            mean = (uint32_t)(sum / n);
+            if (0 == mean)
+            {
+                continue;
+            }
+            for (i = 0; i < n; i++)
+            {
+                period = jitter[i];
+                jitter[i] = (period > mean) ? (period - mean) : (mean - period);
+            }
+            /* Insertion sort for the percentiles */
+            for (i = 1; i < n; i++)
+            {
+                tmp = jitter[i];
+                for (j = i; (j > 0) && (jitter[j - 1] > tmp); j--)
+                {
+                    jitter[j] = jitter[j - 1];
+                }
+                jitter[j] = tmp;
+            }
+            
+            targetUs = (benchStepSizes[st] * 1000000u) / benchScanRates[sr];
+            rate = (uint32_t)(((uint64_t)benchStepSizes[st] * 100000000u) / mean);
+            sprintf(msg, "\r\nBENCH,%u,%u,%u,%u,%u,%u,%u,%u\r\n",
+                    benchScanRates[sr], benchStepSizes[st], targetUs, mean, rate,
+                    jitter[n / 2], jitter[(n * 9) / 10], jitter[n - 1]);
+            PRINT(msg);
+        }
+    }
+    
+    SeqSetAll(10, savedDelay);
+    seq_afe_ampmeas_we3[4]  = savedL1;
+    seq_afe_ampmeas_we3[16] = savedL2;
+}
+
+/* Set the WE2 potential through the external AD5683R DAC */
+void WE2_Voltage(uint32_t voltage)
+{
+    PROF_BEGIN(PROF_WE2_DAC);
+    AD5683R_WE2_Voltage(voltage);
+    PROF_END(PROF_WE2_DAC);
+}
+
+/* Enable the DWT cycle counter and clear the profiling counters */
+void Prof_Init(void)
+{
+    uint32_t    r;
+    
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    
+    for (r = 0; r < PROF_NUM_REGIONS; r++)
+    {
+        profData[r].Count = 0;
+        profData[r].Min = 0xFFFFFFFF;
+        profData[r].Max = 0;
+        profData[r].Total = 0;
+    }
+}
+
+void Prof_Begin(PROF_REGION_TYPE region)
+{
+    profData[region].Start = DWT->CYCCNT;
+}
+
+void Prof_End(PROF_REGION_TYPE region)
+{
+    PROF_REGION_DATA_TYPE   *pData = &profData[region];
+    uint32_t                cycles = DWT->CYCCNT - pData->Start;
+    
+    pData->Count++;
+    pData->Total += cycles;
+    if (cycles < pData->Min)
+    {
+        pData->Min = cycles;
+    }
+    if (cycles > pData->Max)
+    {
+        pData->Max = cycles;
+    }
+}
+
+/*!
+ * @brief       Dump and clear the profiling counters.
+ *
+ * @details     One line per region, all values in core clock cycles:
+ *              "PROF,<name>,<count>,<min>,<max>,<total/1000>"
+ *
+ */
+void Prof_Dump(void)
+{
+    char        msg[MSG_MAXLEN];
+    uint32_t    r;
+    
+    for (r = 0; r < PROF_NUM_REGIONS; r++)
+    {
+        sprintf(msg, "PROF,%s,%u,%u,%u,%u\r\n",
+                profData[r].Name,
+                profData[r].Count,
+                profData[r].Count ? profData[r].Min : 0,
+                profData[r].Max,
+                (uint32_t)(profData[r].Total / 1000));
+        PRINT(msg);
+    }
+    Prof_Init();
+}
+
+/* Reset the command dispatcher */
+void Cmd_Reset(CMD_CTX_TYPE *pCtx)
+{
+    pCtx->State = CMD_STATE_IDLE;
+    pCtx->Cmd = 0;
+    pCtx->Len = 0;
+    pCtx->Fill = 0;
+    pCtx->ScanActive = false;
+    pCtx->ScanAbort = false;
+    pCtx->ScanStep = 0;
+}
+
+/*!
+ * @brief       Feed one received byte to the command dispatcher.
+ *
+ * @param[in]   pCtx        Dispatcher state
+ *              b           Received byte
+ *
+ * @return      Command byte once the command and its payload are complete,
+ *              0 otherwise. The payload is left in pCtx->Payload.
+ *
+ * @details     No hardware access, the state machine only depends on pCtx.
+ *
+ */
+uint8_t Cmd_Feed(CMD_CTX_TYPE *pCtx, uint8_t b)
+{
+    if (CMD_STATE_PAYLOAD == pCtx->State)
+    {
+        pCtx->Payload[pCtx->Fill++] = b;
+        if (pCtx->Fill >= pCtx->Len)
+        {
+            pCtx->State = CMD_STATE_IDLE;
+            return pCtx->Cmd;
+        }
+        return 0;
+    }
+    
+    if (pCtx->ScanActive)
+    {
+        /* Only abort and status are accepted mid-scan, anything else is dropped */
+        if (('x' == b) || ('?' == b))
+        {
+            return b;
+        }
+        return 0;
+    }
+    
+    switch (b)
+    {
+    case 'n':
+        pCtx->Len = CMD_CONFIG_LEN;
+        break;
+    case 'o':
+        pCtx->Len = CMD_OVERSAMPLE_LEN;
+        break;
+    case 'f':
+    case 'u':
+    case 'g':
+        pCtx->Len = CMD_FEATURE_LEN;
+        break;
+    case 'c':
+        pCtx->Len = CMD_CYCLES_LEN;
+        break;
+    default:
+        /* Single byte command */
+        return b;
+    }
+    pCtx->Cmd = b;
+    pCtx->Fill = 0;
+    pCtx->State = CMD_STATE_PAYLOAD;
+    return 0;
+}
+
+/* Drain the UART Rx buffer into the dispatcher, returns the first complete command or 0 */
+uint8_t Cmd_Poll(void)
+{
+    uint8_t     b;
+    uint8_t     cmd;
+    int16_t     size;
+    
+    for (;;)
+    {
+        size = 1;
+        if (ADI_UART_SUCCESS != adi_UART_BufRx(hUartDevice, &b, &size))
+        {
+            test_Fail("adi_UART_BufRx() failed");
+        }
+        if (size < 1)
+        {
+            return 0;
+        }
+        cmd = Cmd_Feed(&cmdCtx, b);
+        if (cmd)
+        {
+            return cmd;
+        }
+    }
+}
+
+/* Handle commands received while a scan is running */
+void Cmd_Service(void)
+{
+    uint8_t     cmd;
+    
+    while (0 != (cmd = Cmd_Poll()))
+    {
+        if ('x' == cmd)
+        {
+            cmdCtx.ScanAbort = true;
+        }
+        else if ('?' == cmd)
+        {
+            Cmd_Status();
+        }
+    }
+}
+
+/* Report "STATUS,<run|idle>,<steps run>" */
+void Cmd_Status(void)
+{
+    char        msg[MSG_MAXLEN];
+    
+    sprintf(msg, "STATUS,%s,%u\r\n", cmdCtx.ScanActive ? "run" : "idle", cmdCtx.ScanStep);
+    PRINT(msg);
+}
+
+/* Report the firmware and board identity: "ID,<fw>,<version>,<device>,<runs>,<baud>,<boot ms>" */
+void Cmd_Identify(void)
+{
+    char        msg[MSG_MAXLEN];
+    
+    sprintf(msg, "ID,%s,%s,%u,%u,%u,%u\r\n", FW_NAME, FW_VERSION, DEVICE_ID, runCount, UART_BAUD_BPS,
+            (uint32_t)(bootCycles / (CORE_CLOCK_HZ / 1000u)));
+    PRINT(msg);
+}
+
+/* Mark the start of a scan */
+void Scan_Begin(uint8_t mode)
+{
+#if (1 == RUN_MARKERS_EN)
+    char        msg[MSG_MAXLEN];
+    uint32_t    r;
+#endif
+    
+    runCount++;
+#if (1 == RUN_MARKERS_EN)
+    sprintf(msg, "RUN,BEGIN,%u,%c\r\n", runCount, mode);
+    PRINT(msg);
+    /* Run header: "RUN,CFG,<test>,<vinit>,<vfinal>,<vstep>,<rate>,<amp>,<we2>,<electrode>,<oversample>,<cycles>,
+       <unit>,<aA per code of range 0>;..", unit 'c' codes or 'a' pA, 0 for an uncalibrated range */
+    sprintf(msg, "RUN,CFG,%c,%d,%d,%d,%d,%d,%d,%c,%u,%u,%c,", runCfg.Test, runCfg.VInit, runCfg.VFinal,
+            runCfg.VStep, runCfg.ScanRate, runCfg.SwvAmp, runCfg.VWe2, runCfg.Electrode, osCfg.Count,
+            runCfg.Cycles, (UNIT_PA == sampleUnit) ? 'a' : 'c');
+    PRINT(msg);
+    msg[0] = '\0';
+    for (r = 0; r < RTIA_NUM_RANGES; r++)
+    {
+        sprintf(msg + strlen(msg), (r > 0) ? ";%u" : "%u", Range_ScaleAa(r));
+    }
+    strcat(msg, "\r\n");
+    PRINT(msg);
+#endif
+    cmdCtx.ScanAbort = false;
+    cmdCtx.ScanStep = 0;
+    cmdCtx.ScanActive = true;
+    
+    thruCtx.Mode = mode;
+    thruCtx.Points = 0;
+    thruCtx.Bytes = 0;
+    thruCtx.Elapsed = 0;
+    thruCtx.Idle = 0;
+    thruCtx.FirstResult = 0;
+    thruCtx.LastCyc = DWT->CYCCNT;
+    thruCtx.Active = true;
+}
+
+/* Mark the end of a scan, an aborted scan is terminated with "ABORT" */
+void Scan_End(void)
+{
+#if (1 == RUN_MARKERS_EN)
+    char        msg[MSG_MAXLEN];
+#endif
+    
+    Thru_Update();
+    thruCtx.Active = false;
+    cmdCtx.ScanActive = false;
+    if (cmdCtx.ScanAbort)
+    {
+        PRINT("ABORT\r\n");
+    }
+#if (1 == RUN_MARKERS_EN)
+    sprintf(msg, "RUN,END,%u,%u,%s\r\n", runCount, thruCtx.Points, cmdCtx.ScanAbort ? "abort" : "ok");
+    PRINT(msg);
+#endif
+    cmdCtx.ScanAbort = false;
+}
+
+/* Accumulate elapsed scan cycles, called at least once per step so the 32 bit DWT counter never wraps unseen */
+void Thru_Update(void)
+{
+    uint32_t    now = DWT->CYCCNT;
+    
+    if (thruCtx.Active)
+    {
+        thruCtx.Elapsed += (uint32_t)(now - thruCtx.LastCyc);
+    }
+    thruCtx.LastCyc = now;
+}
+
+/*!
+ * @brief       Report the throughput of the last scan as one JSON line.
+ *
+ * @details     points_per_s, bytes_per_point and cpu_busy (fraction of the
+ *              scan not spent waiting on the sequencer) are sent with two
+ *              decimals, time to first result in ms.
+ *
+ */
+void Thru_Report(void)
+{
+    char        msg[4 * MSG_MAXLEN];
+    uint32_t    elapsedMs = (uint32_t)(thruCtx.Elapsed / (CORE_CLOCK_HZ / 1000u));
+    uint32_t    pps = 0;
+    uint32_t    bpp = 0;
+    uint32_t    busy = 0;
+    
+    if (elapsedMs)
+    {
+        pps = (uint32_t)(((uint64_t)thruCtx.Points * 100000u) / elapsedMs);
+    }
+    if (thruCtx.Points)
+    {
+        bpp = (thruCtx.Bytes * 100u) / thruCtx.Points;
+    }
+    if (thruCtx.Elapsed)
+    {
+        busy = (uint32_t)(((thruCtx.Elapsed - thruCtx.Idle) * 100u) / thruCtx.Elapsed);
+    }
+    sprintf(msg, "{\"fw\":\"350\",\"mode\":\"%c\",\"baud\":%u,\"enc\":\"%s\",\"oversample\":%u,"
+                 "\"points\":%u,\"bytes\":%u,\"elapsed_ms\":%u,\"points_per_s\":%u.%02u,"
+                 "\"bytes_per_point\":%u.%02u,\"cpu_busy\":%u.%02u,\"ttfr_ms\":%u}\r\n",
+            thruCtx.Mode, UART_BAUD_BPS, (osCfg.Count > 1) ? "ascii_noise" : "ascii", osCfg.Count,
+            thruCtx.Points, thruCtx.Bytes, elapsedMs, pps / 100u, pps % 100u,
+            bpp / 100u, bpp % 100u, busy / 100u, busy % 100u,
+            (uint32_t)(thruCtx.FirstResult / (CORE_CLOCK_HZ / 1000u)));
+    PRINT(msg);
+}
+
+/* Helper function for printing a string to UART or Std. Output */
+void test_print (char *pBuffer) {
+#if (1 == USE_UART_FOR_DATA)
+    int16_t size;
+    int16_t sent;
+    /* Print to UART, the driver is non-blocking so queue until all is sent */
+    size = strlen(pBuffer);
+    if (thruCtx.Active)
+    {
+        thruCtx.Bytes += size;
+    }
+    /* Main context only, the Tx interrupt must be able to drain the ring   */
+    while (size > 0)
+    {
+        sent = size;
+        if (ADI_UART_SUCCESS != adi_UART_BufTx(hUartDevice, pBuffer, &sent))
+        {
+            break;
+        }
+        pBuffer += sent;
+        size -= sent;
+    }
+    
+    
+#elif (0 == USE_UART_FOR_DATA)
+    /* Print  to console */
+    printf(pBuffer);
+ 
+#endif /* USE_UART_FOR_DATA */
+}
+
+/* Initialize the UART, set the baud rate and enable */
+ADI_UART_RESULT_TYPE uart_Init (void) {
+    ADI_UART_RESULT_TYPE    result = ADI_UART_SUCCESS;
+    ADI_UART_INIT_DATA      initData;
+    ADI_UART_GENERIC_SETTINGS_TYPE  Settings;
+    
+    /* Open UART in interrupt mode with internal buffers so Rx fills in the background */
+    initData.pRxBufferData = UartRxData;
+    initData.RxBufferSize  = UART_RX_RING_SIZE;
+    initData.pTxBufferData = UartTxData;
+    initData.TxBufferSize  = UART_TX_RING_SIZE;
+    if (ADI_UART_SUCCESS != (result = adi_UART_Init(ADI_UART_DEVID_0, &hUartDevice, &initData)))
+    {
+        return result;
+    }
+
+    /* Non-blocking: adi_UART_BufRx returns whatever has been received so far */
+    Settings.bBlockingMode  = false;
+    Settings.bInterruptMode = true;
+    Settings.bDmaMode       = false;
+    if (ADI_UART_SUCCESS != (result = adi_UART_SetGenericSettings(hUartDevice, &Settings)))
     {
         return result;
     }
 
     /* Set UART baud rate to 115200 */
-    if (ADI_UART_SUCCESS != (result = adi_UART_SetBaudRate(hUartDevice, ADI_UART_BAUD_9600)))
+    if (ADI_UART_SUCCESS != (result = adi_UART_SetBaudRate(hUartDevice, UART_BAUD_RATE)))
     {
         return result;
     }
@@ -0,0 +1,395 @@
+/*
+ * Serial device, run assignment and run files, see acq_device.h.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "acq_device.h"
+
+static const char * const endNames[ACQ_END_NUM] = { "end", "abort", "idle", "cut" };
+
+static const struct {
+    uint32_t    Bps;
+    speed_t     Speed;
+} bauds[] = {
+    { 9600u, B9600 }, { 19200u, B19200 }, { 38400u, B38400 }, { 57600u, B57600 },
+    { 115200u, B115200 }, { 230400u, B230400 }, { 460800u, B460800 }, { 921600u, B921600 }
+};
+
+/* Write all of it, errors are counted and the data dropped */
+static void write_all(ACQ_DEVICE_TYPE *pDev, int fd, const char *p, uint32_t len)
+{
+    ssize_t     n;
+
+    while (len > 0u)
+    {
+        n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            pDev->Stats.WriteErrors++;
+            return;
+        }
+        p += n;
+        len -= (uint32_t)n;
+    }
+}
+
+static void run_flush(ACQ_DEVICE_TYPE *pDev)
+{
+    if ((pDev->RunFd >= 0) && (pDev->OutLen > 0u))
+    {
+        write_all(pDev, pDev->RunFd, pDev->Out, pDev->OutLen);
+    }
+    pDev->OutLen = 0;
+}
+
+/* Append a formatted line to the run file, through the fixed buffer */
+static void run_printf(ACQ_DEVICE_TYPE *pDev, const char *pFmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void run_printf(ACQ_DEVICE_TYPE *pDev, const char *pFmt, ...)
+{
+    va_list     args;
+    int         n;
+
+    if (pDev->RunFd < 0)
+    {
+        return;
+    }
+    if (pDev->OutLen + 2u * ACQ_LINE_MAX > ACQ_OUT_BUF)
+    {
+        run_flush(pDev);
+    }
+    va_start(args, pFmt);
+    n = vsnprintf(pDev->Out + pDev->OutLen, ACQ_OUT_BUF - pDev->OutLen, pFmt, args);
+    va_end(args);
+    if (n > 0)
+    {
+        pDev->OutLen += ((uint32_t)n < ACQ_OUT_BUF - pDev->OutLen) ? (uint32_t)n : ACQ_OUT_BUF - pDev->OutLen - 1u;
+    }
+}
+
+static void event(ACQ_DEVICE_TYPE *pDev, const char *pFmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void event(ACQ_DEVICE_TYPE *pDev, const char *pFmt, ...)
+{
+    char        line[ACQ_LINE_MAX + 64u];
+    va_list     args;
+    int         n;
+
+    n = snprintf(line, sizeof(line), "%llu.%03llu,", (unsigned long long)(pDev->NowMs / 1000u),
+                 (unsigned long long)(pDev->NowMs % 1000u));
+    va_start(args, pFmt);
+    n += vsnprintf(line + n, sizeof(line) - (size_t)n - 1u, pFmt, args);
+    va_end(args);
+    if ((size_t)n > sizeof(line) - 2u)
+    {
+        n = (int)sizeof(line) - 2;
+    }
+    line[n++] = '\n';
+    if (pDev->EventFd >= 0)
+    {
+        write_all(pDev, pDev->EventFd, line, (uint32_t)n);
+    }
+}
+
+static void run_close(ACQ_DEVICE_TYPE *pDev, ACQ_END_TYPE end)
+{
+    if (pDev->RunFd < 0)
+    {
+        return;
+    }
+    run_printf(pDev, "# %s,%u\n", endNames[end], pDev->RunPoints);
+    run_flush(pDev);
+    close(pDev->RunFd);
+    pDev->RunFd = -1;
+    pDev->Stats.RunEnds[end]++;
+    event(pDev, "RUN,%06u,%s,%u", pDev->RunSeq, endNames[end], pDev->RunPoints);
+}
+
+static void run_open(ACQ_DEVICE_TYPE *pDev, const ACQ_RECORD_TYPE *pBegin)
+{
+    char        path[ACQ_PATH_MAX + 32u];
+
+    run_close(pDev, ACQ_END_CUT);
+    pDev->RunSeq++;
+    snprintf(path, sizeof(path), "%s/run-%06u.csv", pDev->Dir, pDev->RunSeq);
+    pDev->RunFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (pDev->RunFd < 0)
+    {
+        pDev->Stats.WriteErrors++;
+    }
+    pDev->OutLen = 0;
+    pDev->RunPoints = 0;
+    pDev->RunImplicit = (NULL == pBegin);
+    pDev->RunNum = (NULL != pBegin) ? pBegin->u.Begin.Run : 0u;
+    pDev->Stats.Runs++;
+    run_printf(pDev, "# %s,%s,%u,%llu.%03llu\n", pDev->Name, pDev->Fw, pDev->DeviceId,
+               (unsigned long long)(pDev->NowMs / 1000u), (unsigned long long)(pDev->NowMs % 1000u));
+    if (NULL != pBegin)
+    {
+        run_printf(pDev, "# %s\n", pBegin->pText);
+    }
+    event(pDev, "RUN,%06u,begin,%s", pDev->RunSeq, (NULL != pBegin) ? pBegin->pText : "implicit");
+}
+
+/* Results open an implicit run outside a framed one */
+static void result(ACQ_DEVICE_TYPE *pDev)
+{
+    if (pDev->RunFd < 0)
+    {
+        run_open(pDev, NULL);
+    }
+    pDev->RunPoints++;
+    pDev->LastResultMs = pDev->NowMs;
+}
+
+static void on_record(void *pCtx, const ACQ_RECORD_TYPE *pRec)
+{
+    ACQ_DEVICE_TYPE *pDev = (ACQ_DEVICE_TYPE *)pCtx;
+
+    pDev->Stats.Records[pRec->Kind]++;
+    switch (pRec->Kind)
+    {
+    case ACQ_REC_SAMPLE:
+        result(pDev);
+        run_printf(pDev, "S,%u,%d,%d,%d,%u,%u,%u\n", pDev->RunPoints, pRec->u.Sample.Value,
+                   pRec->u.Sample.HasNoise ? pRec->u.Sample.Noise : 0, pRec->u.Sample.Range,
+                   pRec->u.Sample.Sat, pRec->u.Sample.Cycle, pRec->u.Sample.Segment);
+        break;
+    case ACQ_REC_IMPEDANCE:
+        result(pDev);
+        /* The numbers as printed, reformatting would change nothing but the cost */
+        run_printf(pDev, "Z,%u,%c,%s\n", pDev->RunPoints, pRec->u.Imp.Chan ? pRec->u.Imp.Chan : '-',
+                   pRec->u.Imp.Chan ? pRec->pText + 3 : pRec->pText);
+        break;
+    case ACQ_REC_MONITOR:
+        result(pDev);
+        run_printf(pDev, "M,%u,%s\n", pDev->RunPoints, pRec->pText + 2);
+        break;
+    case ACQ_REC_DCLOG:
+        result(pDev);
+        run_printf(pDev, "I,%u,%d,%d\n", pDev->RunPoints, pRec->u.Ints.Field[0], pRec->u.Ints.Field[1]);
+        break;
+    case ACQ_REC_HOLD:
+    case ACQ_REC_PEAK:
+        if (pDev->RunFd >= 0)
+        {
+            run_printf(pDev, "%s\n", pRec->pText);
+        }
+        else
+        {
+            event(pDev, "%s", pRec->pText);
+        }
+        break;
+    case ACQ_REC_RUN_BEGIN:
+        run_open(pDev, pRec);
+        break;
+    case ACQ_REC_RUN_CFG:
+        if (pDev->RunFd >= 0)
+        {
+            run_printf(pDev, "# %s\n", pRec->pText);
+        }
+        event(pDev, "%s", pRec->pText);
+        break;
+    case ACQ_REC_RUN_END:
+        if ((pDev->RunFd >= 0) && (pRec->u.End.Points != pDev->RunPoints) && ('M' != pRec->pText[0]))
+        {
+            event(pDev, "RUN,%06u,points,%u,%u", pDev->RunSeq, pRec->u.End.Points, pDev->RunPoints);
+        }
+        run_close(pDev, pRec->u.End.Abort ? ACQ_END_ABORT : ACQ_END_MARKER);
+        break;
+    case ACQ_REC_ABORT:
+        /* With the markers RUN,END,...,abort follows and closes the run */
+        if (pDev->RunImplicit)
+        {
+            run_close(pDev, ACQ_END_ABORT);
+        }
+        event(pDev, "%s", pRec->pText);
+        break;
+    case ACQ_REC_ID:
+        snprintf(pDev->Fw, sizeof(pDev->Fw), "%s", pRec->u.Id.Fw);
+        pDev->DeviceId = pRec->u.Id.Device;
+        event(pDev, "%s", pRec->pText);
+        break;
+    default:
+        event(pDev, "%s", pRec->pText);
+        break;
+    }
+}
+
+/* Continue the run numbering of an earlier session in the same directory */
+static uint32_t last_run_seq(const char *pDir)
+{
+    DIR            *pD = opendir(pDir);
+    struct dirent  *pEnt;
+    unsigned        seq;
+    uint32_t        last = 0;
+
+    if (NULL == pD)
+    {
+        return 0;
+    }
+    while (NULL != (pEnt = readdir(pD)))
+    {
+        if ((1 == sscanf(pEnt->d_name, "run-%u.csv", &seq)) && (seq > last))
+        {
+            last = seq;
+        }
+    }
+    closedir(pD);
+    return last;
+}
+
+int acq_device_init(ACQ_DEVICE_TYPE *pDev, const char *pSpec, const char *pOutDir, uint32_t baud)
+{
+    const char *pEq = strchr(pSpec, '=');
+    const char *pPath = (NULL != pEq) ? pEq + 1 : pSpec;
+    char        path[ACQ_PATH_MAX + 32u];
+    size_t      n;
+    char       *p;
+
+    memset(pDev, 0, sizeof(*pDev));
+    pDev->Fd = -1;
+    pDev->RunFd = -1;
+    pDev->EventFd = -1;
+    pDev->Baud = baud;
+    snprintf(pDev->Path, sizeof(pDev->Path), "%s", pPath);
+    if (NULL != pEq)
+    {
+        n = (size_t)(pEq - pSpec);
+        snprintf(pDev->Name, sizeof(pDev->Name), "%.*s", (int)n, pSpec);
+    }
+    else
+    {
+        snprintf(pDev->Name, sizeof(pDev->Name), "%s", (0 == strncmp(pPath, "/dev/", 5)) ? pPath + 5 : pPath);
+        for (p = pDev->Name; '\0' != *p; p++)
+        {
+            if ('/' == *p)
+            {
+                *p = '_';
+            }
+        }
+    }
+    if (('\0' == pDev->Name[0]) || ('\0' == pDev->Path[0]))
+    {
+        return -1;
+    }
+    acq_parser_init(&pDev->Parser);
+    snprintf(pDev->Dir, sizeof(pDev->Dir), "%s/%s", pOutDir, pDev->Name);
+    if ((0 != mkdir(pDev->Dir, 0755)) && (EEXIST != errno))
+    {
+        return -1;
+    }
+    pDev->RunSeq = last_run_seq(pDev->Dir);
+    snprintf(path, sizeof(path), "%s/events.log", pDev->Dir);
+    pDev->EventFd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    return (pDev->EventFd >= 0) ? 0 : -1;
+}
+
+int acq_device_open(ACQ_DEVICE_TYPE *pDev, uint64_t nowMs)
+{
+    struct termios  tio;
+    uint32_t        i;
+
+    pDev->NowMs = nowMs;
+    pDev->Fd = open(pDev->Path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (pDev->Fd < 0)
+    {
+        pDev->ReopenMs = nowMs + ACQ_REOPEN_MS;
+        return -1;
+    }
+    /* Anything that is not a tty (a FIFO in tests) is read as it is */
+    if (0 == tcgetattr(pDev->Fd, &tio))
+    {
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        for (i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++)
+        {
+            if (bauds[i].Bps == pDev->Baud)
+            {
+                cfsetispeed(&tio, bauds[i].Speed);
+                cfsetospeed(&tio, bauds[i].Speed);
+            }
+        }
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(pDev->Fd, TCSANOW, &tio);
+        tcflush(pDev->Fd, TCIFLUSH);
+    }
+    /* A line cut by the reconnect must not be glued to the next one */
+    acq_parser_init(&pDev->Parser);
+    pDev->Stats.Opens++;
+    event(pDev, "OPEN,%s", pDev->Path);
+    return pDev->Fd;
+}
+
+void acq_device_close(ACQ_DEVICE_TYPE *pDev, uint64_t nowMs)
+{
+    pDev->NowMs = nowMs;
+    if (pDev->Fd >= 0)
+    {
+        close(pDev->Fd);
+        pDev->Fd = -1;
+        event(pDev, "CLOSE,%s", pDev->Path);
+    }
+    run_close(pDev, ACQ_END_CUT);
+    pDev->ReopenMs = nowMs + ACQ_REOPEN_MS;
+}
+
+void acq_device_input(ACQ_DEVICE_TYPE *pDev, const char *pData, uint32_t len, uint64_t nowMs)
+{
+    pDev->NowMs = nowMs;
+    pDev->Stats.Bytes += len;
+    acq_parser_feed(&pDev->Parser, pData, len, on_record, pDev);
+}
+
+int acq_device_read(ACQ_DEVICE_TYPE *pDev, uint64_t nowMs)
+{
+    char        buf[ACQ_READ_CHUNK];
+    ssize_t     n;
+
+    n = read(pDev->Fd, buf, sizeof(buf));
+    if (n > 0)
+    {
+        acq_device_input(pDev, buf, (uint32_t)n, nowMs);
+        return 1;
+    }
+    if ((n < 0) && ((EAGAIN == errno) || (EWOULDBLOCK == errno) || (EINTR == errno)))
+    {
+        return 0;
+    }
+    /* EOF or EIO: unplugged, or the far end of a pty closed */
+    return -1;
+}
+
+void acq_device_tick(ACQ_DEVICE_TYPE *pDev, uint64_t nowMs, uint32_t idleMs)
+{
+    pDev->NowMs = nowMs;
+    if ((pDev->RunFd >= 0) && pDev->RunImplicit && (nowMs - pDev->LastResultMs >= idleMs))
+    {
+        run_close(pDev, ACQ_END_IDLE);
+    }
+    run_flush(pDev);
+}
+
+void acq_device_fini(ACQ_DEVICE_TYPE *pDev)
+{
+    acq_device_close(pDev, pDev->NowMs);
+    if (pDev->EventFd >= 0)
+    {
+        close(pDev->EventFd);
+        pDev->EventFd = -1;
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * One serial device of the acquisition daemon: the port, its stream parser
+ * and the run being written. All buffers are part of the structure, the
+ * memory per device is fixed whatever the device sends.
+ *
+ * Runs are framed by the RUN,BEGIN / RUN,END (or M,BEGIN / M,END) markers.
+ * Results outside a framed run, from firmware built without the markers,
+ * open an implicit run that ABORT, a marker or IdleMs without results
+ * closes. Each run is one CSV file <dir>/<name>/run-<seq>.csv, everything
+ * else goes to <dir>/<name>/events.log.
+ */
+#ifndef ACQ_DEVICE_H
+#define ACQ_DEVICE_H
+
+#include <stdint.h>
+
+#include "acq_record.h"
+
+#define ACQ_NAME_MAX            (64u)
+#define ACQ_PATH_MAX            (512u)
+#define ACQ_OUT_BUF             (16384u)    /* run file write buffer        */
+#define ACQ_READ_CHUNK          (4096u)     /* bytes read per wakeup        */
+#define ACQ_REOPEN_MS           (1000u)
+
+typedef enum {
+    ACQ_END_MARKER = 0,         /* RUN,END or M,END                         */
+    ACQ_END_ABORT,
+    ACQ_END_IDLE,               /* implicit run, no results for IdleMs      */
+    ACQ_END_CUT,                /* new run began, disconnect or shutdown    */
+    ACQ_END_NUM
+} ACQ_END_TYPE;
+
+typedef struct {
+    uint64_t            Bytes;
+    uint64_t            Records[ACQ_REC_NUM];
+    uint32_t            Runs;                   /* run files written        */
+    uint32_t            RunEnds[ACQ_END_NUM];
+    uint32_t            Opens;
+    uint32_t            WriteErrors;
+} ACQ_STATS_TYPE;
+
+typedef struct {
+    char                Name[ACQ_NAME_MAX];
+    char                Path[ACQ_PATH_MAX];     /* serial port              */
+    char                Dir[ACQ_PATH_MAX];      /* output directory         */
+    uint32_t            Baud;
+    int                 Fd;                     /* -1 while closed          */
+    uint64_t            ReopenMs;
+    ACQ_PARSER_TYPE     Parser;
+
+    /* Identity from the last ID line */
+    char                Fw[16];
+    uint32_t            DeviceId;
+
+    /* Run being written */
+    int                 RunFd;                  /* -1 outside a run         */
+    uint32_t            RunSeq;                 /* last run file number     */
+    uint32_t            RunNum;                 /* firmware run number      */
+    uint32_t            RunPoints;
+    uint8_t             RunImplicit;
+    uint64_t            LastResultMs;
+    char                Out[ACQ_OUT_BUF];
+    uint32_t            OutLen;
+
+    int                 EventFd;
+    uint64_t            NowMs;
+    ACQ_STATS_TYPE      Stats;
+} ACQ_DEVICE_TYPE;
+
+/* "name=path" or a path, the name then being the path without /dev/ */
+int         acq_device_init     (ACQ_DEVICE_TYPE *pDev, const char *pSpec, const char *pOutDir, uint32_t baud);
+int         acq_device_open     (ACQ_DEVICE_TYPE *pDev, uint64_t nowMs);
+void        acq_device_close    (ACQ_DEVICE_TYPE *pDev, uint64_t nowMs);
+/* One non-blocking read: 1 if data came, 0 if none, -1 once the port is gone */
+int         acq_device_read     (ACQ_DEVICE_TYPE *pDev, uint64_t nowMs);
+/* Periodic: idle runs are closed and buffered results written */
+void        acq_device_tick     (ACQ_DEVICE_TYPE *pDev, uint64_t nowMs, uint32_t idleMs);
+/* Records from a byte stream, as acq_device_read does with the port */
+void        acq_device_input    (ACQ_DEVICE_TYPE *pDev, const char *pData, uint32_t len, uint64_t nowMs);
+void        acq_device_fini     (ACQ_DEVICE_TYPE *pDev);
+
+#endif /* ACQ_DEVICE_H */
@@ -0,0 +1,265 @@
+/*
+ * Single threaded epoll loop over the device ports, see acq_loop.h.
+ */
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "acq_loop.h"
+
+#define ACQ_EV_TIMER            (UINT64_MAX - 1u)
+#define ACQ_EV_SIGNAL           (UINT64_MAX - 2u)
+#define ACQ_EVENTS              (256u)
+
+uint64_t acq_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+/* A port at 115200 baud brings a dozen bytes per millisecond. Waking for
+ * each of them costs more than the bytes, so the loop waits out BatchUs
+ * since the last wakeup and then takes every port's data in one pass. The
+ * tty buffers hold far more than a batch */
+static void pace(ACQ_LOOP_TYPE *pLoop)
+{
+    struct timespec ts;
+    uint64_t        now = now_us();
+
+    if (now < pLoop->WakeUs + pLoop->BatchUs)
+    {
+        ts.tv_sec = 0;
+        ts.tv_nsec = (long)(pLoop->WakeUs + pLoop->BatchUs - now) * 1000L;
+        nanosleep(&ts, NULL);
+    }
+    pLoop->WakeUs = now_us();
+}
+
+static int watch(ACQ_LOOP_TYPE *pLoop, int fd, uint64_t tag)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = tag;
+    return epoll_ctl(pLoop->Epoll, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void dev_open(ACQ_LOOP_TYPE *pLoop, uint32_t i, uint64_t now)
+{
+    ACQ_DEVICE_TYPE *pDev = &pLoop->pDev[i];
+
+    if (acq_device_open(pDev, now) < 0)
+    {
+        return;
+    }
+    if (0 != watch(pLoop, pDev->Fd, i))
+    {
+        acq_device_close(pDev, now);
+        return;
+    }
+    if (pLoop->Identify && (1 != write(pDev->Fd, "i", 1)))
+    {
+        /* Identity is informational, the stream is read anyway */
+    }
+}
+
+static void dev_close(ACQ_LOOP_TYPE *pLoop, uint32_t i, uint64_t now)
+{
+    ACQ_DEVICE_TYPE *pDev = &pLoop->pDev[i];
+
+    if (pDev->Fd >= 0)
+    {
+        epoll_ctl(pLoop->Epoll, EPOLL_CTL_DEL, pDev->Fd, NULL);
+    }
+    acq_device_close(pDev, now);
+}
+
+int acq_loop_init(ACQ_LOOP_TYPE *pLoop, ACQ_DEVICE_TYPE *pDev, uint32_t num)
+{
+    struct itimerspec   its;
+    sigset_t            mask;
+
+    memset(pLoop, 0, sizeof(*pLoop));
+    pLoop->pDev = pDev;
+    pLoop->Num = num;
+    pLoop->IdleMs = 2000u;
+    pLoop->BatchUs = ACQ_BATCH_US;
+    pLoop->Timer = -1;
+    pLoop->Signal = -1;
+    pLoop->Epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (pLoop->Epoll < 0)
+    {
+        return -1;
+    }
+    pLoop->Timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    memset(&its, 0, sizeof(its));
+    its.it_interval.tv_nsec = ACQ_TICK_MS * 1000000L;
+    its.it_value = its.it_interval;
+    if ((pLoop->Timer < 0) || (0 != timerfd_settime(pLoop->Timer, 0, &its, NULL)) ||
+        (0 != watch(pLoop, pLoop->Timer, ACQ_EV_TIMER)))
+    {
+        return -1;
+    }
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    pLoop->Signal = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if ((pLoop->Signal < 0) || (0 != watch(pLoop, pLoop->Signal, ACQ_EV_SIGNAL)))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+void acq_loop_open(ACQ_LOOP_TYPE *pLoop)
+{
+    uint64_t    now = acq_now_ms();
+    uint32_t    i;
+
+    for (i = 0; i < pLoop->Num; i++)
+    {
+        dev_open(pLoop, i, now);
+    }
+}
+
+static void tick(ACQ_LOOP_TYPE *pLoop)
+{
+    uint64_t    expirations;
+    uint64_t    now = acq_now_ms();
+    uint32_t    i;
+
+    if (sizeof(expirations) != read(pLoop->Timer, &expirations, sizeof(expirations)))
+    {
+        return;
+    }
+    for (i = 0; i < pLoop->Num; i++)
+    {
+        if ((pLoop->pDev[i].Fd < 0) && (now >= pLoop->pDev[i].ReopenMs))
+        {
+            dev_open(pLoop, i, now);
+        }
+        acq_device_tick(&pLoop->pDev[i], now, pLoop->IdleMs);
+    }
+}
+
+/* Take what the ports already hold before stopping */
+static void drain(ACQ_LOOP_TYPE *pLoop, uint64_t now)
+{
+    uint32_t    i;
+
+    for (i = 0; i < pLoop->Num; i++)
+    {
+        while ((pLoop->pDev[i].Fd >= 0) && (1 == acq_device_read(&pLoop->pDev[i], now)))
+        {
+        }
+    }
+}
+
+int acq_loop_run(ACQ_LOOP_TYPE *pLoop)
+{
+    struct epoll_event  ev[ACQ_EVENTS];
+    uint64_t            now;
+    uint64_t            tag;
+    int                 n;
+    int                 k;
+
+    for (;;)
+    {
+        pace(pLoop);
+        n = epoll_wait(pLoop->Epoll, ev, ACQ_EVENTS, -1);
+        if (n < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            return -1;
+        }
+        pLoop->Wakeups++;
+        now = acq_now_ms();
+        for (k = 0; k < n; k++)
+        {
+            tag = ev[k].data.u64;
+            if (ACQ_EV_TIMER == tag)
+            {
+                tick(pLoop);
+            }
+            else if (ACQ_EV_SIGNAL == tag)
+            {
+                drain(pLoop, now);
+                return 0;
+            }
+            else if ((tag < pLoop->Num) && (pLoop->pDev[tag].Fd >= 0))
+            {
+                /* One chunk per wakeup, level triggered epoll comes back for
+                 * the rest so a busy port can't starve the others */
+                if (acq_device_read(&pLoop->pDev[tag], now) < 0)
+                {
+                    dev_close(pLoop, (uint32_t)tag, now);
+                }
+            }
+        }
+    }
+}
+
+void acq_loop_report(const ACQ_LOOP_TYPE *pLoop, FILE *pOut)
+{
+    const ACQ_STATS_TYPE   *pS;
+    uint64_t                results;
+    uint32_t                i;
+
+    for (i = 0; i < pLoop->Num; i++)
+    {
+        pS = &pLoop->pDev[i].Stats;
+        results = pS->Records[ACQ_REC_SAMPLE] + pS->Records[ACQ_REC_IMPEDANCE] +
+                  pS->Records[ACQ_REC_MONITOR] + pS->Records[ACQ_REC_DCLOG];
+        /* ACQ,DEV,<name>,<bytes>,<results>,<runs>,<end>,<abort>,<idle>,<cut>,<overflows>,<opens>,<write errors> */
+        fprintf(pOut, "ACQ,DEV,%s,%llu,%llu,%u,%u,%u,%u,%u,%u,%u,%u\n", pLoop->pDev[i].Name,
+                (unsigned long long)pS->Bytes, (unsigned long long)results, pS->Runs,
+                pS->RunEnds[ACQ_END_MARKER], pS->RunEnds[ACQ_END_ABORT], pS->RunEnds[ACQ_END_IDLE],
+                pS->RunEnds[ACQ_END_CUT], pLoop->pDev[i].Parser.Overflows, pS->Opens, pS->WriteErrors);
+    }
+}
+
+void acq_loop_fini(ACQ_LOOP_TYPE *pLoop)
+{
+    uint32_t    i;
+
+    for (i = 0; i < pLoop->Num; i++)
+    {
+        if (pLoop->pDev[i].Fd >= 0)
+        {
+            epoll_ctl(pLoop->Epoll, EPOLL_CTL_DEL, pLoop->pDev[i].Fd, NULL);
+        }
+        acq_device_fini(&pLoop->pDev[i]);
+    }
+    if (pLoop->Signal >= 0)
+    {
+        close(pLoop->Signal);
+    }
+    if (pLoop->Timer >= 0)
+    {
+        close(pLoop->Timer);
+    }
+    if (pLoop->Epoll >= 0)
+    {
+        close(pLoop->Epoll);
+    }
+}
@@ -0,0 +1,40 @@
+/*
+ * Event loop of the acquisition daemon: one thread, one epoll set holding
+ * every open port, a timerfd tick for idle runs, write back and reconnects,
+ * and a signalfd for SIGINT / SIGTERM.
+ */
+#ifndef ACQ_LOOP_H
+#define ACQ_LOOP_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "acq_device.h"
+
+#define ACQ_TICK_MS             (100u)
+#define ACQ_BATCH_US            (4000u)
+
+typedef struct {
+    ACQ_DEVICE_TYPE    *pDev;
+    uint32_t            Num;
+    uint32_t            IdleMs;         /* implicit run ends after this     */
+    uint8_t             Identify;       /* send 'i' on every (re)open       */
+    uint32_t            BatchUs;        /* least time between two wakeups   */
+    int                 Epoll;
+    int                 Timer;
+    int                 Signal;
+    uint64_t            Wakeups;
+    uint64_t            WakeUs;
+} ACQ_LOOP_TYPE;
+
+uint64_t    acq_now_ms          (void);
+/* SIGINT / SIGTERM are blocked in the calling thread, the loop takes them */
+int         acq_loop_init       (ACQ_LOOP_TYPE *pLoop, ACQ_DEVICE_TYPE *pDev, uint32_t num);
+/* Opens the ports, the ones that fail are retried on the tick */
+void        acq_loop_open       (ACQ_LOOP_TYPE *pLoop);
+/* Runs until a signal, 0 on a clean stop */
+int         acq_loop_run        (ACQ_LOOP_TYPE *pLoop);
+void        acq_loop_report     (const ACQ_LOOP_TYPE *pLoop, FILE *pOut);
+void        acq_loop_fini       (ACQ_LOOP_TYPE *pLoop);
+
+#endif /* ACQ_LOOP_H */
@@ -0,0 +1,363 @@
+/*
+ * Stream splitting and record classification, see acq_record.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "acq_record.h"
+
+static const char * const recNames[ACQ_REC_NUM] = {
+    "sample", "impedance", "monitor", "dclog", "hold", "peak",
+    "run_begin", "run_cfg", "run_end", "abort", "id", "status", "text"
+};
+
+const char *acq_record_name(ACQ_REC_KIND kind)
+{
+    return (kind < ACQ_REC_NUM) ? recNames[kind] : "?";
+}
+
+void acq_parser_init(ACQ_PARSER_TYPE *pParser)
+{
+    memset(pParser, 0, sizeof(*pParser));
+}
+
+static int is_num_start(char c)
+{
+    return ((c >= '0') && (c <= '9')) || ('-' == c);
+}
+
+/* Start of field n (0 is the tag), NULL if the line is shorter */
+static const char *field(const char *p, uint32_t n)
+{
+    while (n--)
+    {
+        p = strchr(p, ',');
+        if (NULL == p)
+        {
+            return NULL;
+        }
+        p++;
+    }
+    return p;
+}
+
+/* A whole field as a number: it has to end at a comma or the end */
+static int field_long(const char *p, int base, long *pVal)
+{
+    char       *pEnd;
+
+    if ((NULL == p) || ('\0' == *p) || (',' == *p))
+    {
+        return 0;
+    }
+    *pVal = strtol(p, &pEnd, base);
+    return ('\0' == *pEnd) || (',' == *pEnd);
+}
+
+static int field_double(const char *p, double *pVal)
+{
+    char       *pEnd;
+
+    if ((NULL == p) || ('\0' == *p) || (',' == *p))
+    {
+        return 0;
+    }
+    *pVal = strtod(p, &pEnd);
+    return ('\0' == *pEnd) || (',' == *pEnd);
+}
+
+/* Exactly three numbers from p on */
+static int parse_triple(const char *p, double *pA, double *pB, double *pC)
+{
+    return field_double(p, pA) && field_double(field(p, 1), pB) && field_double(field(p, 2), pC)
+           && (NULL == field(p, 3));
+}
+
+/* Leading numeric fields from field 1 on */
+static void parse_ints(const char *pText, ACQ_RECORD_TYPE *pRec)
+{
+    long        val;
+
+    pRec->u.Ints.Num = 0;
+    while ((pRec->u.Ints.Num < ACQ_INT_FIELDS) && field_long(field(pText, pRec->u.Ints.Num + 1u), 10, &val))
+    {
+        pRec->u.Ints.Field[pRec->u.Ints.Num++] = (int32_t)val;
+    }
+}
+
+/* "<value>[,<noise>][:<range>[!]][@<cycle>.<segment>]" */
+static int parse_sample(const char *p, ACQ_RECORD_TYPE *pRec)
+{
+    char       *pEnd;
+
+    memset(&pRec->u.Sample, 0, sizeof(pRec->u.Sample));
+    pRec->u.Sample.Range = -1;
+    pRec->u.Sample.Value = (int32_t)strtol(p, &pEnd, 10);
+    if (pEnd == p)
+    {
+        return 0;
+    }
+    p = pEnd;
+    if (',' == *p)
+    {
+        pRec->u.Sample.Noise = (int32_t)strtol(p + 1, &pEnd, 10);
+        if (pEnd == p + 1)
+        {
+            return 0;
+        }
+        pRec->u.Sample.HasNoise = 1;
+        p = pEnd;
+    }
+    if (':' == *p)
+    {
+        pRec->u.Sample.Range = (int8_t)strtol(p + 1, &pEnd, 10);
+        if (pEnd == p + 1)
+        {
+            return 0;
+        }
+        p = pEnd;
+        if ('!' == *p)
+        {
+            pRec->u.Sample.Sat = 1;
+            p++;
+        }
+    }
+    if ('@' == *p)
+    {
+        pRec->u.Sample.Cycle = (uint16_t)strtoul(p + 1, &pEnd, 10);
+        if ((pEnd == p + 1) || ('.' != *pEnd))
+        {
+            return 0;
+        }
+        p = pEnd + 1;
+        pRec->u.Sample.Segment = (uint8_t)strtoul(p, &pEnd, 10);
+        if (pEnd == p)
+        {
+            return 0;
+        }
+        p = pEnd;
+    }
+    return '\0' == *p;
+}
+
+static void parse_id(const char *pText, ACQ_RECORD_TYPE *pRec)
+{
+    const char *p;
+    size_t      n;
+    long        val;
+
+    memset(&pRec->u.Id, 0, sizeof(pRec->u.Id));
+    p = field(pText, 1);
+    n = strcspn(p, ",");
+    if (n >= sizeof(pRec->u.Id.Fw))
+    {
+        n = sizeof(pRec->u.Id.Fw) - 1u;
+    }
+    memcpy(pRec->u.Id.Fw, p, n);
+    p = field(pText, 2);
+    if (NULL != p)
+    {
+        n = strcspn(p, ",");
+        if (n >= sizeof(pRec->u.Id.Version))
+        {
+            n = sizeof(pRec->u.Id.Version) - 1u;
+        }
+        memcpy(pRec->u.Id.Version, p, n);
+    }
+    if (field_long(field(pText, 3), 10, &val))
+    {
+        pRec->u.Id.Device = (uint32_t)val;
+    }
+    if (field_long(field(pText, 4), 10, &val))
+    {
+        pRec->u.Id.Runs = (uint32_t)val;
+    }
+    if (field_long(field(pText, 5), 10, &val))
+    {
+        pRec->u.Id.Baud = (uint32_t)val;
+    }
+}
+
+static int prefix(const char *pText, const char *pTag)
+{
+    return 0 == strncmp(pText, pTag, strlen(pTag));
+}
+
+void acq_record_parse(char *pText, uint32_t len, ACQ_RECORD_TYPE *pRec)
+{
+    long        val;
+    const char *p;
+
+    pRec->Kind = ACQ_REC_TEXT;
+    pRec->pText = pText;
+    pRec->Len = len;
+
+    if (is_num_start(pText[0]))
+    {
+        /* 355 sweep point or 350 step result, which has one comma at most */
+        if (NULL != field(pText, 2))
+        {
+            if (parse_triple(pText, &pRec->u.Imp.Freq, &pRec->u.Imp.Mag, &pRec->u.Imp.Phase))
+            {
+                pRec->u.Imp.Chan = 0;
+                pRec->Kind = ACQ_REC_IMPEDANCE;
+            }
+        }
+        else if (parse_sample(pText, pRec))
+        {
+            pRec->Kind = ACQ_REC_SAMPLE;
+        }
+        return;
+    }
+    if (('C' == pText[0]) && (pText[1] >= '0') && (pText[1] <= '9') && (',' == pText[2]))
+    {
+        if (parse_triple(pText + 3, &pRec->u.Imp.Freq, &pRec->u.Imp.Mag, &pRec->u.Imp.Phase))
+        {
+            pRec->u.Imp.Chan = pText[1];
+            pRec->Kind = ACQ_REC_IMPEDANCE;
+        }
+        return;
+    }
+    if (prefix(pText, "RUN,BEGIN,") || prefix(pText, "M,BEGIN,"))
+    {
+        pRec->Kind = ACQ_REC_RUN_BEGIN;
+        memset(&pRec->u.Begin, 0, sizeof(pRec->u.Begin));
+        if ('M' == pText[0])
+        {
+            pRec->u.Begin.Mode = 'm';
+            return;
+        }
+        if (field_long(field(pText, 2), 10, &val))
+        {
+            pRec->u.Begin.Run = (uint32_t)val;
+        }
+        p = field(pText, 3);
+        if (NULL != p)
+        {
+            pRec->u.Begin.Mode = *p;
+        }
+        if (field_long(field(pText, 4), 16, &val))
+        {
+            pRec->u.Begin.Grid = (uint32_t)val;
+        }
+        return;
+    }
+    if (prefix(pText, "RUN,END,") || prefix(pText, "M,END,"))
+    {
+        pRec->Kind = ACQ_REC_RUN_END;
+        memset(&pRec->u.End, 0, sizeof(pRec->u.End));
+        if ('M' == pText[0])
+        {
+            if (field_long(field(pText, 2), 10, &val))
+            {
+                pRec->u.End.Points = (uint32_t)val;
+            }
+            return;
+        }
+        if (field_long(field(pText, 2), 10, &val))
+        {
+            pRec->u.End.Run = (uint32_t)val;
+        }
+        if (field_long(field(pText, 3), 10, &val))
+        {
+            pRec->u.End.Points = (uint32_t)val;
+        }
+        p = field(pText, 4);
+        pRec->u.End.Abort = (NULL != p) && prefix(p, "abort");
+        return;
+    }
+    if (prefix(pText, "RUN,CFG,"))
+    {
+        pRec->Kind = ACQ_REC_RUN_CFG;
+    }
+    else if (prefix(pText, "M,") && is_num_start(pText[2]))
+    {
+        if (parse_triple(pText + 2, &pRec->u.Mon.Ms, &pRec->u.Mon.Mag, &pRec->u.Mon.Phase))
+        {
+            pRec->Kind = ACQ_REC_MONITOR;
+        }
+    }
+    else if (prefix(pText, "I,") && is_num_start(pText[2]))
+    {
+        parse_ints(pText, pRec);
+        if (2u == pRec->u.Ints.Num)
+        {
+            pRec->Kind = ACQ_REC_DCLOG;
+        }
+    }
+    else if (prefix(pText, "HOLD,"))
+    {
+        pRec->Kind = ACQ_REC_HOLD;
+        parse_ints(pText, pRec);
+    }
+    else if (prefix(pText, "PK,"))
+    {
+        pRec->Kind = ACQ_REC_PEAK;
+        parse_ints(pText, pRec);
+    }
+    else if (prefix(pText, "STATUS,"))
+    {
+        pRec->Kind = ACQ_REC_STATUS;
+        parse_ints(pText, pRec);
+    }
+    else if (prefix(pText, "ID,"))
+    {
+        pRec->Kind = ACQ_REC_ID;
+        parse_id(pText, pRec);
+    }
+    else if (0 == strcmp(pText, "ABORT"))
+    {
+        pRec->Kind = ACQ_REC_ABORT;
+    }
+}
+
+void acq_parser_feed(ACQ_PARSER_TYPE *pParser, const char *pData, uint32_t len,
+                     ACQ_RECORD_CB cb, void *pCtx)
+{
+    ACQ_RECORD_TYPE rec;
+    uint32_t        i;
+    char            c;
+    int             end;
+
+    for (i = 0; i < len; i++)
+    {
+        c = pData[i];
+        /* Lines end at LF only, tokens at any blank */
+        end = pParser->Line ? ('\n' == c) : ((' ' == c) || ('\r' == c) || ('\n' == c));
+        if (pParser->Skip)
+        {
+            pParser->Skip = !end;
+            continue;
+        }
+        if (0u == pParser->Len)
+        {
+            if ((' ' == c) || ('\r' == c) || ('\n' == c))
+            {
+                continue;
+            }
+            pParser->Line = !is_num_start(c);
+            end = 0;
+        }
+        if (end)
+        {
+            pParser->Buf[pParser->Len] = '\0';
+            acq_record_parse(pParser->Buf, pParser->Len, &rec);
+            cb(pCtx, &rec);
+            pParser->Len = 0;
+            continue;
+        }
+        if ('\r' == c)
+        {
+            continue;
+        }
+        if (pParser->Len >= ACQ_LINE_MAX - 1u)
+        {
+            /* Garbage or a lost line end, drop the rest of it */
+            pParser->Overflows++;
+            pParser->Skip = 1;
+            pParser->Len = 0;
+            continue;
+        }
+        pParser->Buf[pParser->Len++] = c;
+    }
+}
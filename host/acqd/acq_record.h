@@ -0,0 +1,102 @@
+/*
+ * Typed records of the device UART streams.
+ *
+ * The ADuCM350 application streams its step results as space separated
+ * tokens ("<code>[,<noise>][:<range>[!]][@<cycle>.<segment>] ") between
+ * CRLF terminated lines (RUN, HOLD, PK, STATUS, ID, ABORT ...). The
+ * ADuCM355 application prints one CRLF line per result ("<f>,<mag>,<phase>",
+ * "C<ch>,..." and the "M,..." monitor lines). ACQ_PARSER_TYPE splits either
+ * stream into records, one byte at a time, in a fixed buffer.
+ */
+#ifndef ACQ_RECORD_H
+#define ACQ_RECORD_H
+
+#include <stdint.h>
+
+#define ACQ_LINE_MAX            (256u)  /* longest line or token kept       */
+#define ACQ_INT_FIELDS          (8u)
+
+typedef enum {
+    ACQ_REC_SAMPLE = 0,         /* 350 step result                          */
+    ACQ_REC_IMPEDANCE,          /* 355 sweep point                          */
+    ACQ_REC_MONITOR,            /* 355 "M,<ms>,<mag>,<phase>"               */
+    ACQ_REC_DCLOG,              /* 355 "I,<ms>,<code>"                      */
+    ACQ_REC_HOLD,               /* 350 "HOLD,<mV>,<ms>,<current>,<end>"     */
+    ACQ_REC_PEAK,               /* 350 "PK,<segment>,<dir>,<pot>,..."       */
+    ACQ_REC_RUN_BEGIN,          /* "RUN,BEGIN,..." and "M,BEGIN,..."        */
+    ACQ_REC_RUN_CFG,
+    ACQ_REC_RUN_END,            /* "RUN,END,..." and "M,END,..."            */
+    ACQ_REC_ABORT,
+    ACQ_REC_ID,
+    ACQ_REC_STATUS,
+    ACQ_REC_TEXT,               /* anything else, kept as is                */
+    ACQ_REC_NUM
+} ACQ_REC_KIND;
+
+typedef struct {
+    ACQ_REC_KIND        Kind;
+    const char         *pText;          /* the token or line, NUL terminated */
+    uint32_t            Len;
+    union {
+        struct {
+            int32_t     Value;
+            int32_t     Noise;
+            int8_t      Range;          /* -1 without a range tag           */
+            uint8_t     HasNoise;
+            uint8_t     Sat;
+            uint8_t     Segment;
+            uint16_t    Cycle;          /* 0 without a cycle tag            */
+        } Sample;
+        struct {
+            char        Chan;           /* '0'/'1', 0 for a plain sweep     */
+            double      Freq;
+            double      Mag;
+            double      Phase;
+        } Imp;
+        struct {
+            double      Ms;
+            double      Mag;
+            double      Phase;
+        } Mon;
+        struct {
+            uint32_t    Run;            /* 0 for a monitor stream           */
+            char        Mode;
+            uint32_t    Grid;           /* 355 frequency grid, 0 if none    */
+        } Begin;
+        struct {
+            uint32_t    Run;
+            uint32_t    Points;
+            uint8_t     Abort;
+        } End;
+        struct {
+            char        Fw[16];
+            char        Version[16];
+            uint32_t    Device;
+            uint32_t    Runs;
+            uint32_t    Baud;
+        } Id;
+        struct {
+            int32_t     Field[ACQ_INT_FIELDS];
+            uint32_t    Num;
+        } Ints;                         /* HOLD, PK, STATUS and I           */
+    } u;
+} ACQ_RECORD_TYPE;
+
+typedef void (*ACQ_RECORD_CB)(void *pCtx, const ACQ_RECORD_TYPE *pRec);
+
+typedef struct {
+    char                Buf[ACQ_LINE_MAX];
+    uint32_t            Len;
+    uint8_t             Line;           /* collecting a line, not a token   */
+    uint8_t             Skip;           /* overlong, drop until its end     */
+    uint32_t            Overflows;
+} ACQ_PARSER_TYPE;
+
+void        acq_parser_init     (ACQ_PARSER_TYPE *pParser);
+void        acq_parser_feed     (ACQ_PARSER_TYPE *pParser, const char *pData, uint32_t len,
+                                 ACQ_RECORD_CB cb, void *pCtx);
+/* Classify one complete token or line, pText must stay valid while pRec is used */
+void        acq_record_parse    (char *pText, uint32_t len, ACQ_RECORD_TYPE *pRec);
+const char *acq_record_name     (ACQ_REC_KIND kind);
+
+#endif /* ACQ_RECORD_H */
@@ -0,0 +1,95 @@
+/*
+ * Acquisition daemon for a bench of potentiostat boards.
+ *
+ *   acqd [-o dir] [-b baud] [-t idle ms] [-i] [name=]port ...
+ *
+ * Every port is read by one epoll loop, each device stream is split into
+ * typed records and written as runs under <dir>/<name>/. SIGINT or SIGTERM
+ * closes the open runs and prints one ACQ,DEV line per device.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "acq_loop.h"
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: acqd [-o dir] [-b baud] [-t idle ms] [-i] [name=]port ...\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    ACQ_DEVICE_TYPE    *pDev;
+    ACQ_LOOP_TYPE       loop;
+    const char         *pOut = ".";
+    uint32_t            baud = 9600u;
+    uint32_t            idleMs = 2000u;
+    uint8_t             identify = 0;
+    uint32_t            num;
+    uint32_t            i;
+    int                 opt;
+    int                 rc;
+
+    while (-1 != (opt = getopt(argc, argv, "o:b:t:i")))
+    {
+        switch (opt)
+        {
+        case 'o':
+            pOut = optarg;
+            break;
+        case 'b':
+            baud = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            idleMs = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            identify = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind >= argc)
+    {
+        usage();
+    }
+    if ((0 != mkdir(pOut, 0755)) && (EEXIST != errno))
+    {
+        perror(pOut);
+        return 1;
+    }
+    num = (uint32_t)(argc - optind);
+    /* The only allocation, sized once for the whole bench */
+    pDev = calloc(num, sizeof(ACQ_DEVICE_TYPE));
+    if (NULL == pDev)
+    {
+        return 1;
+    }
+    for (i = 0; i < num; i++)
+    {
+        if (0 != acq_device_init(&pDev[i], argv[optind + (int)i], pOut, baud))
+        {
+            fprintf(stderr, "acqd: %s: can't create its output\n", argv[optind + (int)i]);
+            return 1;
+        }
+    }
+    if (0 != acq_loop_init(&loop, pDev, num))
+    {
+        perror("acqd");
+        return 1;
+    }
+    loop.IdleMs = idleMs;
+    loop.Identify = identify;
+    acq_loop_open(&loop);
+    rc = acq_loop_run(&loop);
+    acq_loop_fini(&loop);
+    acq_loop_report(&loop, stdout);
+    free(pDev);
+    return (0 == rc) ? 0 : 1;
+}
@@ -0,0 +1,440 @@
+/*
+ * Load test of the acquisition loop against emulated boards on ptys.
+ *
+ *   test_acq_load [devices [seconds [baud [max cpu %]]]]
+ *
+ * The loop runs in a child pinned to one core and opens the pty slaves as
+ * it would open serial ports. This process plays the boards on the pty
+ * masters: it answers 'i' and then streams at the line rate of the baud,
+ * a third each of 350 scans with run markers, 355 sweeps with run markers
+ * and legacy 350 scans that only an idle gap ends. Every run has to land
+ * on disk complete, and the loop has to stay under the CPU budget.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "acq_loop.h"
+
+#define LOAD_IDLE_MS            (300u)
+#define LOAD_GAP_MS             (2u * LOAD_IDLE_MS)
+#define LOAD_MAX_RUNS           (512u)
+
+typedef enum {
+    EMU_350 = 0,                /* RUN markers, step results              */
+    EMU_355,                    /* RUN markers, sweep points              */
+    EMU_LEGACY,                 /* 350 without markers, gaps between runs */
+    EMU_NUM
+} EMU_KIND;
+
+typedef struct {
+    int                 Master;
+    char                Slave[64];
+    EMU_KIND            Kind;
+    char               *pScript;
+    uint32_t            Len;
+    uint32_t            Sent;
+    uint32_t            Gap[LOAD_MAX_RUNS];     /* offsets to pause after  */
+    uint32_t            NumGaps;
+    uint32_t            NextGap;
+    uint32_t            Points[LOAD_MAX_RUNS];  /* results per run          */
+    uint32_t            Runs;
+    uint8_t             Started;                /* 'i' answered             */
+    double              Credit;
+    uint64_t            ResumeUs;
+    uint32_t            Stalls;
+} EMU_TYPE;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void append(EMU_TYPE *pEmu, uint32_t *pCap, const char *pText)
+{
+    uint32_t    n = (uint32_t)strlen(pText);
+
+    if (pEmu->Len + n + 1u > *pCap)
+    {
+        *pCap = 2u * (*pCap + n);
+        pEmu->pScript = realloc(pEmu->pScript, *pCap);
+        if (NULL == pEmu->pScript)
+        {
+            exit(1);
+        }
+    }
+    memcpy(pEmu->pScript + pEmu->Len, pText, n);
+    pEmu->Len += n;
+}
+
+/* Whole runs until the stream, gaps included, lasts seconds at bytesPerS */
+static void build_script(EMU_TYPE *pEmu, uint32_t index, double seconds, double bytesPerS)
+{
+    static const double freqs[5] = { 10.0, 3.1623, 1.0, 0.31623, 0.1 };
+    uint32_t    cap = 0;
+    uint32_t    points;
+    uint32_t    p;
+    char        line[160];
+
+    pEmu->Kind = (EMU_KIND)(index % EMU_NUM);
+    while (((double)pEmu->Len / bytesPerS + pEmu->NumGaps * LOAD_GAP_MS / 1000.0 < seconds) &&
+           (pEmu->Runs < LOAD_MAX_RUNS))
+    {
+        points = 0;
+        switch (pEmu->Kind)
+        {
+        case EMU_350:
+            snprintf(line, sizeof(line), "RUN,BEGIN,%u,a\r\nRUN,CFG,a,-500,600,10,100,0,200,n,1,1\r\n",
+                     pEmu->Runs + 1u);
+            append(pEmu, &cap, line);
+            for (p = 0; p < 220u; p++)
+            {
+                snprintf(line, sizeof(line), (p % 50u) ? "%u " : "%u:1 ", 30000u + (p * 37u + index) % 5000u);
+                append(pEmu, &cap, line);
+                points++;
+            }
+            snprintf(line, sizeof(line), "PK,0,1,-120,41,3300\r\nRUN,END,%u,%u,ok\r\n", pEmu->Runs + 1u, points);
+            append(pEmu, &cap, line);
+            break;
+        case EMU_355:
+            snprintf(line, sizeof(line), "RUN,BEGIN,%u,1,3A7F\r\nRUN,CFG,200,5,10.0000;3.1623;1.0000;0.3162;0.1000\r\n",
+                     pEmu->Runs + 1u);
+            append(pEmu, &cap, line);
+            for (p = 0; p < 5u; p++)
+            {
+                snprintf(line, sizeof(line), "%.4f,%.4f,%.4f\r\n", freqs[p], 1000.0 + index + p * 13.5,
+                         -10.0 - p * 7.25);
+                append(pEmu, &cap, line);
+                points++;
+            }
+            snprintf(line, sizeof(line), "RUN,END,%u,%u\r\nPWR,1500,1200\r\n", pEmu->Runs + 1u, points);
+            append(pEmu, &cap, line);
+            break;
+        default:
+            for (p = 0; p < 150u; p++)
+            {
+                snprintf(line, sizeof(line), "%u,%u ", 31000u + (p * 53u + index) % 4000u, p % 17u);
+                append(pEmu, &cap, line);
+                points++;
+            }
+            pEmu->Gap[pEmu->NumGaps++] = pEmu->Len;
+            break;
+        }
+        pEmu->Points[pEmu->Runs++] = points;
+    }
+}
+
+static int open_pty(EMU_TYPE *pEmu)
+{
+    pEmu->Master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if ((pEmu->Master < 0) || (0 != grantpt(pEmu->Master)) || (0 != unlockpt(pEmu->Master)) ||
+        (0 != ptsname_r(pEmu->Master, pEmu->Slave, sizeof(pEmu->Slave))))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/* The acquisition loop, as acqd runs it, on core 0 */
+static void daemon_child(EMU_TYPE *pEmu, uint32_t num, const char *pDir, uint32_t baud, int ready)
+{
+    static ACQ_DEVICE_TYPE  dev[1024];
+    ACQ_LOOP_TYPE           loop;
+    cpu_set_t               cpus;
+    char                    spec[128];
+    char                    path[600];
+    FILE                   *pReport;
+    uint32_t                i;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(0, &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+    for (i = 0; i < num; i++)
+    {
+        close(pEmu[i].Master);
+        snprintf(spec, sizeof(spec), "dev%03u=%s", i, pEmu[i].Slave);
+        if (0 != acq_device_init(&dev[i], spec, pDir, baud))
+        {
+            _exit(3);
+        }
+    }
+    if (0 != acq_loop_init(&loop, dev, num))
+    {
+        _exit(3);
+    }
+    loop.IdleMs = LOAD_IDLE_MS;
+    loop.Identify = 1;
+    acq_loop_open(&loop);
+    if (1 != write(ready, "R", 1))
+    {
+        _exit(3);
+    }
+    if (0 != acq_loop_run(&loop))
+    {
+        _exit(4);
+    }
+    acq_loop_fini(&loop);
+    snprintf(path, sizeof(path), "%s/report.txt", pDir);
+    pReport = fopen(path, "w");
+    if (NULL != pReport)
+    {
+        acq_loop_report(&loop, pReport);
+        fprintf(pReport, "ACQ,WAKEUPS,%llu\n", (unsigned long long)loop.Wakeups);
+        fclose(pReport);
+    }
+    _exit(0);
+}
+
+/* One emulation step of a board: answer 'i', then stream what the line rate allows */
+static void emulate(EMU_TYPE *pEmu, uint32_t index, uint64_t now, double bytesPerUs)
+{
+    char        cmd[16];
+    char        id[64];
+    uint32_t    chunk;
+    ssize_t     n;
+    int         len;
+
+    n = read(pEmu->Master, cmd, sizeof(cmd));
+    if ((n > 0) && (NULL != memchr(cmd, 'i', (size_t)n)) && !pEmu->Started)
+    {
+        len = snprintf(id, sizeof(id), "ID,%s,1.1,%u,0,9600,5\r\n", (EMU_355 == pEmu->Kind) ? "EIS355" : "VBP350",
+                       index);
+        if (len == write(pEmu->Master, id, (size_t)len))
+        {
+            pEmu->Started = 1;
+            pEmu->ResumeUs = now;
+        }
+    }
+    if (!pEmu->Started || (pEmu->Sent >= pEmu->Len) || (now < pEmu->ResumeUs))
+    {
+        return;
+    }
+    pEmu->Credit += (double)(now - pEmu->ResumeUs) * bytesPerUs;
+    pEmu->ResumeUs = now;
+    chunk = (uint32_t)pEmu->Credit;
+    if (pEmu->Sent + chunk > pEmu->Len)
+    {
+        chunk = pEmu->Len - pEmu->Sent;
+    }
+    if ((pEmu->NextGap < pEmu->NumGaps) && (pEmu->Sent + chunk >= pEmu->Gap[pEmu->NextGap]))
+    {
+        chunk = pEmu->Gap[pEmu->NextGap] - pEmu->Sent;
+    }
+    if (0u == chunk)
+    {
+        return;
+    }
+    n = write(pEmu->Master, pEmu->pScript + pEmu->Sent, chunk);
+    if (n < 0)
+    {
+        /* The pty is full: the loop did not keep up with the line rate */
+        pEmu->Stalls++;
+        return;
+    }
+    pEmu->Sent += (uint32_t)n;
+    pEmu->Credit -= (double)n;
+    if ((pEmu->NextGap < pEmu->NumGaps) && (pEmu->Sent == pEmu->Gap[pEmu->NextGap]))
+    {
+        pEmu->NextGap++;
+        pEmu->ResumeUs = now + LOAD_GAP_MS * 1000u;
+        pEmu->Credit = 0.0;
+    }
+}
+
+/* Results and the end line of one run file */
+static int read_run(const char *pPath, uint32_t *pResults, char *pEnd, size_t endLen)
+{
+    char        line[512];
+    FILE       *pF = fopen(pPath, "r");
+
+    if (NULL == pF)
+    {
+        return -1;
+    }
+    *pResults = 0;
+    pEnd[0] = '\0';
+    while (NULL != fgets(line, sizeof(line), pF))
+    {
+        if (('S' == line[0]) || ('Z' == line[0]))
+        {
+            (*pResults)++;
+        }
+        else if (0 == strncmp(line, "# end,", 6) || (0 == strncmp(line, "# idle,", 7)) ||
+                 (0 == strncmp(line, "# cut,", 6)) || (0 == strncmp(line, "# abort,", 8)))
+        {
+            snprintf(pEnd, endLen, "%.48s", line + 2);
+        }
+    }
+    fclose(pF);
+    return 0;
+}
+
+static void verify(const EMU_TYPE *pEmu, uint32_t num, const char *pDir)
+{
+    char        path[700];
+    char        end[64];
+    char        want[64];
+    uint32_t    results;
+    uint32_t    i;
+    uint32_t    r;
+    uint32_t    bad = 0;
+
+    for (i = 0; i < num; i++)
+    {
+        for (r = 0; r < pEmu[i].Runs; r++)
+        {
+            snprintf(path, sizeof(path), "%s/dev%03u/run-%06u.csv", pDir, i, r + 1u);
+            snprintf(want, sizeof(want), "%s,%u\n", (EMU_LEGACY == pEmu[i].Kind) ? "idle" : "end", pEmu[i].Points[r]);
+            if (0 != read_run(path, &results, end, sizeof(end)))
+            {
+                if (bad++ < 10u)
+                {
+                    fprintf(stderr, "%s: missing\n", path);
+                }
+            }
+            else if ((results != pEmu[i].Points[r]) || (0 != strcmp(end, want)))
+            {
+                if (bad++ < 10u)
+                {
+                    fprintf(stderr, "%s: %u results, want %u, ends %s", path, results, pEmu[i].Points[r], end);
+                }
+            }
+        }
+        snprintf(path, sizeof(path), "%s/dev%03u/run-%06u.csv", pDir, i, pEmu[i].Runs + 1u);
+        CHECK(0 != access(path, F_OK));
+    }
+    CHECK(0u == bad);
+}
+
+int main(int argc, char **argv)
+{
+    static EMU_TYPE     emu[1024];
+    uint32_t            num = (argc > 1) ? (uint32_t)atoi(argv[1]) : 64u;
+    double              seconds = (argc > 2) ? atof(argv[2]) : 3.0;
+    uint32_t            baud = (argc > 3) ? (uint32_t)atoi(argv[3]) : 115200u;
+    double              maxCpu = (argc > 4) ? atof(argv[4]) : 50.0;
+    double              bytesPerUs = (double)baud / 10.0 / 1e6;
+    char                shm[] = "/dev/shm/acq_loadXXXXXX";
+    char                tmp[] = "/tmp/acq_loadXXXXXX";
+    char               *dir;
+    char                cmd[64];
+    struct rusage       ru;
+    struct timespec     ts = { 0, 1000000L };
+    cpu_set_t           cpus;
+    uint64_t            t0, t1, tEnd;
+    uint64_t            bytes = 0;
+    uint64_t            results = 0;
+    uint32_t            stalls = 0;
+    uint32_t            done;
+    uint32_t            i, r;
+    double              cpu;
+    int                 ready[2];
+    int                 status;
+    pid_t               child;
+    char                c;
+
+    /* The runs go to tmpfs where there is one: at this rate a board starts
+     * several run files a second and the cost of creating them on a disk
+     * file system depends on what was deleted before, not on the loop */
+    dir = mkdtemp(shm);
+    dir = (NULL != dir) ? dir : mkdtemp(tmp);
+    if ((num < 1u) || (num > 1024u) || (NULL == dir) || (0 != pipe(ready)))
+    {
+        return 2;
+    }
+    for (i = 0; i < num; i++)
+    {
+        if (0 != open_pty(&emu[i]))
+        {
+            fprintf(stderr, "pty %u: %s\n", i, strerror(errno));
+            return 2;
+        }
+        build_script(&emu[i], i, seconds, (double)baud / 10.0);
+    }
+    child = fork();
+    if (0 == child)
+    {
+        close(ready[0]);
+        daemon_child(emu, num, dir, baud, ready[1]);
+    }
+    close(ready[1]);
+    if (1 != read(ready[0], &c, 1))
+    {
+        fprintf(stderr, "acquisition loop did not start\n");
+        return 1;
+    }
+    /* The boards get their own core where there is one */
+    CPU_ZERO(&cpus);
+    CPU_SET((sysconf(_SC_NPROCESSORS_ONLN) > 1) ? 1 : 0, &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+
+    t0 = now_us();
+    tEnd = t0 + (uint64_t)(seconds * 4e6) + 5000000u;
+    do
+    {
+        done = 0;
+        t1 = now_us();
+        for (i = 0; i < num; i++)
+        {
+            emulate(&emu[i], i, t1, bytesPerUs);
+            done += (emu[i].Sent >= emu[i].Len);
+        }
+        nanosleep(&ts, NULL);
+    } while ((done < num) && (now_us() < tEnd));
+    t1 = now_us();
+    /* Last legacy runs end by idle */
+    usleep((LOAD_IDLE_MS + 2u * ACQ_TICK_MS) * 1000u);
+    kill(child, SIGTERM);
+    if ((child != wait4(child, &status, 0, &ru)) || !WIFEXITED(status) || (0 != WEXITSTATUS(status)))
+    {
+        fprintf(stderr, "acquisition loop failed, status %d\n", status);
+        return 1;
+    }
+    CHECK(done == num);
+
+    for (i = 0; i < num; i++)
+    {
+        bytes += emu[i].Sent;
+        stalls += emu[i].Stalls;
+        for (r = 0; r < emu[i].Runs; r++)
+        {
+            results += emu[i].Points[r];
+        }
+    }
+    cpu = 100.0 * ((double)ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + (double)ru.ru_stime.tv_sec +
+                   ru.ru_stime.tv_usec / 1e6) / ((double)(t1 - t0) / 1e6);
+    /* LOAD,<devices>,<baud>,<seconds>,<bytes/s>,<results/s>,<loop cpu %>,<pty full> */
+    printf("LOAD,%u,%u,%.2f,%.0f,%.0f,%.1f,%u\n", num, baud, (double)(t1 - t0) / 1e6,
+           (double)bytes / ((double)(t1 - t0) / 1e6), (double)results / ((double)(t1 - t0) / 1e6), cpu, stalls);
+    verify(emu, num, dir);
+    CHECK(0u == stalls);
+    CHECK(cpu < maxCpu);
+
+    for (i = 0; i < num; i++)
+    {
+        close(emu[i].Master);
+        free(emu[i].pScript);
+    }
+    if (0 == checkFailures)
+    {
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+        CHECK(0 == system(cmd));
+    }
+    else
+    {
+        fprintf(stderr, "output kept in %s\n", dir);
+    }
+    return CHECK_DONE();
+}
@@ -0,0 +1,258 @@
+/*
+ * Stream parser and run files of the acquisition daemon, on the lines the
+ * two applications print.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "acq_device.h"
+
+typedef struct {
+    ACQ_RECORD_TYPE     Rec[64];
+    char                Text[64][ACQ_LINE_MAX];
+    uint32_t            Num;
+} LOG_TYPE;
+
+static void on_rec(void *pCtx, const ACQ_RECORD_TYPE *pRec)
+{
+    LOG_TYPE   *pLog = (LOG_TYPE *)pCtx;
+
+    if (pLog->Num < 64u)
+    {
+        pLog->Rec[pLog->Num] = *pRec;
+        snprintf(pLog->Text[pLog->Num], ACQ_LINE_MAX, "%s", pRec->pText);
+        pLog->Rec[pLog->Num].pText = pLog->Text[pLog->Num];
+        pLog->Num++;
+    }
+}
+
+/* A 350 scan with markers, tags and peaks, then a 355 sweep and monitor */
+static const char stream[] =
+    "\r\nID,VBP350,1.1,7,3,9600,812\r\n"
+    "RUN,BEGIN,4,a\r\n"
+    "RUN,CFG,a,-500,600,10,100,0,200,n,4,2\r\n"
+    "32768 32900,12 -1534 -2040,3:2! 33000:0@1.0 33010,7:1@2.1 "
+    "HOLD,-500,2000,-1534,stable\r\n"
+    "PK,0,1,-120,41,3300\r\n"
+    "STATUS,run,12\r\n"
+    "ABORT\r\n"
+    "RUN,END,4,5,abort\r\n"
+    "RUN,BEGIN,9,1,3A7F\r\n"
+    "10.0000,1234.5678,-45.1230\r\n"
+    "C0,3.1623,2210.0000,-61.0000\r\n"
+    "RUN,END,9,2\r\n"
+    "M,BEGIN,1.0000,1\r\n"
+    "M,12.345,1000.0000,-10.5000\r\n"
+    "M,LOST,3\r\n"
+    "M,END,1,3\r\n"
+    "I,1500,2048\r\n"
+    "SEQ,LEN,412,140000,0\r\n"
+    "  1234\r\n";
+
+static void check_stream(const LOG_TYPE *pLog)
+{
+    const ACQ_RECORD_TYPE *r = pLog->Rec;
+
+    CHECK(25u == pLog->Num);
+    CHECK((ACQ_REC_ID == r[0].Kind) && (0 == strcmp("VBP350", r[0].u.Id.Fw)) && (7u == r[0].u.Id.Device) &&
+          (3u == r[0].u.Id.Runs) && (9600u == r[0].u.Id.Baud) && (0 == strcmp("1.1", r[0].u.Id.Version)));
+    CHECK((ACQ_REC_RUN_BEGIN == r[1].Kind) && (4u == r[1].u.Begin.Run) && ('a' == r[1].u.Begin.Mode) &&
+          (0u == r[1].u.Begin.Grid));
+    CHECK(ACQ_REC_RUN_CFG == r[2].Kind);
+    CHECK((ACQ_REC_SAMPLE == r[3].Kind) && (32768 == r[3].u.Sample.Value) && !r[3].u.Sample.HasNoise &&
+          (-1 == r[3].u.Sample.Range));
+    CHECK((ACQ_REC_SAMPLE == r[4].Kind) && (32900 == r[4].u.Sample.Value) && (12 == r[4].u.Sample.Noise) &&
+          r[4].u.Sample.HasNoise);
+    CHECK((ACQ_REC_SAMPLE == r[5].Kind) && (-1534 == r[5].u.Sample.Value));
+    CHECK((ACQ_REC_SAMPLE == r[6].Kind) && (-2040 == r[6].u.Sample.Value) && (3 == r[6].u.Sample.Noise) &&
+          (2 == r[6].u.Sample.Range) && r[6].u.Sample.Sat);
+    CHECK((ACQ_REC_SAMPLE == r[7].Kind) && (0 == r[7].u.Sample.Range) && !r[7].u.Sample.Sat &&
+          (1u == r[7].u.Sample.Cycle) && (0u == r[7].u.Sample.Segment));
+    CHECK((ACQ_REC_SAMPLE == r[8].Kind) && (7 == r[8].u.Sample.Noise) && (1 == r[8].u.Sample.Range) &&
+          (2u == r[8].u.Sample.Cycle) && (1u == r[8].u.Sample.Segment));
+    CHECK((ACQ_REC_HOLD == r[9].Kind) && (3u == r[9].u.Ints.Num) && (-500 == r[9].u.Ints.Field[0]) &&
+          (-1534 == r[9].u.Ints.Field[2]));
+    CHECK((ACQ_REC_PEAK == r[10].Kind) && (5u == r[10].u.Ints.Num) && (3300 == r[10].u.Ints.Field[4]));
+    CHECK(ACQ_REC_STATUS == r[11].Kind);
+    CHECK(ACQ_REC_ABORT == r[12].Kind);
+    CHECK((ACQ_REC_RUN_END == r[13].Kind) && (4u == r[13].u.End.Run) && (5u == r[13].u.End.Points) &&
+          r[13].u.End.Abort);
+    CHECK((ACQ_REC_RUN_BEGIN == r[14].Kind) && (9u == r[14].u.Begin.Run) && ('1' == r[14].u.Begin.Mode) &&
+          (0x3A7Fu == r[14].u.Begin.Grid));
+    CHECK((ACQ_REC_IMPEDANCE == r[15].Kind) && (0 == r[15].u.Imp.Chan) && (10.0 == r[15].u.Imp.Freq) &&
+          (1234.5678 == r[15].u.Imp.Mag) && (-45.123 == r[15].u.Imp.Phase));
+    CHECK((ACQ_REC_IMPEDANCE == r[16].Kind) && ('0' == r[16].u.Imp.Chan) && (3.1623 == r[16].u.Imp.Freq));
+    CHECK((ACQ_REC_RUN_END == r[17].Kind) && (2u == r[17].u.End.Points) && !r[17].u.End.Abort);
+    CHECK((ACQ_REC_RUN_BEGIN == r[18].Kind) && ('m' == r[18].u.Begin.Mode));
+    CHECK((ACQ_REC_MONITOR == r[19].Kind) && (12.345 == r[19].u.Mon.Ms) && (-10.5 == r[19].u.Mon.Phase));
+    CHECK(ACQ_REC_TEXT == r[20].Kind);
+    CHECK((ACQ_REC_RUN_END == r[21].Kind) && (1u == r[21].u.End.Points));
+    CHECK((ACQ_REC_DCLOG == r[22].Kind) && (2048 == r[22].u.Ints.Field[1]));
+    CHECK((ACQ_REC_TEXT == r[23].Kind) && (0 == strcmp("SEQ,LEN,412,140000,0", r[23].pText)));
+    CHECK((ACQ_REC_SAMPLE == r[24].Kind) && (1234 == r[24].u.Sample.Value));
+}
+
+/* The same records whatever the read boundaries */
+static void test_parse(void)
+{
+    static LOG_TYPE     whole;
+    static LOG_TYPE     split;
+    ACQ_PARSER_TYPE     parser;
+    uint32_t            len = (uint32_t)sizeof(stream) - 1u;
+    uint32_t            cut;
+    uint32_t            i;
+
+    acq_parser_init(&parser);
+    acq_parser_feed(&parser, stream, len, on_rec, &whole);
+    check_stream(&whole);
+    for (cut = 1; cut < len; cut += 7u)
+    {
+        memset(&split, 0, sizeof(split));
+        acq_parser_init(&parser);
+        acq_parser_feed(&parser, stream, cut, on_rec, &split);
+        acq_parser_feed(&parser, stream + cut, len - cut, on_rec, &split);
+        CHECK(split.Num == whole.Num);
+        for (i = 0; (i < split.Num) && (i < whole.Num); i++)
+        {
+            CHECK((split.Rec[i].Kind == whole.Rec[i].Kind) && (0 == strcmp(split.Text[i], whole.Text[i])));
+        }
+    }
+}
+
+/* Garbage without line ends costs no memory and is dropped as a whole */
+static void test_overflow(void)
+{
+    static LOG_TYPE     log;
+    static char         junk[3u * ACQ_LINE_MAX];
+    ACQ_PARSER_TYPE     parser;
+
+    memset(junk, 'Z', sizeof(junk));
+    acq_parser_init(&parser);
+    acq_parser_feed(&parser, junk, sizeof(junk), on_rec, &log);
+    acq_parser_feed(&parser, "ZZ\r\nRUN,END,1,0\r\n", 17u, on_rec, &log);
+    memset(junk, '1', sizeof(junk));
+    acq_parser_feed(&parser, junk, sizeof(junk), on_rec, &log);
+    acq_parser_feed(&parser, " 42 ", 4u, on_rec, &log);
+    CHECK(2u == parser.Overflows);
+    CHECK(2u == log.Num);
+    CHECK(ACQ_REC_RUN_END == log.Rec[0].Kind);
+    CHECK((ACQ_REC_SAMPLE == log.Rec[1].Kind) && (42 == log.Rec[1].u.Sample.Value));
+}
+
+static uint32_t count_lines(const char *pPath, char kind)
+{
+    char        line[512];
+    uint32_t    n = 0;
+    FILE       *pF = fopen(pPath, "r");
+
+    if (NULL == pF)
+    {
+        return 0xFFFFFFFFu;
+    }
+    while (NULL != fgets(line, sizeof(line), pF))
+    {
+        n += (kind == line[0]);
+    }
+    fclose(pF);
+    return n;
+}
+
+static int file_has(const char *pPath, const char *pText)
+{
+    static char buf[1u << 16];
+    FILE       *pF = fopen(pPath, "r");
+    size_t      n;
+
+    if (NULL == pF)
+    {
+        return 0;
+    }
+    n = fread(buf, 1, sizeof(buf) - 1u, pF);
+    buf[n] = '\0';
+    fclose(pF);
+    return NULL != strstr(buf, pText);
+}
+
+/* Runs: framed, implicit closed by ABORT or idle, cut by a new begin */
+static void test_runs(void)
+{
+    static ACQ_DEVICE_TYPE  dev;
+    char                    dir[] = "/tmp/acq_recXXXXXX";
+    char                    path[1024];
+    char                    cmd[1100];
+
+    CHECK(NULL != mkdtemp(dir));
+    CHECK(0 == acq_device_init(&dev, "bench7=/dev/null", dir, 9600u));
+    CHECK(0 == strcmp("bench7", dev.Name));
+    acq_device_input(&dev, stream, (uint32_t)sizeof(stream) - 1u, 1000u);
+    /* I,... and the "  1234" after M,END are results outside a run */
+    acq_device_tick(&dev, 3000u, 2000u);
+    CHECK(dev.RunFd < 0);
+    /* 350 legacy scan, no markers: ABORT ends it */
+    acq_device_input(&dev, "100 101 102 ABORT\r\n", 19u, 4000u);
+    CHECK(dev.RunFd < 0);
+    /* Implicit run ending by idle */
+    acq_device_input(&dev, "200 201 ", 8u, 5000u);
+    acq_device_tick(&dev, 6000u, 2000u);
+    CHECK(dev.RunFd >= 0);
+    acq_device_tick(&dev, 7000u, 2000u);
+    CHECK(dev.RunFd < 0);
+    /* A begin before the end cuts the open run */
+    acq_device_input(&dev, "RUN,BEGIN,10,a\r\n300 RUN,BEGIN,11,a\r\n301 302 RUN,END,11,2,ok\r\n", 61u, 8000u);
+    acq_device_fini(&dev);
+
+    CHECK(8u == dev.Stats.Runs);
+    CHECK(3u == dev.Stats.RunEnds[ACQ_END_MARKER]);
+    CHECK(2u == dev.Stats.RunEnds[ACQ_END_ABORT]);
+    CHECK(2u == dev.Stats.RunEnds[ACQ_END_IDLE]);
+    CHECK(1u == dev.Stats.RunEnds[ACQ_END_CUT]);
+    CHECK(0u == dev.Stats.WriteErrors);
+
+    snprintf(path, sizeof(path), "%s/bench7/run-000001.csv", dir);
+    CHECK(6u == count_lines(path, 'S'));
+    CHECK(file_has(path, "# bench7,VBP350,7,"));
+    CHECK(file_has(path, "# RUN,CFG,a,-500,600"));
+    CHECK(file_has(path, "S,4,-2040,3,2,1,0,0\n"));
+    CHECK(file_has(path, "HOLD,-500,2000,-1534,stable\n"));
+    CHECK(file_has(path, "# abort,6\n"));
+    snprintf(path, sizeof(path), "%s/bench7/run-000002.csv", dir);
+    CHECK(2u == count_lines(path, 'Z'));
+    CHECK(file_has(path, "Z,1,-,10.0000,1234.5678,-45.1230\n"));
+    CHECK(file_has(path, "Z,2,0,3.1623,2210.0000,-61.0000\n"));
+    CHECK(file_has(path, "# end,2\n"));
+    snprintf(path, sizeof(path), "%s/bench7/run-000003.csv", dir);
+    CHECK(1u == count_lines(path, 'M'));
+    snprintf(path, sizeof(path), "%s/bench7/run-000004.csv", dir);
+    CHECK((1u == count_lines(path, 'I')) && (1u == count_lines(path, 'S')));
+    CHECK(file_has(path, "# idle,2\n"));
+    snprintf(path, sizeof(path), "%s/bench7/run-000005.csv", dir);
+    CHECK((3u == count_lines(path, 'S')) && file_has(path, "# abort,3\n"));
+    snprintf(path, sizeof(path), "%s/bench7/run-000006.csv", dir);
+    CHECK((2u == count_lines(path, 'S')) && file_has(path, "# idle,2\n"));
+    snprintf(path, sizeof(path), "%s/bench7/run-000007.csv", dir);
+    CHECK((1u == count_lines(path, 'S')) && file_has(path, "# cut,1\n"));
+    snprintf(path, sizeof(path), "%s/bench7/run-000008.csv", dir);
+    CHECK((2u == count_lines(path, 'S')) && file_has(path, "# end,2\n"));
+    snprintf(path, sizeof(path), "%s/bench7/events.log", dir);
+    CHECK(file_has(path, "ID,VBP350,1.1,7,3,9600,812\n"));
+    CHECK(file_has(path, "STATUS,run,12\n"));
+    CHECK(file_has(path, "SEQ,LEN,412,140000,0\n"));
+
+    /* Numbering goes on after a restart in the same directory */
+    CHECK(0 == acq_device_init(&dev, "bench7=/dev/null", dir, 9600u));
+    CHECK(8u == dev.RunSeq);
+    acq_device_fini(&dev);
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    CHECK(0 == system(cmd));
+}
+
+int main(void)
+{
+    test_parse();
+    test_overflow();
+    test_runs();
+    return CHECK_DONE();
+}
@@ -0,0 +1,128 @@
+/*
+ * Spectra per second of the DRT engine.
+ *
+ *   bench_drt [spectra [threads [points per decade [taus]]]]
+ *
+ * rebuild forms and factors the system for every spectrum, as the analysis
+ * scripts did, cached solves on the factor of the grid, on one thread and
+ * then on threads (0 all cores). The grid runs 100 kHz to 0.1 Hz.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drt.h"
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    DRT_PARAM_TYPE          param;
+    DRT_CACHE_TYPE          cache;
+    DRT_GRID_TYPE           grid;
+    const DRT_GRID_TYPE    *pGrid;
+    uint32_t                count = (argc > 1) ? (uint32_t)atoi(argv[1]) : 100000u;
+    uint32_t                threads = (argc > 2) ? (uint32_t)atoi(argv[2]) : 0u;
+    uint32_t                perDecade = (argc > 3) ? (uint32_t)atoi(argv[3]) : 10u;
+    double                  freq[DRT_MAX_FREQS];
+    double                  w;
+    double                  t1;
+    double                  t2;
+    double                 *pRe;
+    double                 *pIm;
+    double                 *pX;
+    double                  t;
+    double                  check = 0.0;
+    uint32_t                nf = 6u * perDecade + 1u;
+    uint32_t                rebuilds = (count < 200u) ? count : 200u;
+    uint32_t                s;
+    uint32_t                k;
+
+    drt_param_default(&param);
+    param.Taus = (argc > 4) ? (uint32_t)atoi(argv[4]) : param.Taus;
+    if ((0u == count) || (0u == perDecade) || (nf > DRT_MAX_FREQS))
+    {
+        fprintf(stderr, "usage: bench_drt [spectra [threads [points per decade [taus]]]]\n");
+        return 2;
+    }
+    if (0u == threads)
+    {
+        threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    for (k = 0; k < nf; k++)
+    {
+        freq[k] = 1e5 * pow(10.0, -(double)k / perDecade);
+    }
+    pRe = malloc((size_t)count * nf * sizeof(double));
+    pIm = malloc((size_t)count * nf * sizeof(double));
+    pX = malloc((size_t)count * (param.Taus + 1u) * sizeof(double));
+    if ((NULL == pRe) || (NULL == pIm) || (NULL == pX))
+    {
+        return 1;
+    }
+    /* Two RC in series, time constants drifting from spectrum to spectrum */
+    for (s = 0; s < count; s++)
+    {
+        t1 = 1e-4 * (1.0 + (s % 97) / 97.0);
+        t2 = 1e-1 * (1.0 + (s % 89) / 89.0);
+        for (k = 0; k < nf; k++)
+        {
+            w = 2.0 * M_PI * freq[k];
+            pRe[(size_t)s * nf + k] = 20.0 + 500.0 / (1.0 + w * w * t1 * t1) + 2000.0 / (1.0 + w * w * t2 * t2);
+            pIm[(size_t)s * nf + k] = -500.0 * w * t1 / (1.0 + w * w * t1 * t1) -
+                                      2000.0 * w * t2 / (1.0 + w * w * t2 * t2);
+        }
+    }
+    printf("DRT,GRID,%u points,%u taus,order %u\n", nf, param.Taus, param.Order);
+
+    memset(&grid, 0, sizeof(grid));
+    t = now_s();
+    for (s = 0; s < rebuilds; s++)
+    {
+        if (0 != drt_grid_build(&grid, &param, 0u, freq, nf))
+        {
+            return 1;
+        }
+        drt_solve(&grid, &pRe[(size_t)s * nf], &pIm[(size_t)s * nf], pX);
+    }
+    t = now_s() - t;
+    drt_grid_free(&grid);
+    /* DRT,BENCH,<mode>,<threads>,<spectra>,<spectra/s> */
+    printf("DRT,BENCH,rebuild,1,%u,%.0f\n", rebuilds, rebuilds / t);
+
+    drt_cache_init(&cache, &param);
+    pGrid = drt_cache_grid(&cache, 0u, freq, nf);
+    if (NULL == pGrid)
+    {
+        return 1;
+    }
+    t = now_s();
+    drt_solve_batch(pGrid, pRe, pIm, pX, count, 1u);
+    t = now_s() - t;
+    printf("DRT,BENCH,cached,1,%u,%.0f\n", count, count / t);
+
+    t = now_s();
+    drt_solve_batch(pGrid, pRe, pIm, pX, count, threads);
+    t = now_s() - t;
+    printf("DRT,BENCH,cached,%u,%u,%.0f\n", threads, count, count / t);
+
+    for (s = 0; s < count; s++)
+    {
+        check += pX[(size_t)s * pGrid->Num];
+    }
+    printf("DRT,BENCH,mean rinf %.3f\n", check / count);
+    drt_cache_fini(&cache);
+    free(pRe);
+    free(pIm);
+    free(pX);
+    return 0;
+}
@@ -0,0 +1,382 @@
+/*
+ * DRT engine, see drt.h.
+ */
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "drt.h"
+
+#ifndef M_PI
+#define M_PI                    (3.14159265358979323846)
+#endif
+
+typedef struct {
+    const DRT_GRID_TYPE    *pGrid;
+    const double           *pRe;
+    const double           *pIm;
+    double                 *pX;
+    uint32_t                First;
+    uint32_t                Count;
+} DRT_SLICE_TYPE;
+
+uint16_t drt_grid_id(const float *pFreq, uint32_t num)
+{
+    const uint8_t  *pByte;
+    uint16_t        crc = 0xFFFFu;
+    uint32_t        i;
+    uint32_t        k;
+    uint32_t        b;
+
+    for (i = 0; i < num; i++)
+    {
+        pByte = (const uint8_t *)&pFreq[i];
+        for (k = 0; k < sizeof(float); k++)
+        {
+            crc ^= (uint16_t)(pByte[k] << 8);
+            for (b = 0; b < 8u; b++)
+            {
+                crc = (crc & 0x8000u) ? (uint16_t)((crc << 1) ^ 0x1021u) : (uint16_t)(crc << 1);
+            }
+        }
+    }
+    return crc;
+}
+
+void drt_param_default(DRT_PARAM_TYPE *pParam)
+{
+    pParam->Taus = 100u;
+    pParam->Extend = 1.0;
+    pParam->Lambda = 1e-3;
+    pParam->Order = 1u;
+}
+
+/* In place lower Cholesky factor of the n x n row major matrix */
+static int cholesky(double *pM, uint32_t n)
+{
+    double      sum;
+    uint32_t    i;
+    uint32_t    j;
+    uint32_t    k;
+
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j <= i; j++)
+        {
+            sum = pM[i * n + j];
+            for (k = 0; k < j; k++)
+            {
+                sum -= pM[i * n + k] * pM[j * n + k];
+            }
+            if (i == j)
+            {
+                if (!(sum > 0.0))
+                {
+                    return -1;
+                }
+                pM[i * n + i] = sqrt(sum);
+            }
+            else
+            {
+                pM[i * n + j] = sum / pM[j * n + j];
+            }
+        }
+        for (j = i + 1u; j < n; j++)
+        {
+            pM[i * n + j] = 0.0;
+        }
+    }
+    return 0;
+}
+
+/* Lambda L'L of the difference penalty, added to the g block of pG */
+static void add_penalty(double *pG, uint32_t n, uint32_t taus, uint32_t order, double lambda)
+{
+    static const double diff[3][3] = { { 1.0, 0.0, 0.0 }, { -1.0, 1.0, 0.0 }, { 1.0, -2.0, 1.0 } };
+    uint32_t            r;
+    uint32_t            a;
+    uint32_t            b;
+
+    /* Row r of L has diff[order] at g_r..g_r+order, L'L sums their outer products */
+    for (r = 0; r + order < taus; r++)
+    {
+        for (a = 0; a <= order; a++)
+        {
+            for (b = 0; b <= order; b++)
+            {
+                pG[(1u + r + a) * n + 1u + r + b] += lambda * diff[order][a] * diff[order][b];
+            }
+        }
+    }
+}
+
+int drt_grid_build(DRT_GRID_TYPE *pGrid, const DRT_PARAM_TYPE *pParam, uint16_t id, const double *pFreq,
+                   uint32_t numFreq)
+{
+    double      fMin = pFreq[0];
+    double      fMax = pFreq[0];
+    double      lnMin;
+    double      lnMax;
+    double      wt;
+    double      sum;
+    uint32_t    rows = 2u * numFreq;
+    uint32_t    n = 1u + pParam->Taus;
+    uint32_t    i;
+    uint32_t    j;
+    uint32_t    k;
+
+    drt_grid_free(pGrid);
+    if ((0u == numFreq) || (numFreq > DRT_MAX_FREQS) || (pParam->Taus < 3u) || (pParam->Taus > DRT_MAX_TAUS) ||
+        (pParam->Order > 2u))
+    {
+        return -1;
+    }
+    pGrid->pFreq = malloc(numFreq * sizeof(double));
+    pGrid->pTau = malloc(pParam->Taus * sizeof(double));
+    pGrid->pAt = malloc((size_t)n * rows * sizeof(double));
+    pGrid->pChol = calloc((size_t)n * n, sizeof(double));
+    if ((NULL == pGrid->pFreq) || (NULL == pGrid->pTau) || (NULL == pGrid->pAt) || (NULL == pGrid->pChol))
+    {
+        drt_grid_free(pGrid);
+        return -1;
+    }
+    pGrid->Id = id;
+    pGrid->NumFreq = numFreq;
+    pGrid->Num = n;
+    memcpy(pGrid->pFreq, pFreq, numFreq * sizeof(double));
+    for (i = 1; i < numFreq; i++)
+    {
+        fMin = (pFreq[i] < fMin) ? pFreq[i] : fMin;
+        fMax = (pFreq[i] > fMax) ? pFreq[i] : fMax;
+    }
+    lnMin = log(1.0 / (2.0 * M_PI * fMax)) - pParam->Extend * log(10.0);
+    lnMax = log(1.0 / (2.0 * M_PI * fMin)) + pParam->Extend * log(10.0);
+    pGrid->DlnTau = (lnMax - lnMin) / (double)(pParam->Taus - 1u);
+    for (j = 0; j < pParam->Taus; j++)
+    {
+        pGrid->pTau[j] = exp(lnMin + j * pGrid->DlnTau);
+    }
+
+    /* Rows of A: Re Z at each frequency, then Im Z */
+    for (k = 0; k < numFreq; k++)
+    {
+        pGrid->pAt[k] = 1.0;
+        pGrid->pAt[numFreq + k] = 0.0;
+        for (j = 0; j < pParam->Taus; j++)
+        {
+            wt = 2.0 * M_PI * pFreq[k] * pGrid->pTau[j];
+            pGrid->pAt[(1u + j) * rows + k] = pGrid->DlnTau / (1.0 + wt * wt);
+            pGrid->pAt[(1u + j) * rows + numFreq + k] = -pGrid->DlnTau * wt / (1.0 + wt * wt);
+        }
+    }
+    /* A'A + Lambda L'L, Rinf not penalised */
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j <= i; j++)
+        {
+            sum = 0.0;
+            for (k = 0; k < rows; k++)
+            {
+                sum += pGrid->pAt[i * rows + k] * pGrid->pAt[j * rows + k];
+            }
+            pGrid->pChol[i * n + j] = sum;
+            pGrid->pChol[j * n + i] = sum;
+        }
+    }
+    add_penalty(pGrid->pChol, n, pParam->Taus, pParam->Order, pParam->Lambda);
+    if (0 != cholesky(pGrid->pChol, n))
+    {
+        drt_grid_free(pGrid);
+        return -1;
+    }
+    return 0;
+}
+
+void drt_grid_free(DRT_GRID_TYPE *pGrid)
+{
+    free(pGrid->pFreq);
+    free(pGrid->pTau);
+    free(pGrid->pAt);
+    free(pGrid->pChol);
+    memset(pGrid, 0, sizeof(*pGrid));
+}
+
+void drt_cache_init(DRT_CACHE_TYPE *pCache, const DRT_PARAM_TYPE *pParam)
+{
+    memset(pCache, 0, sizeof(*pCache));
+    pCache->Param = *pParam;
+}
+
+const DRT_GRID_TYPE *drt_cache_grid(DRT_CACHE_TYPE *pCache, uint16_t id, const double *pFreq, uint32_t numFreq)
+{
+    DRT_GRID_TYPE  *pGrid;
+    DRT_GRID_TYPE  *pOld = &pCache->Grid[0];
+    uint32_t        i;
+
+    pCache->Uses++;
+    for (i = 0; i < DRT_CACHE_GRIDS; i++)
+    {
+        pGrid = &pCache->Grid[i];
+        /* The id is 16 bits, the frequencies settle a collision */
+        if ((NULL != pGrid->pChol) && (pGrid->Id == id) && (pGrid->NumFreq == numFreq) &&
+            (0 == memcmp(pGrid->pFreq, pFreq, numFreq * sizeof(double))))
+        {
+            pGrid->LastUse = pCache->Uses;
+            pCache->Hits++;
+            return pGrid;
+        }
+        if (pGrid->LastUse < pOld->LastUse)
+        {
+            pOld = pGrid;
+        }
+    }
+    pCache->Builds++;
+    if (0 != drt_grid_build(pOld, &pCache->Param, id, pFreq, numFreq))
+    {
+        return NULL;
+    }
+    pOld->LastUse = pCache->Uses;
+    return pOld;
+}
+
+void drt_cache_fini(DRT_CACHE_TYPE *pCache)
+{
+    uint32_t    i;
+
+    for (i = 0; i < DRT_CACHE_GRIDS; i++)
+    {
+        drt_grid_free(&pCache->Grid[i]);
+    }
+}
+
+void drt_polar(const double *pMag, const double *pPhase, uint32_t num, double *pRe, double *pIm)
+{
+    uint32_t    i;
+
+    for (i = 0; i < num; i++)
+    {
+        pRe[i] = pMag[i] * cos(pPhase[i] * M_PI / 180.0);
+        pIm[i] = pMag[i] * sin(pPhase[i] * M_PI / 180.0);
+    }
+}
+
+void drt_solve(const DRT_GRID_TYPE *pGrid, const double *pRe, const double *pIm, double *pX)
+{
+    const double   *pRow;
+    const double   *pL = pGrid->pChol;
+    uint32_t        nf = pGrid->NumFreq;
+    uint32_t        n = pGrid->Num;
+    uint32_t        i;
+    uint32_t        k;
+    double          sum;
+
+    /* A'z */
+    for (i = 0; i < n; i++)
+    {
+        pRow = &pGrid->pAt[(size_t)i * 2u * nf];
+        sum = 0.0;
+        for (k = 0; k < nf; k++)
+        {
+            sum += pRow[k] * pRe[k] + pRow[nf + k] * pIm[k];
+        }
+        pX[i] = sum;
+    }
+    /* L y = A'z, rows of L */
+    for (i = 0; i < n; i++)
+    {
+        sum = pX[i];
+        for (k = 0; k < i; k++)
+        {
+            sum -= pL[i * n + k] * pX[k];
+        }
+        pX[i] = sum / pL[i * n + i];
+    }
+    /* L'x = y, by columns of L' so L is still read along its rows */
+    for (i = n; i-- > 0;)
+    {
+        pX[i] /= pL[i * n + i];
+        for (k = 0; k < i; k++)
+        {
+            pX[k] -= pL[i * n + k] * pX[i];
+        }
+    }
+}
+
+static void *solve_slice(void *pArg)
+{
+    const DRT_SLICE_TYPE   *pS = pArg;
+    uint32_t                nf = pS->pGrid->NumFreq;
+    uint32_t                s;
+
+    for (s = pS->First; s < pS->First + pS->Count; s++)
+    {
+        drt_solve(pS->pGrid, &pS->pRe[(size_t)s * nf], &pS->pIm[(size_t)s * nf], &pS->pX[(size_t)s * pS->pGrid->Num]);
+    }
+    return NULL;
+}
+
+int drt_solve_batch(const DRT_GRID_TYPE *pGrid, const double *pRe, const double *pIm, double *pX, uint32_t count,
+                    uint32_t threads)
+{
+    pthread_t       tid[64];
+    DRT_SLICE_TYPE  slice[64];
+    uint8_t         started[64];
+    uint32_t        first = 0;
+    uint32_t        t;
+    int             rc = 0;
+
+    if (0u == threads)
+    {
+        threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    threads = (threads > 64u) ? 64u : ((threads < 1u) ? 1u : threads);
+    threads = (threads > count) ? ((count > 0u) ? count : 1u) : threads;
+    for (t = 0; t < threads; t++)
+    {
+        slice[t].pGrid = pGrid;
+        slice[t].pRe = pRe;
+        slice[t].pIm = pIm;
+        slice[t].pX = pX;
+        slice[t].First = first;
+        slice[t].Count = count / threads + ((t < count % threads) ? 1u : 0u);
+        first += slice[t].Count;
+    }
+    /* Slice 0 runs here, a thread that can't start leaves its slice here too */
+    for (t = 1; t < threads; t++)
+    {
+        started[t] = (0 == pthread_create(&tid[t], NULL, solve_slice, &slice[t]));
+        if (!started[t])
+        {
+            solve_slice(&slice[t]);
+        }
+    }
+    solve_slice(&slice[0]);
+    for (t = 1; t < threads; t++)
+    {
+        if (started[t])
+        {
+            rc |= pthread_join(tid[t], NULL);
+        }
+    }
+    return (0 == rc) ? 0 : -1;
+}
+
+void drt_model(const DRT_GRID_TYPE *pGrid, const double *pX, double *pRe, double *pIm)
+{
+    uint32_t    nf = pGrid->NumFreq;
+    uint32_t    i;
+    uint32_t    k;
+
+    for (k = 0; k < nf; k++)
+    {
+        pRe[k] = 0.0;
+        pIm[k] = 0.0;
+        for (i = 0; i < pGrid->Num; i++)
+        {
+            pRe[k] += pGrid->pAt[(size_t)i * 2u * nf + k] * pX[i];
+            pIm[k] += pGrid->pAt[(size_t)i * 2u * nf + nf + k] * pX[i];
+        }
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ * Distribution of relaxation times of EIS spectra by Tikhonov regularized
+ * least squares.
+ *
+ *   Z(f) = Rinf + sum_m g_m * dlnt / (1 + j 2 pi f t_m)
+ *
+ * minimising |A x - z|^2 + Lambda |L g|^2 over x = [Rinf, g_1..g_M], with
+ * L the identity or the first or second difference. Everything except z
+ * depends on the frequency grid only, so the kernel A and the Cholesky
+ * factor of A'A + Lambda L'L are built once per grid and each spectrum is
+ * one A'z product and two triangular solves. Sweeps of a board share the
+ * ImpResult_hold grid, whose id the firmware reports on RUN,BEGIN and GRID.
+ */
+#ifndef DRT_H
+#define DRT_H
+
+#include <stdint.h>
+
+#define DRT_CACHE_GRIDS         (8u)
+#define DRT_MAX_FREQS           (256u)
+#define DRT_MAX_TAUS            (512u)
+
+typedef struct {
+    uint32_t            Taus;           /* relaxation times, log spaced     */
+    double              Extend;         /* decades past 1/(2 pi f) each end */
+    double              Lambda;         /* regularization weight            */
+    uint32_t            Order;          /* penalty: 0 g, 1 dg, 2 d2g        */
+} DRT_PARAM_TYPE;
+
+typedef struct {
+    uint16_t            Id;             /* firmware grid id                 */
+    uint32_t            NumFreq;
+    uint32_t            Num;            /* unknowns, Rinf and Taus          */
+    double             *pFreq;          /* Hz, NumFreq                      */
+    double             *pTau;           /* s, Taus                          */
+    double              DlnTau;
+    double             *pAt;            /* kernel transposed, Num x 2 NumFreq */
+    double             *pChol;          /* lower factor, Num x Num          */
+    uint64_t            LastUse;
+} DRT_GRID_TYPE;
+
+typedef struct {
+    DRT_PARAM_TYPE      Param;
+    DRT_GRID_TYPE       Grid[DRT_CACHE_GRIDS];
+    uint64_t            Uses;
+    uint32_t            Hits;
+    uint32_t            Builds;
+} DRT_CACHE_TYPE;
+
+/* CRC-16/CCITT over the float frequencies, as GridId() of the 355 firmware */
+uint16_t                drt_grid_id         (const float *pFreq, uint32_t num);
+void                    drt_param_default   (DRT_PARAM_TYPE *pParam);
+/* Kernel and factor of one grid, 0 or -1 when the system is not positive definite */
+int                     drt_grid_build      (DRT_GRID_TYPE *pGrid, const DRT_PARAM_TYPE *pParam, uint16_t id,
+                                             const double *pFreq, uint32_t numFreq);
+void                    drt_grid_free       (DRT_GRID_TYPE *pGrid);
+
+void                    drt_cache_init      (DRT_CACHE_TYPE *pCache, const DRT_PARAM_TYPE *pParam);
+/* The grid of id and frequencies, built on a miss in the least recently used
+ * slot. NULL if it can't be built. The cache belongs to one thread, the
+ * grids it returns are read only and stay valid until evicted */
+const DRT_GRID_TYPE    *drt_cache_grid      (DRT_CACHE_TYPE *pCache, uint16_t id, const double *pFreq,
+                                             uint32_t numFreq);
+void                    drt_cache_fini      (DRT_CACHE_TYPE *pCache);
+
+/* Magnitude (ohm) and phase (degree) lines of the firmware to Z */
+void                    drt_polar           (const double *pMag, const double *pPhase, uint32_t num,
+                                             double *pRe, double *pIm);
+/* x = [Rinf, g_1..g_M] in ohm of one spectrum */
+void                    drt_solve           (const DRT_GRID_TYPE *pGrid, const double *pRe, const double *pIm,
+                                             double *pX);
+/* count spectra of NumFreq points each, back to back, on threads (0 all cores) */
+int                     drt_solve_batch     (const DRT_GRID_TYPE *pGrid, const double *pRe, const double *pIm,
+                                             double *pX, uint32_t count, uint32_t threads);
+/* Z of x on the grid frequencies */
+void                    drt_model           (const DRT_GRID_TYPE *pGrid, const double *pX, double *pRe,
+                                             double *pIm);
+
+#endif /* DRT_H */
@@ -0,0 +1,355 @@
+/*
+ * DRT engine against a reference solver: the same regularized problem by
+ * Householder QR of the stacked [A; sqrt(Lambda) L], with the kernel built
+ * again from complex 1 / (1 + j w t). Then the recovery of a ZARC whose
+ * DRT is known, the grid cache and the threaded batch.
+ */
+#include <complex.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "drt.h"
+
+#define REF_ROWS                (2u * DRT_MAX_FREQS + DRT_MAX_TAUS)
+
+/* ImpResult_hold of the 355 firmware, GridId() EC08 */
+static const float  fwGrid[5] = { 10.0f, 3.1623f, 1.0f, 0.31623f, 0.1f };
+
+static double       refA[REF_ROWS][DRT_MAX_TAUS + 1u];
+static double       refB[REF_ROWS];
+
+static uint32_t dense_grid(double *pFreq, uint32_t perDecade, double fLow, double fHigh)
+{
+    uint32_t    n = (uint32_t)lround(log10(fHigh / fLow) * perDecade) + 1u;
+    uint32_t    i;
+
+    /* High to low, as the boards sweep */
+    for (i = 0; i < n; i++)
+    {
+        pFreq[i] = fHigh * pow(10.0, -(double)i / perDecade);
+    }
+    return n;
+}
+
+/* Rinf + R / (1 + (j w t0)^phi) */
+static void zarc(const double *pFreq, uint32_t n, double rInf, double r, double t0, double phi, double *pRe,
+                 double *pIm)
+{
+    double complex  z;
+    uint32_t        k;
+
+    for (k = 0; k < n; k++)
+    {
+        z = rInf + r / (1.0 + cpow(I * 2.0 * M_PI * pFreq[k] * t0, phi));
+        pRe[k] = creal(z);
+        pIm[k] = cimag(z);
+    }
+}
+
+/* Its DRT per ln t */
+static double zarc_drt(double r, double t0, double phi, double tau)
+{
+    return r / (2.0 * M_PI) * sin((1.0 - phi) * M_PI) / (cosh(phi * log(tau / t0)) - cos((1.0 - phi) * M_PI));
+}
+
+static void ref_solve(const DRT_GRID_TYPE *pGrid, const DRT_PARAM_TYPE *pParam, const double *pRe,
+                      const double *pIm, double *pX)
+{
+    static const double diff[3][3] = { { 1.0, 0.0, 0.0 }, { -1.0, 1.0, 0.0 }, { 1.0, -2.0, 1.0 } };
+    double complex      k;
+    uint32_t            nf = pGrid->NumFreq;
+    uint32_t            n = pGrid->Num;
+    uint32_t            rows = 2u * nf + pParam->Taus - pParam->Order;
+    uint32_t            r, c, j;
+    double              norm, s, v0;
+
+    memset(refA, 0, sizeof(refA));
+    for (r = 0; r < nf; r++)
+    {
+        refA[r][0] = 1.0;
+        for (c = 0; c < pParam->Taus; c++)
+        {
+            k = pGrid->DlnTau / (1.0 + I * 2.0 * M_PI * pGrid->pFreq[r] * pGrid->pTau[c]);
+            refA[r][1u + c] = creal(k);
+            refA[nf + r][1u + c] = cimag(k);
+        }
+        refB[r] = pRe[r];
+        refB[nf + r] = pIm[r];
+    }
+    for (r = 0; r + pParam->Order < pParam->Taus; r++)
+    {
+        for (c = 0; c <= pParam->Order; c++)
+        {
+            refA[2u * nf + r][1u + r + c] = sqrt(pParam->Lambda) * diff[pParam->Order][c];
+        }
+        refB[2u * nf + r] = 0.0;
+    }
+    /* Householder QR, applied to b on the way */
+    for (c = 0; c < n; c++)
+    {
+        norm = 0.0;
+        for (r = c; r < rows; r++)
+        {
+            norm += refA[r][c] * refA[r][c];
+        }
+        norm = (refA[c][c] > 0.0) ? -sqrt(norm) : sqrt(norm);
+        v0 = refA[c][c] - norm;
+        refA[c][c] = v0;
+        /* v = [v0, A[c+1..][c]], H = I - 2 v v' / v'v with v'v = -2 norm v0 */
+        for (j = c + 1u; j <= n; j++)
+        {
+            s = 0.0;
+            for (r = c; r < rows; r++)
+            {
+                s += refA[r][c] * ((j < n) ? refA[r][j] : refB[r]);
+            }
+            s /= norm * v0;
+            for (r = c; r < rows; r++)
+            {
+                if (j < n)
+                {
+                    refA[r][j] += s * refA[r][c];
+                }
+                else
+                {
+                    refB[r] += s * refA[r][c];
+                }
+            }
+        }
+        refA[c][c] = norm;
+    }
+    for (c = n; c-- > 0;)
+    {
+        s = refB[c];
+        for (j = c + 1u; j < n; j++)
+        {
+            s -= refA[c][j] * pX[j];
+        }
+        pX[c] = s / refA[c][c];
+    }
+}
+
+static double rel_diff(const double *pA, const double *pB, uint32_t n)
+{
+    double      d = 0.0;
+    double      m = 0.0;
+    uint32_t    i;
+
+    for (i = 0; i < n; i++)
+    {
+        d += (pA[i] - pB[i]) * (pA[i] - pB[i]);
+        m += pB[i] * pB[i];
+    }
+    return sqrt(d / m);
+}
+
+static void test_grid_id(void)
+{
+    CHECK(0xEC08u == drt_grid_id(fwGrid, 5));
+    CHECK(0xFFFFu == drt_grid_id(fwGrid, 0));
+}
+
+static void test_reference(void)
+{
+    DRT_PARAM_TYPE  param;
+    DRT_GRID_TYPE   grid;
+    double          freq[DRT_MAX_FREQS];
+    double          re[DRT_MAX_FREQS];
+    double          im[DRT_MAX_FREQS];
+    double          x[DRT_MAX_TAUS + 1u];
+    double          xRef[DRT_MAX_TAUS + 1u];
+    double          worst = 0.0;
+    double          d;
+    uint32_t        nf;
+    uint32_t        order;
+    uint32_t        g;
+    uint32_t        s;
+    uint32_t        k;
+
+    memset(&grid, 0, sizeof(grid));
+    srand(47);
+    for (g = 0; g < 2u; g++)
+    {
+        if (0u == g)
+        {
+            for (nf = 0; nf < 5u; nf++)
+            {
+                freq[nf] = fwGrid[nf];
+            }
+        }
+        else
+        {
+            nf = dense_grid(freq, 10u, 0.1, 1e5);
+        }
+        for (order = 0; order <= 2u; order++)
+        {
+            drt_param_default(&param);
+            param.Order = order;
+            param.Taus = (0u == g) ? 40u : 120u;
+            CHECK(0 == drt_grid_build(&grid, &param, 1u, freq, nf));
+            for (s = 0; s < 5u; s++)
+            {
+                zarc(freq, nf, 10.0 + rand() % 100, 200.0 + rand() % 5000, pow(10.0, -4.0 + (rand() % 40) / 10.0),
+                     0.6 + (rand() % 40) / 100.0, re, im);
+                for (k = 0; k < nf; k++)
+                {
+                    re[k] *= 1.0 + ((rand() % 2001) - 1000) * 1e-5;
+                    im[k] *= 1.0 + ((rand() % 2001) - 1000) * 1e-5;
+                }
+                drt_solve(&grid, re, im, x);
+                ref_solve(&grid, &param, re, im, xRef);
+                d = rel_diff(x, xRef, grid.Num);
+                worst = (d > worst) ? d : worst;
+            }
+        }
+    }
+    printf("DRT,REF,worst relative difference %.3g\n", worst);
+    CHECK(worst < 1e-6);
+    drt_grid_free(&grid);
+}
+
+/* A ZARC sampled densely: Rinf, R, the peak and the shape come back */
+static void test_zarc(void)
+{
+    DRT_PARAM_TYPE  param;
+    DRT_GRID_TYPE   grid;
+    double          freq[DRT_MAX_FREQS];
+    double          re[DRT_MAX_FREQS];
+    double          im[DRT_MAX_FREQS];
+    double          fitRe[DRT_MAX_FREQS];
+    double          fitIm[DRT_MAX_FREQS];
+    double          x[DRT_MAX_TAUS + 1u];
+    double          area = 0.0;
+    double          err = 0.0;
+    double          res = 0.0;
+    double          truth;
+    uint32_t        nf = dense_grid(freq, 10u, 0.01, 1e5);
+    uint32_t        peak = 1;
+    uint32_t        i;
+
+    memset(&grid, 0, sizeof(grid));
+    drt_param_default(&param);
+    param.Lambda = 1e-4;
+    param.Taus = 140u;
+    CHECK(0 == drt_grid_build(&grid, &param, 2u, freq, nf));
+    zarc(freq, nf, 50.0, 1000.0, 1e-2, 0.75, re, im);
+    drt_solve(&grid, re, im, x);
+    for (i = 1; i < grid.Num; i++)
+    {
+        area += x[i] * grid.DlnTau;
+        peak = (x[i] > x[peak]) ? i : peak;
+        truth = zarc_drt(1000.0, 1e-2, 0.75, grid.pTau[i - 1u]);
+        err = (fabs(x[i] - truth) > err) ? fabs(x[i] - truth) : err;
+    }
+    drt_model(&grid, x, fitRe, fitIm);
+    for (i = 0; i < nf; i++)
+    {
+        res += hypot(fitRe[i] - re[i], fitIm[i] - im[i]) / hypot(re[i], im[i]);
+    }
+    printf("DRT,ZARC,rinf %.3f,area %.2f,peak %.3g s,max error %.2f of %.2f,mean residual %.2g\n", x[0], area,
+           grid.pTau[peak - 1u], err, zarc_drt(1000.0, 1e-2, 0.75, 1e-2), res / nf);
+    CHECK(fabs(x[0] - 50.0) < 0.5);
+    CHECK(fabs(area - 1000.0) < 10.0);
+    CHECK(fabs(log(grid.pTau[peak - 1u] / 1e-2)) <= grid.DlnTau);
+    CHECK(err < 0.05 * zarc_drt(1000.0, 1e-2, 0.75, 1e-2));
+    CHECK(res / nf < 1e-3);
+    drt_grid_free(&grid);
+}
+
+static void test_cache(void)
+{
+    DRT_PARAM_TYPE          param;
+    DRT_CACHE_TYPE          cache;
+    const DRT_GRID_TYPE    *pFirst;
+    const DRT_GRID_TYPE    *pGrid;
+    double                  freq[DRT_CACHE_GRIDS + 1u][5];
+    uint32_t                g;
+    uint32_t                k;
+
+    drt_param_default(&param);
+    param.Taus = 20u;
+    drt_cache_init(&cache, &param);
+    for (g = 0; g <= DRT_CACHE_GRIDS; g++)
+    {
+        for (k = 0; k < 5u; k++)
+        {
+            freq[g][k] = fwGrid[k] * (1.0 + 0.1 * g);
+        }
+    }
+    pFirst = drt_cache_grid(&cache, 0xEC08u, freq[0], 5);
+    CHECK(NULL != pFirst);
+    CHECK(pFirst == drt_cache_grid(&cache, 0xEC08u, freq[0], 5));
+    CHECK((1u == cache.Builds) && (1u == cache.Hits));
+
+    /* Same id, other frequencies: a collision is not a hit */
+    pGrid = drt_cache_grid(&cache, 0xEC08u, freq[1], 5);
+    CHECK((NULL != pGrid) && (pGrid != pFirst) && (2u == cache.Builds));
+
+    /* Fill the cache, keeping grid 0 in use: grid 1 is the one evicted */
+    for (g = 2; g < DRT_CACHE_GRIDS; g++)
+    {
+        CHECK(NULL != drt_cache_grid(&cache, (uint16_t)g, freq[g], 5));
+    }
+    CHECK(pFirst == drt_cache_grid(&cache, 0xEC08u, freq[0], 5));
+    CHECK(pGrid == drt_cache_grid(&cache, 0x1234u, freq[DRT_CACHE_GRIDS], 5));
+    CHECK(pFirst == drt_cache_grid(&cache, 0xEC08u, freq[0], 5));
+    CHECK((DRT_CACHE_GRIDS + 1u == cache.Builds) && (3u == cache.Hits));
+
+    /* A grid that can't be factored is not returned */
+    param.Taus = 1u;
+    drt_cache_fini(&cache);
+    drt_cache_init(&cache, &param);
+    CHECK(NULL == drt_cache_grid(&cache, 1u, freq[0], 5));
+    drt_cache_fini(&cache);
+}
+
+static void test_batch(void)
+{
+    DRT_PARAM_TYPE          param;
+    DRT_CACHE_TYPE          cache;
+    const DRT_GRID_TYPE    *pGrid;
+    double                  freq[DRT_MAX_FREQS];
+    uint32_t                nf = dense_grid(freq, 10u, 0.1, 1e5);
+    uint32_t                count = 1001u;
+    double                 *pRe = malloc(count * nf * sizeof(double));
+    double                 *pIm = malloc(count * nf * sizeof(double));
+    double                 *pX1;
+    double                 *pX4;
+    double                  x[DRT_MAX_TAUS + 1u];
+    uint32_t                s;
+
+    drt_param_default(&param);
+    drt_cache_init(&cache, &param);
+    pGrid = drt_cache_grid(&cache, 3u, freq, nf);
+    CHECK(NULL != pGrid);
+    pX1 = malloc(count * pGrid->Num * sizeof(double));
+    pX4 = malloc(count * pGrid->Num * sizeof(double));
+    for (s = 0; s < count; s++)
+    {
+        zarc(freq, nf, 20.0 + s % 7, 500.0 + s, 1e-3 * (1.0 + s % 13), 0.7 + 0.01 * (s % 25), &pRe[s * nf],
+             &pIm[s * nf]);
+    }
+    CHECK(0 == drt_solve_batch(pGrid, pRe, pIm, pX1, count, 1));
+    CHECK(0 == drt_solve_batch(pGrid, pRe, pIm, pX4, count, 4));
+    CHECK(0 == memcmp(pX1, pX4, count * pGrid->Num * sizeof(double)));
+    drt_solve(pGrid, &pRe[(count - 1u) * nf], &pIm[(count - 1u) * nf], x);
+    CHECK(0 == memcmp(x, &pX4[(count - 1u) * pGrid->Num], pGrid->Num * sizeof(double)));
+    CHECK(0 == drt_solve_batch(pGrid, pRe, pIm, pX4, 3u, 8));
+    free(pRe);
+    free(pIm);
+    free(pX1);
+    free(pX4);
+    drt_cache_fini(&cache);
+}
+
+int main(void)
+{
+    test_grid_id();
+    test_reference();
+    test_zarc();
+    test_cache();
+    test_batch();
+    return CHECK_DONE();
+}
@@ -0,0 +1,185 @@
+/*
+ * Host stand-in for the ADuCM350 BSP headers.
+ *
+ * Just enough of the driver API for VoltammetricBipotentiostatApp_350.c to
+ * compile on a PC. The functions are implemented in adi350_host.c on top of
+ * simulated flash, UART and AFE state that the tests inspect and drive.
+ */
+#ifndef ADI350_HOST_H
+#define ADI350_HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef bool                bool_t;
+
+#define __weak              __attribute__((weak))
+
+/* Core debug, DWT->CYCCNT is advanced by the simulated drivers */
+typedef struct {
+    volatile uint32_t   CTRL;
+    volatile uint32_t   CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    volatile uint32_t   DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type             host_dwt;
+extern CoreDebug_Type       host_coredebug;
+#define DWT                 (&host_dwt)
+#define CoreDebug           (&host_coredebug)
+#define DWT_CTRL_CYCCNTENA_Msk          (1u << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk      (1u << 24)
+
+/* AFE registers touched directly by the application */
+typedef struct {
+    volatile uint32_t   AFE_WG_DAC_CODE;
+    volatile uint32_t   AFE_SEQ_CRC;
+    volatile uint32_t   AFE_ADC_GAIN_TIA;
+    volatile uint32_t   AFE_ADC_OFFSET_TIA;
+    volatile uint32_t   AFE_DAC_GAIN;
+    volatile uint32_t   AFE_DAC_OFFSET_UNITY;
+} ADI_AFE_TypeDef;
+
+extern ADI_AFE_TypeDef      host_afe;
+#define pADI_AFE            (&host_afe)
+
+#define REG_AFE_AFE_WG_DAC_CODE         (0x40080034u)
+#define SEQ_MMR_WRITE(reg, data)        (0x80000000u | ((((uint32_t)(reg) >> 2) & 0x7Fu) << 24) | ((uint32_t)(data) & 0xFFFFFFu))
+
+/* System */
+#define ADI_SYS_CLOCK_TRIGGER_MEASUREMENT_ON    (1)
+#define ADI_SYS_CLOCK_UART                      (1)
+void        SystemInit                  (void);
+void        SystemTransitionClocks      (int trigger);
+void        SetSystemClockDivider       (int clock, uint32_t div);
+
+/* Test harness of the BSP examples */
+void        test_Init                   (void);
+void        test_Pass                   (void);
+void        test_Fail                   (char *FailureReason);
+#define PASS()                          test_Pass()
+#define FAIL(s)                         test_Fail(s)
+
+/* AFE */
+typedef void               *ADI_AFE_DEV_HANDLE;
+typedef void              (*ADI_CALLBACK)(void *pHandle, uint32_t length, void *pBuffer);
+typedef enum {
+    ADI_AFE_SUCCESS = 0,
+    ADI_AFE_ERR
+} ADI_AFE_RESULT_TYPE;
+
+ADI_AFE_RESULT_TYPE adi_AFE_Init                        (ADI_AFE_DEV_HANDLE *phDevice);
+ADI_AFE_RESULT_TYPE adi_AFE_UnInit                      (ADI_AFE_DEV_HANDLE hDevice);
+ADI_AFE_RESULT_TYPE adi_AFE_PowerUp                     (ADI_AFE_DEV_HANDLE hDevice);
+ADI_AFE_RESULT_TYPE adi_AFE_PowerDown                   (ADI_AFE_DEV_HANDLE hDevice);
+ADI_AFE_RESULT_TYPE adi_AFE_SetRcal                     (ADI_AFE_DEV_HANDLE hDevice, uint32_t rcal);
+ADI_AFE_RESULT_TYPE adi_AFE_SetRtia                     (ADI_AFE_DEV_HANDLE hDevice, uint32_t rtia);
+ADI_AFE_RESULT_TYPE adi_AFE_ExciteChanPowerUp           (ADI_AFE_DEV_HANDLE hDevice);
+ADI_AFE_RESULT_TYPE adi_AFE_TiaChanCal                  (ADI_AFE_DEV_HANDLE hDevice);
+ADI_AFE_RESULT_TYPE adi_AFE_ExciteChanCalNoAtten        (ADI_AFE_DEV_HANDLE hDevice);
+ADI_AFE_RESULT_TYPE adi_AFE_SetDmaRxBufferMaxSize       (ADI_AFE_DEV_HANDLE hDevice, uint32_t maxSize, uint32_t dmaSize);
+ADI_AFE_RESULT_TYPE adi_AFE_RegisterCallbackOnReceiveDMA(ADI_AFE_DEV_HANDLE hDevice, ADI_CALLBACK cb, uint32_t unused);
+ADI_AFE_RESULT_TYPE adi_AFE_EnableSoftwareCRC           (ADI_AFE_DEV_HANDLE hDevice, bool_t enable);
+ADI_AFE_RESULT_TYPE adi_AFE_RunSequence                 (ADI_AFE_DEV_HANDLE hDevice, const uint32_t *pSeq, uint16_t *pBuffer, uint32_t size);
+
+/* UART */
+typedef void               *ADI_UART_HANDLE;
+typedef enum {
+    ADI_UART_SUCCESS = 0,
+    ADI_UART_ERR
+} ADI_UART_RESULT_TYPE;
+typedef enum {
+    ADI_UART_DEVID_0 = 0
+} ADI_UART_DEV_ID_TYPE;
+typedef enum {
+    ADI_UART_BAUD_9600 = 9600
+} ADI_UART_BAUD_TYPE;
+typedef struct {
+    uint8_t            *pRxBufferData;
+    uint32_t            RxBufferSize;
+    uint8_t            *pTxBufferData;
+    uint32_t            TxBufferSize;
+} ADI_UART_INIT_DATA;
+typedef struct {
+    bool_t              bBlockingMode;
+    bool_t              bInterruptMode;
+    bool_t              bDmaMode;
+} ADI_UART_GENERIC_SETTINGS_TYPE;
+
+ADI_UART_RESULT_TYPE adi_UART_Init              (ADI_UART_DEV_ID_TYPE devId, ADI_UART_HANDLE *phDevice, ADI_UART_INIT_DATA *pInitData);
+ADI_UART_RESULT_TYPE adi_UART_UnInit            (ADI_UART_HANDLE hDevice);
+ADI_UART_RESULT_TYPE adi_UART_SetGenericSettings(ADI_UART_HANDLE hDevice, ADI_UART_GENERIC_SETTINGS_TYPE *pSettings);
+ADI_UART_RESULT_TYPE adi_UART_SetBaudRate       (ADI_UART_HANDLE hDevice, ADI_UART_BAUD_TYPE baud);
+ADI_UART_RESULT_TYPE adi_UART_Enable            (ADI_UART_HANDLE hDevice, bool_t enable);
+ADI_UART_RESULT_TYPE adi_UART_BufRx             (ADI_UART_HANDLE hDevice, void *pBuffer, int16_t *pSize);
+ADI_UART_RESULT_TYPE adi_UART_BufTx             (ADI_UART_HANDLE hDevice, const void *pBuffer, int16_t *pSize);
+
+/* GPIO */
+typedef enum {
+    ADI_GPIO_PORT_4 = 4
+} ADI_GPIO_PORT_TYPE;
+typedef uint32_t            ADI_GPIO_MUX_TYPE;
+typedef uint16_t            ADI_GPIO_DATA_TYPE;
+#define ADI_GPIO_P40        (0u)
+#define ADI_GPIO_P41        (0u)
+#define ADI_GPIO_P42        (0u)
+#define ADI_GPIO_PIN_0      ((ADI_GPIO_DATA_TYPE)(1u << 0))
+#define ADI_GPIO_PIN_1      ((ADI_GPIO_DATA_TYPE)(1u << 1))
+#define ADI_GPIO_PIN_2      ((ADI_GPIO_DATA_TYPE)(1u << 2))
+int         adi_GPIO_Init               (void);
+int         adi_GPIO_SetOutputEnable    (ADI_GPIO_PORT_TYPE port, ADI_GPIO_DATA_TYPE pins, bool_t enable);
+int         adi_GPIO_SetHigh            (ADI_GPIO_PORT_TYPE port, ADI_GPIO_DATA_TYPE pins);
+int         adi_GPIO_SetLow             (ADI_GPIO_PORT_TYPE port, ADI_GPIO_DATA_TYPE pins);
+
+/* SPI, AD5683R DAC driving WE2 */
+void        openSPIH                    (void);
+void        AD5683R_WE2_Voltage         (uint32_t voltage);
+extern uint32_t             host_we2_voltage;
+
+/* GP flash, addresses map onto host_flash (see adi350_host.c) */
+typedef void               *ADI_FEE_DEV_HANDLE;
+typedef enum {
+    ADI_FEE_SUCCESS = 0,
+    ADI_FEE_ERR
+} ADI_FEE_RESULT_TYPE;
+typedef enum {
+    ADI_FEE_DEVID_GP = 1
+} ADI_FEE_DEV_ID_TYPE;
+ADI_FEE_RESULT_TYPE adi_FEE_Init        (ADI_FEE_DEV_ID_TYPE devId, bool_t bBlocking, ADI_FEE_DEV_HANDLE *phDevice);
+ADI_FEE_RESULT_TYPE adi_FEE_PageErase   (ADI_FEE_DEV_HANDLE hDevice, uint32_t page);
+ADI_FEE_RESULT_TYPE adi_FEE_Write       (ADI_FEE_DEV_HANDLE hDevice, uint32_t addr, uint8_t *pData, uint32_t size);
+
+/*
+ * Simulation controls used by the tests.
+ *
+ * Flash: HOST_FLASH_PAGES pages of HOST_FLASH_PAGE bytes are mapped at
+ * HOST_FLASH_BASE so the application can read them through pointers. Erase
+ * sets a page to 0xFF, writes can only clear bits. host_flash_budget limits
+ * how many more bytes are programmed before every write fails, which models
+ * a reset in the middle of a write.
+ */
+#define HOST_FLASH_BASE     (0x10000000u)
+#define HOST_FLASH_PAGE     (2048u)
+#define HOST_FLASH_PAGES    (4u)
+
+extern uint32_t             host_flash_erases[HOST_FLASH_PAGES];
+extern int32_t              host_flash_budget;      /* < 0: unlimited       */
+void        host_flash_init             (void);
+uint8_t    *host_flash_ptr              (uint32_t addr);
+
+/* UART: bytes queued here are returned by adi_UART_BufRx, Tx is collected */
+void        host_uart_rx                (const char *pData, uint32_t len);
+uint32_t    host_uart_rx_pending        (void);
+const char *host_uart_tx                (void);
+void        host_uart_tx_clear          (void);
+
+/* AFE: adi_AFE_RunSequence passes size copies of host_afe_code to the DMA */
+/* callback and then calls host_afe_hook, if set                           */
+extern uint16_t             host_afe_code;
+extern uint32_t             host_afe_runs;
+extern void               (*host_afe_hook)(const uint32_t *pSeq);
+
+#endif /* ADI350_HOST_H */
@@ -0,0 +1,2 @@
+/* Host stand-in, see adi350_host.h */
+#include "adi350_host.h"
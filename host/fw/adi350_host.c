@@ -0,0 +1,246 @@
+/*
+ * Simulated ADuCM350 drivers for the host tests, see adi350/adi350_host.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "adi350_host.h"
+
+DWT_Type                host_dwt;
+CoreDebug_Type          host_coredebug;
+ADI_AFE_TypeDef         host_afe;
+
+uint32_t                host_flash_erases[HOST_FLASH_PAGES];
+int32_t                 host_flash_budget = -1;
+
+uint16_t                host_afe_code = 0x8000u;
+uint32_t                host_afe_runs = 0;
+void                  (*host_afe_hook)(const uint32_t *pSeq) = NULL;
+
+static uint8_t         *hostFlash = NULL;
+static ADI_CALLBACK     hostDmaCb = NULL;
+static uint16_t         hostDma[4096];
+
+static char             hostRx[4096];
+static uint32_t         hostRxHead = 0;
+static uint32_t         hostRxTail = 0;
+static char             hostTx[1u << 20];
+static uint32_t         hostTxLen = 0;
+
+/* Core and test harness */
+void SystemInit(void) {}
+void SystemTransitionClocks(int trigger) { (void)trigger; }
+void SetSystemClockDivider(int clock, uint32_t div) { (void)clock; (void)div; }
+void test_Init(void) {}
+void test_Pass(void) {}
+void openSPIH(void) {}
+int32_t adi_initpinmux(void) { return 0; }
+
+uint32_t                host_we2_voltage = 0;
+
+void AD5683R_WE2_Voltage(uint32_t voltage)
+{
+    host_we2_voltage = voltage;
+}
+
+void test_Fail(char *FailureReason)
+{
+    fprintf(stderr, "FAIL: %s\n", FailureReason);
+    exit(1);
+}
+
+/* Flash */
+void host_flash_init(void)
+{
+    if (NULL == hostFlash)
+    {
+        hostFlash = mmap((void *)(uintptr_t)HOST_FLASH_BASE, HOST_FLASH_PAGES * HOST_FLASH_PAGE,
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if ((MAP_FAILED == hostFlash) || ((uintptr_t)HOST_FLASH_BASE != (uintptr_t)hostFlash))
+        {
+            fprintf(stderr, "cannot map the simulated flash at 0x%08X\n", HOST_FLASH_BASE);
+            exit(2);
+        }
+    }
+    memset(hostFlash, 0xFF, HOST_FLASH_PAGES * HOST_FLASH_PAGE);
+    memset(host_flash_erases, 0, sizeof(host_flash_erases));
+    host_flash_budget = -1;
+}
+
+uint8_t *host_flash_ptr(uint32_t addr)
+{
+    if ((addr < HOST_FLASH_BASE) || (addr >= HOST_FLASH_BASE + HOST_FLASH_PAGES * HOST_FLASH_PAGE))
+    {
+        return NULL;
+    }
+    return hostFlash + (addr - HOST_FLASH_BASE);
+}
+
+ADI_FEE_RESULT_TYPE adi_FEE_Init(ADI_FEE_DEV_ID_TYPE devId, bool_t bBlocking, ADI_FEE_DEV_HANDLE *phDevice)
+{
+    (void)devId;
+    (void)bBlocking;
+    *phDevice = (ADI_FEE_DEV_HANDLE)&hostFlash;
+    return ADI_FEE_SUCCESS;
+}
+
+ADI_FEE_RESULT_TYPE adi_FEE_PageErase(ADI_FEE_DEV_HANDLE hDevice, uint32_t page)
+{
+    uint8_t    *p = host_flash_ptr(page * HOST_FLASH_PAGE);
+    
+    (void)hDevice;
+    if ((NULL == p) || (0 == host_flash_budget))
+    {
+        return ADI_FEE_ERR;
+    }
+    memset(p, 0xFF, HOST_FLASH_PAGE);
+    host_flash_erases[(page * HOST_FLASH_PAGE - HOST_FLASH_BASE) / HOST_FLASH_PAGE]++;
+    return ADI_FEE_SUCCESS;
+}
+
+ADI_FEE_RESULT_TYPE adi_FEE_Write(ADI_FEE_DEV_HANDLE hDevice, uint32_t addr, uint8_t *pData, uint32_t size)
+{
+    uint8_t    *p = host_flash_ptr(addr);
+    uint32_t    i;
+    
+    (void)hDevice;
+    if ((NULL == p) || (NULL == host_flash_ptr(addr + size - 1u)) || (addr & 7u))
+    {
+        return ADI_FEE_ERR;
+    }
+    for (i = 0; i < size; i++)
+    {
+        if (0 == host_flash_budget)
+        {
+            return ADI_FEE_ERR;
+        }
+        if (host_flash_budget > 0)
+        {
+            host_flash_budget--;
+        }
+        p[i] &= pData[i];
+    }
+    return ADI_FEE_SUCCESS;
+}
+
+/* UART */
+void host_uart_rx(const char *pData, uint32_t len)
+{
+    while (len--)
+    {
+        hostRx[hostRxHead++ % sizeof(hostRx)] = *pData++;
+    }
+}
+
+uint32_t host_uart_rx_pending(void)
+{
+    return hostRxHead - hostRxTail;
+}
+
+const char *host_uart_tx(void)
+{
+    hostTx[hostTxLen] = '\0';
+    return hostTx;
+}
+
+void host_uart_tx_clear(void)
+{
+    hostTxLen = 0;
+}
+
+ADI_UART_RESULT_TYPE adi_UART_Init(ADI_UART_DEV_ID_TYPE devId, ADI_UART_HANDLE *phDevice, ADI_UART_INIT_DATA *pInitData)
+{
+    (void)devId;
+    (void)pInitData;
+    *phDevice = (ADI_UART_HANDLE)hostRx;
+    return ADI_UART_SUCCESS;
+}
+
+ADI_UART_RESULT_TYPE adi_UART_UnInit(ADI_UART_HANDLE hDevice) { (void)hDevice; return ADI_UART_SUCCESS; }
+ADI_UART_RESULT_TYPE adi_UART_SetGenericSettings(ADI_UART_HANDLE hDevice, ADI_UART_GENERIC_SETTINGS_TYPE *pSettings) { (void)hDevice; (void)pSettings; return ADI_UART_SUCCESS; }
+ADI_UART_RESULT_TYPE adi_UART_SetBaudRate(ADI_UART_HANDLE hDevice, ADI_UART_BAUD_TYPE baud) { (void)hDevice; (void)baud; return ADI_UART_SUCCESS; }
+ADI_UART_RESULT_TYPE adi_UART_Enable(ADI_UART_HANDLE hDevice, bool_t enable) { (void)hDevice; (void)enable; return ADI_UART_SUCCESS; }
+
+ADI_UART_RESULT_TYPE adi_UART_BufRx(ADI_UART_HANDLE hDevice, void *pBuffer, int16_t *pSize)
+{
+    uint8_t    *p = (uint8_t *)pBuffer;
+    int16_t     n = 0;
+    
+    (void)hDevice;
+    while ((n < *pSize) && (hostRxTail != hostRxHead))
+    {
+        p[n++] = (uint8_t)hostRx[hostRxTail++ % sizeof(hostRx)];
+    }
+    *pSize = n;
+    return ADI_UART_SUCCESS;
+}
+
+ADI_UART_RESULT_TYPE adi_UART_BufTx(ADI_UART_HANDLE hDevice, const void *pBuffer, int16_t *pSize)
+{
+    int16_t     n = *pSize;
+    
+    (void)hDevice;
+    if (hostTxLen + (uint32_t)n >= sizeof(hostTx))
+    {
+        n = (int16_t)(sizeof(hostTx) - 1u - hostTxLen);
+    }
+    memcpy(hostTx + hostTxLen, pBuffer, (size_t)n);
+    hostTxLen += (uint32_t)n;
+    *pSize = n;
+    return ADI_UART_SUCCESS;
+}
+
+/* GPIO */
+int adi_GPIO_Init(void) { return 0; }
+int adi_GPIO_SetOutputEnable(ADI_GPIO_PORT_TYPE port, ADI_GPIO_DATA_TYPE pins, bool_t enable) { (void)port; (void)pins; (void)enable; return 0; }
+int adi_GPIO_SetHigh(ADI_GPIO_PORT_TYPE port, ADI_GPIO_DATA_TYPE pins) { (void)port; (void)pins; return 0; }
+int adi_GPIO_SetLow(ADI_GPIO_PORT_TYPE port, ADI_GPIO_DATA_TYPE pins) { (void)port; (void)pins; return 0; }
+
+/* AFE */
+ADI_AFE_RESULT_TYPE adi_AFE_Init(ADI_AFE_DEV_HANDLE *phDevice) { *phDevice = (ADI_AFE_DEV_HANDLE)&host_afe; return ADI_AFE_SUCCESS; }
+ADI_AFE_RESULT_TYPE adi_AFE_UnInit(ADI_AFE_DEV_HANDLE hDevice) { (void)hDevice; return ADI_AFE_SUCCESS; }
+ADI_AFE_RESULT_TYPE adi_AFE_PowerUp(ADI_AFE_DEV_HANDLE hDevice) { (void)hDevice; return ADI_AFE_SUCCESS; }
+ADI_AFE_RESULT_TYPE adi_AFE_PowerDown(ADI_AFE_DEV_HANDLE hDevice) { (void)hDevice; return ADI_AFE_SUCCESS; }
+ADI_AFE_RESULT_TYPE adi_AFE_SetRcal(ADI_AFE_DEV_HANDLE hDevice, uint32_t rcal) { (void)hDevice; (void)rcal; return ADI_AFE_SUCCESS; }
+ADI_AFE_RESULT_TYPE adi_AFE_SetRtia(ADI_AFE_DEV_HANDLE hDevice, uint32_t rtia) { (void)hDevice; (void)rtia; return ADI_AFE_SUCCESS; }
+ADI_AFE_RESULT_TYPE adi_AFE_ExciteChanPowerUp(ADI_AFE_DEV_HANDLE hDevice) { (void)hDevice; return ADI_AFE_SUCCESS; }
+ADI_AFE_RESULT_TYPE adi_AFE_TiaChanCal(ADI_AFE_DEV_HANDLE hDevice) { (void)hDevice; return ADI_AFE_SUCCESS; }
+ADI_AFE_RESULT_TYPE adi_AFE_ExciteChanCalNoAtten(ADI_AFE_DEV_HANDLE hDevice) { (void)hDevice; return ADI_AFE_SUCCESS; }
+ADI_AFE_RESULT_TYPE adi_AFE_SetDmaRxBufferMaxSize(ADI_AFE_DEV_HANDLE hDevice, uint32_t maxSize, uint32_t dmaSize) { (void)hDevice; (void)maxSize; (void)dmaSize; return ADI_AFE_SUCCESS; }
+ADI_AFE_RESULT_TYPE adi_AFE_EnableSoftwareCRC(ADI_AFE_DEV_HANDLE hDevice, bool_t enable) { (void)hDevice; (void)enable; return ADI_AFE_SUCCESS; }
+
+ADI_AFE_RESULT_TYPE adi_AFE_RegisterCallbackOnReceiveDMA(ADI_AFE_DEV_HANDLE hDevice, ADI_CALLBACK cb, uint32_t unused)
+{
+    (void)hDevice;
+    (void)unused;
+    hostDmaCb = cb;
+    return ADI_AFE_SUCCESS;
+}
+
+ADI_AFE_RESULT_TYPE adi_AFE_RunSequence(ADI_AFE_DEV_HANDLE hDevice, const uint32_t *pSeq, uint16_t *pBuffer, uint32_t size)
+{
+    uint32_t    i;
+    
+    (void)pBuffer;
+    if (size > sizeof(hostDma) / sizeof(hostDma[0]))
+    {
+        return ADI_AFE_ERR;
+    }
+    for (i = 0; i < size; i++)
+    {
+        hostDma[i] = host_afe_code;
+    }
+    host_dwt.CYCCNT += 16000u;
+    host_afe_runs++;
+    if ((NULL != hostDmaCb) && (size > 0u))
+    {
+        hostDmaCb(hDevice, size, hostDma);
+    }
+    if (NULL != host_afe_hook)
+    {
+        host_afe_hook(pSeq);
+    }
+    return ADI_AFE_SUCCESS;
+}
@@ -0,0 +1,2 @@
+/* Host stand-in, see adi355_host.h */
+#include "adi355_host.h"
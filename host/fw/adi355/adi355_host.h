@@ -0,0 +1,354 @@
+/*
+ * Host stand-in for the ADuCM355 BSP headers and the M355 sensor library.
+ *
+ * Just enough for EISApp_355.c to compile on a PC. The AFE register block
+ * keeps the offsets of the part for the registers the sequencer reaches, so
+ * compiled command words carry real register offsets. The library functions
+ * in adi355_host.c store their arguments in the registers they configure.
+ */
+#ifndef ADI355_HOST_H
+#define ADI355_HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+
+/* Core */
+typedef struct {
+    volatile uint32_t   CTRL;
+    volatile uint32_t   CYCCNT;
+} DWT_Type;
+typedef struct {
+    volatile uint32_t   DEMCR;
+} CoreDebug_Type;
+extern DWT_Type             host_dwt;
+extern CoreDebug_Type       host_coredebug;
+#define DWT                 (&host_dwt)
+#define CoreDebug           (&host_coredebug)
+#define DWT_CTRL_CYCCNTENA_Msk          (1u << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk      (1u << 24)
+
+typedef enum {
+    UART_EVT_IRQn, TMR0_EVT_IRQn, AFE_EVT3_IRQn, AFE_ADC_IRQn, SYS_GPIO_INTA_IRQn
+} IRQn_Type;
+void        NVIC_EnableIRQ      (IRQn_Type irq);
+void        NVIC_DisableIRQ     (IRQn_Type irq);
+extern uint32_t             host_primask;
+#define __disable_irq()     (host_primask = 1u)
+#define __enable_irq()      (host_primask = 0u)
+#define __get_PRIMASK()     (host_primask)
+#define __set_PRIMASK(m)    (host_primask = (m))
+
+/* AFE die, offsets from the AFE base as on the part */
+typedef struct {
+    uint8_t             rsvd0[0x2000];
+    volatile uint32_t   AFECON;         /* 0x2000 */
+    volatile uint32_t   SEQCON;         /* 0x2004 */
+    volatile uint32_t   FIFOCON;        /* 0x2008 */
+    volatile uint32_t   SWCON;          /* 0x200C */
+    volatile uint32_t   HSDACCON;       /* 0x2010 */
+    volatile uint32_t   WGCON;          /* 0x2014 */
+    uint8_t             rsvd1[0x2030 - 0x2018];
+    volatile uint32_t   WGFCW;          /* 0x2030 */
+    volatile uint32_t   WGPHASE;        /* 0x2034 */
+    volatile uint32_t   WGOFFSET;       /* 0x2038 */
+    volatile uint32_t   WGAMPLITUDE;    /* 0x203C */
+    uint8_t             rsvd2[0x2044 - 0x2040];
+    volatile uint32_t   ADCFILTERCON;   /* 0x2044 */
+    uint8_t             rsvd3[0x206C - 0x2048];
+    volatile uint32_t   DATAFIFORD;     /* 0x206C */
+    volatile uint32_t   CMDFIFOWRITE;   /* 0x2070 */
+    volatile uint32_t   ADCDAT;         /* 0x2074 */
+    volatile uint32_t   DFTREAL;        /* 0x2078 */
+    volatile uint32_t   DFTIMAG;        /* 0x207C */
+    volatile uint32_t   SINC2DAT;       /* 0x2080 */
+    uint8_t             rsvd4[0x20BC - 0x2084];
+    volatile uint32_t   HPOSCCON;       /* 0x20BC */
+    uint8_t             rsvd5[0x20D0 - 0x20C0];
+    volatile uint32_t   DFTCON;         /* 0x20D0 */
+    uint8_t             rsvd6[0x20E0 - 0x20D4];
+    volatile uint32_t   LPTIASW1;       /* 0x20E0 */
+    volatile uint32_t   LPTIASW0;       /* 0x20E4 */
+    volatile uint32_t   LPTIACON1;      /* 0x20E8 */
+    volatile uint32_t   LPTIACON0;      /* 0x20EC */
+    volatile uint32_t   HSRTIACON;      /* 0x20F0 */
+    volatile uint32_t   DE1RESCON;      /* 0x20F4 */
+    volatile uint32_t   DE0RESCON;      /* 0x20F8 */
+    volatile uint32_t   HSTIACON;       /* 0x20FC */
+    uint8_t             rsvd7[0x2150 - 0x2100];
+    volatile uint32_t   DSWFULLCON;     /* 0x2150 */
+    volatile uint32_t   NSWFULLCON;     /* 0x2154 */
+    volatile uint32_t   PSWFULLCON;     /* 0x2158 */
+    volatile uint32_t   TSWFULLCON;     /* 0x215C */
+    uint8_t             rsvd8[0x21A8 - 0x2160];
+    volatile uint32_t   ADCCON;         /* 0x21A8 */
+    uint8_t             rsvd9[0x21CC - 0x21AC];
+    volatile uint32_t   SEQ0INFO;       /* 0x21CC */
+    uint8_t             rsvd10[0x21D4 - 0x21D0];
+    volatile uint32_t   CMDFIFOWADDR;   /* 0x21D4 */
+    volatile uint32_t   CMDDATACON;     /* 0x21D8 */
+    uint8_t             rsvd11[0x2200 - 0x21DC];
+    volatile uint32_t   FIFOCNTSTA;     /* 0x2200 */
+    uint8_t             rsvd12[0x2238 - 0x2204];
+    volatile uint32_t   DACDCBUFCON;    /* 0x2238 */
+    uint8_t             rsvd13[0x3000 - 0x223C];
+    volatile uint32_t   ADCINTIEN;      /* 0x3000 */
+    volatile uint32_t   ADCINTSTA;      /* 0x3004 */
+    volatile uint32_t   TRIGSEQ;        /* 0x3008 */
+} ADI_AFE_TypeDef;
+
+extern ADI_AFE_TypeDef      host_afe;
+#define pADI_AFE            (&host_afe)
+
+#define BITM_AFE_AFECON_DACBUFEN        (1u << 21)
+#define BITM_AFE_AFECON_SINC2EN         (1u << 16)
+#define BITM_AFE_AFECON_DFTEN           (1u << 15)
+#define BITM_AFE_AFECON_WAVEGENEN       (1u << 14)
+#define BITM_AFE_AFECON_ADCCONVEN       (1u << 8)
+#define BITM_AFE_AFECON_ADCEN           (1u << 7)
+#define BITM_AFE_SEQCON_SEQEN           (1u << 0)
+#define BITM_AFE_TRIGSEQ_TRIG0          (1u << 0)
+#define BITP_AFE_HSDACCON_RATE          (1u)
+#define BITM_AFE_HPOSCCON_CLK32MHZEN    (1u << 2)
+#define BITM_AFE_DFTCON_HANNINGEN       (1u << 0)
+#define BITM_AFE_DFTCON_DFTINSEL        (3u << 20)
+#define BITP_AFE_CMDDATACON_CMD_MEM_SEL (3u)
+#define BITP_AFE_CMDDATACON_CMDMEMMDE   (0u)
+#define BITP_AFE_CMDDATACON_DATA_MEM_SEL (9u)
+#define BITP_AFE_CMDDATACON_DATAMEMMDE  (6u)
+#define BITP_AFE_FIFOCON_DATAFIFOSRCSEL (13u)
+#define BITM_AFE_FIFOCON_DATAFIFOEN     (1u << 11)
+#define BITP_AFE_FIFOCNTSTA_DATAFIFOCNTSTA (16u)
+#define BITM_AFE_FIFOCNTSTA_DATAFIFOCNTSTA (0x7FFu << 16)
+#define BITM_AFE_ADCINTIEN_DFTRDYIEN    (1u << 1)
+#define BITM_AFE_ADCINTIEN_SINC2RDYIEN  (1u << 2)
+#define BITM_AFE_ADCINTIEN_ADCRDYIEN    (1u << 0)
+#define BITM_AFE_ADCINTSTA_ADCRDY       (1u << 0)
+#define BITM_AFE_ADCINTSTA_DFTRDY       (1u << 1)
+#define BITM_AFE_ADCINTSTA_SINC2RDY     (1u << 2)
+#define ENUM_AFE_DACDCBUFCON_CHAN0      (0u)
+#define ENUM_AFE_DACDCBUFCON_CHAN1      (1u)
+#define NOINT                           (0u)
+
+/* AFE library */
+#define AFE_ACTIVE          (1)
+#define AFE_SYSCLKDIV_1     (1)
+#define AFE_SYSCLKDIV_2     (2)
+#define AFECLK_SOURCE_HFOSC (0)
+#define DIGCLK_SOURCE_HFOSC (0)
+#define ENUM_AFE_PMBW_LP    (0)
+#define ENUM_AFE_PMBW_HP    (1)
+#define ENUM_AFE_PMBW_BW50  (1)
+#define ENUM_AFE_PMBW_BW250 (3)
+#define HPTIABIAS_1V1       (0)
+enum { SINC3OSR_5 = 0, SINC3OSR_4 = 1, SINC3OSR_2 = 2 };
+enum { SINC2OSR_22, SINC2OSR_44, SINC2OSR_89, SINC2OSR_178, SINC2OSR_267, SINC2OSR_533,
+       SINC2OSR_640, SINC2OSR_667, SINC2OSR_800, SINC2OSR_889, SINC2OSR_1067, SINC2OSR_1333 };
+enum { ADCSAMPLERATE_800K = 1, ADCSAMPLERATE_1600K = 0 };
+enum { LFPBYPEN_NOBYP = 0, LFPBYPEN_BYP = 1 };
+enum { DFTNUM_256 = 6, DFTNUM_8192 = 11, DFTNUM_16384 = 12 };
+enum { DFTIN_SINC2 = 0, DFTIN_GAIN_OFFSET = 1, DFTIN_SINC3 = 2 };
+enum { GNPGA_1 = 0, GNPGA_1_5, GNPGA_2, GNPGA_4, GNPGA_9 };
+enum { MUXSELP_AIN6 = 0x0B, MUXSELP_LPTIA0_LPF = 0x21, MUXSELP_LPTIA1_LPF = 0x22 };
+enum { MUXSELN_VZERO0 = 0x04, MUXSELN_LPTIA0_N = 0x02, MUXSELN_LPTIA1_N = 0x03 };
+enum { HPTIASE_RTIA_OPEN = 0xF };
+enum { HPTIADE_RTIA_50 = 0, HPTIADE_RTIA_100, HPTIADE_RTIA_200, HPTIADE_RTIA_1K, HPTIADE_RTIA_5K,
+       HPTIADE_RTIA_10K, HPTIADE_RTIA_20K, HPTIADE_RTIA_40K, HPTIADE_RTIA_80K, HPTIADE_RTIA_160K,
+       HPTIADE_RTIA_OPEN = 0x1F };
+enum { HPTIADE_RLOAD_0 = 0, HPTIADE_RLOAD_10, HPTIADE_RLOAD_30, HPTIADE_RLOAD_50, HPTIADE_RLOAD_100,
+       HPTIADE_RLOAD_OPEN = 7 };
+#define BITM_HPTIA_CTIA_1PF     (1u << 5)
+#define BITM_HPTIA_CTIA_2PF     (1u << 6)
+#define BITM_HPTIA_CTIA_4PF     (1u << 7)
+#define BITM_HPTIA_CTIA_8PF     (1u << 8)
+#define BITM_HPTIA_CTIA_16PF    (1u << 9)
+#define HPDAC_ATTEN_DIV5        (1)
+#define HPDAC_RATE_REG          (0x1B)
+#define HPDAC_INAMPGAIN_DIV4    (1)
+#define HPDAC_WGTYPE_SINE       (2)
+#define LPTIA_RGAIN_DISCONNECT  (0)
+#define SWMODE_NORM             (0)
+#define SWMODE_AC               (2)
+#define SWITCH_GROUP_T          (3)
+#define SWID_ALLOPEN            (0u)
+#define SWID_D5_CE0             (1u << 4)
+#define SWID_D6_CE1             (1u << 5)
+#define SWID_DR0_RCAL0          (1u << 8)
+#define SWID_P6_RE1             (1u << 5)
+#define SWID_P11_CE0            (1u << 10)
+#define SWID_PR0_RCAL0          (1u << 14)
+#define SWID_NL                 (1u << 10)
+#define SWID_N7_SE1RLOAD        (1u << 6)
+#define SWID_NR1_RCAL1          (1u << 9)
+#define SWID_T1_AIN0            (1u << 0)
+#define SWID_T2_AIN1            (1u << 1)
+#define SWID_T3_AIN2            (1u << 2)
+#define SWID_T4_AIN3            (1u << 3)
+#define SWID_T5_SE0RLOAD        (1u << 4)
+#define SWID_T7_SE1RLOAD        (1u << 6)
+#define SWID_T8_DE1             (1u << 7)
+#define SWID_T9                 (1u << 8)
+#define SWID_TR1_RCAL1          (1u << 11)
+
+uint32_t    AfeDieSta           (void);
+void        AfeWdtGo            (bool enable);
+void        AfePwrCfg           (uint32_t mode);
+void        AfeClkSel           (uint32_t src);
+void        AfeSysClkDiv        (uint32_t div);
+void        AfeSysCfg           (uint32_t pmbw, uint32_t bw);
+void        AfeHFOsc32M         (uint32_t en);
+void        AfeAdcChopEn        (uint32_t en);
+void        AfeHpTiaCon         (uint32_t bias);
+void        AfeHpTiaPwrUp       (bool en);
+void        AfeHpTiaSeCfg       (uint32_t rtia, uint32_t ctia, uint32_t diosel);
+void        AfeHpTiaDeCfg       (uint32_t chan, uint32_t rload, uint32_t rtia);
+void        AfeLpTiaCon         (uint32_t chan, uint32_t rload, uint32_t rtia, uint32_t rfilter);
+void        AfeLpTiaSwitchCfg   (uint32_t chan, uint32_t mode);
+void        AfeSwitchFullCfg    (uint32_t group, uint32_t sw);
+void        AfeSwitchDPNT       (uint32_t d, uint32_t p, uint32_t n, uint32_t t);
+void        AfeAdcFiltCfg       (uint32_t sinc3osr, uint32_t sinc2osr, uint32_t lpfbyp, uint32_t rate);
+void        AfeAdcDFTCfg        (uint32_t hanning, uint32_t dftnum, uint32_t dftsrc);
+void        AfeAdcPgaCfg        (uint32_t gain, uint32_t offset);
+void        AfeAdcChan          (uint32_t muxp, uint32_t muxn);
+void        AfeAdcIntCfg        (uint32_t ien);
+void        AfeHPDacPwrUp       (bool en);
+void        AfeHPDacCfg         (uint32_t atten, uint32_t rate, uint32_t gain);
+void        AfeHPDacSineCfg     (uint32_t fcw, uint32_t phase, uint32_t offset, uint32_t amp);
+void        AfeHPDacWgType      (uint32_t type);
+void        AfeWaveGenGo        (bool en);
+
+/* Digital die */
+typedef struct { volatile uint32_t CTL; } ADI_TMR_TypeDef;
+typedef struct { volatile uint32_t DATA; } ADI_GPIO_TypeDef;
+typedef struct {
+    volatile uint32_t   COMFCR;
+    volatile uint32_t   COMIEN;
+    volatile uint32_t   COMLCR2;
+    volatile uint32_t   COMLSR;
+    volatile uint32_t   COMRFC;
+} ADI_UART_TypeDef;
+typedef struct {
+    volatile uint32_t   CFG0;
+    volatile uint32_t   CLR;
+} ADI_XINT_TypeDef;
+typedef struct {
+    volatile uint32_t   KEY;
+    volatile uint32_t   CMD;
+    volatile uint32_t   STAT;
+    volatile uint32_t   PAGE_ADDR0;
+    volatile uint32_t   KH_ADDR;
+    volatile uint32_t   KH_DATA0;
+    volatile uint32_t   KH_DATA1;
+} ADI_FLCC_TypeDef;
+extern ADI_TMR_TypeDef      host_tmr0, host_tmr1;
+extern ADI_GPIO_TypeDef     host_gpio0, host_gpio1;
+extern ADI_UART_TypeDef     host_uart0;
+extern ADI_XINT_TypeDef     host_xint0;
+extern ADI_FLCC_TypeDef     host_flcc0;
+#define pADI_TMR0           (&host_tmr0)
+#define pADI_TMR1           (&host_tmr1)
+#define pADI_GPIO0          (&host_gpio0)
+#define pADI_GPIO1          (&host_gpio1)
+#define pADI_UART0          (&host_uart0)
+#define pADI_XINT0          (&host_xint0)
+#define pADI_FLCC0          (&host_flcc0)
+
+#define PIN0    (1u << 0)
+#define PIN1    (1u << 1)
+#define PIN2    (1u << 2)
+#define PIN10   (1u << 10)
+#define PIN11   (1u << 11)
+#define EXTUARTRX                       (1u)
+#define BITM_XINT_CLR_UART_RX_CLR       (1u << 8)
+#define ENUM_PMG_PWRMOD_FLEXI           (0u)
+#define BITM_PMG_SRAMRET_BNK2EN         (1u << 1)
+#define TCTL_CLK_LFOSC                  (0u)
+#define TCTL_PRE_DIV16                  (1u)
+#define TCTL_PRE_DIV256                 (2u)
+#define BITM_TMR_CTL_EN                 (1u << 5)
+#define BITM_TMR_CTL_MODE               (1u << 3)
+#define BITM_TMR_CTL_UP                 (1u << 2)
+#define BITM_TMR_CLRINT_TIMEOUT         (1u << 0)
+#define B9600                           (9600u)
+#define B115200                         (115200u)
+#define BITM_UART_COMLCR_WLS            (3u)
+#define BITM_UART_COMFCR_FIFOEN         (1u << 0)
+#define BITM_UART_COMFCR_RFCLR          (1u << 1)
+#define BITM_UART_COMFCR_TFCLR          (1u << 2)
+#define BITM_UART_COMIEN_ERBFI          (1u << 0)
+#define BITM_UART_COMIEN_ELSI           (1u << 2)
+#define BITM_UART_COMLSR_TEMT           (1u << 6)
+#define RX_FIFO_1BYTE                   (0u)
+#define ENUM_FLCC_KEY_USERKEY           (0x676C7565u)
+#define ENUM_FLCC_CMD_ERASEPAGE         (1u)
+#define ENUM_FLCC_CMD_WRITE             (2u)
+#define BITM_FLCC_STAT_CMDBUSY          (1u << 2)
+#define BITM_FLCC_STAT_CMDFAIL          (3u << 4)
+
+void        DigClkSel           (uint32_t src);
+void        ClkDivCfg           (uint32_t hclk, uint32_t pclk);
+void        PwrCfg              (uint32_t mode, uint32_t mon, uint32_t sramret);
+void        GptCfg              (ADI_TMR_TypeDef *pTmr, uint32_t clk, uint32_t pre, uint32_t ctl);
+void        GptLd               (ADI_TMR_TypeDef *pTmr, uint32_t ld);
+uint32_t    GptVal              (ADI_TMR_TypeDef *pTmr);
+void        GptClrInt           (ADI_TMR_TypeDef *pTmr, uint32_t src);
+void        DioCfgPin           (ADI_GPIO_TypeDef *pPort, uint32_t pin, uint32_t func);
+void        DioOenPin           (ADI_GPIO_TypeDef *pPort, uint32_t pin, uint32_t en);
+void        DioPulPin           (ADI_GPIO_TypeDef *pPort, uint32_t pin, uint32_t en);
+void        DioIenPin           (ADI_GPIO_TypeDef *pPort, uint32_t pin, uint32_t en);
+void        DioIntPolPin        (ADI_GPIO_TypeDef *pPort, uint32_t pin, uint32_t pol);
+void        DioIntPin           (ADI_GPIO_TypeDef *pPort, uint32_t pin, uint32_t irq);
+uint32_t    DioIntSta           (ADI_GPIO_TypeDef *pPort);
+void        DioIntClrPin        (ADI_GPIO_TypeDef *pPort, uint32_t pin);
+void        DioClrPin           (ADI_GPIO_TypeDef *pPort, uint32_t pin);
+void        DioTglPin           (ADI_GPIO_TypeDef *pPort, uint32_t pin);
+void        UrtCfg              (ADI_UART_TypeDef *pPort, uint32_t baud, uint32_t bits, uint32_t fmt);
+void        UrtFifoCfg          (ADI_UART_TypeDef *pPort, uint32_t rx, uint32_t en);
+void        UrtFifoClr          (ADI_UART_TypeDef *pPort, uint32_t clr);
+void        UrtIntCfg           (ADI_UART_TypeDef *pPort, uint32_t ien);
+uint32_t    UrtIntSta           (ADI_UART_TypeDef *pPort);
+uint32_t    UrtLinSta           (ADI_UART_TypeDef *pPort);
+uint8_t     UrtRx               (ADI_UART_TypeDef *pPort);
+int         UrtTx               (ADI_UART_TypeDef *pPort, int c);
+
+/* M355 sensor library */
+#define EOL                     "\r\n"
+#define PI                      (3.14159265f)
+#define AFE_RCAL                (200.0f)
+#define CHAN0                   (0)
+#define CHAN1                   (1)
+#define SENSOR_CHANNEL_ENABLE   (1)
+#define SINE_FREQ_REG           (0x30000u)
+#define SINE_OFFSET_REG         (0u)
+#define SINE_AMPLITUDE_REG      (0x1F0u)
+
+typedef struct {
+    float       freq;
+    int32_t     DFT_result[8];
+    float       DFT_Mag[4];
+    float       Mag;
+    float       Phase;
+    float       RloadMag;
+} ImpResult_t;
+
+typedef struct {
+    uint8_t     Enable;
+    char        SensorName[16];
+    uint32_t    Rload;
+    uint32_t    Rtia;
+    uint32_t    Rfilter;
+} SNS_CFG_Type;
+
+SNS_CFG_Type *getSnsCfg         (uint32_t channel);
+void        SnsInit             (SNS_CFG_Type *pCfg);
+int32_t     convertDftToInt     (uint32_t dft);
+void        delay_10us          (uint32_t time);
+uint8_t     SnsACInit           (uint8_t channel);
+uint8_t     SnsACTest           (uint8_t channel);
+uint8_t     SnsMagPhaseCal      (void);
+
+/* Simulation state for the tests */
+extern uint64_t             host_time_10us;     /* advanced by delay_10us   */
+
+#endif /* ADI355_HOST_H */
@@ -0,0 +1,221 @@
+/*
+ * Simulated ADuCM355 drivers and M355 sensor library for the host tests,
+ * see adi355/adi355_host.h. Configuration functions store their arguments
+ * in the registers they own, which is all the sequence compiler observes.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "adi355_host.h"
+
+DWT_Type                host_dwt;
+CoreDebug_Type          host_coredebug;
+uint32_t                host_primask = 0;
+ADI_AFE_TypeDef         host_afe;
+ADI_TMR_TypeDef         host_tmr0, host_tmr1;
+ADI_GPIO_TypeDef        host_gpio0, host_gpio1;
+ADI_UART_TypeDef        host_uart0;
+ADI_XINT_TypeDef        host_xint0;
+ADI_FLCC_TypeDef        host_flcc0;
+uint64_t                host_time_10us = 0;
+
+static SNS_CFG_Type     hostSns[2] = {
+    { SENSOR_CHANNEL_ENABLE, "SNS0", 1, 2, 3 },
+    { 0, "SNS1", 1, 2, 3 },
+};
+
+void NVIC_EnableIRQ(IRQn_Type irq) { (void)irq; }
+void NVIC_DisableIRQ(IRQn_Type irq) { (void)irq; }
+
+/* AFE */
+uint32_t AfeDieSta(void) { return 1; }
+void AfeWdtGo(bool enable) { (void)enable; }
+void AfePwrCfg(uint32_t mode) { (void)mode; }
+void AfeClkSel(uint32_t src) { (void)src; }
+void AfeSysClkDiv(uint32_t div) { (void)div; }
+void AfeSysCfg(uint32_t pmbw, uint32_t bw) { (void)pmbw; (void)bw; }
+void AfeAdcChopEn(uint32_t en) { (void)en; }
+void AfeHpTiaPwrUp(bool en) { (void)en; }
+void AfeHPDacPwrUp(bool en) { (void)en; }
+void AfeHPDacWgType(uint32_t type) { pADI_AFE->WGCON = type << 1; }
+
+void AfeHFOsc32M(uint32_t en)
+{
+    pADI_AFE->HPOSCCON = en;
+}
+
+void AfeHpTiaCon(uint32_t bias)
+{
+    pADI_AFE->HSTIACON = bias;
+}
+
+void AfeHpTiaSeCfg(uint32_t rtia, uint32_t ctia, uint32_t diosel)
+{
+    pADI_AFE->HSRTIACON = rtia | ctia | (diosel << 12);
+}
+
+void AfeHpTiaDeCfg(uint32_t chan, uint32_t rload, uint32_t rtia)
+{
+    if (chan)
+    {
+        pADI_AFE->DE1RESCON = (rload << 5) | rtia;
+    }
+    else
+    {
+        pADI_AFE->DE0RESCON = (rload << 5) | rtia;
+    }
+}
+
+void AfeLpTiaCon(uint32_t chan, uint32_t rload, uint32_t rtia, uint32_t rfilter)
+{
+    uint32_t    val = (rload << 10) | (rtia << 5) | rfilter;
+    
+    if (chan)
+    {
+        pADI_AFE->LPTIACON1 = val;
+    }
+    else
+    {
+        pADI_AFE->LPTIACON0 = val;
+    }
+}
+
+void AfeLpTiaSwitchCfg(uint32_t chan, uint32_t mode)
+{
+    if (chan)
+    {
+        pADI_AFE->LPTIASW1 = mode;
+    }
+    else
+    {
+        pADI_AFE->LPTIASW0 = mode;
+    }
+}
+
+void AfeSwitchFullCfg(uint32_t group, uint32_t sw)
+{
+    if (SWITCH_GROUP_T == group)
+    {
+        pADI_AFE->TSWFULLCON |= sw;
+    }
+}
+
+void AfeSwitchDPNT(uint32_t d, uint32_t p, uint32_t n, uint32_t t)
+{
+    pADI_AFE->DSWFULLCON = d;
+    pADI_AFE->PSWFULLCON = p;
+    pADI_AFE->NSWFULLCON = n;
+    pADI_AFE->TSWFULLCON = t;
+    pADI_AFE->SWCON |= 1u << 16;
+}
+
+void AfeAdcFiltCfg(uint32_t sinc3osr, uint32_t sinc2osr, uint32_t lpfbyp, uint32_t rate)
+{
+    pADI_AFE->ADCFILTERCON = (sinc2osr << 8) | (sinc3osr << 12) | (lpfbyp << 4) | rate;
+}
+
+void AfeAdcDFTCfg(uint32_t hanning, uint32_t dftnum, uint32_t dftsrc)
+{
+    pADI_AFE->DFTCON = hanning | (dftnum << 4) | (dftsrc << 20);
+}
+
+void AfeAdcPgaCfg(uint32_t gain, uint32_t offset)
+{
+    pADI_AFE->ADCCON = (pADI_AFE->ADCCON & 0xFFFFu) | (gain << 16) | (offset << 20);
+}
+
+void AfeAdcChan(uint32_t muxp, uint32_t muxn)
+{
+    pADI_AFE->ADCCON = (pADI_AFE->ADCCON & ~0xFFFFu) | muxp | (muxn << 8);
+}
+
+void AfeAdcIntCfg(uint32_t ien)
+{
+    pADI_AFE->ADCINTIEN = ien;
+}
+
+void AfeHPDacCfg(uint32_t atten, uint32_t rate, uint32_t gain)
+{
+    pADI_AFE->HSDACCON = (atten << 12) | (rate << BITP_AFE_HSDACCON_RATE) | (gain << 13);
+}
+
+void AfeHPDacSineCfg(uint32_t fcw, uint32_t phase, uint32_t offset, uint32_t amp)
+{
+    pADI_AFE->WGFCW = fcw;
+    pADI_AFE->WGPHASE = phase;
+    pADI_AFE->WGOFFSET = offset;
+    pADI_AFE->WGAMPLITUDE = amp;
+}
+
+void AfeWaveGenGo(bool en)
+{
+    if (en)
+    {
+        pADI_AFE->AFECON |= BITM_AFE_AFECON_WAVEGENEN;
+    }
+    else
+    {
+        pADI_AFE->AFECON &= ~BITM_AFE_AFECON_WAVEGENEN;
+    }
+}
+
+/* Digital die */
+void DigClkSel(uint32_t src) { (void)src; }
+void ClkDivCfg(uint32_t hclk, uint32_t pclk) { (void)hclk; (void)pclk; }
+void PwrCfg(uint32_t mode, uint32_t mon, uint32_t sramret) { (void)mode; (void)mon; (void)sramret; }
+void GptCfg(ADI_TMR_TypeDef *pTmr, uint32_t clk, uint32_t pre, uint32_t ctl) { (void)clk; (void)pre; pTmr->CTL = ctl; }
+void GptLd(ADI_TMR_TypeDef *pTmr, uint32_t ld) { (void)pTmr; (void)ld; }
+void GptClrInt(ADI_TMR_TypeDef *pTmr, uint32_t src) { (void)pTmr; (void)src; }
+
+/* TMR1 is the 128 Hz timebase */
+uint32_t GptVal(ADI_TMR_TypeDef *pTmr)
+{
+    if (pTmr == pADI_TMR1)
+    {
+        return (uint32_t)((host_time_10us * 128u / 100000u) & 0xFFFFu);
+    }
+    return 0;
+}
+
+void DioCfgPin(ADI_GPIO_TypeDef *pPort, uint32_t pin, uint32_t func) { (void)pPort; (void)pin; (void)func; }
+void DioOenPin(ADI_GPIO_TypeDef *pPort, uint32_t pin, uint32_t en) { (void)pPort; (void)pin; (void)en; }
+void DioPulPin(ADI_GPIO_TypeDef *pPort, uint32_t pin, uint32_t en) { (void)pPort; (void)pin; (void)en; }
+void DioIenPin(ADI_GPIO_TypeDef *pPort, uint32_t pin, uint32_t en) { (void)pPort; (void)pin; (void)en; }
+void DioIntPolPin(ADI_GPIO_TypeDef *pPort, uint32_t pin, uint32_t pol) { (void)pPort; (void)pin; (void)pol; }
+void DioIntPin(ADI_GPIO_TypeDef *pPort, uint32_t pin, uint32_t irq) { (void)pPort; (void)pin; (void)irq; }
+uint32_t DioIntSta(ADI_GPIO_TypeDef *pPort) { (void)pPort; return 0; }
+void DioIntClrPin(ADI_GPIO_TypeDef *pPort, uint32_t pin) { (void)pPort; (void)pin; }
+void DioClrPin(ADI_GPIO_TypeDef *pPort, uint32_t pin) { pPort->DATA &= ~pin; }
+void DioTglPin(ADI_GPIO_TypeDef *pPort, uint32_t pin) { pPort->DATA ^= pin; }
+
+void UrtCfg(ADI_UART_TypeDef *pPort, uint32_t baud, uint32_t bits, uint32_t fmt) { (void)pPort; (void)baud; (void)bits; (void)fmt; }
+void UrtFifoCfg(ADI_UART_TypeDef *pPort, uint32_t rx, uint32_t en) { (void)pPort; (void)rx; (void)en; }
+void UrtFifoClr(ADI_UART_TypeDef *pPort, uint32_t clr) { (void)pPort; (void)clr; }
+void UrtIntCfg(ADI_UART_TypeDef *pPort, uint32_t ien) { pPort->COMIEN = ien; }
+uint32_t UrtIntSta(ADI_UART_TypeDef *pPort) { (void)pPort; return 0; }
+uint32_t UrtLinSta(ADI_UART_TypeDef *pPort) { (void)pPort; return BITM_UART_COMLSR_TEMT; }
+uint8_t UrtRx(ADI_UART_TypeDef *pPort) { (void)pPort; return 0; }
+int UrtTx(ADI_UART_TypeDef *pPort, int c) { (void)pPort; return c; }
+
+/* M355 sensor library */
+SNS_CFG_Type *getSnsCfg(uint32_t channel)
+{
+    return &hostSns[channel ? 1 : 0];
+}
+
+void SnsInit(SNS_CFG_Type *pCfg)
+{
+    (void)pCfg;
+}
+
+/* 18 bit two's complement DFT result */
+int32_t convertDftToInt(uint32_t dft)
+{
+    dft &= 0x3FFFFu;
+    return (dft & 0x20000u) ? (int32_t)dft - 0x40000 : (int32_t)dft;
+}
+
+void delay_10us(uint32_t time)
+{
+    host_time_10us += time;
+}
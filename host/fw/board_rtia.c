@@ -0,0 +1,12 @@
+/*
+ * RTIA switch for the sample unit tests, overrides the weak
+ * Board_SelectRtia of the application: every range can be selected.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+bool Board_SelectRtia(uint32_t range)
+{
+    (void)range;
+    return true;
+}
@@ -0,0 +1,12 @@
+/*
+ * Board temperature for the calibration store tests, overrides the weak
+ * Board_Temperature of the application.
+ */
+#include <stdint.h>
+
+int16_t     host_board_temp = 0x7FFF;
+
+int16_t Board_Temperature(void)
+{
+    return host_board_temp;
+}
@@ -0,0 +1,23 @@
+/*
+ * Minimal checks for the host tests: CHECK records a failure and goes on,
+ * CHECK_DONE returns the exit status for main.
+ */
+#ifndef HOST_CHECK_H
+#define HOST_CHECK_H
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond))                                                        \
+        {                                                                   \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            checkFailures++;                                                \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_DONE()        ((0 == checkFailures) ? 0 : 1)
+
+#endif /* HOST_CHECK_H */
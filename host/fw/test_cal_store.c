@@ -0,0 +1,226 @@
+/*
+ * Calibration store of the ADuCM350 application against a simulated flash:
+ * record format, page rollover, interrupted writes and calibration aging.
+ */
+#include "check.h"
+
+#define main fw_main
+#include "../../VoltammetricBipotentiostatApp_350.c"
+#undef main
+
+extern int16_t      host_board_temp;
+
+static uint32_t     calibrations;
+
+/* The store part of main(): restore or calibrate, then count the boot */
+static bool_t boot(void)
+{
+    bool_t      restored;
+    uint32_t    r;
+    
+    memset(&calRec, 0xA5, sizeof(calRec));
+    calAddr = 0xDEADBEEFu;
+    memset(&rangeCtx, 0, sizeof(rangeCtx));
+    restored = Cal_Restore();
+    if (!restored)
+    {
+        calibrations++;
+        for (r = 0; r < RTIA_NUM_RANGES; r++)
+        {
+            rangeCtx.Cal[r].Gain = 0x4000u + calibrations * 16u + r;
+            rangeCtx.Cal[r].Offset = calibrations * 16u + r;
+            rangeCtx.Cal[r].Valid = (r < 2u);
+        }
+        pADI_AFE->AFE_DAC_OFFSET_UNITY = 0x100u + calibrations;
+        pADI_AFE->AFE_DAC_GAIN = 0x200u + calibrations;
+        Cal_Capture();
+    }
+    Cal_Write(true);
+    return restored;
+}
+
+static uint32_t records_in_page(uint32_t page)
+{
+    uint32_t    addr;
+    uint32_t    n = 0;
+    const CAL_REC_TYPE *pRec;
+    
+    for (addr = CAL_STORE_BASE + page * CAL_STORE_PAGE_SIZE;
+         addr + sizeof(CAL_REC_TYPE) <= CAL_STORE_BASE + (page + 1u) * CAL_STORE_PAGE_SIZE;
+         addr += sizeof(CAL_REC_TYPE))
+    {
+        pRec = (const CAL_REC_TYPE *)host_flash_ptr(addr);
+        if (CAL_REC_MAGIC == pRec->Magic)
+        {
+            n++;
+        }
+    }
+    return n;
+}
+
+static void test_format(void)
+{
+    static const uint8_t check[9] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    
+    /* CRC-16/CCITT-FALSE check value, and 64 bit flash writes */
+    CHECK(0x29B1u == Cal_Crc(check, sizeof(check)));
+    CHECK(0u == (sizeof(CAL_REC_TYPE) % 8u));
+    CHECK(0u != (CAL_STORE_PAGE_SIZE % sizeof(CAL_REC_TYPE)));
+    CHECK(offsetof(CAL_REC_TYPE, Crc) + sizeof(uint32_t) == sizeof(CAL_REC_TYPE));
+}
+
+static void test_first_boot(void)
+{
+    host_flash_init();
+    calibrations = 0;
+    CHECK(!boot());
+    CHECK(1u == calibrations);
+    CHECK(CAL_STORE_BASE == calAddr);
+    CHECK(boot());
+    CHECK(1u == calibrations);
+    CHECK(calRec.Boots == 2u);
+    CHECK(rangeCtx.Cal[1].Gain == 0x4000u + 16u + 1u);
+    CHECK(rangeCtx.Cal[1].Valid && !rangeCtx.Cal[2].Valid);
+    CHECK(pADI_AFE->AFE_DAC_GAIN == 0x201u);
+}
+
+/* Fill page 0, roll over to page 1 and back, nothing is lost on the way */
+static void test_rollover(void)
+{
+    const uint32_t  perPage = CAL_STORE_PAGE_SIZE / sizeof(CAL_REC_TYPE);
+    uint8_t         cfg[CMD_CONFIG_LEN];
+    uint32_t        i;
+    uint32_t        seq;
+    uint32_t        boots;
+    
+    host_flash_init();
+    calibrations = 0;
+    boot();
+    for (i = 0; i < 3u * perPage; i++)
+    {
+        memset(cfg, (int)('0' + (i % 10u)), sizeof(cfg));
+        cfg[0] = (uint8_t)i;
+        Cal_SaveConfig(cfg);
+        CHECK(0 == memcmp(calRec.Cfg, cfg, sizeof(cfg)));
+        
+        /* a reboot finds the record just written */
+        seq = calRec.Seq;
+        boots = calRec.Boots;
+        CHECK(boot());
+        CHECK(calRec.Seq == seq + 1u);
+        CHECK(calRec.Boots == boots + 1u);
+        CHECK(0 == memcmp(calRec.Cfg, cfg, sizeof(cfg)));
+        if ((0 != checkFailures))
+        {
+            fprintf(stderr, "  at record %u\n", (unsigned)i);
+            return;
+        }
+    }
+    CHECK(1u == calibrations);
+    /* 6 * perPage + 1 records: both pages used, each erased a few times */
+    CHECK((host_flash_erases[0] >= 2u) && (host_flash_erases[0] <= 4u));
+    CHECK((host_flash_erases[1] >= 2u) && (host_flash_erases[1] <= 4u));
+    CHECK(records_in_page(0) + records_in_page(1) > perPage);
+}
+
+/* A write cut off anywhere keeps the previous record current */
+static void test_interrupted_write(void)
+{
+    const uint32_t  perPage = CAL_STORE_PAGE_SIZE / sizeof(CAL_REC_TYPE);
+    uint8_t         cfg[CMD_CONFIG_LEN];
+    uint32_t        cut;
+    uint32_t        seq;
+    uint32_t        fill;
+    uint32_t        i;
+    
+    /* cut in the last slot of page 0, then as the first record of page 1 */
+    for (fill = perPage - 2u; fill < perPage; fill++)
+    for (cut = 0; cut < sizeof(CAL_REC_TYPE); cut += 4u)
+    {
+        host_flash_init();
+        calibrations = 0;
+        boot();
+        for (i = 0; i < fill; i++)
+        {
+            memset(cfg, (int)i, sizeof(cfg));
+            Cal_SaveConfig(cfg);
+        }
+        seq = calRec.Seq;
+        memset(cfg, 0x5A, sizeof(cfg));
+        host_flash_budget = (int32_t)cut;
+        Cal_SaveConfig(cfg);
+        host_flash_budget = -1;
+        
+        CHECK(boot());
+        CHECK(calRec.Seq == seq + 1u);
+        CHECK(cfg[0] != calRec.Cfg[0]);
+        CHECK(1u == calibrations);
+        /* and the store keeps working behind the damaged record */
+        Cal_SaveConfig(cfg);
+        CHECK(boot());
+        CHECK(0x5Au == calRec.Cfg[0]);
+    }
+}
+
+/* Recalibrate after CAL_MAX_BOOTS, on a temperature change or a new firmware */
+static void test_aging(void)
+{
+    uint32_t        i;
+    CAL_REC_TYPE    rec;
+    uint32_t        addr;
+    
+    host_flash_init();
+    calibrations = 0;
+    host_board_temp = CAL_TEMP_UNKNOWN;
+    boot();
+    for (i = 1; i < CAL_MAX_BOOTS; i++)
+    {
+        CHECK(boot());
+    }
+    CHECK(1u == calibrations);
+    CHECK(!boot());
+    CHECK(2u == calibrations);
+    CHECK(boot());
+    
+    /* without a temperature at calibration only the boots age it */
+    host_board_temp = 250;
+    CHECK(boot());
+    CHECK(2u == calibrations);
+    
+    host_flash_init();
+    calibrations = 0;
+    boot();
+    CHECK(250 == calRec.CalTemp);
+    host_board_temp = 250 + CAL_MAX_DTEMP;
+    CHECK(boot());
+    host_board_temp = CAL_TEMP_UNKNOWN;
+    CHECK(boot());
+    host_board_temp = 250 - CAL_MAX_DTEMP - 1;
+    CHECK(!boot());
+    CHECK(2u == calibrations);
+    CHECK(250 - CAL_MAX_DTEMP - 1 == calRec.CalTemp);
+    
+    /* a newer record from another firmware version */
+    memcpy(&rec, &calRec, sizeof(rec));
+    rec.Seq++;
+    memset(rec.FwVersion, 0, sizeof(rec.FwVersion));
+    strncpy(rec.FwVersion, "0.9", sizeof(rec.FwVersion));
+    rec.Crc = Cal_Crc((const uint8_t *)&rec, offsetof(CAL_REC_TYPE, Crc));
+    addr = calAddr + sizeof(CAL_REC_TYPE);
+    CHECK(ADI_FEE_SUCCESS == adi_FEE_Write(NULL, addr, (uint8_t *)&rec, sizeof(rec)));
+    CHECK(!boot());
+    CHECK(3u == calibrations);
+    CHECK(0 == strncmp(calRec.FwVersion, FW_VERSION, sizeof(calRec.FwVersion)));
+    host_board_temp = CAL_TEMP_UNKNOWN;
+}
+
+int main(void)
+{
+    host_flash_init();
+    test_format();
+    test_first_boot();
+    test_rollover();
+    test_interrupted_write();
+    test_aging();
+    return CHECK_DONE();
+}
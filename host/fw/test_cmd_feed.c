@@ -0,0 +1,157 @@
+/*
+ * Command dispatcher of the ADuCM350 application: payload assembly of 'n'
+ * and 'o' from whole and split UART reads, the commands honored while a
+ * scan runs and recovery after a malformed payload.
+ */
+#include "check.h"
+
+#define main fw_main
+#include "../../VoltammetricBipotentiostatApp_350.c"
+#undef main
+
+/* CV, -0.50 V to +0.60 V, 10 mV steps at 100 mV/s, WE2 +0.20 V, no clean */
+static const char       cfgPayload[] = "a-0.50+0.60010100000+0.20un";
+
+/* Feed a string byte by byte, returns the last non zero command */
+static uint8_t feed(CMD_CTX_TYPE *pCtx, const char *pData, uint32_t len, uint32_t *pCmds)
+{
+    uint8_t     cmd;
+    uint8_t     last = 0;
+    uint32_t    i;
+
+    for (i = 0; i < len; i++)
+    {
+        cmd = Cmd_Feed(pCtx, (uint8_t)pData[i]);
+        if (cmd)
+        {
+            last = cmd;
+            (*pCmds)++;
+        }
+    }
+    return last;
+}
+
+static void test_payload(void)
+{
+    CMD_CTX_TYPE    ctx;
+    uint32_t        cmds = 0;
+    uint32_t        i;
+
+    CHECK(sizeof(cfgPayload) - 1u == CMD_CONFIG_LEN);
+    Cmd_Reset(&ctx);
+    /* 'n' completes with its last payload byte, not before */
+    CHECK(0 == Cmd_Feed(&ctx, 'n'));
+    for (i = 0; i + 1u < CMD_CONFIG_LEN; i++)
+    {
+        CHECK(0 == Cmd_Feed(&ctx, (uint8_t)cfgPayload[i]));
+    }
+    CHECK('n' == Cmd_Feed(&ctx, (uint8_t)cfgPayload[i]));
+    CHECK(0 == memcmp(ctx.Payload, cfgPayload, CMD_CONFIG_LEN));
+    CHECK(CMD_STATE_IDLE == ctx.State);
+
+    /* Payload bytes are data even when they look like commands */
+    CHECK('o' == feed(&ctx, "ox?e ", 6u, &cmds));
+    CHECK(1u == cmds);
+    CHECK(0 == memcmp(ctx.Payload, "x?e \0", CMD_OVERSAMPLE_LEN));
+
+    /* Back to back commands and single byte commands in between */
+    cmds = 0;
+    CHECK('?' == feed(&ctx, "ot0802c05?", 10u, &cmds));
+    CHECK(3u == cmds);
+    CHECK(0 == memcmp(ctx.Payload, "05", CMD_CYCLES_LEN));
+    CHECK('f' == feed(&ctx, "f2", 2u, &cmds));
+    CHECK('2' == ctx.Payload[0]);
+}
+
+/* Cmd_Poll over the UART, the payload arriving in pieces */
+static void test_split(void)
+{
+    Cmd_Reset(&cmdCtx);
+    CHECK(0 == Cmd_Poll());
+    host_uart_rx("n", 1u);
+    CHECK(0 == Cmd_Poll());
+    host_uart_rx(cfgPayload, 10u);
+    CHECK(0 == Cmd_Poll());
+    CHECK(CMD_STATE_PAYLOAD == cmdCtx.State);
+    host_uart_rx(&cfgPayload[10], CMD_CONFIG_LEN - 10u);
+    CHECK('n' == Cmd_Poll());
+    CHECK(0 == memcmp(cmdCtx.Payload, cfgPayload, CMD_CONFIG_LEN));
+
+    /* A complete command stops the poll, the rest stays queued */
+    host_uart_rx("om0400o", 7u);
+    CHECK('o' == Cmd_Poll());
+    CHECK(0 == memcmp(cmdCtx.Payload, "m0400", CMD_OVERSAMPLE_LEN));
+    CHECK(1u == host_uart_rx_pending());
+    CHECK(0 == Cmd_Poll());
+    host_uart_rx("k1204", 5u);
+    CHECK('o' == Cmd_Poll());
+    CHECK(0 == memcmp(cmdCtx.Payload, "k1204", CMD_OVERSAMPLE_LEN));
+    CHECK(0u == host_uart_rx_pending());
+}
+
+static void test_scan_active(void)
+{
+    CMD_CTX_TYPE    ctx;
+    const char      all[] = "abcdefghijklmnopqrstuvwyz 0123456789!";
+    uint32_t        cmds = 0;
+    uint32_t        i;
+
+    Cmd_Reset(&ctx);
+    ctx.ScanActive = true;
+    for (i = 0; i < sizeof(all) - 1u; i++)
+    {
+        CHECK(0 == Cmd_Feed(&ctx, (uint8_t)all[i]));
+        CHECK(CMD_STATE_IDLE == ctx.State);
+    }
+    CHECK('x' == Cmd_Feed(&ctx, 'x'));
+    CHECK('?' == Cmd_Feed(&ctx, '?'));
+
+    /* Cmd_Service acts on them, the dropped bytes are not replayed later */
+    Cmd_Reset(&cmdCtx);
+    cmdCtx.ScanActive = true;
+    cmdCtx.ScanStep = 12u;
+    host_uart_tx_clear();
+    host_uart_rx("n ?c", 4u);
+    Cmd_Service();
+    CHECK(!cmdCtx.ScanAbort);
+    CHECK(NULL != strstr(host_uart_tx(), "STATUS,run,12\r\n"));
+    host_uart_rx("x", 1u);
+    Cmd_Service();
+    CHECK(cmdCtx.ScanAbort);
+    CHECK(0u == host_uart_rx_pending());
+    cmdCtx.ScanActive = false;
+    CHECK(' ' == feed(&cmdCtx, " ", 1u, &cmds));
+}
+
+/* A malformed payload is still consumed whole, the next command is clean */
+static void test_bad_payload(void)
+{
+    CMD_CTX_TYPE    ctx;
+    uint32_t        cmds = 0;
+
+    Cmd_Reset(&ctx);
+    CHECK('o' == feed(&ctx, "o\xff\x00zz", 6u, &cmds));
+    CHECK(CMD_STATE_IDLE == ctx.State);
+    CHECK('x' == Cmd_Feed(&ctx, 'x'));
+    CHECK('g' == feed(&ctx, "g\x80", 2u, &cmds));
+
+    /* A reset drops a half received payload */
+    CHECK(0 == Cmd_Feed(&ctx, 'n'));
+    CHECK(0 == Cmd_Feed(&ctx, 'a'));
+    CHECK(1u == ctx.Fill);
+    Cmd_Reset(&ctx);
+    CHECK(CMD_STATE_IDLE == ctx.State);
+    CHECK(0u == ctx.Fill);
+    CHECK('?' == Cmd_Feed(&ctx, '?'));
+    CHECK('o' == feed(&ctx, "ot0801", 6u, &cmds));
+    CHECK(0 == memcmp(ctx.Payload, "t0801", CMD_OVERSAMPLE_LEN));
+}
+
+int main(void)
+{
+    test_payload();
+    test_split();
+    test_scan_active();
+    test_bad_payload();
+    return CHECK_DONE();
+}
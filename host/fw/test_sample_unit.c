@@ -0,0 +1,149 @@
+/*
+ * Current output of the ADuCM350 application ('u' 'a'): the pA of a code
+ * follow the selected range's RTIA and calibration, the RUN,CFG header
+ * reports the scale of each range, and the host conversion of the va
+ * library agrees with the board on it.
+ */
+#include <math.h>
+#include <stdlib.h>
+
+#include "check.h"
+#include "va.h"
+
+#define main fw_main
+#include "../../VoltammetricBipotentiostatApp_350.c"
+#undef main
+
+/* Ideal current of a code on a range, in pA */
+static double ideal_pa(int32_t code, uint32_t range)
+{
+    return (code - ADC_ZERO_CODE) * (ADC_SPAN_MV * 1e-3 / 65536.0) / rtiaRanges[range] * 1e12;
+}
+
+static void calibrate(uint32_t validMask)
+{
+    uint32_t    r;
+
+    for (r = 0; r < RTIA_NUM_RANGES; r++)
+    {
+        rangeCtx.Cal[r].Valid = (0 != (validMask & (1u << r)));
+    }
+}
+
+static void test_scale(void)
+{
+    uint32_t    r;
+
+    calibrate(0u);
+    for (r = 0; r < RTIA_NUM_RANGES; r++)
+    {
+        CHECK(0u == Range_ScaleAa(r));
+    }
+    calibrate(0x7u);
+    for (r = 0; r < RTIA_NUM_RANGES; r++)
+    {
+        CHECK(fabs(Range_ScaleAa(r) - ideal_pa(ADC_ZERO_CODE + 1, r) * 1e6) <= 0.5);
+    }
+    CHECK(2746582u == Range_ScaleAa(0));
+    CHECK(0u == Range_ScaleAa(RTIA_NUM_RANGES));
+}
+
+/* EmitSample in pA on each range, as after 'u' 'a' */
+static void test_emit(void)
+{
+    static const int32_t    codes[] = { 0, 1000, 32767, 32768, 32769, 40000, 65535 };
+    double                  expect;
+    uint32_t                r;
+    uint32_t                i;
+
+    calibrate(0x7u);
+    sampleUnit = UNIT_PA;
+    osCfg.Count = 1u;
+    for (r = 0; r < RTIA_NUM_RANGES; r++)
+    {
+        Range_Select(r);
+        CHECK(r == rangeCtx.Range);
+        for (i = 0; i < sizeof(codes) / sizeof(codes[0]); i++)
+        {
+            host_uart_tx_clear();
+            EmitSample((uint16_t)codes[i], 0u);
+            expect = ideal_pa(codes[i], r);
+            /* Rounded to the pA, the scale to the aA per code */
+            CHECK(fabs(atof(host_uart_tx()) - expect) <= 0.5 + 32768e-6);
+        }
+    }
+    /* An uncalibrated range is not selected, the pA stay those of range 0 */
+    Range_Select(0);
+    calibrate(0x5u);
+    Range_Select(1);
+    CHECK(0u == rangeCtx.Range);
+    CHECK(2746582u == rangeCtx.ScaleAa);
+    /* Codes again, for the legacy stream */
+    sampleUnit = UNIT_CODES;
+    host_uart_tx_clear();
+    EmitSample(40000u, 0u);
+    CHECK(0 == strcmp(host_uart_tx(), "40000 "));
+}
+
+/* The header carries the scales, the host converts with them */
+static void test_header(void)
+{
+    VA_SCALE_TYPE   scale;
+    const char     *pCfg;
+    uint16_t        code[RTIA_NUM_RANGES * 64u];
+    uint8_t         range[RTIA_NUM_RANGES * 64u];
+    float           pa[RTIA_NUM_RANGES * 64u];
+    double          worst = 0.0;
+    int32_t         board;
+    uint32_t        r;
+    uint32_t        i;
+
+    calibrate(0x5u);
+    sampleUnit = UNIT_PA;
+    host_uart_tx_clear();
+    Scan_Begin('C');
+    pCfg = strstr(host_uart_tx(), "RUN,CFG,");
+    CHECK(NULL != pCfg);
+    CHECK(0 == va_scale_parse(&scale, (NULL != pCfg) ? pCfg : ""));
+    CHECK('a' == scale.Unit);
+    CHECK(RTIA_NUM_RANGES == scale.Num);
+    for (r = 0; r < RTIA_NUM_RANGES; r++)
+    {
+        CHECK(Range_ScaleAa(r) == scale.ScaleAa[r]);
+    }
+    CHECK(0u == scale.ScaleAa[1]);
+    Scan_End();
+
+    /* Every calibrated range, codes over the whole span */
+    calibrate(0x7u);
+    for (r = 0; r < RTIA_NUM_RANGES; r++)
+    {
+        scale.ScaleAa[r] = Range_ScaleAa(r);
+        for (i = 0; i < 64u; i++)
+        {
+            code[r * 64u + i] = (uint16_t)((i * 1031u + r * 17u) & 0xFFFFu);
+            range[r * 64u + i] = (uint8_t)r;
+        }
+    }
+    va_convert(&scale, code, range, RTIA_NUM_RANGES * 64u, pa);
+    for (r = 0; r < RTIA_NUM_RANGES; r++)
+    {
+        Range_Select(r);
+        for (i = 0; i < 64u; i++)
+        {
+            board = Sample_CurrentPa(code[r * 64u + i]);
+            /* The board rounds to the pA, the host keeps a float */
+            CHECK(fabs(pa[r * 64u + i] - board) <= 0.5 + 1e-6 * abs(board));
+            worst = (fabs(pa[r * 64u + i] - board) > worst) ? fabs(pa[r * 64u + i] - board) : worst;
+        }
+    }
+    printf("UNIT,host against board worst %.3f pA\n", worst);
+}
+
+int main(void)
+{
+    test_scale();
+    test_emit();
+    test_header();
+    return CHECK_DONE();
+}
@@ -0,0 +1,185 @@
+/*
+ * Resident sequence cache of the ADuCM350 application: the incrementally
+ * patched CRC-8 is compared against a full Seq_Crc and a bitwise reference
+ * after random word patches, and the self-check switches the cache on or off.
+ */
+#include "check.h"
+
+#define main fw_main
+#include "../../VoltammetricBipotentiostatApp_350.c"
+#undef main
+
+#define ROUNDS          (2000u)
+
+static uint32_t         rng = 12345u;
+
+static uint32_t rand32(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/* Bit at a time CRC-8 of the commands, independent of seqCache.Table */
+static uint8_t ref_crc(const uint32_t *pSeq, uint32_t count)
+{
+    uint8_t     crc = SEQ_CRC_SEED;
+    uint32_t    i;
+    int         b;
+
+    for (i = 1; i <= count; i++)
+    {
+        for (b = 31; b >= 0; b--)
+        {
+            uint8_t in = (uint8_t)((pSeq[i] >> b) & 1u);
+
+            crc = (((crc >> 7) ^ in) & 1u) ? (uint8_t)((crc << 1) ^ SEQ_CRC_POLY) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static void random_seq(uint32_t *pSeq, uint32_t count)
+{
+    uint32_t    i;
+
+    pSeq[0] = count << 16;
+    for (i = 1; i <= count; i++)
+    {
+        pSeq[i] = rand32();
+    }
+}
+
+static void test_full_crc(void)
+{
+    uint32_t    seq[SEQ_CACHE_WORDS];
+    uint32_t    count;
+
+    Seq_CacheInit();
+    /* A shipped step sequence and random ones of every resident length */
+    CHECK(Seq_Crc(seq_afe_ampmeas_we3, SEQ_SAFETY_COUNT(seq_afe_ampmeas_we3[0]))
+          == ref_crc(seq_afe_ampmeas_we3, SEQ_SAFETY_COUNT(seq_afe_ampmeas_we3[0])));
+    for (count = 1; count < SEQ_CACHE_WORDS; count++)
+    {
+        random_seq(seq, count);
+        CHECK(Seq_Crc(seq, count) == ref_crc(seq, count));
+    }
+}
+
+/* Patch random words of resident sequences, the cached CRC must follow */
+static void test_patch(void)
+{
+    static uint32_t seqs[SEQ_CACHE_MAX][SEQ_CACHE_WORDS];
+    uint32_t        counts[SEQ_CACHE_MAX];
+    SEQ_ENTRY_TYPE *pEntry;
+    uint32_t        r, s, n, i;
+
+    Seq_CacheInit();
+    seqCache.State = SEQ_CACHE_ON;
+    for (s = 0; s < SEQ_CACHE_MAX; s++)
+    {
+        counts[s] = (s == 0u) ? 1u : (s == 1u) ? (SEQ_CACHE_WORDS - 1u) : (1u + rand32() % (SEQ_CACHE_WORDS - 1u));
+        random_seq(seqs[s], counts[s]);
+        Seq_Prepare(seqs[s]);
+        CHECK((seqs[s][0] & SEQ_SAFETY_CRC_MASK) == ref_crc(seqs[s], counts[s]));
+    }
+    CHECK(seqCache.Num == SEQ_CACHE_MAX);
+    for (r = 0; r < ROUNDS; r++)
+    {
+        s = rand32() % SEQ_CACHE_MAX;
+        n = rand32() % 4u;                  /* no change at all also counts */
+        while (n--)
+        {
+            i = 1u + rand32() % counts[s];
+            switch (rand32() % 3u)
+            {
+            case 0:
+                seqs[s][i] ^= 1u << (rand32() % 32u);
+                break;
+            case 1:
+                seqs[s][i] = (seqs[s][i] & 0xFFFF0000u) | (rand32() & 0xFFFFu);   /* DAC code */
+                break;
+            default:
+                seqs[s][i] = rand32();
+                break;
+            }
+        }
+        Seq_Prepare(seqs[s]);
+        pEntry = Seq_Lookup(seqs[s]);
+        CHECK(pEntry->Crc == Seq_Crc(seqs[s], counts[s]));
+        CHECK((seqs[s][0] & SEQ_SAFETY_CRC_MASK) == ref_crc(seqs[s], counts[s]));
+        CHECK(SEQ_SAFETY_COUNT(seqs[s][0]) == counts[s]);
+    }
+    CHECK(seqCache.Patched > 0u);
+}
+
+/* Sequences past the cache still get a correct CRC once the driver CRC is off */
+static void test_not_resident(void)
+{
+    static uint32_t seqs[SEQ_CACHE_MAX][SEQ_CACHE_WORDS];
+    uint32_t        full[SEQ_CACHE_WORDS];
+    uint32_t        longSeq[SEQ_CACHE_WORDS + 1u];
+    uint32_t        s;
+
+    Seq_CacheInit();
+    seqCache.State = SEQ_CACHE_ON;
+    for (s = 0; s < SEQ_CACHE_MAX; s++)
+    {
+        random_seq(seqs[s], 4u);
+        Seq_Prepare(seqs[s]);
+    }
+    random_seq(full, 6u);
+    Seq_Prepare(full);
+    CHECK(NULL == Seq_Lookup(full));
+    CHECK((full[0] & SEQ_SAFETY_CRC_MASK) == ref_crc(full, 6u));
+    full[3] ^= 0x00800000u;
+    Seq_Prepare(full);
+    CHECK((full[0] & SEQ_SAFETY_CRC_MASK) == ref_crc(full, 6u));
+
+    Seq_CacheInit();
+    seqCache.State = SEQ_CACHE_ON;
+    random_seq(longSeq, SEQ_CACHE_WORDS);
+    Seq_Prepare(longSeq);
+    CHECK(NULL == Seq_Lookup(longSeq));
+    CHECK((longSeq[0] & SEQ_SAFETY_CRC_MASK) == ref_crc(longSeq, SEQ_CACHE_WORDS));
+}
+
+/* The first step leaves the safety word alone and compares with AFE_SEQ_CRC */
+static void test_verify(void)
+{
+    uint32_t    seq[SEQ_CACHE_WORDS];
+    uint32_t    safety;
+
+    Seq_CacheInit();
+    random_seq(seq, 10u);
+    safety = seq[0];
+    Seq_Prepare(seq);
+    CHECK(seq[0] == safety);
+    pADI_AFE->AFE_SEQ_CRC = ref_crc(seq, 10u);
+    Seq_Verify(NULL, seq);
+    CHECK(SEQ_CACHE_ON == seqCache.State);
+    seq[5] ^= 0x100u;
+    Seq_Prepare(seq);
+    CHECK((seq[0] & SEQ_SAFETY_CRC_MASK) == ref_crc(seq, 10u));
+
+    Seq_CacheInit();
+    random_seq(seq, 10u);
+    Seq_Prepare(seq);
+    pADI_AFE->AFE_SEQ_CRC = ref_crc(seq, 10u) ^ 0x5Au;
+    Seq_Verify(NULL, seq);
+    CHECK(SEQ_CACHE_OFF == seqCache.State);
+    safety = seq[0];
+    seq[5] ^= 0x100u;
+    Seq_Prepare(seq);
+    CHECK(seq[0] == safety);
+}
+
+int main(void)
+{
+    test_full_crc();
+    test_patch();
+    test_not_resident();
+    test_verify();
+    return CHECK_DONE();
+}
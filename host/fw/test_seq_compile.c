@@ -0,0 +1,154 @@
+/*
+ * Sequencer compile of the ADuCM355 application against the simulated AFE:
+ * the command stream of the ImpResult_hold sweep is decoded and checked for
+ * register reach, wait chunking, the filter flush on band changes and the
+ * compiled sweep time.
+ */
+#include "check.h"
+
+#define main fw_main
+#include "../../EISApp_355.c"
+#undef main
+
+#define TEST_NUM        (sizeof(ImpResult_hold)/sizeof(ImpResult_t))
+#define AFECON_OFF      0u
+#define CONV_BITS       (BITM_AFE_AFECON_ADCCONVEN|BITM_AFE_AFECON_DFTEN)
+
+/* Decoded command: a write of data to AFECON+off, or a wait of clk AFE clocks */
+typedef struct
+{
+    int         wr;
+    uint32_t    off;
+    uint32_t    data;
+    uint32_t    clk;
+} SEQ_OP_TYPE;
+
+static SEQ_OP_TYPE decode(uint32_t cmd)
+{
+    SEQ_OP_TYPE op = {0, 0, 0, 0};
+
+    if (cmd & 0x80000000u)
+    {
+        op.wr = 1;
+        op.off = ((cmd >> 24) & 0x7Fu) << 2;
+        op.data = cmd & 0xFFFFFFu;
+    }
+    else
+    {
+        op.clk = cmd & 0x3FFFFFFFu;
+    }
+    return op;
+}
+
+static void test_encoding(void)
+{
+    uint32_t    before = u32SeqLen;
+    SEQ_OP_TYPE op;
+
+    u32SeqMs = 0;
+    SnsSeqWr(&pADI_AFE->DFTCON, 0x123456u);
+    op = decode(SeqCmd[before]);
+    CHECK(op.wr && (op.off == 0xD0u) && (op.data == 0x123456u));
+    SnsSeqWait(2u * EIS_SEQ_WAIT_MAX + 5u);
+    CHECK(u32SeqLen == before + 4u);
+    CHECK(decode(SeqCmd[before + 1]).clk == EIS_SEQ_WAIT_MAX);
+    CHECK(decode(SeqCmd[before + 2]).clk == EIS_SEQ_WAIT_MAX);
+    CHECK(decode(SeqCmd[before + 3]).clk == 5u);
+    /* DACDCBUFCON is past the 0x200 bytes the sequencer reaches */
+    CHECK(!u8SeqErr);
+    SnsSeqWr(&pADI_AFE->DACDCBUFCON, 0);
+    CHECK(u8SeqErr && (u32SeqLen == before + 4u));
+    u8SeqErr = 0;
+    u32SeqLen = 0;
+}
+
+static void test_sweep(void)
+{
+    uint32_t    regs[SEQ_REG_NUM];
+    uint32_t    i;
+    uint32_t    meas = 0;
+    uint32_t    flushes = 0;
+    uint32_t    changes = 0;
+    uint64_t    clk = 0;
+    int         cleared = 0;
+    int         flushed = 0;
+    uint8_t     band = SIG_BAND_NONE;
+    SEQ_OP_TYPE op;
+
+    SnsACInit(CHAN0);
+    for (i = 0; i < SEQ_REG_NUM; i++)
+        regs[i] = *SeqReg[i];
+    CHECK(SnsSeqCompile(ImpResult_hold, TEST_NUM, CHAN0));
+    CHECK(!u8SeqErr);
+    CHECK((u32SeqLen > 0u) && (u32SeqLen <= EIS_SEQ_MAX));
+    for (i = 0; i < SEQ_REG_NUM; i++)
+        CHECK(*SeqReg[i] == regs[i]);
+    CHECK(u8SigBand == SIG_BAND_NONE);
+
+    for (i = 0; i < u32SeqLen; i++)
+    {
+        op = decode(SeqCmd[i]);
+        if (!op.wr)
+        {
+            CHECK(op.clk > 0u);
+            clk += op.clk;
+            continue;
+        }
+        CHECK(op.off < 0x200u);
+        if (op.off != AFECON_OFF)
+            continue;
+        if (!(op.data & BITM_AFE_AFECON_SINC2EN))
+        {
+            /* a flush clears the DFT with SINC2 and waits before setting it again */
+            CHECK(!(op.data & CONV_BITS));
+            CHECK((i + 2u < u32SeqLen) && !decode(SeqCmd[i + 1]).wr);
+            cleared = 1;
+        }
+        else if (cleared)
+        {
+            cleared = 0;
+            flushed = 1;
+            flushes++;
+        }
+        if ((op.data & CONV_BITS) == CONV_BITS)
+        {
+            /* sensor then RCAL for each point, the flush comes before the sensor */
+            if (0u == (meas % 2u))
+            {
+                uint8_t b = SnsSigBand(ImpResult_hold[meas / 2u].freq);
+
+                CHECK(flushed == (b != band));
+                changes += (b != band);
+                band = b;
+            }
+            else
+            {
+                CHECK(!flushed);
+            }
+            flushed = 0;
+            meas++;
+        }
+    }
+    CHECK(meas == 2u * TEST_NUM);
+    CHECK(flushes == changes);
+    CHECK(changes == 4u);           /* 10, 3.16 and 1, 0.316, 0.1 Hz */
+    /* the last command ends the sequence */
+    op = decode(SeqCmd[u32SeqLen - 1u]);
+    CHECK(op.wr && (op.off == (uint32_t)((uint32_t)&pADI_AFE->SEQCON - (uint32_t)&pADI_AFE->AFECON)));
+    CHECK(op.data == 0u);
+    /* u32SeqMs rounds each wait down */
+    CHECK(u32SeqMs <= clk / (EIS_SEQ_CLK_HZ / 1000u));
+    CHECK(u32SeqMs + u32SeqLen >= clk / (EIS_SEQ_CLK_HZ / 1000u));
+    /* ten 0.1 Hz periods at least */
+    CHECK(u32SeqMs > 100000u);
+}
+
+int main(void)
+{
+    /* the sensor part of fw_main() */
+    pSnsCfg0 = getSnsCfg(CHAN0);
+    pSnsCfg1 = getSnsCfg(CHAN1);
+    test_encoding();
+    test_sweep();
+    return CHECK_DONE();
+}
@@ -0,0 +1,133 @@
+/*
+ * Scans per second of the voltammogram post-processing.
+ *
+ *   bench_va [scans [points [threads]]]
+ *
+ * The whole chain (convert, smooth, baseline, peak) with the scalar kernels
+ * and with the best the CPU has on one thread, then on threads (0 all
+ * cores), and the conversion and smoothing stages alone at each level.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "va.h"
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    static const char  *levelName[4] = { "auto", "scalar", "sse2", "avx2" };
+    VA_PIPE_TYPE        pipe;
+    VA_SIMD_TYPE        best = va_simd(VA_SIMD_AUTO);
+    VA_SIMD_TYPE        level;
+    VA_PEAK_TYPE       *pPeaks;
+    uint32_t            count = (argc > 1) ? (uint32_t)atoi(argv[1]) : 100000u;
+    uint32_t            n = (argc > 2) ? (uint32_t)atoi(argv[2]) : 500u;
+    uint32_t            threads = (argc > 3) ? (uint32_t)atoi(argv[3]) : 0u;
+    uint16_t           *pCode;
+    float              *pE;
+    float              *pSmooth;
+    float              *pBase;
+    double              e;
+    double              t;
+    double              check = 0.0;
+    uint32_t            s;
+    uint32_t            i;
+
+    if ((0u == count) || (n < VA_SG_MAX))
+    {
+        fprintf(stderr, "usage: bench_va [scans [points >= %u [threads]]]\n", VA_SG_MAX);
+        return 2;
+    }
+    if (0u == threads)
+    {
+        threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    pCode = malloc((size_t)count * n * sizeof(uint16_t));
+    pSmooth = malloc((size_t)count * n * sizeof(float));
+    pBase = malloc((size_t)count * n * sizeof(float));
+    pE = malloc(n * sizeof(float));
+    pPeaks = malloc(count * sizeof(VA_PEAK_TYPE));
+    if ((NULL == pCode) || (NULL == pSmooth) || (NULL == pBase) || (NULL == pE) || (NULL == pPeaks))
+    {
+        return 1;
+    }
+    memset(&pipe, 0, sizeof(pipe));
+    pipe.Scale.Num = 1u;
+    pipe.Scale.ScaleAa[0] = 2746582u;       /* 10 MOhm */
+    va_sg_init(&pipe.Sg, 11u, 2u);
+    va_als_default(&pipe.Als);
+    pipe.Dir = 1;
+    /* Sloped background and a peak wandering from scan to scan, with noise */
+    srand(35);
+    for (i = 0; i < n; i++)
+    {
+        pE[i] = -200.0f + 800.0f * i / (n - 1u);
+    }
+    for (s = 0; s < count; s++)
+    {
+        for (i = 0; i < n; i++)
+        {
+            e = pE[i] - (100.0 + s % 200);
+            pCode[(size_t)s * n + i] = (uint16_t)(32768 + (800.0 + 2.0 * pE[i] + 400.0 * exp(-e * e / 1800.0)) /
+                                                  2.746582 + rand() % 8);
+        }
+    }
+    printf("VA,SCAN,%u points,window %u,order %u\n", n, pipe.Sg.Window, pipe.Sg.Order);
+
+    /* VA,BENCH,<stage>,<kernels>,<threads>,<scans>,<scans/s> */
+    for (level = VA_SIMD_NONE; level <= best; level++)
+    {
+        va_simd(level);
+        t = now_s();
+        for (s = 0; s < count; s++)
+        {
+            va_convert(&pipe.Scale, &pCode[(size_t)s * n], NULL, n, &pBase[(size_t)s * n]);
+        }
+        t = now_s() - t;
+        printf("VA,BENCH,convert,%s,1,%u,%.0f\n", levelName[level], count, count / t);
+        t = now_s();
+        for (s = 0; s < count; s++)
+        {
+            va_sg_apply(&pipe.Sg, &pBase[(size_t)s * n], n, &pSmooth[(size_t)s * n]);
+        }
+        t = now_s() - t;
+        printf("VA,BENCH,smooth,%s,1,%u,%.0f\n", levelName[level], count, count / t);
+    }
+    va_simd(VA_SIMD_NONE);
+    t = now_s();
+    va_batch(&pipe, pCode, NULL, pE, n, count, pSmooth, pBase, pPeaks, 1u);
+    t = now_s() - t;
+    printf("VA,BENCH,chain,%s,1,%u,%.0f\n", levelName[VA_SIMD_NONE], count, count / t);
+    va_simd(best);
+    t = now_s();
+    va_batch(&pipe, pCode, NULL, pE, n, count, pSmooth, pBase, pPeaks, 1u);
+    t = now_s() - t;
+    printf("VA,BENCH,chain,%s,1,%u,%.0f\n", levelName[best], count, count / t);
+    t = now_s();
+    va_batch(&pipe, pCode, NULL, pE, n, count, pSmooth, pBase, pPeaks, threads);
+    t = now_s() - t;
+    printf("VA,BENCH,chain,%s,%u,%u,%.0f\n", levelName[best], threads, count, count / t);
+
+    for (s = 0; s < count; s++)
+    {
+        check += pPeaks[s].Potential;
+    }
+    printf("VA,BENCH,mean peak %.1f mV\n", check / count);
+    free(pCode);
+    free(pSmooth);
+    free(pBase);
+    free(pE);
+    free(pPeaks);
+    return 0;
+}
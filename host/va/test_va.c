@@ -0,0 +1,421 @@
+/*
+ * Voltammogram post-processing against references: Savitzky-Golay against
+ * the tabulated coefficients and polynomials it must pass, every kernel
+ * level against a scalar double computation, the baseline against a dense
+ * solve of the same weighted problem, the peak area of a Gaussian, the
+ * threaded batch against one thread and the RUN,CFG parse.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "va.h"
+
+#define SCAN_POINTS             (400u)
+#define ALS_REF_POINTS          (40u)
+
+/* Current per code of the 10 MOhm range, as Range_ScaleAa reports it */
+#define SCALE_10M_AA            (2746582u)
+
+static double       alsRef[ALS_REF_POINTS][ALS_REF_POINTS];
+
+/* Potential axis of a scan, -200 to 600 mV */
+static void axis(float *pE, uint32_t n)
+{
+    uint32_t    i;
+
+    for (i = 0; i < n; i++)
+    {
+        pE[i] = -200.0f + 800.0f * i / (n - 1u);
+    }
+}
+
+/* Sloped background with some curvature under a Gaussian peak, in pA */
+static double signal(double e, double height, double centre, double sigma, double *pBase)
+{
+    double      base = 800.0 + 2.0 * e + 5e-5 * e * e;
+
+    if (NULL != pBase)
+    {
+        *pBase = base;
+    }
+    return base + height * exp(-0.5 * (e - centre) * (e - centre) / (sigma * sigma));
+}
+
+static void test_sg_table(void)
+{
+    static const float  q5[5] = { -3, 12, 17, 12, -3 };
+    static const float  q7[7] = { -2, 3, 6, 7, 6, 3, -2 };
+    static const float  q9[9] = { 15, -55, 30, 135, 179, 135, 30, -55, 15 };
+    VA_SG_TYPE          sg;
+    uint32_t            k;
+
+    CHECK(0 == va_sg_init(&sg, 5u, 2u));
+    for (k = 0; k < 5u; k++)
+    {
+        CHECK(fabsf(sg.Coef[k] - q5[k] / 35.0f) < 1e-6f);
+    }
+    CHECK(0 == va_sg_init(&sg, 7u, 3u));
+    for (k = 0; k < 7u; k++)
+    {
+        CHECK(fabsf(sg.Coef[k] - q7[k] / 21.0f) < 1e-6f);
+    }
+    CHECK(0 == va_sg_init(&sg, 9u, 4u));
+    for (k = 0; k < 9u; k++)
+    {
+        CHECK(fabsf(sg.Coef[k] - q9[k] / 429.0f) < 1e-6f);
+    }
+    CHECK(0 != va_sg_init(&sg, 4u, 2u));
+    CHECK(0 != va_sg_init(&sg, VA_SG_MAX + 2u, 2u));
+    CHECK(0 != va_sg_init(&sg, 5u, 5u));
+}
+
+/* A polynomial up to the order comes out as it went in, ends included */
+static void test_sg_exact(void)
+{
+    VA_SG_TYPE  sg;
+    float       in[64];
+    float       out[64];
+    double      x;
+    float       worst = 0.0f;
+    uint32_t    i;
+
+    CHECK(0 == va_sg_init(&sg, 11u, 3u));
+    for (i = 0; i < 64u; i++)
+    {
+        x = (i - 30.0) / 10.0;
+        in[i] = (float)(1.0 - 2.0 * x + 0.5 * x * x - 0.25 * x * x * x);
+    }
+    va_sg_apply(&sg, in, 64u, out);
+    for (i = 0; i < 64u; i++)
+    {
+        worst = (fabsf(out[i] - in[i]) > worst) ? fabsf(out[i] - in[i]) : worst;
+    }
+    printf("VA,SG,polynomial worst error %.3g\n", worst);
+    CHECK(worst < 1e-4f);
+}
+
+/* Every kernel level against the same arithmetic in double */
+static void test_simd(void)
+{
+    static const VA_SIMD_TYPE   level[3] = { VA_SIMD_NONE, VA_SIMD_SSE2, VA_SIMD_AVX2 };
+    VA_SCALE_TYPE               scale;
+    VA_SG_TYPE                  sg;
+    uint16_t                    code[SCAN_POINTS + 3u];
+    uint8_t                     range[SCAN_POINTS + 3u];
+    float                       pa[SCAN_POINTS + 3u];
+    float                       out[SCAN_POINTS + 3u];
+    double                      ref[SCAN_POINTS + 3u];
+    double                      sum;
+    double                      worstPa;
+    double                      worstSg;
+    uint32_t                    n = SCAN_POINTS + 3u;   /* tails off the vector width */
+    uint32_t                    l;
+    uint32_t                    i;
+    uint32_t                    k;
+
+    memset(&scale, 0, sizeof(scale));
+    scale.Num = 3u;
+    scale.ScaleAa[0] = SCALE_10M_AA;
+    scale.ScaleAa[1] = 274658u;
+    scale.ScaleAa[2] = 0u;
+    srand(35);
+    for (i = 0; i < n; i++)
+    {
+        code[i] = (uint16_t)(rand() & 0xFFFF);
+        range[i] = (uint8_t)((i < 150u) ? 0u : ((i < 390u) ? 1u : ((i < 395u) ? 2u : 0u)));
+    }
+    CHECK(0 == va_sg_init(&sg, 15u, 4u));
+    for (l = 0; l < 3u; l++)
+    {
+        if (va_simd(level[l]) != level[l])
+        {
+            printf("VA,SIMD,level %u not on this CPU\n", level[l]);
+            continue;
+        }
+        va_convert(&scale, code, range, n, pa);
+        worstPa = 0.0;
+        for (i = 0; i < n; i++)
+        {
+            ref[i] = ((int32_t)code[i] - VA_ZERO_CODE) * (scale.ScaleAa[range[i]] * 1e-6);
+            worstPa = (fabs(pa[i] - ref[i]) > worstPa) ? fabs(pa[i] - ref[i]) : worstPa;
+        }
+        va_sg_apply(&sg, pa, n, out);
+        worstSg = 0.0;
+        for (i = sg.Window / 2u; i + sg.Window / 2u < n; i++)
+        {
+            sum = 0.0;
+            for (k = 0; k < sg.Window; k++)
+            {
+                sum += (double)sg.Coef[k] * pa[i - sg.Window / 2u + k];
+            }
+            worstSg = (fabs(out[i] - sum) > worstSg) ? fabs(out[i] - sum) : worstSg;
+        }
+        printf("VA,SIMD,level %u,convert %.3g pA,smooth %.3g pA\n", level[l], worstPa, worstSg);
+        /* Float rounding of up to 90 nA full scale */
+        CHECK(worstPa < 90000.0 * 2e-7);
+        CHECK(worstSg < 90000.0 * 2e-6);
+        CHECK(0.0f == pa[392]);
+    }
+    va_simd(VA_SIMD_AUTO);
+}
+
+/* The weighted problem of every iteration solved densely */
+static void als_dense(const VA_ALS_TYPE *pAls, const float *pY, uint32_t n, double *pZ)
+{
+    double      b[ALS_REF_POINTS];
+    double      w[ALS_REF_POINTS];
+    double      d[ALS_REF_POINTS - 2u][ALS_REF_POINTS];
+    double      t;
+    uint32_t    it, i, j, k;
+
+    memset(d, 0, sizeof(d));
+    for (i = 0; i + 2u < n; i++)
+    {
+        d[i][i] = 1.0;
+        d[i][i + 1u] = -2.0;
+        d[i][i + 2u] = 1.0;
+    }
+    for (it = 0; it < pAls->Iterations; it++)
+    {
+        for (i = 0; i < n; i++)
+        {
+            w[i] = (0u == it) ? 1.0 : ((pY[i] > pZ[i]) ? pAls->P : 1.0 - pAls->P);
+        }
+        for (i = 0; i < n; i++)
+        {
+            for (j = 0; j < n; j++)
+            {
+                t = 0.0;
+                for (k = 0; k + 2u < n; k++)
+                {
+                    t += d[k][i] * d[k][j];
+                }
+                alsRef[i][j] = pAls->Lambda * t + ((i == j) ? w[i] : 0.0);
+            }
+            b[i] = w[i] * pY[i];
+        }
+        /* Gaussian elimination, the system is positive definite */
+        for (k = 0; k < n; k++)
+        {
+            for (i = k + 1u; i < n; i++)
+            {
+                t = alsRef[i][k] / alsRef[k][k];
+                for (j = k; j < n; j++)
+                {
+                    alsRef[i][j] -= t * alsRef[k][j];
+                }
+                b[i] -= t * b[k];
+            }
+        }
+        for (k = n; k-- > 0;)
+        {
+            t = b[k];
+            for (j = k + 1u; j < n; j++)
+            {
+                t -= alsRef[k][j] * pZ[j];
+            }
+            pZ[k] = t / alsRef[k][k];
+        }
+    }
+}
+
+static void test_als_dense(void)
+{
+    VA_ALS_TYPE     als;
+    float           e[ALS_REF_POINTS];
+    float           y[ALS_REF_POINTS];
+    float           base[ALS_REF_POINTS];
+    double          work[5u * ALS_REF_POINTS];
+    double          z[ALS_REF_POINTS];
+    double          worst = 0.0;
+    double          span = 0.0;
+    uint32_t        n;
+    uint32_t        i;
+
+    va_als_default(&als);
+    axis(e, ALS_REF_POINTS);
+    for (n = 4u; n <= ALS_REF_POINTS; n += 12u)
+    {
+        for (als.Lambda = 1.0; als.Lambda < 1e5; als.Lambda *= 100.0)
+        {
+            for (i = 0; i < n; i++)
+            {
+                y[i] = (float)signal(e[i], 300.0, 200.0, 60.0, NULL);
+                span = (y[i] > span) ? y[i] : span;
+            }
+            va_als(&als, y, n, base, work);
+            als_dense(&als, y, n, z);
+            for (i = 0; i < n; i++)
+            {
+                worst = (fabs(base[i] - z[i]) > worst) ? fabs(base[i] - z[i]) : worst;
+            }
+        }
+    }
+    printf("VA,ALS,dense reference worst %.3g of %.0f pA\n", worst, span);
+    CHECK(worst < 1e-5 * span);
+}
+
+/* The background comes back from under the peak, close enough to integrate
+ * it. The asymmetric weights leave a bias of a few percent of the peak */
+static void test_als_recovery(void)
+{
+    VA_ALS_TYPE     als;
+    VA_PEAK_TYPE    peak;
+    float           e[SCAN_POINTS];
+    float           y[SCAN_POINTS];
+    float           base[SCAN_POINTS];
+    double          work[5u * SCAN_POINTS];
+    double          truth;
+    double          worst = 0.0;
+    double          area = 500.0 * 40.0 * sqrt(2.0 * M_PI);
+    uint32_t        i;
+
+    va_als_default(&als);
+    axis(e, SCAN_POINTS);
+    for (i = 0; i < SCAN_POINTS; i++)
+    {
+        y[i] = (float)signal(e[i], 500.0, 250.0, 40.0, NULL);
+    }
+    va_als(&als, y, SCAN_POINTS, base, work);
+    for (i = 0; i < SCAN_POINTS; i++)
+    {
+        signal(e[i], 0.0, 0.0, 1.0, &truth);
+        worst = (fabs(base[i] - truth) > worst) ? fabs(base[i] - truth) : worst;
+    }
+    CHECK(0 == va_peak(y, base, e, SCAN_POINTS, 1, &peak));
+    printf("VA,ALS,baseline worst error %.2f pA under a 500 pA peak,area %.0f of %.0f pA mV\n", worst,
+           peak.Area, area);
+    CHECK(worst < 0.05 * 500.0);
+    CHECK(fabs(peak.Area - area) < 0.05 * area);
+}
+
+static void test_peak(void)
+{
+    VA_PEAK_TYPE    peak;
+    float           e[SCAN_POINTS];
+    float           y[SCAN_POINTS];
+    float           base[SCAN_POINTS];
+    double          b;
+    double          area = 500.0 * 40.0 * sqrt(2.0 * M_PI);
+    uint32_t        i;
+
+    axis(e, SCAN_POINTS);
+    for (i = 0; i < SCAN_POINTS; i++)
+    {
+        y[i] = (float)signal(e[i], 500.0, 250.0, 40.0, &b);
+        base[i] = (float)b;
+    }
+    CHECK(0 == va_peak(y, base, e, SCAN_POINTS, 1, &peak));
+    printf("VA,PEAK,%.1f mV,%.1f pA,area %.0f of %.0f pA mV\n", peak.Potential, peak.Height, peak.Area, area);
+    CHECK(fabsf(peak.Potential - 250.0f) <= 1.0f);
+    CHECK(fabsf(peak.Height - 500.0f) < 0.5f);
+    CHECK(fabs(peak.Area - area) < 1e-3 * area);
+    /* None the other way, and a reduction peak on a reversed sweep */
+    CHECK(0 != va_peak(y, base, e, SCAN_POINTS, -1, &peak));
+    for (i = 0; i < SCAN_POINTS; i++)
+    {
+        e[i] = 600.0f - 800.0f * i / (SCAN_POINTS - 1u);
+        y[i] = (float)(2.0 * signal(e[i], 0.0, 0.0, 1.0, &b) - signal(e[i], 500.0, 250.0, 40.0, NULL));
+        base[i] = (float)b;
+    }
+    CHECK(0 == va_peak(y, base, e, SCAN_POINTS, -1, &peak));
+    CHECK(fabsf(peak.Potential - 250.0f) <= 1.0f);
+    CHECK(fabs(peak.Area - area) < 1e-3 * area);
+}
+
+static void test_batch(void)
+{
+    VA_PIPE_TYPE    pipe;
+    VA_PEAK_TYPE   *pPeak1;
+    VA_PEAK_TYPE   *pPeak4;
+    VA_PEAK_TYPE    peak;
+    uint32_t        count = 203u;
+    uint32_t        n = SCAN_POINTS;
+    uint16_t       *pCode = malloc((size_t)count * n * sizeof(uint16_t));
+    float          *pSmooth1 = malloc((size_t)count * n * sizeof(float));
+    float          *pSmooth4 = malloc((size_t)count * n * sizeof(float));
+    float          *pBase1 = malloc((size_t)count * n * sizeof(float));
+    float          *pBase4 = malloc((size_t)count * n * sizeof(float));
+    float           e[SCAN_POINTS];
+    float           pa[SCAN_POINTS];
+    float           smooth[SCAN_POINTS];
+    float           base[SCAN_POINTS];
+    double          work[5u * SCAN_POINTS];
+    uint32_t        s;
+    uint32_t        i;
+
+    pPeak1 = malloc(count * sizeof(VA_PEAK_TYPE));
+    pPeak4 = malloc(count * sizeof(VA_PEAK_TYPE));
+    memset(&pipe, 0, sizeof(pipe));
+    pipe.Scale.Num = 1u;
+    pipe.Scale.ScaleAa[0] = SCALE_10M_AA;
+    CHECK(0 == va_sg_init(&pipe.Sg, 11u, 2u));
+    va_als_default(&pipe.Als);
+    pipe.Dir = 1;
+    axis(e, n);
+    srand(350);
+    for (s = 0; s < count; s++)
+    {
+        for (i = 0; i < n; i++)
+        {
+            pCode[(size_t)s * n + i] = (uint16_t)lround(VA_ZERO_CODE + (signal(e[i], 100.0 + s, 100.0 + s % 50,
+                                                        30.0, NULL) + rand() % 20) / (SCALE_10M_AA * 1e-6));
+        }
+    }
+    CHECK(0 == va_batch(&pipe, pCode, NULL, e, n, count, pSmooth1, pBase1, pPeak1, 1u));
+    CHECK(0 == va_batch(&pipe, pCode, NULL, e, n, count, pSmooth4, pBase4, pPeak4, 4u));
+    CHECK(0 == memcmp(pSmooth1, pSmooth4, (size_t)count * n * sizeof(float)));
+    CHECK(0 == memcmp(pBase1, pBase4, (size_t)count * n * sizeof(float)));
+    CHECK(0 == memcmp(pPeak1, pPeak4, count * sizeof(VA_PEAK_TYPE)));
+    /* The last scan step by step */
+    s = count - 1u;
+    va_convert(&pipe.Scale, &pCode[(size_t)s * n], NULL, n, pa);
+    va_sg_apply(&pipe.Sg, pa, n, smooth);
+    va_als(&pipe.Als, smooth, n, base, work);
+    CHECK(0 == va_peak(smooth, base, e, n, 1, &peak));
+    CHECK(0 == memcmp(base, &pBase4[(size_t)s * n], n * sizeof(float)));
+    CHECK(0 == memcmp(&peak, &pPeak4[s], sizeof(peak)));
+    CHECK(fabsf(peak.Potential - (100.0f + s % 50)) < 5.0f);
+    CHECK(0 == va_batch(&pipe, pCode, NULL, e, n, 3u, pSmooth4, pBase4, pPeak4, 8u));
+    CHECK(0 != va_batch(&pipe, pCode, NULL, e, 5u, 3u, pSmooth4, pBase4, pPeak4, 1u));
+    free(pCode);
+    free(pSmooth1);
+    free(pSmooth4);
+    free(pBase1);
+    free(pBase4);
+    free(pPeak1);
+    free(pPeak4);
+}
+
+static void test_scale_parse(void)
+{
+    VA_SCALE_TYPE   scale;
+
+    CHECK(0 == va_scale_parse(&scale, "RUN,CFG,C,-200,600,2,100,25,0,1,4,1,a,2746582;0;27465824\r\n"));
+    CHECK('a' == scale.Unit);
+    CHECK(3u == scale.Num);
+    CHECK(SCALE_10M_AA == scale.ScaleAa[0]);
+    CHECK(0u == scale.ScaleAa[1]);
+    CHECK(27465824u == scale.ScaleAa[2]);
+    CHECK(0 == va_scale_parse(&scale, "RUN,CFG,S,0,-500,-5,50,25,0,0,1,3,c,2746582"));
+    CHECK(('c' == scale.Unit) && (1u == scale.Num));
+    /* Headers from before the scales were reported */
+    CHECK(0 != va_scale_parse(&scale, "RUN,CFG,C,-200,600,2,100,25,0,1,4,1\r\n"));
+    CHECK(0 != va_scale_parse(&scale, "RUN,CFG,C,-200,600,2,100,25,0,1,4,1,a,\r\n"));
+    CHECK(0 != va_scale_parse(&scale, "RUN,BEGIN,1,C\r\n"));
+}
+
+int main(void)
+{
+    test_sg_table();
+    test_sg_exact();
+    test_simd();
+    test_als_dense();
+    test_als_recovery();
+    test_peak();
+    test_batch();
+    test_scale_parse();
+    return CHECK_DONE();
+}
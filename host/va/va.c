@@ -0,0 +1,606 @@
+/*
+ * Voltammogram post-processing, see va.h.
+ */
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VA_X86                  (1)
+#else
+#define VA_X86                  (0)
+#endif
+
+#include "va.h"
+
+#define VA_MAX_THREADS          (64u)
+
+typedef struct {
+    const VA_PIPE_TYPE *pPipe;
+    const uint16_t     *pCode;
+    const uint8_t      *pRange;
+    const float        *pE;
+    uint32_t            N;
+    uint32_t            First;
+    uint32_t            Count;
+    float              *pSmooth;
+    float              *pBase;
+    VA_PEAK_TYPE       *pPeaks;
+    int                 Rc;
+} VA_SLICE_TYPE;
+
+static VA_SIMD_TYPE     simdLevel = VA_SIMD_AUTO;
+
+VA_SIMD_TYPE va_simd(VA_SIMD_TYPE level)
+{
+#if VA_X86
+    VA_SIMD_TYPE    best = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) ? VA_SIMD_AVX2 :
+                           (__builtin_cpu_supports("sse2") ? VA_SIMD_SSE2 : VA_SIMD_NONE);
+
+    /* Never above what the CPU has */
+    simdLevel = ((VA_SIMD_AUTO == level) || (level > best)) ? best : level;
+#else
+    (void)level;
+    simdLevel = VA_SIMD_NONE;
+#endif
+    return simdLevel;
+}
+
+static VA_SIMD_TYPE simd(void)
+{
+    return (VA_SIMD_AUTO == simdLevel) ? va_simd(VA_SIMD_AUTO) : simdLevel;
+}
+
+int va_scale_parse(VA_SCALE_TYPE *pScale, const char *pRunCfg)
+{
+    const char *p = pRunCfg;
+    char       *pEnd;
+    uint32_t    commas = 0;
+
+    memset(pScale, 0, sizeof(*pScale));
+    if (0 != strncmp(p, "RUN,CFG,", 8))
+    {
+        return -1;
+    }
+    /* <test>,<vinit>,<vfinal>,<vstep>,<rate>,<amp>,<we2>,<electrode>,<oversample>,<cycles>, */
+    for (p += 8; ('\0' != *p) && (commas < 10u); p++)
+    {
+        commas += (',' == *p);
+    }
+    if ((commas < 10u) || (('a' != p[0]) && ('c' != p[0])) || (',' != p[1]))
+    {
+        return -1;
+    }
+    pScale->Unit = p[0];
+    p += 2;
+    while (pScale->Num < VA_MAX_RANGES)
+    {
+        pScale->ScaleAa[pScale->Num] = (uint32_t)strtoul(p, &pEnd, 10);
+        if (pEnd == p)
+        {
+            break;
+        }
+        pScale->Num++;
+        p = (';' == *pEnd) ? pEnd + 1 : pEnd;
+        if (p == pEnd)
+        {
+            break;
+        }
+    }
+    return (pScale->Num > 0u) ? 0 : -1;
+}
+
+static void convert_scalar(const uint16_t *pCode, uint32_t n, float scale, float *pPa)
+{
+    uint32_t    i;
+
+    for (i = 0; i < n; i++)
+    {
+        pPa[i] = (float)((int32_t)pCode[i] - VA_ZERO_CODE) * scale;
+    }
+}
+
+#if VA_X86
+__attribute__((target("avx2")))
+static uint32_t convert_avx2(const uint16_t *pCode, uint32_t n, float scale, float *pPa)
+{
+    const __m256i   zero = _mm256_set1_epi32(VA_ZERO_CODE);
+    const __m256    k = _mm256_set1_ps(scale);
+    __m256i         c;
+    uint32_t        i;
+
+    for (i = 0; i + 8u <= n; i += 8u)
+    {
+        c = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)&pCode[i]));
+        _mm256_storeu_ps(&pPa[i], _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(c, zero)), k));
+    }
+    return i;
+}
+
+static uint32_t convert_sse2(const uint16_t *pCode, uint32_t n, float scale, float *pPa)
+{
+    const __m128i   zero = _mm_set1_epi32(VA_ZERO_CODE);
+    const __m128i   z16 = _mm_setzero_si128();
+    const __m128    k = _mm_set1_ps(scale);
+    __m128i         c;
+    uint32_t        i;
+
+    for (i = 0; i + 8u <= n; i += 8u)
+    {
+        c = _mm_loadu_si128((const __m128i *)&pCode[i]);
+        _mm_storeu_ps(&pPa[i], _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(_mm_unpacklo_epi16(c, z16), zero)), k));
+        _mm_storeu_ps(&pPa[i + 4u], _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(_mm_unpackhi_epi16(c, z16), zero)), k));
+    }
+    return i;
+}
+#endif
+
+/* One stretch of codes of the same range */
+static void convert_run(const uint16_t *pCode, uint32_t n, float scale, float *pPa)
+{
+    uint32_t    done = 0;
+
+#if VA_X86
+    switch (simd())
+    {
+    case VA_SIMD_AVX2:
+        done = convert_avx2(pCode, n, scale, pPa);
+        break;
+    case VA_SIMD_SSE2:
+        done = convert_sse2(pCode, n, scale, pPa);
+        break;
+    default:
+        break;
+    }
+#endif
+    convert_scalar(pCode + done, n - done, scale, pPa + done);
+}
+
+void va_convert(const VA_SCALE_TYPE *pScale, const uint16_t *pCode, const uint8_t *pRange, uint32_t n, float *pPa)
+{
+    uint32_t    i = 0;
+    uint32_t    j;
+    uint8_t     r;
+
+    /* Ranges change rarely within a scan, each stretch is converted at once */
+    while (i < n)
+    {
+        r = (NULL != pRange) ? pRange[i] : 0u;
+        for (j = i + 1u; (j < n) && (NULL != pRange) && (pRange[j] == r); j++)
+        {
+        }
+        convert_run(&pCode[i], j - i, (r < pScale->Num) ? (float)(pScale->ScaleAa[r] * 1e-6) : 0.0f, &pPa[i]);
+        i = j;
+    }
+}
+
+/* Solve the m x m system in place by Gaussian elimination with pivoting */
+static int solve_small(double *pA, double *pB, uint32_t m)
+{
+    double      t;
+    uint32_t    i, j, k, piv;
+
+    for (k = 0; k < m; k++)
+    {
+        piv = k;
+        for (i = k + 1u; i < m; i++)
+        {
+            piv = (fabs(pA[i * m + k]) > fabs(pA[piv * m + k])) ? i : piv;
+        }
+        if (0.0 == pA[piv * m + k])
+        {
+            return -1;
+        }
+        for (j = 0; j < m; j++)
+        {
+            t = pA[k * m + j];
+            pA[k * m + j] = pA[piv * m + j];
+            pA[piv * m + j] = t;
+        }
+        t = pB[k];
+        pB[k] = pB[piv];
+        pB[piv] = t;
+        for (i = k + 1u; i < m; i++)
+        {
+            t = pA[i * m + k] / pA[k * m + k];
+            for (j = k; j < m; j++)
+            {
+                pA[i * m + j] -= t * pA[k * m + j];
+            }
+            pB[i] -= t * pB[k];
+        }
+    }
+    for (k = m; k-- > 0;)
+    {
+        for (j = k + 1u; j < m; j++)
+        {
+            pB[k] -= pA[k * m + j] * pB[j];
+        }
+        pB[k] /= pA[k * m + k];
+    }
+    return 0;
+}
+
+/* Weights of the window samples giving the fitted polynomial at position t */
+static int sg_weights(uint32_t window, uint32_t order, uint32_t t, float *pW)
+{
+    double      jtj[(VA_SG_MAX / 2u) * (VA_SG_MAX / 2u)];
+    double      e[VA_SG_MAX / 2u];
+    double      h = (double)(window / 2u);
+    double      x;
+    double      w;
+    uint32_t    m = order + 1u;
+    uint32_t    a, b, k;
+
+    /* p(x) = sum c_j x^j on x = (k - h) / h, the weights are e' (J'J)^-1 J'
+     * with e the powers of the position, solved as (J'J) v = e */
+    memset(jtj, 0, sizeof(jtj));
+    for (k = 0; k < window; k++)
+    {
+        x = ((double)k - h) / h;
+        for (a = 0; a < m; a++)
+        {
+            for (b = 0; b < m; b++)
+            {
+                jtj[a * m + b] += pow(x, a) * pow(x, b);
+            }
+        }
+    }
+    for (a = 0; a < m; a++)
+    {
+        e[a] = pow(((double)t - h) / h, a);
+    }
+    if (0 != solve_small(jtj, e, m))
+    {
+        return -1;
+    }
+    for (k = 0; k < window; k++)
+    {
+        x = ((double)k - h) / h;
+        w = 0.0;
+        for (a = 0; a < m; a++)
+        {
+            w += e[a] * pow(x, a);
+        }
+        pW[k] = (float)w;
+    }
+    return 0;
+}
+
+int va_sg_init(VA_SG_TYPE *pSg, uint32_t window, uint32_t order)
+{
+    uint32_t    t;
+
+    memset(pSg, 0, sizeof(*pSg));
+    if ((window < 3u) || (window > VA_SG_MAX) || (0u == (window & 1u)) || (order >= window) ||
+        (order + 1u > VA_SG_MAX / 2u))
+    {
+        return -1;
+    }
+    pSg->Window = window;
+    pSg->Order = order;
+    if (0 != sg_weights(window, order, window / 2u, pSg->Coef))
+    {
+        return -1;
+    }
+    for (t = 0; t < window / 2u; t++)
+    {
+        if (0 != sg_weights(window, order, t, pSg->Edge[t]))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#if VA_X86
+__attribute__((target("avx2,fma")))
+static uint32_t sg_avx2(const float *pCoef, uint32_t window, const float *pIn, uint32_t count, float *pOut)
+{
+    __m256      acc;
+    uint32_t    i;
+    uint32_t    k;
+
+    for (i = 0; i + 8u <= count; i += 8u)
+    {
+        acc = _mm256_setzero_ps();
+        for (k = 0; k < window; k++)
+        {
+            acc = _mm256_fmadd_ps(_mm256_set1_ps(pCoef[k]), _mm256_loadu_ps(&pIn[i + k]), acc);
+        }
+        _mm256_storeu_ps(&pOut[i], acc);
+    }
+    return i;
+}
+
+static uint32_t sg_sse2(const float *pCoef, uint32_t window, const float *pIn, uint32_t count, float *pOut)
+{
+    __m128      acc;
+    uint32_t    i;
+    uint32_t    k;
+
+    for (i = 0; i + 4u <= count; i += 4u)
+    {
+        acc = _mm_setzero_ps();
+        for (k = 0; k < window; k++)
+        {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(pCoef[k]), _mm_loadu_ps(&pIn[i + k])));
+        }
+        _mm_storeu_ps(&pOut[i], acc);
+    }
+    return i;
+}
+#endif
+
+void va_sg_apply(const VA_SG_TYPE *pSg, const float *pIn, uint32_t n, float *pOut)
+{
+    uint32_t    h = pSg->Window / 2u;
+    uint32_t    count = n - 2u * h;     /* outputs with a full centred window */
+    uint32_t    done = 0;
+    uint32_t    i;
+    uint32_t    k;
+    float       sum;
+
+    /* Output i + h is the window starting at input i */
+#if VA_X86
+    switch (simd())
+    {
+    case VA_SIMD_AVX2:
+        done = sg_avx2(pSg->Coef, pSg->Window, pIn, count, pOut + h);
+        break;
+    case VA_SIMD_SSE2:
+        done = sg_sse2(pSg->Coef, pSg->Window, pIn, count, pOut + h);
+        break;
+    default:
+        break;
+    }
+#endif
+    for (i = done; i < count; i++)
+    {
+        sum = 0.0f;
+        for (k = 0; k < pSg->Window; k++)
+        {
+            sum += pSg->Coef[k] * pIn[i + k];
+        }
+        pOut[i + h] = sum;
+    }
+    /* Ends: the polynomial of the first and last window, mirrored at the end */
+    for (i = 0; i < h; i++)
+    {
+        sum = 0.0f;
+        for (k = 0; k < pSg->Window; k++)
+        {
+            sum += pSg->Edge[i][k] * pIn[k];
+        }
+        pOut[i] = sum;
+        sum = 0.0f;
+        for (k = 0; k < pSg->Window; k++)
+        {
+            sum += pSg->Edge[i][k] * pIn[n - 1u - k];
+        }
+        pOut[n - 1u - i] = sum;
+    }
+}
+
+void va_als_default(VA_ALS_TYPE *pAls)
+{
+    /* A few hundred points a scan, a peak a tenth of it wide: at p 0.01 the
+     * peak lifts the baseline enough to lose some 7 % of its area, 2 % at 0.001 */
+    pAls->Lambda = 1e6;
+    pAls->P = 0.001;
+    pAls->Iterations = 10u;
+}
+
+/* (W + Lambda D'D) z = W y with D the second difference: pentadiagonal,
+ * factored as L D L' row by row with the forward solve, then solved back,
+ * O(n) per iteration. Iterations stop early once no weight changes, the
+ * solution would not either */
+void va_als(const VA_ALS_TYPE *pAls, const float *pY, uint32_t n, float *pBase, double *pWork)
+{
+    double     *pL1 = pWork;            /* L(i + 1, i)                  */
+    double     *pL2 = pWork + n;        /* L(i + 2, i)                  */
+    double     *pU = pWork + 2u * n;    /* (L D)^-1 W y                 */
+    double     *pZ = pWork + 3u * n;
+    double     *pW = pWork + 4u * n;
+    double      lambda = pAls->Lambda;
+    double      l1 = 0.0, l2 = 0.0, l2Prev = 0.0;   /* L of rows i - 1, i - 2 */
+    double      d1 = 0.0, d2 = 0.0;                 /* D of rows i - 1, i - 2 */
+    double      y1 = 0.0, y2 = 0.0;                 /* L^-1 W y of rows i - 1, i - 2 */
+    double      d;
+    double      inv;
+    double      y;
+    double      w;
+    uint32_t    changed = n;
+    uint32_t    it;
+    uint32_t    i;
+
+    /* The band below is D'D from 4 points on */
+    if (n < 4u)
+    {
+        for (i = 0; i < n; i++)
+        {
+            pBase[i] = pY[i];
+        }
+        return;
+    }
+    for (i = 0; i < n; i++)
+    {
+        pW[i] = 1.0;
+    }
+    for (it = 0; (it < pAls->Iterations) && (changed > 0u); it++)
+    {
+        /* D'D rows: 1 -2 1 / -2 5 -4 1 / 1 -4 6 -4 1 ... mirrored at the end */
+        l1 = l2 = l2Prev = d1 = d2 = y1 = y2 = 0.0;
+        for (i = 0; i < n; i++)
+        {
+            d = pW[i] + lambda * (((0u == i) || (n - 1u == i)) ? 1.0 : (((1u == i) || (n - 2u == i)) ? 5.0 : 6.0)) -
+                l1 * l1 * d1 - l2Prev * l2Prev * d2;
+            y = pW[i] * pY[i] - l1 * y1 - l2Prev * y2;
+            inv = 1.0 / d;
+            pU[i] = y * inv;
+            /* Row i of L from row i - 1, then shift */
+            pL1[i] = (lambda * (((0u == i) || (n - 2u == i)) ? -2.0 : -4.0) - l2 * l1 * d1) * inv;
+            pL2[i] = lambda * inv;
+            l2Prev = l2;
+            l1 = pL1[i];
+            l2 = pL2[i];
+            d2 = d1;
+            d1 = d;
+            y2 = y1;
+            y1 = y;
+        }
+        /* L' z = D^-1 L^-1 W y, rows past the end are zero */
+        y1 = y2 = 0.0;
+        for (i = n; i-- > 0;)
+        {
+            pZ[i] = pU[i] - ((i + 1u < n) ? pL1[i] * y1 : 0.0) - ((i + 2u < n) ? pL2[i] * y2 : 0.0);
+            y2 = y1;
+            y1 = pZ[i];
+        }
+        /* Asymmetric weights for the next pass */
+        changed = 0;
+        for (i = 0; i < n; i++)
+        {
+            w = (pY[i] > pZ[i]) ? pAls->P : 1.0 - pAls->P;
+            changed += (w != pW[i]);
+            pW[i] = w;
+        }
+    }
+    for (i = 0; i < n; i++)
+    {
+        pBase[i] = (float)pZ[i];
+    }
+}
+
+int va_peak(const float *pY, const float *pBase, const float *pE, uint32_t n, int dir, VA_PEAK_TYPE *pPeak)
+{
+    float       s = (dir < 0) ? -1.0f : 1.0f;
+    float       best = 0.0f;
+    float       area = 0.0f;
+    uint32_t    apex = n;
+    uint32_t    l;
+    uint32_t    r;
+    uint32_t    i;
+
+    memset(pPeak, 0, sizeof(*pPeak));
+    for (i = 0; i < n; i++)
+    {
+        if (s * (pY[i] - pBase[i]) > best)
+        {
+            best = s * (pY[i] - pBase[i]);
+            apex = i;
+        }
+    }
+    if (n == apex)
+    {
+        return -1;
+    }
+    /* Out to where the signal meets the baseline */
+    for (l = apex; (l > 0u) && (s * (pY[l - 1u] - pBase[l - 1u]) > 0.0f); l--)
+    {
+    }
+    for (r = apex; (r + 1u < n) && (s * (pY[r + 1u] - pBase[r + 1u]) > 0.0f); r++)
+    {
+    }
+    /* Trapezoids, the potential axis may run either way */
+    for (i = l; i < r; i++)
+    {
+        area += 0.5f * s * ((pY[i] - pBase[i]) + (pY[i + 1u] - pBase[i + 1u])) * fabsf(pE[i + 1u] - pE[i]);
+    }
+    pPeak->Index = apex;
+    pPeak->Left = l;
+    pPeak->Right = r;
+    pPeak->Potential = pE[apex];
+    pPeak->Height = best;
+    pPeak->Area = area;
+    return 0;
+}
+
+static void *batch_slice(void *pArg)
+{
+    VA_SLICE_TYPE      *pS = pArg;
+    const VA_PIPE_TYPE *pPipe = pS->pPipe;
+    size_t              at;
+    float              *pPa = malloc(pS->N * sizeof(float));
+    double             *pWork = malloc(5u * pS->N * sizeof(double));
+    uint32_t            s;
+
+    if ((NULL == pPa) || (NULL == pWork))
+    {
+        pS->Rc = -1;
+    }
+    for (s = pS->First; (0 == pS->Rc) && (s < pS->First + pS->Count); s++)
+    {
+        at = (size_t)s * pS->N;
+        va_convert(&pPipe->Scale, &pS->pCode[at], (NULL != pS->pRange) ? &pS->pRange[at] : NULL, pS->N, pPa);
+        va_sg_apply(&pPipe->Sg, pPa, pS->N, &pS->pSmooth[at]);
+        va_als(&pPipe->Als, &pS->pSmooth[at], pS->N, &pS->pBase[at], pWork);
+        /* A scan without a peak keeps a zero VA_PEAK_TYPE */
+        va_peak(&pS->pSmooth[at], &pS->pBase[at], pS->pE, pS->N, pPipe->Dir, &pS->pPeaks[s]);
+    }
+    free(pPa);
+    free(pWork);
+    return NULL;
+}
+
+int va_batch(const VA_PIPE_TYPE *pPipe, const uint16_t *pCode, const uint8_t *pRange, const float *pE, uint32_t n,
+             uint32_t count, float *pSmooth, float *pBase, VA_PEAK_TYPE *pPeaks, uint32_t threads)
+{
+    pthread_t       tid[VA_MAX_THREADS];
+    VA_SLICE_TYPE   slice[VA_MAX_THREADS];
+    uint8_t         started[VA_MAX_THREADS];
+    uint32_t        first = 0;
+    uint32_t        t;
+    int             rc = 0;
+
+    if (n < pPipe->Sg.Window)
+    {
+        return -1;
+    }
+    /* Pick the kernels before the threads read the level */
+    simd();
+    if (0u == threads)
+    {
+        threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    threads = (threads > VA_MAX_THREADS) ? VA_MAX_THREADS : ((threads < 1u) ? 1u : threads);
+    threads = (threads > count) ? ((count > 0u) ? count : 1u) : threads;
+    for (t = 0; t < threads; t++)
+    {
+        slice[t].pPipe = pPipe;
+        slice[t].pCode = pCode;
+        slice[t].pRange = pRange;
+        slice[t].pE = pE;
+        slice[t].N = n;
+        slice[t].First = first;
+        slice[t].Count = count / threads + ((t < count % threads) ? 1u : 0u);
+        slice[t].pSmooth = pSmooth;
+        slice[t].pBase = pBase;
+        slice[t].pPeaks = pPeaks;
+        slice[t].Rc = 0;
+        first += slice[t].Count;
+    }
+    /* Slice 0 runs here, a thread that can't start leaves its slice here too */
+    for (t = 1; t < threads; t++)
+    {
+        started[t] = (0 == pthread_create(&tid[t], NULL, batch_slice, &slice[t]));
+        if (!started[t])
+        {
+            batch_slice(&slice[t]);
+        }
+    }
+    batch_slice(&slice[0]);
+    rc = slice[0].Rc;
+    for (t = 1; t < threads; t++)
+    {
+        if (started[t])
+        {
+            rc |= pthread_join(tid[t], NULL);
+        }
+        rc |= slice[t].Rc;
+    }
+    return (0 == rc) ? 0 : -1;
+}
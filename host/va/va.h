@@ -0,0 +1,95 @@
+/*
+ * Post-processing of 350 voltammograms: LPF codes to current, Savitzky-
+ * Golay smoothing, asymmetric least squares baseline and peak integration,
+ * one scan at a time or a batch of scans on threads.
+ *
+ * The conversion takes the current per code of each RTIA range from the
+ * RUN,CFG header of the run, where the firmware reports it for its
+ * calibrated ranges, so the host and the 'u' output of the board agree.
+ * Conversion and smoothing have AVX2 and SSE2 kernels picked at run time,
+ * the baseline is a banded solve in double.
+ */
+#ifndef VA_H
+#define VA_H
+
+#include <stdint.h>
+
+#define VA_MAX_RANGES           (8u)
+#define VA_SG_MAX               (25u)       /* longest smoothing window     */
+#define VA_ZERO_CODE            (32768)
+
+typedef enum {
+    VA_SIMD_AUTO = 0,           /* best the CPU has                         */
+    VA_SIMD_NONE,
+    VA_SIMD_SSE2,
+    VA_SIMD_AVX2
+} VA_SIMD_TYPE;
+
+/* Current per code of each range, in aA, 0 for an uncalibrated range */
+typedef struct {
+    uint32_t            ScaleAa[VA_MAX_RANGES];
+    uint32_t            Num;
+    char                Unit;                   /* 'c' codes, 'a' pA        */
+} VA_SCALE_TYPE;
+
+typedef struct {
+    uint32_t            Window;                 /* odd                      */
+    uint32_t            Order;                  /* polynomial order         */
+    float               Coef[VA_SG_MAX];        /* centre output            */
+    float               Edge[VA_SG_MAX / 2u][VA_SG_MAX]; /* first outputs from the first window */
+} VA_SG_TYPE;
+
+typedef struct {
+    double              Lambda;                 /* smoothness               */
+    double              P;                      /* weight of points above   */
+    uint32_t            Iterations;
+} VA_ALS_TYPE;
+
+typedef struct {
+    uint32_t            Index;                  /* apex                     */
+    uint32_t            Left;                   /* integration bounds       */
+    uint32_t            Right;
+    float               Potential;              /* mV at the apex           */
+    float               Height;                 /* pA above the baseline    */
+    float               Area;                   /* pA mV                    */
+} VA_PEAK_TYPE;
+
+typedef struct {
+    VA_SCALE_TYPE       Scale;
+    VA_SG_TYPE          Sg;
+    VA_ALS_TYPE         Als;
+    int                 Dir;                    /* +1 oxidation, -1 reduction */
+} VA_PIPE_TYPE;
+
+/* Kernels used by the calls that follow, VA_SIMD_AUTO unless set. Not to be
+ * changed while a batch runs. Returns the level in use */
+VA_SIMD_TYPE    va_simd         (VA_SIMD_TYPE level);
+
+/* The unit and scales of a "RUN,CFG,..." line of the 350, 0 or -1 */
+int             va_scale_parse  (VA_SCALE_TYPE *pScale, const char *pRunCfg);
+/* Codes to pA, pRange the range of each code or NULL for range 0 */
+void            va_convert      (const VA_SCALE_TYPE *pScale, const uint16_t *pCode, const uint8_t *pRange,
+                                 uint32_t n, float *pPa);
+
+/* Least squares coefficients of an odd window up to VA_SG_MAX, 0 or -1 */
+int             va_sg_init      (VA_SG_TYPE *pSg, uint32_t window, uint32_t order);
+/* n >= Window, the ends are the fitted polynomial of the end windows */
+void            va_sg_apply     (const VA_SG_TYPE *pSg, const float *pIn, uint32_t n, float *pOut);
+
+void            va_als_default  (VA_ALS_TYPE *pAls);
+/* Baseline under pY, pWork holds 5 n doubles */
+void            va_als          (const VA_ALS_TYPE *pAls, const float *pY, uint32_t n, float *pBase,
+                                 double *pWork);
+
+/* Largest peak of pY - pBase in direction dir over potentials pE, 0 or -1 if none */
+int             va_peak         (const float *pY, const float *pBase, const float *pE, uint32_t n, int dir,
+                                 VA_PEAK_TYPE *pPeak);
+
+/* count scans of n codes back to back sharing the potentials pE: convert,
+ * smooth into pSmooth, baseline into pBase and the peak of each, on threads
+ * (0 all cores). pRange NULL for range 0. 0 or -1 */
+int             va_batch        (const VA_PIPE_TYPE *pPipe, const uint16_t *pCode, const uint8_t *pRange,
+                                 const float *pE, uint32_t n, uint32_t count, float *pSmooth, float *pBase,
+                                 VA_PEAK_TYPE *pPeaks, uint32_t threads);
+
+#endif /* VA_H */